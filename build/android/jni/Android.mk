@@ -142,6 +142,7 @@ LOCAL_SRC_FILES :=                                \
 		jni/src/dungeongen.cpp                    \
 		jni/src/emerge.cpp                        \
 		jni/src/environment.cpp                   \
+		jni/src/falling_nodes.cpp                 \
 		jni/src/filecache.cpp                     \
 		jni/src/filesys.cpp                       \
 		jni/src/fontengine.cpp                    \
@@ -229,18 +230,25 @@ LOCAL_SRC_FILES :=                                \
 		jni/src/util/srp.cpp                      \
 		jni/src/util/timetaker.cpp                \
 		jni/src/unittest/test.cpp                 \
+		jni/src/unittest/test_asyncengine.cpp     \
+		jni/src/unittest/test_biome.cpp           \
 		jni/src/unittest/test_collision.cpp       \
 		jni/src/unittest/test_compression.cpp     \
 		jni/src/unittest/test_connection.cpp      \
 		jni/src/unittest/test_filepath.cpp        \
+		jni/src/unittest/test_genericobject.cpp   \
 		jni/src/unittest/test_inventory.cpp       \
+		jni/src/unittest/test_luavoxelmanip.cpp   \
 		jni/src/unittest/test_mapnode.cpp         \
 		jni/src/unittest/test_nodedef.cpp         \
 		jni/src/unittest/test_noderesolver.cpp    \
 		jni/src/unittest/test_noise.cpp           \
 		jni/src/unittest/test_objdef.cpp          \
+		jni/src/unittest/test_pathfinder.cpp      \
+		jni/src/unittest/test_placementindex.cpp  \
 		jni/src/unittest/test_profiler.cpp        \
 		jni/src/unittest/test_random.cpp          \
+		jni/src/unittest/test_raycast.cpp         \
 		jni/src/unittest/test_schematic.cpp       \
 		jni/src/unittest/test_serialization.cpp   \
 		jni/src/unittest/test_settings.cpp        \
@@ -282,6 +290,7 @@ LOCAL_SRC_FILES +=                                \
 		jni/src/script/cpp_api/s_node.cpp         \
 		jni/src/script/cpp_api/s_nodemeta.cpp     \
 		jni/src/script/cpp_api/s_player.cpp       \
+		jni/src/script/cpp_api/s_profiler.cpp     \
 		jni/src/script/cpp_api/s_security.cpp     \
 		jni/src/script/cpp_api/s_server.cpp       \
 		jni/src/script/lua_api/l_areastore.cpp    \
@@ -303,7 +312,8 @@ LOCAL_SRC_FILES +=                                \
 		jni/src/script/lua_api/l_util.cpp         \
 		jni/src/script/lua_api/l_vmanip.cpp       \
 		jni/src/script/scripting_game.cpp         \
-		jni/src/script/scripting_mainmenu.cpp
+		jni/src/script/scripting_mainmenu.cpp     \
+		jni/src/script/scripting_mapgen.cpp
 
 #freetype2 support
 LOCAL_SRC_FILES +=                                \
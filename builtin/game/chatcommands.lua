@@ -15,16 +15,33 @@ function core.register_chatcommand(cmd, def)
 end
 
 if core.setting_getbool("mod_profiling") then
-	local tracefct = profiling_print_log
-	profiling_print_log = nil
-	core.register_chatcommand("save_mod_profile",
-			{
-				params      = "",
-				description = "save mod profiling data to logfile " ..
-						"(depends on default loglevel)",
-				func        = tracefct,
-				privs       = { server=true }
-			})
+	core.register_chatcommand("save_mod_profile", {
+		params = "[csv | clear]",
+		description = "save mod profiling data to logfile " ..
+				"(depends on default loglevel), to mod_profile.csv " ..
+				"in the world directory, or clear it",
+		privs = {server=true},
+		func = function(name, param)
+			if param == "clear" then
+				core.clear_mod_profile()
+				return true, "Mod profile cleared."
+			elseif param == "csv" then
+				local path = core.get_worldpath() .. DIR_DELIM ..
+						"mod_profile.csv"
+				local file, err = io.open(path, "w")
+				if not file then
+					return false, "Failed to open " .. path .. ": " .. err
+				end
+				file:write(core.get_mod_profile("csv"))
+				file:close()
+				return true, "Mod profile saved to " .. path
+			end
+			for line in core.get_mod_profile():gmatch("[^\n]+") do
+				core.log("action", line)
+			end
+			return true, "Mod profile saved to log."
+		end,
+	})
 end
 
 core.register_on_chat_message(function(name, message)
@@ -49,48 +49,15 @@ core.register_entity(":__builtin:falling_node", {
 				(bcd.walkable or
 				(core.get_item_group(self.node.name, "float") ~= 0 and
 				bcd.liquidtype ~= "none")) then
-			if bcd and bcd.leveled and
-					bcn.name == self.node.name then
-				local addlevel = self.node.level
-				if addlevel == nil or addlevel <= 0 then
-					addlevel = bcd.leveled
-				end
-				if core.add_node_level(bcp, addlevel) == 0 then
-					self.object:remove()
-					return
-				end
-			elseif bcd and bcd.buildable_to and
+			if bcd and bcd.buildable_to and
+					not (bcd.leveled and bcn.name == self.node.name) and
 					(core.get_item_group(self.node.name, "float") == 0 or
 					bcd.liquidtype == "none") then
 				core.remove_node(bcp)
 				return
 			end
-			local np = {x=bcp.x, y=bcp.y+1, z=bcp.z}
-			-- Check what's here
-			local n2 = core.get_node(np)
-			-- If it's not air or liquid, remove node and replace it with
-			-- it's drops
-			if n2.name ~= "air" and (not core.registered_nodes[n2.name] or
-					core.registered_nodes[n2.name].liquidtype == "none") then
-				core.remove_node(np)
-				if core.registered_nodes[n2.name].buildable_to == false then
-					-- Add dropped items
-					local drops = core.get_node_drops(n2.name, "")
-					local _, dropped_item
-					for _, dropped_item in ipairs(drops) do
-						core.add_item(np, dropped_item)
-					end
-				end
-				-- Run script hook
-				local _, callback
-				for _, callback in ipairs(core.registered_on_dignodes) do
-					callback(np, n2, nil)
-				end
-			end
-			-- Create node and remove entity
-			core.add_node(np, self.node)
+			core.falling_node_landed({x=bcp.x, y=bcp.y+1, z=bcp.z}, self.node)
 			self.object:remove()
-			nodeupdate(np)
 			return
 		end
 		local vel = self.object:getvelocity()
@@ -101,9 +68,52 @@ core.register_entity(":__builtin:falling_node", {
 	end
 })
 
+-- Called for every node of a falling column when it lands at np, bottom
+-- node first. Falling nodes are simulated by the engine; the entity above
+-- is only kept for falling nodes saved by older versions.
+function core.falling_node_landed(np, node)
+	local bcp = {x=np.x, y=np.y-1, z=np.z}
+	local bcn = core.get_node(bcp)
+	local bcd = core.registered_nodes[bcn.name]
+	if bcd and bcd.leveled and bcn.name == node.name then
+		local addlevel = node.level
+		if addlevel == nil or addlevel <= 0 then
+			addlevel = bcd.leveled
+		end
+		if core.add_node_level(bcp, addlevel) == 0 then
+			return
+		end
+	end
+	-- Check what's here
+	local n2 = core.get_node(np)
+	-- If it's not air or liquid, remove node and replace it with
+	-- it's drops
+	if n2.name ~= "air" and (not core.registered_nodes[n2.name] or
+			core.registered_nodes[n2.name].liquidtype == "none") then
+		core.remove_node(np)
+		if core.registered_nodes[n2.name].buildable_to == false then
+			-- Add dropped items
+			local drops = core.get_node_drops(n2.name, "")
+			local _, dropped_item
+			for _, dropped_item in ipairs(drops) do
+				core.add_item(np, dropped_item)
+			end
+		end
+		-- Run script hook
+		local _, callback
+		for _, callback in ipairs(core.registered_on_dignodes) do
+			callback(np, n2, nil)
+		end
+	end
+	-- Create node
+	core.add_node(np, node)
+	nodeupdate(np)
+end
+
+-- Starts node to fall at p, from where it has to be removed already.
+-- Falling nodes on top of it fall along; returns the number of nodes.
 function spawn_falling_node(p, node)
-	local obj = core.add_entity(p, "__builtin:falling_node")
-	obj:get_luaentity():set_node(node)
+	return core.spawn_falling_node(p, node)
 end
 
 function drop_attached_node(p)
@@ -170,8 +180,10 @@ function nodeupdate_single(p, delay)
 			else
 				n.level = core.get_node_level(p)
 				core.remove_node(p)
-				spawn_falling_node(p, n)
-				nodeupdate(p)
+				local height = spawn_falling_node(p, n)
+				for y = p.y, p.y + height - 1 do
+					nodeupdate({x=p.x, y=y, z=p.z})
+				end
 			end
 		end
 	end
@@ -8,8 +8,8 @@ dofile(commonpath.."vector.lua")
 dofile(gamepath.."item.lua")
 dofile(gamepath.."register.lua")
 
-if core.setting_getbool("mod_profiling") then
-	dofile(gamepath.."mod_profiling.lua")
+if core.do_async_callback then
+	dofile(commonpath.."async_event.lua")
 end
 
 dofile(gamepath.."item_entity.lua")
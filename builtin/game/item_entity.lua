@@ -8,13 +8,13 @@ function core.spawn_item(pos, item)
 	return obj
 end
 
--- If item_entity_ttl is not set, enity will have default life time 
--- Setting it to -1 disables the feature
-
-local time_to_live = tonumber(core.setting_get("item_entity_ttl"))
-if not time_to_live then
-	time_to_live = 900
-end
+-- Falling, resting, merging with other stacks and removal after
+-- item_entity_ttl seconds are done by the engine; this entity only keeps
+-- the item and handles pickup. self.age is only updated when the entity
+-- is saved, or when on_step is called.
+-- on_step and try_merge_with are engine functions, kept for mods that
+-- replace them and call the originals. The engine keeps stepping the item
+-- on its own, and only calls on_step when it was replaced by a Lua function.
 
 core.register_entity(":__builtin:item", {
 	initial_properties = {
@@ -31,7 +31,6 @@ core.register_entity(":__builtin:item", {
 	},
 
 	itemstring = '',
-	physical_state = true,
 	age = 0,
 
 	set_item = function(self, itemstring)
@@ -96,105 +95,9 @@ core.register_entity(":__builtin:item", {
 		self:set_item(self.itemstring)
 	end,
 
-	try_merge_with = function(self, own_stack, object, obj)
-		local stack = ItemStack(obj.itemstring)
-		if own_stack:get_name() == stack:get_name() and stack:get_free_space() > 0 then
-			local overflow = false
-			local count = stack:get_count() + own_stack:get_count()
-			local max_count = stack:get_stack_max()
-			if count > max_count then
-				overflow = true
-				count = count - max_count
-			else
-				self.itemstring = ''
-			end
-			local pos = object:getpos()
-			pos.y = pos.y + (count - stack:get_count()) / max_count * 0.15
-			object:moveto(pos, false)
-			local s, c
-			local max_count = stack:get_stack_max()
-			local name = stack:get_name()
-			if not overflow then
-				obj.itemstring = name .. " " .. count
-				s = 0.2 + 0.1 * (count / max_count)
-				c = s
-				object:set_properties({
-					visual_size = {x = s, y = s},
-					collisionbox = {-c, -c, -c, c, c, c}
-				})
-				self.object:remove()
-				-- merging succeeded
-				return true
-			else
-				s = 0.4
-				c = 0.3
-				object:set_properties({
-					visual_size = {x = s, y = s},
-					collisionbox = {-c, -c, -c, c, c, c}
-				})
-				obj.itemstring = name .. " " .. max_count
-				s = 0.2 + 0.1 * (count / max_count)
-				c = s
-				self.object:set_properties({
-					visual_size = {x = s, y = s},
-					collisionbox = {-c, -c, -c, c, c, c}
-				})
-				self.itemstring = name .. " " .. count
-			end
-		end
-		-- merging didn't succeed
-		return false
-	end,
+	try_merge_with = core.item_entity_try_merge_with,
 
-	on_step = function(self, dtime)
-		self.age = self.age + dtime
-		if time_to_live > 0 and self.age > time_to_live then
-			self.itemstring = ''
-			self.object:remove()
-			return
-		end
-		local p = self.object:getpos()
-		p.y = p.y - 0.5
-		local node = core.get_node_or_nil(p)
-		local in_unloaded = (node == nil)
-		if in_unloaded then
-			-- Don't infinetly fall into unloaded map
-			self.object:setvelocity({x = 0, y = 0, z = 0})
-			self.object:setacceleration({x = 0, y = 0, z = 0})
-			self.physical_state = false
-			self.object:set_properties({physical = false})
-			return
-		end
-		local nn = node.name
-		-- If node is not registered or node is walkably solid and resting on nodebox
-		local v = self.object:getvelocity()
-		if not core.registered_nodes[nn] or core.registered_nodes[nn].walkable and v.y == 0 then
-			if self.physical_state then
-				local own_stack = ItemStack(self.object:get_luaentity().itemstring)
-				-- Merge with close entities of the same item
-				for _, object in ipairs(core.get_objects_inside_radius(p, 0.8)) do
-					local obj = object:get_luaentity()
-					if obj and obj.name == "__builtin:item"
-							and obj.physical_state == false then
-						if self:try_merge_with(own_stack, object, obj) then
-							return
-						end
-					end
-				end
-				self.object:setvelocity({x = 0, y = 0, z = 0})
-				self.object:setacceleration({x = 0, y = 0, z = 0})
-				self.physical_state = false
-				self.object:set_properties({physical = false})
-			end
-		else
-			if not self.physical_state then
-				self.object:setvelocity({x = 0, y = 0, z = 0})
-				self.object:setacceleration({x = 0, y = -10, z = 0})
-				self.physical_state = true
-				self.object:set_properties({physical = true})
-			end
-		end
-	end,
+	on_step = core.item_entity_on_step,
 
 	on_punch = function(self, hitter)
 		if self.itemstring ~= '' then
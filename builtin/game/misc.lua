@@ -74,6 +74,35 @@ function core.after(time, func, ...)
 	}
 end
 
+local path_searches = {}
+local path_searches_pending = 0
+
+core.register_globalstep(function(dtime)
+	if path_searches_pending == 0 then
+		return
+	end
+	for _, search in ipairs(core.get_finished_path_searches()) do
+		local callback = path_searches[search.id]
+		path_searches[search.id] = nil
+		path_searches_pending = path_searches_pending - 1
+		core.set_last_run_mod(callback.mod_origin)
+		callback.func(search.path)
+	end
+end)
+
+function core.find_path_async(pos1, pos2, searchdistance, max_jump, max_drop,
+		algorithm, callback)
+	assert(type(callback) == "function",
+			"Invalid core.find_path_async invocation")
+	local id = core.queue_path_search(pos1, pos2, searchdistance,
+			max_jump, max_drop, algorithm)
+	path_searches[id] = {
+		func = callback,
+		mod_origin = core.get_last_run_mod(),
+	}
+	path_searches_pending = path_searches_pending + 1
+end
+
 function core.check_player_privs(name, privs)
 	local player_privs = core.get_player_privs(name)
 	local missing_privileges = {}
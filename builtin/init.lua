@@ -16,6 +16,7 @@ local scriptdir = core.get_builtin_path()..DIR_DELIM
 local gamepath = scriptdir.."game"..DIR_DELIM
 local commonpath = scriptdir.."common"..DIR_DELIM
 local asyncpath = scriptdir.."async"..DIR_DELIM
+local mapgenpath = scriptdir.."mapgen"..DIR_DELIM
 
 dofile(commonpath.."strict.lua")
 dofile(commonpath.."serialize.lua")
@@ -32,6 +33,8 @@ elseif INIT == "mainmenu" then
 	end
 elseif INIT == "async" then
 	dofile(asyncpath.."init.lua")
+elseif INIT == "mapgen" then
+	dofile(mapgenpath.."init.lua")
 else
 	error(("Unrecognized builtin initialization type %s!"):format(tostring(INIT)))
 end
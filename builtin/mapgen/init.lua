@@ -0,0 +1,27 @@
+
+core.log("info", "Initializing mapgen environment")
+
+local scriptpath = core.get_builtin_path()..DIR_DELIM
+local commonpath = scriptpath.."common"..DIR_DELIM
+local gamepath = scriptpath.."game"..DIR_DELIM
+
+dofile(commonpath.."vector.lua")
+dofile(gamepath.."voxelarea.lua")
+
+-- Only RUN_CALLBACKS_MODE_FIRST is used in this environment
+function core.run_callbacks(callbacks, mode, ...)
+	local ret = nil
+	for i = 1, #callbacks do
+		local cb_ret = callbacks[i](...)
+		if i == 1 then
+			ret = cb_ret
+		end
+	end
+	return ret
+end
+
+core.registered_on_generateds = {}
+
+function core.register_on_generated(func)
+	table.insert(core.registered_on_generateds, func)
+end
@@ -46,12 +46,17 @@ struct ActiveObjectMessage
 	ActiveObjectMessage(u16 id_, bool reliable_=true, std::string data_=""):
 		id(id_),
 		reliable(reliable_),
-		datastring(data_)
+		datastring(data_),
+		min_proto_version(0),
+		max_proto_version(0xffff)
 	{}
 
 	u16 id;
 	bool reliable;
 	std::string datastring;
+	// Only sent to clients using a network protocol version in this range
+	u16 min_proto_version;
+	u16 max_proto_version;
 };
 
 /*
@@ -29,6 +29,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "environment.h"
 #include "map.h"
 #include "emerge.h"
+#include "gamedef.h"
+#include "nodedef.h"
 #include "serverobject.h"              // TODO this is used for cleanup of only
 #include "log.h"
 #include "util/srp.h"
@@ -61,11 +63,10 @@ void RemoteClient::ResendBlockIfOnWire(v3s16 p)
 	}
 }
 
-void RemoteClient::GetNextBlocks (
-		ServerEnvironment *env,
-		EmergeManager * emerge,
+s16 RemoteClient::GetBlockCandidates(
+		const PlayerViewpoint *view,
 		float dtime,
-		std::vector<PrioritySortedBlockTransfer> &dest)
+		std::vector<PrioritySortedBlockTransfer> &candidates)
 {
 	DSTACK(__FUNCTION_NAME);
 
@@ -73,25 +74,24 @@ void RemoteClient::GetNextBlocks (
 	// Increment timers
 	m_nothing_to_send_pause_timer -= dtime;
 	m_nearest_unsent_reset_timer += dtime;
+	m_time_from_building += dtime;
 
 	if(m_nothing_to_send_pause_timer >= 0)
-		return;
+		return -1;
 
-	Player *player = env->getPlayer(peer_id);
-	// This can happen sometimes; clients and players are not in perfect sync.
-	if(player == NULL)
-		return;
+	if(view == NULL)
+		return -1;
 
 	// Won't send anything if already sending
 	if(m_blocks_sending.size() >= g_settings->getU16
 			("max_simultaneous_block_sends_per_client"))
 	{
 		//infostream<<"Not sending any blocks, Queue full."<<std::endl;
-		return;
+		return -1;
 	}
 
-	v3f playerpos = player->getPosition();
-	v3f playerspeed = player->getSpeed();
+	v3f playerpos = view->position;
+	v3f playerspeed = view->speed;
 	v3f playerspeeddir(0,0,0);
 	if(playerspeed.getLength() > 1.0*BS)
 		playerspeeddir = playerspeed / playerspeed.getLength();
@@ -103,10 +103,11 @@ void RemoteClient::GetNextBlocks (
 	v3s16 center = getNodeBlockPos(center_nodepos);
 
 	// Camera position and direction
-	v3f camera_pos = player->getEyePosition();
+	v3f camera_pos = view->eye_position;
 	v3f camera_dir = v3f(0,0,1);
-	camera_dir.rotateYZBy(player->getPitch());
-	camera_dir.rotateXZBy(player->getYaw());
+	camera_dir.rotateYZBy(view->pitch);
+	camera_dir.rotateXZBy(view->yaw);
+	m_camera_pos_nodes = floatToInt(camera_pos, BS);
 
 	/*infostream<<"camera_dir=("<<camera_dir.X<<","<<camera_dir.Y<<","
 			<<camera_dir.Z<<")"<<std::endl;*/
@@ -138,6 +139,76 @@ void RemoteClient::GetNextBlocks (
 
 	//infostream<<"d_start="<<d_start<<std::endl;
 
+	const s16 full_d_max = g_settings->getS16("max_block_send_distance");
+	s16 d_max = full_d_max;
+
+	// Don't loop very much at a time
+	s16 max_d_increment_at_time = 2;
+	if(d_max > d_start + max_d_increment_at_time)
+		d_max = d_start + max_d_increment_at_time;
+
+	float camera_fov = (72.0*M_PI/180) * 4./3.;
+
+	for(s16 d = d_start; d <= d_max; d++) {
+		/*
+			Get the border/face dot coordinates of a "d-radiused"
+			box
+		*/
+		std::vector<v3s16> list = FacePositionCache::getFacePositions(d);
+
+		std::vector<v3s16>::iterator li;
+		for(li = list.begin(); li != list.end(); ++li) {
+			v3s16 p = *li + center;
+
+			// Don't send blocks that are currently being transferred
+			if (m_blocks_sending.find(p) != m_blocks_sending.end())
+				continue;
+
+			/*
+				Do not go over-limit
+			*/
+			if (blockpos_over_limit(p))
+				continue;
+
+			// Limit the send area vertically to 1/2
+			if (abs(p.Y - center.Y) > full_d_max / 2)
+				continue;
+
+			/*
+				Don't generate or send if not in sight
+				FIXME This only works if the client uses a small enough
+				FOV setting. The default of 72 degrees is fine.
+			*/
+			if(isBlockInSight(p, camera_pos, camera_dir, camera_fov, 10000*BS) == false)
+			{
+				continue;
+			}
+
+			/*
+				Don't send already sent blocks
+			*/
+			if (m_blocks_sent.contains(p))
+				continue;
+
+			candidates.push_back(PrioritySortedBlockTransfer((float)d, p, peer_id));
+		}
+	}
+
+	return d_max;
+}
+
+void RemoteClient::GetNextBlocks (
+		ServerEnvironment *env,
+		EmergeManager * emerge,
+		const std::vector<PrioritySortedBlockTransfer> &candidates,
+		s16 d_max,
+		std::vector<PrioritySortedBlockTransfer> &dest)
+{
+	DSTACK(__FUNCTION_NAME);
+
+	if (d_max < 0)
+		return;
+
 	u16 max_simul_sends_setting = g_settings->getU16
 			("max_simultaneous_block_sends_per_client");
 	u16 max_simul_sends_usually = max_simul_sends_setting;
@@ -147,7 +218,6 @@ void RemoteClient::GetNextBlocks (
 
 		Decrease send rate if player is building stuff.
 	*/
-	m_time_from_building += dtime;
 	if(m_time_from_building < g_settings->getFloat(
 				"full_block_send_enable_min_time_from_building"))
 	{
@@ -155,6 +225,19 @@ void RemoteClient::GetNextBlocks (
 			= LIMITED_MAX_SIMULTANEOUS_BLOCK_SENDS;
 	}
 
+	/*
+		Don't cull if the camera is inside solid nodes (noclip), everything
+		would be occluded
+	*/
+	v3s16 cam_pos_nodes = m_camera_pos_nodes;
+	bool occ_cull = g_settings->getBool("server_side_occlusion_culling");
+	if (occ_cull) {
+		INodeDefManager *ndef = env->getGameDef()->ndef();
+		MapNode n = env->getMap().getNodeNoEx(cam_pos_nodes);
+		if (n.getContent() == CONTENT_IGNORE || ndef->get(n).drawtype == NDT_NORMAL)
+			occ_cull = false;
+	}
+
 	/*
 		Number of blocks sending + number of blocks selected for sending
 	*/
@@ -169,181 +252,134 @@ void RemoteClient::GetNextBlocks (
 	*/
 	s32 new_nearest_unsent_d = -1;
 
-	const s16 full_d_max = g_settings->getS16("max_block_send_distance");
-	s16 d_max = full_d_max;
 	s16 d_max_gen = g_settings->getS16("max_block_generate_distance");
 
-	// Don't loop very much at a time
-	s16 max_d_increment_at_time = 2;
-	if(d_max > d_start + max_d_increment_at_time)
-		d_max = d_start + max_d_increment_at_time;
-
 	s32 nearest_emerged_d = -1;
 	s32 nearest_emergefull_d = -1;
 	s32 nearest_sent_d = -1;
 	//bool queue_is_full = false;
 
-	s16 d;
-	for(d = d_start; d <= d_max; d++) {
-		/*
-			Get the border/face dot coordinates of a "d-radiused"
-			box
-		*/
-		std::vector<v3s16> list = FacePositionCache::getFacePositions(d);
+	// Radius the search got to, the candidates are sorted by it
+	s16 d = d_max + 1;
 
-		std::vector<v3s16>::iterator li;
-		for(li = list.begin(); li != list.end(); ++li) {
-			v3s16 p = *li + center;
-
-			/*
-				Send throttling
-				- Don't allow too many simultaneous transfers
-				- EXCEPT when the blocks are very close
+	std::vector<PrioritySortedBlockTransfer>::const_iterator ci;
+	for(ci = candidates.begin(); ci != candidates.end(); ++ci) {
+		v3s16 p = ci->pos;
+		d = (s16)ci->priority;
 
-				Also, don't send blocks that are already flying.
-			*/
+		/*
+			Send throttling
+			- Don't allow too many simultaneous transfers
+			- EXCEPT when the blocks are very close
+		*/
 
-			// Start with the usual maximum
-			u16 max_simul_dynamic = max_simul_sends_usually;
+		// Start with the usual maximum
+		u16 max_simul_dynamic = max_simul_sends_usually;
 
-			// If block is very close, allow full maximum
-			if(d <= BLOCK_SEND_DISABLE_LIMITS_MAX_D)
-				max_simul_dynamic = max_simul_sends_setting;
+		// If block is very close, allow full maximum
+		if(d <= BLOCK_SEND_DISABLE_LIMITS_MAX_D)
+			max_simul_dynamic = max_simul_sends_setting;
 
-			// Don't select too many blocks for sending
-			if (num_blocks_selected >= max_simul_dynamic) {
-				//queue_is_full = true;
-				goto queue_full_break;
-			}
+		// Don't select too many blocks for sending
+		if (num_blocks_selected >= max_simul_dynamic) {
+			//queue_is_full = true;
+			goto queue_full_break;
+		}
 
-			// Don't send blocks that are currently being transferred
-			if (m_blocks_sending.find(p) != m_blocks_sending.end())
-				continue;
+		// If this is true, inexistent block will be made from scratch
+		bool generate = d <= d_max_gen;
 
-			/*
-				Do not go over-limit
-			*/
-			if (blockpos_over_limit(p))
-				continue;
+		/*
+			Check if map has this block
+		*/
+		MapBlock *block = env->getMap().getBlockNoCreateNoEx(p);
 
-			// If this is true, inexistent block will be made from scratch
-			bool generate = d <= d_max_gen;
+		bool surely_not_found_on_disk = false;
+		bool block_is_invalid = false;
+		if(block != NULL)
+		{
+			// Reset usage timer, this block will be of use in the future.
+			block->resetUsageTimer();
 
+			// Block is dummy if data doesn't exist.
+			// It means it has been not found from disk and not generated
+			if(block->isDummy())
 			{
-				/*// Limit the generating area vertically to 2/3
-				if(abs(p.Y - center.Y) > d_max_gen - d_max_gen / 3)
-					generate = false;*/
-
-				// Limit the send area vertically to 1/2
-				if (abs(p.Y - center.Y) > full_d_max / 2)
-					continue;
+				surely_not_found_on_disk = true;
 			}
 
-			/*
-				Don't generate or send if not in sight
-				FIXME This only works if the client uses a small enough
-				FOV setting. The default of 72 degrees is fine.
-			*/
-
-			float camera_fov = (72.0*M_PI/180) * 4./3.;
-			if(isBlockInSight(p, camera_pos, camera_dir, camera_fov, 10000*BS) == false)
+			// Block is valid if lighting is up-to-date and data exists
+			if(block->isValid() == false)
 			{
-				continue;
+				block_is_invalid = true;
 			}
 
-			/*
-				Don't send already sent blocks
-			*/
-			{
-				if(m_blocks_sent.find(p) != m_blocks_sent.end())
-				{
-					continue;
-				}
-			}
+			if(block->isGenerated() == false)
+				block_is_invalid = true;
 
 			/*
-				Check if map has this block
-			*/
-			MapBlock *block = env->getMap().getBlockNoCreateNoEx(p);
+				If block is not close, don't send it unless it is near
+				ground level.
 
-			bool surely_not_found_on_disk = false;
-			bool block_is_invalid = false;
-			if(block != NULL)
-			{
-				// Reset usage timer, this block will be of use in the future.
-				block->resetUsageTimer();
-
-				// Block is dummy if data doesn't exist.
-				// It means it has been not found from disk and not generated
-				if(block->isDummy())
-				{
-					surely_not_found_on_disk = true;
-				}
-
-				// Block is valid if lighting is up-to-date and data exists
-				if(block->isValid() == false)
-				{
-					block_is_invalid = true;
-				}
-
-				if(block->isGenerated() == false)
-					block_is_invalid = true;
-
-				/*
-					If block is not close, don't send it unless it is near
-					ground level.
-
-					Block is near ground level if night-time mesh
-					differs from day-time mesh.
-				*/
-				if(d >= 4)
-				{
-					if(block->getDayNightDiff() == false)
-						continue;
-				}
-			}
-
-			/*
-				If block has been marked to not exist on disk (dummy)
-				and generating new ones is not wanted, skip block.
+				Block is near ground level if night-time mesh
+				differs from day-time mesh.
 			*/
-			if(generate == false && surely_not_found_on_disk == true)
+			if(d >= 4)
 			{
-				// get next one.
-				continue;
+				if(block->getDayNightDiff() == false)
+					continue;
 			}
 
 			/*
-				Add inexistent block to emerge queue.
+				Don't send blocks hidden behind solid nodes. They are
+				not marked as sent, so they are checked again when the
+				player moves to another block.
 			*/
-			if(block == NULL || surely_not_found_on_disk || block_is_invalid)
-			{
-				if (emerge->enqueueBlockEmerge(peer_id, p, generate)) {
-					if (nearest_emerged_d == -1)
-						nearest_emerged_d = d;
-				} else {
-					if (nearest_emergefull_d == -1)
-						nearest_emergefull_d = d;
-					goto queue_full_break;
-				}
-
-				// get next one.
+			if (occ_cull && d >= 2 && !block_is_invalid &&
+					!surely_not_found_on_disk &&
+					env->getMap().isBlockOccluded(block, cam_pos_nodes))
 				continue;
+		}
+
+		/*
+			If block has been marked to not exist on disk (dummy)
+			and generating new ones is not wanted, skip block.
+		*/
+		if(generate == false && surely_not_found_on_disk == true)
+		{
+			// get next one.
+			continue;
+		}
+
+		/*
+			Add inexistent block to emerge queue.
+		*/
+		if(block == NULL || surely_not_found_on_disk || block_is_invalid)
+		{
+			if (emerge->enqueueBlockEmerge(peer_id, p, generate)) {
+				if (nearest_emerged_d == -1)
+					nearest_emerged_d = d;
+			} else {
+				if (nearest_emergefull_d == -1)
+					nearest_emergefull_d = d;
+				goto queue_full_break;
 			}
 
-			if(nearest_sent_d == -1)
-				nearest_sent_d = d;
+			// get next one.
+			continue;
+		}
 
-			/*
-				Add block to send queue
-			*/
-			PrioritySortedBlockTransfer q((float)d, p, peer_id);
+		if(nearest_sent_d == -1)
+			nearest_sent_d = d;
 
-			dest.push_back(q);
+		/*
+			Add block to send queue
+		*/
+		dest.push_back(*ci);
 
-			num_blocks_selected += 1;
-		}
+		num_blocks_selected += 1;
 	}
+	d = d_max + 1;
 queue_full_break:
 
 	// If nothing was found for sending and nothing was queued for
@@ -394,8 +430,7 @@ void RemoteClient::SetBlockNotSent(v3s16 p)
 
 	if(m_blocks_sending.find(p) != m_blocks_sending.end())
 		m_blocks_sending.erase(p);
-	if(m_blocks_sent.find(p) != m_blocks_sent.end())
-		m_blocks_sent.erase(p);
+	m_blocks_sent.erase(p);
 }
 
 void RemoteClient::SetBlocksNotSent(std::map<v3s16, MapBlock*> &blocks)
@@ -410,8 +445,7 @@ void RemoteClient::SetBlocksNotSent(std::map<v3s16, MapBlock*> &blocks)
 
 		if(m_blocks_sending.find(p) != m_blocks_sending.end())
 			m_blocks_sending.erase(p);
-		if(m_blocks_sent.find(p) != m_blocks_sent.end())
-			m_blocks_sent.erase(p);
+		m_blocks_sent.erase(p);
 	}
 }
 
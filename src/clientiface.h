@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serialization.h"             // for SER_FMT_VER_INVALID
 #include "threading/mutex.h"
 #include "network/networkpacket.h"
+#include "util/container.h"
 
 #include <list>
 #include <vector>
@@ -220,6 +221,19 @@ struct PrioritySortedBlockTransfer
 	u16 peer_id;
 };
 
+/*
+	Where a player is and looks to, copied from the Player while the
+	environment is locked
+*/
+struct PlayerViewpoint
+{
+	v3f position;
+	v3f speed;
+	v3f eye_position;
+	f32 pitch;
+	f32 yaw;
+};
+
 class RemoteClient
 {
 public:
@@ -274,12 +288,25 @@ class RemoteClient
 	}
 
 	/*
-		Finds block that should be sent next to the client.
-		Environment should be locked when this is called.
+		Finds blocks in sight of the player that haven't been sent yet,
+		sorted by distance. Only uses the viewpoint, which may be NULL
+		if there is no player, so the environment doesn't have to be
+		locked.
 		dtime is used for resetting send radius at slow interval
+		Returns the radius searched up to, or -1 if nothing should be
+		sent now.
+	*/
+	s16 GetBlockCandidates(const PlayerViewpoint *view, float dtime,
+			std::vector<PrioritySortedBlockTransfer> &candidates);
+
+	/*
+		Checks the candidates against the map and adds the blocks that
+		should be sent next to dest, emerging missing ones.
+		Environment should be locked when this is called.
 	*/
 	void GetNextBlocks(ServerEnvironment *env, EmergeManager* emerge,
-			float dtime, std::vector<PrioritySortedBlockTransfer> &dest);
+			const std::vector<PrioritySortedBlockTransfer> &candidates,
+			s16 d_max, std::vector<PrioritySortedBlockTransfer> &dest);
 
 	void GotBlock(v3s16 p);
 
@@ -377,12 +404,13 @@ class RemoteClient
 		- A block is cleared from here when client says it has
 		  deleted it from it's memory
 
-		Key is position, value is dummy.
 		No MapBlock* is stored here because the blocks can get deleted.
 	*/
-	std::set<v3s16> m_blocks_sent;
+	PositionSet m_blocks_sent;
 	s16 m_nearest_unsent_d;
 	v3s16 m_last_center;
+	// Camera position of the last GetBlockCandidates() call
+	v3s16 m_camera_pos_nodes;
 	float m_nearest_unsent_reset_timer;
 
 	/*
@@ -226,16 +226,13 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 	/*
 		Collect node boxes in movement range
 	*/
-	std::vector<aabb3f> cboxes;
-	std::vector<bool> is_unloaded;
-	std::vector<bool> is_step_up;
-	std::vector<bool> is_object;
-	std::vector<int> bouncy_values;
-	std::vector<v3s16> node_positions;
+	CollisionCandidates &candidates = env->getCollisionCandidates();
+	candidates.clear();
 	{
 	//TimeTaker tt2("collisionMoveSimple collect boxes");
     ScopeProfiler sp(g_profiler, "collisionMoveSimple collect boxes avg", SPT_AVG);
 
+	INodeDefManager *ndef = gamedef->getNodeDefManager();
 	v3s16 oldpos_i = floatToInt(pos_f, BS);
 	v3s16 newpos_i = floatToInt(pos_f + speed_f * dtime, BS);
 	s16 min_x = MYMIN(oldpos_i.X, newpos_i.X) + (box_0.MinEdge.X / BS) - 1;
@@ -257,36 +254,41 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		if (is_position_valid) {
 			// Object collides into walkable nodes
 
-			const ContentFeatures &f = gamedef->getNodeDefManager()->get(n);
+			const ContentFeatures &f = ndef->get(n);
 			if(f.walkable == false)
 				continue;
-			int n_bouncy_value = itemgroup_get(f.groups, "bouncy");
 
-			std::vector<aabb3f> nodeboxes = n.getCollisionBoxes(gamedef->ndef());
-			for(std::vector<aabb3f>::iterator
-					i = nodeboxes.begin();
-					i != nodeboxes.end(); ++i)
+			v3f offset = v3f(x, y, z) * BS;
+			const std::vector<u32> &index = f.collision_boxes_index;
+			if (index.empty()) {
+				// Not set through the node definition manager
+				std::vector<aabb3f> nodeboxes = n.getCollisionBoxes(ndef);
+				for(std::vector<aabb3f>::iterator
+						i = nodeboxes.begin();
+						i != nodeboxes.end(); ++i)
+				{
+					aabb3f box = *i;
+					box.MinEdge += offset;
+					box.MaxEdge += offset;
+					candidates.add(box, p,
+						itemgroup_get(f.groups, "bouncy"), 0);
+				}
+				continue;
+			}
+
+			u32 i = n.getParam2() & (index.size() - 2);
+			for(u32 j = index[i]; j < index[i + 1]; j++)
 			{
-				aabb3f box = *i;
-				box.MinEdge += v3f(x, y, z)*BS;
-				box.MaxEdge += v3f(x, y, z)*BS;
-				cboxes.push_back(box);
-				is_unloaded.push_back(false);
-				is_step_up.push_back(false);
-				bouncy_values.push_back(n_bouncy_value);
-				node_positions.push_back(p);
-				is_object.push_back(false);
+				aabb3f box = f.collision_boxes_cache[j];
+				box.MinEdge += offset;
+				box.MaxEdge += offset;
+				candidates.add(box, p, f.bouncy, 0);
 			}
 		}
 		else {
 			// Collide with unloaded nodes
 			aabb3f box = getNodeBox(p, BS);
-			cboxes.push_back(box);
-			is_unloaded.push_back(true);
-			is_step_up.push_back(false);
-			bouncy_values.push_back(0);
-			node_positions.push_back(p);
-			is_object.push_back(false);
+			candidates.add(box, p, 0, CANDIDATE_UNLOADED);
 		}
 	}
 	} // tt2
@@ -296,7 +298,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		ScopeProfiler sp(g_profiler, "collisionMoveSimple objects avg", SPT_AVG);
 		//TimeTaker tt3("collisionMoveSimple collect object boxes");
 
-		/* add object boxes to cboxes */
+		/* add object boxes to the candidates */
 
 
 		std::vector<ActiveObject*> objects;
@@ -337,22 +339,15 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				aabb3f object_collisionbox;
 				if (object->getCollisionBox(&object_collisionbox) &&
 						object->collideWithObjects()) {
-					cboxes.push_back(object_collisionbox);
-					is_unloaded.push_back(false);
-					is_step_up.push_back(false);
-					bouncy_values.push_back(0);
-					node_positions.push_back(v3s16(0,0,0));
-					is_object.push_back(true);
+					candidates.add(object_collisionbox, v3s16(0,0,0), 0,
+						CANDIDATE_OBJECT);
 				}
 			}
 		}
 	} //tt3
 
-	assert(cboxes.size() == is_unloaded.size());    // post-condition
-	assert(cboxes.size() == is_step_up.size());     // post-condition
-	assert(cboxes.size() == bouncy_values.size());  // post-condition
-	assert(cboxes.size() == node_positions.size()); // post-condition
-	assert(cboxes.size() == is_object.size());      // post-condition
+	const std::vector<aabb3f> &cboxes = candidates.boxes;
+	std::vector<u8> &flags = candidates.flags;
 
 	/*
 		Collision detection
@@ -373,9 +368,6 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 
 	while(dtime > BS*1e-10)
 	{
-		//TimeTaker tt3("collisionMoveSimple dtime loop");
-        ScopeProfiler sp(g_profiler, "collisionMoveSimple dtime loop avg", SPT_AVG);
-
 		// Avoid infinite loop
 		loopcount++;
 		if(loopcount >= 100)
@@ -399,7 +391,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		for(u32 boxindex = 0; boxindex < cboxes.size(); boxindex++)
 		{
 			// Ignore if already stepped up this nodebox.
-			if(is_step_up[boxindex])
+			if(flags[boxindex] & CANDIDATE_STEPPED_UP)
 				continue;
 
 			// Find nearest collision of the two boxes (raytracing-like)
@@ -436,8 +428,9 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 							d));
 
 			// Get bounce multiplier
-			bool bouncy = (bouncy_values[nearest_boxindex] >= 1);
-			float bounce = -(float)bouncy_values[nearest_boxindex] / 100.0;
+			s16 bouncy_value = candidates.bouncy_values[nearest_boxindex];
+			bool bouncy = (bouncy_value >= 1);
+			float bounce = -(float)bouncy_value / 100.0;
 
 			// Move to the point of collision and reduce dtime by nearest_dtime
 			if(nearest_dtime < 0)
@@ -460,17 +453,17 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 			}
 
 			bool is_collision = true;
-			if(is_unloaded[nearest_boxindex])
+			if(flags[nearest_boxindex] & CANDIDATE_UNLOADED)
 				is_collision = false;
 
 			CollisionInfo info;
-			if (is_object[nearest_boxindex]) {
+			if (flags[nearest_boxindex] & CANDIDATE_OBJECT) {
 				info.type = COLLISION_OBJECT;
 			}
 			else {
 				info.type = COLLISION_NODE;
 			}
-			info.node_p = node_positions[nearest_boxindex];
+			info.node_p = candidates.node_positions[nearest_boxindex];
 			info.bouncy = bouncy;
 			info.old_speed = speed_f;
 
@@ -478,7 +471,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 			if(step_up)
 			{
 				// Special case: Handle stairs
-				is_step_up[nearest_boxindex] = true;
+				flags[nearest_boxindex] |= CANDIDATE_STEPPED_UP;
 				is_collision = false;
 			}
 			else if(nearest_collided == 0) // X
@@ -543,7 +536,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 				cbox.MaxEdge.Z-d > box.MinEdge.Z &&
 				cbox.MinEdge.Z+d < box.MaxEdge.Z
 		){
-			if(is_step_up[boxindex])
+			if(flags[boxindex] & CANDIDATE_STEPPED_UP)
 			{
 				pos_f.Y += (cbox.MaxEdge.Y - box.MinEdge.Y);
 				box = box_0;
@@ -553,7 +546,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 			if(fabs(cbox.MaxEdge.Y-box.MinEdge.Y) < 0.15*BS)
 			{
 				result.touching_ground = true;
-				if(is_unloaded[boxindex])
+				if(flags[boxindex] & CANDIDATE_UNLOADED)
 					result.standing_on_unloaded = true;
 			}
 		}
@@ -67,6 +67,42 @@ struct collisionMoveResult
 	{}
 };
 
+enum CollisionCandidateFlags
+{
+	CANDIDATE_UNLOADED = 0x01,
+	CANDIDATE_OBJECT = 0x02,
+	CANDIDATE_STEPPED_UP = 0x04,
+};
+
+/*
+	Boxes that a moving box may collide with, as parallel arrays.
+	Every Environment keeps one for collisionMoveSimple, so that the
+	arrays keep their capacity between calls.
+*/
+struct CollisionCandidates
+{
+	std::vector<aabb3f> boxes;
+	std::vector<v3s16> node_positions;
+	std::vector<s16> bouncy_values;
+	std::vector<u8> flags;
+
+	void clear()
+	{
+		boxes.clear();
+		node_positions.clear();
+		bouncy_values.clear();
+		flags.clear();
+	}
+
+	void add(const aabb3f &box, v3s16 p, s16 bouncy, u8 flag)
+	{
+		boxes.push_back(box);
+		node_positions.push_back(p);
+		bouncy_values.push_back(bouncy);
+		flags.push_back(flag);
+	}
+};
+
 // Moves using a single iteration; speed should not exceed pos_max_d/dtime
 collisionMoveResult collisionMoveSimple(Environment *env,IGameDef *gamedef,
 		f32 pos_max_d, const aabb3f &box_0,
@@ -48,6 +48,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // resend_timeout = avg_rtt * this
 #define RESEND_TIMEOUT_FACTOR 4
 
+// Limits of the send rate to a peer in bytes per second
+#define SEND_RATE_MIN (16 * 1024)
+#define SEND_RATE_INITIAL (64 * 1024)
+#define SEND_RATE_MAX (64 * 1024 * 1024)
+// The send rate is adapted at most this often (seconds), else once per rtt
+#define SEND_RATE_UPDATE_MIN 0.05
+// Data sent at once is limited to this many seconds worth of the rate
+#define SEND_BURST_TIME 0.02
+// A link is congested when the rtt grows over min_rtt * factor + slack
+#define SEND_RTT_INFLATION_FACTOR 2.0
+#define SEND_RTT_INFLATION_SLACK 0.02
+
 /*
     Server
 */
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientobject.h"
 #include "object_properties.h"
 #include "itemgroup.h"
+#include "genericobject.h"
 
 /*
 	SmoothTranslator
@@ -78,6 +79,8 @@ class GenericCAO : public ClientActiveObject
 	float m_yaw;
 	s16 m_hp;
 	SmoothTranslator pos_translator;
+	// Last key frame of GENERIC_CMD_UPDATE_POSITION_COMPACT
+	ObjectPositionKey m_position_key;
 	// Spritesheet/animation stuff
 	v2f m_tx_size;
 	v2s16 m_tx_basepos;
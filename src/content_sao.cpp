@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "content_sao.h"
+#include <algorithm>
 #include "util/serialize.h"
 #include "util/mathconstants.h"
 #include "collision.h"
@@ -31,9 +32,34 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "scripting_game.h"
 #include "genericobject.h"
 #include "log.h"
+#include "nodedef.h"
+#include "itemdef.h"
 
 std::map<u16, ServerActiveObject::Factory> ServerActiveObject::m_types;
 
+/*
+	Queues a position update for the clients, as
+	GENERIC_CMD_UPDATE_POSITION_COMPACT for those that support it
+*/
+static void queuePositionUpdate(std::queue<ActiveObjectMessage> &messages,
+		u16 id, ObjectPositionKey &key, const ObjectPositionUpdate &update)
+{
+	ActiveObjectMessage aom(id, false, gob_cmd_update_position(
+			update.position, update.velocity, update.acceleration,
+			update.yaw, update.do_interpolate, update.is_movement_end,
+			update.update_interval));
+	aom.max_proto_version = 27;
+	messages.push(aom);
+
+	bool is_key_frame;
+	ActiveObjectMessage aom_compact(id, false,
+			gob_cmd_update_position_compact(key, update, is_key_frame));
+	// Updates in between are relative to the key frame, so it must arrive
+	aom_compact.reliable = is_key_frame;
+	aom_compact.min_proto_version = 28;
+	messages.push(aom_compact);
+}
+
 /*
 	TestSAO
 */
@@ -113,6 +139,11 @@ TestSAO proto_TestSAO(NULL, v3f(0,0,0));
 	LuaEntitySAO
 */
 
+static bool compareStepLODTiers(const StepLODTier &a, const StepLODTier &b)
+{
+	return a.distance < b.distance;
+}
+
 // Prototype (registers item for deserialization)
 LuaEntitySAO proto_LuaEntitySAO(NULL, v3f(0,0,0), "_prototype", "");
 
@@ -139,7 +170,9 @@ LuaEntitySAO::LuaEntitySAO(ServerEnvironment *env, v3f pos,
 	m_animation_sent(false),
 	m_bone_position_sent(false),
 	m_attachment_parent_id(0),
-	m_attachment_sent(false)
+	m_attachment_sent(false),
+	m_step_interval(0),
+	m_step_dtime(0)
 {
 	// Only register type if no environment supplied
 	if(env == NULL){
@@ -172,6 +205,9 @@ void LuaEntitySAO::addedToEnvironment(u32 dtime_s)
 			luaentity_GetProperties(m_id, &m_prop);
 		// Initialize HP from properties
 		m_hp = m_prop.hp_max;
+		m_env->getScriptIface()->
+			luaentity_GetStepLOD(m_id, &m_step_lod);
+		std::sort(m_step_lod.begin(), m_step_lod.end(), compareStepLODTiers);
 		// Activate entity, supplying serialized state
 		m_env->getScriptIface()->
 			luaentity_Activate(m_id, m_init_state.c_str(), dtime_s);
@@ -206,13 +242,21 @@ ServerActiveObject* LuaEntitySAO::create(ServerEnvironment *env, v3f pos,
 	// create object
 	infostream<<"LuaEntitySAO::create(name=\""<<name<<"\" state=\""
 			<<state<<"\")"<<std::endl;
-	LuaEntitySAO *sao = new LuaEntitySAO(env, pos, name, state);
+	LuaEntitySAO *sao = createEntity(env, pos, name, state);
 	sao->m_hp = hp;
 	sao->m_velocity = velocity;
 	sao->m_yaw = yaw;
 	return sao;
 }
 
+LuaEntitySAO* LuaEntitySAO::createEntity(ServerEnvironment *env, v3f pos,
+		const std::string &name, const std::string &state)
+{
+	if (name == ITEM_ENTITY_NAME)
+		return new ItemSAO(env, pos, state);
+	return new LuaEntitySAO(env, pos, name, state);
+}
+
 bool LuaEntitySAO::isAttached()
 {
 	if(!m_attachment_parent_id)
@@ -258,39 +302,10 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 	}
 	else
 	{
-		if(m_prop.physical){
-			core::aabbox3d<f32> box = m_prop.collisionbox;
-			box.MinEdge *= BS;
-			box.MaxEdge *= BS;
-			collisionMoveResult moveresult;
-			f32 pos_max_d = BS*0.25; // Distance per iteration
-			v3f p_pos = m_base_position;
-			v3f p_velocity = m_velocity;
-			v3f p_acceleration = m_acceleration;
-			moveresult = collisionMoveSimple(m_env,m_env->getGameDef(),
-					pos_max_d, box, m_prop.stepheight, dtime,
-					p_pos, p_velocity, p_acceleration,
-					this, m_prop.collideWithObjects);
-
-			// Apply results
-			m_base_position = p_pos;
-			m_velocity = p_velocity;
-			m_acceleration = p_acceleration;
-		} else {
-			m_base_position += dtime * m_velocity + 0.5 * dtime
-					* dtime * m_acceleration;
-			m_velocity += dtime * m_acceleration;
-		}
-
-		if((m_prop.automatic_face_movement_dir) &&
-				(fabs(m_velocity.Z) > 0.001 || fabs(m_velocity.X) > 0.001)){
-			m_yaw = atan2(m_velocity.Z,m_velocity.X) * 180 / M_PI + m_prop.automatic_face_movement_dir_offset;
-		}
+		stepMovement(dtime);
 	}
 
-	if(m_registered){
-		m_env->getScriptIface()->luaentity_Step(m_id, dtime);
-	}
+	stepScript(dtime);
 
 	if(send_recommended == false)
 		return;
@@ -350,10 +365,65 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 	}
 }
 
+void LuaEntitySAO::stepMovement(float dtime)
+{
+	if(m_prop.physical){
+		core::aabbox3d<f32> box = m_prop.collisionbox;
+		box.MinEdge *= BS;
+		box.MaxEdge *= BS;
+		collisionMoveResult moveresult;
+		f32 pos_max_d = BS*0.25; // Distance per iteration
+		v3f p_pos = m_base_position;
+		v3f p_velocity = m_velocity;
+		v3f p_acceleration = m_acceleration;
+		moveresult = collisionMoveSimple(m_env,m_env->getGameDef(),
+				pos_max_d, box, m_prop.stepheight, dtime,
+				p_pos, p_velocity, p_acceleration,
+				this, m_prop.collideWithObjects);
+
+		// Apply results
+		m_base_position = p_pos;
+		m_velocity = p_velocity;
+		m_acceleration = p_acceleration;
+	} else {
+		m_base_position += dtime * m_velocity + 0.5 * dtime
+				* dtime * m_acceleration;
+		m_velocity += dtime * m_acceleration;
+	}
+
+	if((m_prop.automatic_face_movement_dir) &&
+			(fabs(m_velocity.Z) > 0.001 || fabs(m_velocity.X) > 0.001)){
+		m_yaw = atan2(m_velocity.Z,m_velocity.X) * 180 / M_PI + m_prop.automatic_face_movement_dir_offset;
+	}
+}
+
+void LuaEntitySAO::stepScript(float dtime)
+{
+	if(!m_registered)
+		return;
+
+	m_step_dtime += dtime;
+	if(m_step_dtime < m_step_interval)
+		return;
+	m_env->getScriptIface()->luaentity_Step(m_id, m_step_dtime);
+	m_step_dtime = 0;
+}
+
+void LuaEntitySAO::setNearestPlayerDistance(float d)
+{
+	m_step_interval = 0;
+	for(size_t i = 0; i < m_step_lod.size() &&
+			m_step_lod[i].distance * BS <= d; i++)
+		m_step_interval = m_step_lod[i].interval;
+}
+
 std::string LuaEntitySAO::getClientInitializationData(u16 protocol_version)
 {
 	std::ostringstream os(std::ios::binary);
 
+	// The new client has none of the key frames sent so far
+	m_position_key.valid = false;
+
 	if(protocol_version >= 14)
 	{
 		writeU8(os, 1); // version
@@ -691,20 +761,15 @@ void LuaEntitySAO::sendPosition(bool do_interpolate, bool is_movement_end)
 	m_last_sent_velocity = m_velocity;
 	//m_last_sent_acceleration = m_acceleration;
 
-	float update_interval = m_env->getSendRecommendedInterval();
-
-	std::string str = gob_cmd_update_position(
-		m_base_position,
-		m_velocity,
-		m_acceleration,
-		m_yaw,
-		do_interpolate,
-		is_movement_end,
-		update_interval
-	);
-	// create message and add to list
-	ActiveObjectMessage aom(getId(), false, str);
-	m_messages_out.push(aom);
+	ObjectPositionUpdate update;
+	update.position = m_base_position;
+	update.velocity = m_velocity;
+	update.acceleration = m_acceleration;
+	update.yaw = m_yaw;
+	update.do_interpolate = do_interpolate;
+	update.is_movement_end = is_movement_end;
+	update.update_interval = m_env->getSendRecommendedInterval();
+	queuePositionUpdate(m_messages_out, getId(), m_position_key, update);
 }
 
 bool LuaEntitySAO::getCollisionBox(aabb3f *toset) {
@@ -727,6 +792,227 @@ bool LuaEntitySAO::collideWithObjects(){
 	return m_prop.collideWithObjects;
 }
 
+/*
+	ItemSAO
+*/
+
+// Same as the acceleration the Lua entity used to set
+#define ITEM_GRAVITY (10.0 * BS)
+// How often resting items look for the node under them
+#define ITEM_SUPPORT_CHECK_INTERVAL 0.5
+#define ITEM_MERGE_RADIUS (0.8 * BS)
+
+ItemSAO::ItemSAO(ServerEnvironment *env, v3f pos, const std::string &state):
+	LuaEntitySAO(env, pos, ITEM_ENTITY_NAME, state),
+	m_scripted(false),
+	m_resting(false),
+	m_resting_pos(0,0,0),
+	m_age(0),
+	m_time_to_live(g_settings->getFloat("item_entity_ttl")),
+	m_support_check_timer(0)
+{
+}
+
+ItemSAO::~ItemSAO()
+{
+	if(m_resting)
+		m_env->removeRestingItem(m_resting_pos, m_id);
+}
+
+void ItemSAO::addedToEnvironment(u32 dtime_s)
+{
+	LuaEntitySAO::addedToEnvironment(dtime_s);
+
+	if(!m_registered)
+		return;
+
+	// The builtin on_step is a C function doing what stepping does here
+	// anyway; a Lua one comes from a mod replacing the entity
+	GameScripting *script = m_env->getScriptIface();
+	m_scripted = script->luaentity_HasLuaFunctionField(m_id, "on_step");
+	m_age = script->luaentity_GetFloatField(m_id, "age", 0);
+}
+
+std::string ItemSAO::getStaticData()
+{
+	if(m_registered)
+		m_env->getScriptIface()->luaentity_SetFloatField(m_id, "age", m_age);
+	return LuaEntitySAO::getStaticData();
+}
+
+void ItemSAO::stepMovement(float dtime)
+{
+	if(!m_registered){
+		LuaEntitySAO::stepMovement(dtime);
+		return;
+	}
+
+	if(m_resting){
+		// Mods may push items around
+		bool pushed = m_velocity != v3f(0,0,0) ||
+				m_acceleration != v3f(0,0,0);
+		if(!pushed){
+			m_support_check_timer += dtime;
+			if(m_support_check_timer < ITEM_SUPPORT_CHECK_INTERVAL)
+				return;
+			m_support_check_timer = 0;
+			if(isSupported(NULL))
+				return;
+		}
+		wakeUp();
+	}
+
+	LuaEntitySAO::stepMovement(dtime);
+
+	bool can_merge;
+	if(isSupported(&can_merge))
+		rest(can_merge);
+}
+
+void ItemSAO::stepScript(float dtime)
+{
+	m_age += dtime;
+	if(m_registered && m_time_to_live > 0 && m_age > m_time_to_live){
+		m_env->getScriptIface()->luaentity_SetStringField(m_id,
+				"itemstring", "");
+		m_removed = true;
+		return;
+	}
+
+	if(m_scripted)
+		LuaEntitySAO::stepScript(dtime);
+}
+
+void ItemSAO::update()
+{
+	if(!m_registered || m_removed)
+		return;
+
+	if(m_resting){
+		if(!isSupported(NULL))
+			wakeUp();
+		return;
+	}
+
+	bool can_merge;
+	if(isSupported(&can_merge))
+		rest(can_merge);
+}
+
+bool ItemSAO::isSupported(bool *can_merge)
+{
+	v3s16 p = floatToInt(m_base_position - v3f(0, BS/2, 0), BS);
+	bool valid_position;
+	MapNode n = m_env->getMap().getNodeNoEx(p, &valid_position);
+
+	// Don't fall into unloaded areas
+	if(!valid_position || n.getContent() == CONTENT_IGNORE){
+		if(can_merge)
+			*can_merge = false;
+		return true;
+	}
+
+	if(can_merge)
+		*can_merge = true;
+	const ContentFeatures &f = m_env->getGameDef()->ndef()->get(n);
+	return f.walkable && m_velocity.Y == 0;
+}
+
+void ItemSAO::rest(bool merge)
+{
+	m_velocity = v3f(0,0,0);
+	m_acceleration = v3f(0,0,0);
+	m_support_check_timer = 0;
+
+	if(merge){
+		mergeWithNearby();
+		if(m_removed)
+			return;
+	}
+
+	m_resting = true;
+	m_resting_pos = floatToInt(m_base_position, BS);
+	m_env->addRestingItem(m_resting_pos, m_id);
+	sendPosition(false, true);
+}
+
+void ItemSAO::wakeUp()
+{
+	m_env->removeRestingItem(m_resting_pos, m_id);
+	m_resting = false;
+	if(m_acceleration == v3f(0,0,0))
+		m_acceleration = v3f(0, -ITEM_GRAVITY, 0);
+}
+
+void ItemSAO::mergeWithNearby()
+{
+	std::vector<u16> ids;
+	m_env->getRestingItemsAround(floatToInt(m_base_position, BS), ids);
+
+	for(size_t i = 0; i < ids.size(); i++){
+		// Only items are in the index
+		ItemSAO *item = (ItemSAO *)m_env->getActiveObject(ids[i]);
+		if(!item || item == this || item->m_removed)
+			continue;
+		if(item->getBasePosition().getDistanceFrom(m_base_position) >
+				ITEM_MERGE_RADIUS)
+			continue;
+
+		if(mergeInto(item))
+			return;
+	}
+}
+
+bool ItemSAO::mergeInto(ItemSAO *item)
+{
+	if(!m_registered || !item->m_registered || m_removed || item->m_removed)
+		return false;
+
+	GameScripting *script = m_env->getScriptIface();
+	IItemDefManager *idef = m_env->getGameDef()->idef();
+
+	ItemStack stack;
+	stack.deSerialize(script->luaentity_GetStringField(m_id, "itemstring"),
+			idef);
+	ItemStack other;
+	other.deSerialize(script->luaentity_GetStringField(item->m_id,
+			"itemstring"), idef);
+	if(stack.empty() || other.empty())
+		return false;
+
+	u16 old_count = other.count;
+	stack = other.addItem(stack, idef);
+	if(other.count == old_count)
+		return false;
+
+	script->luaentity_SetStringField(item->m_id, "itemstring",
+			other.getItemString());
+	item->updateSize(other);
+	// Bigger stacks are drawn bigger, keep them above the ground
+	v3f pos = item->getBasePosition();
+	pos.Y += (float)(other.count - old_count) /
+			other.getStackMax(idef) * 0.15 * BS;
+	item->moveTo(pos, false);
+
+	script->luaentity_SetStringField(m_id, "itemstring",
+			stack.getItemString());
+	if(stack.empty()){
+		m_removed = true;
+		return true;
+	}
+	updateSize(stack);
+	return false;
+}
+
+void ItemSAO::updateSize(const ItemStack &stack)
+{
+	IItemDefManager *idef = m_env->getGameDef()->idef();
+	float s = 0.2 + 0.1 * stack.count / stack.getStackMax(idef);
+	m_prop.visual_size = v2f(s, s);
+	m_prop.collisionbox = aabb3f(-s, -s, -s, s, s, s);
+	notifyObjectPropertiesModified();
+}
+
 /*
 	PlayerSAO
 */
@@ -835,6 +1121,9 @@ std::string PlayerSAO::getClientInitializationData(u16 protocol_version)
 {
 	std::ostringstream os(std::ios::binary);
 
+	// The new client has none of the key frames sent so far
+	m_position_key.valid = false;
+
 	if(protocol_version >= 15)
 	{
 		writeU8(os, 1); // version
@@ -947,24 +1236,15 @@ void PlayerSAO::step(float dtime, bool send_recommended)
 	if(m_position_not_sent && !isAttached())
 	{
 		m_position_not_sent = false;
-		float update_interval = m_env->getSendRecommendedInterval();
-		v3f pos;
+		ObjectPositionUpdate update;
 		if(isAttached()) // Just in case we ever do send attachment position too
-			pos = m_env->getActiveObject(m_attachment_parent_id)->getBasePosition();
+			update.position = m_env->getActiveObject(m_attachment_parent_id)->getBasePosition();
 		else
-			pos = m_player->getPosition() + v3f(0,BS*1,0);
-		std::string str = gob_cmd_update_position(
-			pos,
-			v3f(0,0,0),
-			v3f(0,0,0),
-			m_player->getYaw(),
-			true,
-			false,
-			update_interval
-		);
-		// create message and add to list
-		ActiveObjectMessage aom(getId(), false, str);
-		m_messages_out.push(aom);
+			update.position = m_player->getPosition() + v3f(0,BS*1,0);
+		update.yaw = m_player->getYaw();
+		update.do_interpolate = true;
+		update.update_interval = m_env->getSendRecommendedInterval();
+		queuePositionUpdate(m_messages_out, getId(), m_position_key, update);
 	}
 
 	if(m_armor_groups_sent == false) {
@@ -24,6 +24,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "itemgroup.h"
 #include "player.h"
 #include "object_properties.h"
+#include "genericobject.h"
+
+/*
+	Entities at least distance nodes away from the nearest player run
+	on_step only every interval seconds (step_lod in entity definitions).
+*/
+struct StepLODTier
+{
+	float distance;
+	float interval;
+};
 
 /*
 	LuaEntitySAO needs some internals exposed.
@@ -42,6 +53,9 @@ class LuaEntitySAO : public ServerActiveObject
 	virtual void addedToEnvironment(u32 dtime_s);
 	static ServerActiveObject* create(ServerEnvironment *env, v3f pos,
 			const std::string &data);
+	// Creates an entity of the SAO class implementing it
+	static LuaEntitySAO* createEntity(ServerEnvironment *env, v3f pos,
+			const std::string &name, const std::string &state);
 	bool isAttached();
 	void step(float dtime, bool send_recommended);
 	std::string getClientInitializationData(u16 protocol_version);
@@ -83,7 +97,16 @@ class LuaEntitySAO : public ServerActiveObject
 	std::string getName();
 	bool getCollisionBox(aabb3f *toset);
 	bool collideWithObjects();
-private:
+	bool hasStepLOD() const
+	{ return !m_step_lod.empty(); }
+	// Picks the on_step interval, in BS units
+	void setNearestPlayerDistance(float d);
+protected:
+	// Moves the entity when it is not attached
+	virtual void stepMovement(float dtime);
+	// Runs on_step
+	virtual void stepScript(float dtime);
+
 	std::string getPropertyPacket();
 	void sendPosition(bool do_interpolate, bool is_movement_end);
 
@@ -104,6 +127,7 @@ class LuaEntitySAO : public ServerActiveObject
 	v3f m_last_sent_velocity;
 	float m_last_sent_position_timer;
 	float m_last_sent_move_precision;
+	ObjectPositionKey m_position_key;
 	bool m_armor_groups_sent;
 
 	v2f m_animation_range;
@@ -121,6 +145,60 @@ class LuaEntitySAO : public ServerActiveObject
 	v3f m_attachment_position;
 	v3f m_attachment_rotation;
 	bool m_attachment_sent;
+
+	// Sorted by distance
+	std::vector<StepLODTier> m_step_lod;
+	float m_step_interval;
+	// Time since on_step was last called
+	float m_step_dtime;
+};
+
+/*
+	Dropped items (__builtin:item)
+
+	The Lua entity keeps the item string and handles pickup, but falling,
+	resting and merging with other stacks are done here instead of in
+	on_step. Items lying still are not moved at all and only check every
+	now and then whether the node under them is gone.
+*/
+
+#define ITEM_ENTITY_NAME "__builtin:item"
+
+class ItemSAO : public LuaEntitySAO
+{
+public:
+	ItemSAO(ServerEnvironment *env, v3f pos, const std::string &state);
+	~ItemSAO();
+	virtual void addedToEnvironment(u32 dtime_s);
+	std::string getStaticData();
+	bool isResting() const { return m_resting; }
+	float getAge() const { return m_age; }
+	// Lets the item come to rest or start falling right away, instead of
+	// at the next check
+	void update();
+	// Merges as much of this stack as fits into the stack of item. Returns
+	// true if this one was used up and removed.
+	bool mergeInto(ItemSAO *item);
+protected:
+	void stepMovement(float dtime);
+	void stepScript(float dtime);
+private:
+	// Whether the item should lie still at the current position
+	bool isSupported(bool *can_merge);
+	void rest(bool merge);
+	void wakeUp();
+	// Merges this stack into the resting ones around it
+	void mergeWithNearby();
+	void updateSize(const ItemStack &stack);
+
+	// Set if a mod overrode the entity with its own on_step, which is
+	// called in addition to the native stepping
+	bool m_scripted;
+	bool m_resting;
+	v3s16 m_resting_pos;
+	float m_age;
+	float m_time_to_live;
+	float m_support_check_timer;
 };
 
 /*
@@ -308,6 +386,7 @@ class PlayerSAO : public ServerActiveObject
 
 	int m_wield_index;
 	bool m_position_not_sent;
+	ObjectPositionKey m_position_key;
 	ItemGroupList m_armor_groups;
 	bool m_armor_groups_sent;
 
@@ -35,6 +35,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serverobject.h"
 #include "settings.h"
 #include "scripting_game.h"
+#include "scripting_mapgen.h"
+#include "mods.h"
 #include "profiler.h"
 #include "log.h"
 #include "nodedef.h"
@@ -66,6 +68,7 @@ class EmergeThread : public Thread
 	ServerMap *map;
 	EmergeManager *emerge;
 	Mapgen *mapgen;
+	MapgenScripting *script;
 	bool enable_mapgen_debug_info;
 	int id;
 
@@ -77,12 +80,18 @@ class EmergeThread : public Thread
 		map(NULL),
 		emerge(NULL),
 		mapgen(NULL),
+		script(NULL),
 		enable_mapgen_debug_info(false),
 		id(ethreadid)
 	{
 		name = "Emerge-" + itos(id);
 	}
 
+	~EmergeThread()
+	{
+		delete script;
+	}
+
 	void *run();
 	bool popBlockEmerge(v3s16 *pos, u8 *flags);
 	bool getBlockOrStartGen(v3s16 p, MapBlock **b,
@@ -190,6 +199,32 @@ void EmergeManager::initMapgens()
 		assert(mg);
 		mapgen.push_back(mg);
 	}
+
+	// All biomes, ores and decorations have been registered by now
+	biomemgr->updateBiomeLookup();
+	oremgr->updatePlacementIndex();
+	decomgr->updatePlacementIndex();
+
+	// Every thread gets its own Lua environment for the mapgen scripts
+	if (mapgen_scripts.empty())
+		return;
+
+	for (u32 i = 0; i != emergethread.size(); i++) {
+		MapgenScripting *script =
+			new MapgenScripting(emergethread[i]->m_server);
+
+		std::string error_msg;
+		if (!script->loadScripts(mapgen_scripts, &error_msg)) {
+			delete script;
+			throw ModError("Failed to load mapgen scripts"
+				"\nError from Lua:\n" + error_msg);
+		}
+
+		emergethread[i]->script = script;
+	}
+
+	infostream << "EmergeManager: loaded " << mapgen_scripts.size()
+		<< " mapgen scripts" << std::endl;
 }
 
 
@@ -455,6 +490,10 @@ void *EmergeThread::run()
 		std::map<v3s16, MapBlock *> modified_blocks;
 
 		if (getBlockOrStartGen(p, &block, &data, allow_generate) && mapgen) {
+			v3s16 minp = data.blockpos_min * MAP_BLOCKSIZE;
+			v3s16 maxp = data.blockpos_max * MAP_BLOCKSIZE +
+						 v3s16(1,1,1) * (MAP_BLOCKSIZE - 1);
+
 			{
 				ScopeProfiler sp(g_profiler, "EmergeThread: Mapgen::makeChunk", SPT_AVG);
 				TimeTaker t("mapgen::make_block()");
@@ -465,6 +504,17 @@ void *EmergeThread::run()
 					t.stop(true); // Hide output
 			}
 
+			// The mapgen scripts work on the chunk before it is added to
+			// the map, so they need neither the envlock nor write_to_map()
+			if (script) {
+				ScopeProfiler sp(g_profiler, "EmergeThread: mapgen scripts", SPT_AVG);
+				try {
+					script->on_generated(minp, maxp, mapgen->blockseed);
+				} catch (LuaError &e) {
+					m_server->setAsyncFatalError("Lua: " + std::string(e.what()));
+				}
+			}
+
 			{
 				//envlock: usually 0ms, but can take either 30 or 400ms to acquire
 				MutexAutoLock envlock(m_server->m_env_mutex);
@@ -478,9 +528,6 @@ void *EmergeThread::run()
 					/*
 						Do some post-generate stuff
 					*/
-					v3s16 minp = data.blockpos_min * MAP_BLOCKSIZE;
-					v3s16 maxp = data.blockpos_max * MAP_BLOCKSIZE +
-								 v3s16(1,1,1) * (MAP_BLOCKSIZE - 1);
 
 					// Ignore map edit events, they will not need to be sent
 					// to anybody because the block hasn't been sent to anybody
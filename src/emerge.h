@@ -66,6 +66,12 @@ struct BlockEmergeData {
 	u8 flags;
 };
 
+// Lua file registered by a mod to run on every emerge thread
+struct MapgenScriptSpec {
+	std::string mod_name;
+	std::string path;
+};
+
 class EmergeManager {
 public:
 	INodeDefManager *ndef;
@@ -85,6 +91,8 @@ class EmergeManager {
 	u32 gen_notify_on;
 	std::set<u32> gen_notify_on_deco_ids;
 
+	std::vector<MapgenScriptSpec> mapgen_scripts;
+
 	//// Block emerge queue data structures
 	Mutex queuemutex;
 	std::map<v3s16, BlockEmergeData *> blocks_enqueued;
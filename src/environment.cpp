@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include <fstream>
+#include <cfloat>
 #include "environment.h"
 #include "filesys.h"
 #include "porting.h"
@@ -43,11 +44,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "daynightratio.h"
 #include "map.h"
 #include "emerge.h"
+#include "falling_nodes.h"
+#include "pathfinder.h"
+#include "voxelalgorithms.h"
 #include "util/serialize.h"
 #include "threading/mutex_auto_lock.h"
 
 #define PP(x) "("<<(x).X<<","<<(x).Y<<","<<(x).Z<<")"
 
+// Objects whose collision box reaches further than this many nodes from
+// their position can be missed by raycasts
+#define RAYCAST_MAX_OBJECT_EXTENT 4
+
 Environment::Environment():
 	m_time_of_day(9000),
 	m_time_of_day_f(9000./24000),
@@ -248,6 +256,182 @@ void Environment::stepTimeOfDay(float dtime)
 	}
 }
 
+/*
+	Reads nodes along a line, keeping the last MapBlock looked up, since
+	consecutive nodes of a line are mostly in the same block.
+*/
+static MapNode getNodeCached(Map &map, v3s16 p, MapBlock *&block,
+		v3s16 &blockpos)
+{
+	v3s16 bp = getNodeBlockPos(p);
+	if (!block || bp != blockpos) {
+		block = map.getBlockNoCreateNoEx(bp);
+		blockpos = bp;
+	}
+	if (!block)
+		return MapNode(CONTENT_IGNORE);
+	bool valid_position;
+	return block->getNodeNoCheck(p - bp * MAP_BLOCKSIZE, &valid_position);
+}
+
+/*
+	Intersects the line start + t * dir (t in 0...1) with box, using the
+	slab method. On a hit, t is where the line enters the box and normal
+	is the face it enters through; both are zero if start is inside.
+*/
+static bool intersectLineBox(const aabb3f &box, const v3f &start,
+		const v3f &dir, f32 *t, v3s16 *normal)
+{
+	f32 s[3] = {start.X, start.Y, start.Z};
+	f32 d[3] = {dir.X, dir.Y, dir.Z};
+	f32 bmin[3] = {box.MinEdge.X, box.MinEdge.Y, box.MinEdge.Z};
+	f32 bmax[3] = {box.MaxEdge.X, box.MaxEdge.Y, box.MaxEdge.Z};
+	f32 t_enter = 0;
+	f32 t_exit = 1;
+	int enter_axis = -1;
+	s16 enter_side = 0;
+
+	for (int i = 0; i < 3; i++) {
+		if (d[i] == 0) {
+			if (s[i] < bmin[i] || s[i] > bmax[i])
+				return false;
+			continue;
+		}
+		f32 t1 = (bmin[i] - s[i]) / d[i];
+		f32 t2 = (bmax[i] - s[i]) / d[i];
+		// The line enters through the min face when going positive
+		s16 side = -1;
+		if (t1 > t2) {
+			f32 tmp = t1;
+			t1 = t2;
+			t2 = tmp;
+			side = 1;
+		}
+		if (t1 > t_enter) {
+			t_enter = t1;
+			enter_axis = i;
+			enter_side = side;
+		}
+		if (t2 < t_exit)
+			t_exit = t2;
+		if (t_enter > t_exit)
+			return false;
+	}
+
+	*t = t_enter;
+	*normal = v3s16(0, 0, 0);
+	if (enter_axis == 0)
+		normal->X = enter_side;
+	else if (enter_axis == 1)
+		normal->Y = enter_side;
+	else if (enter_axis == 2)
+		normal->Z = enter_side;
+	return true;
+}
+
+bool Environment::line_of_sight(v3f pos1, v3f pos2, float stepsize, v3s16 *p)
+{
+	// stepsize is not needed anymore, every node on the line is checked
+	(void)stepsize;
+
+	Map &map = getMap();
+	MapBlock *block = NULL;
+	v3s16 blockpos;
+
+	voxalgo::VoxelLineIterator iterator(pos1 / BS, (pos2 - pos1) / BS);
+	for (;;) {
+		MapNode n = getNodeCached(map, iterator.m_current_node_pos,
+			block, blockpos);
+		if (n.param0 != CONTENT_AIR) {
+			if (p)
+				*p = iterator.m_current_node_pos;
+			return false;
+		}
+		if (!iterator.hasNext())
+			break;
+		iterator.next();
+	}
+	return true;
+}
+
+bool Environment::raycastObjectBox(const aabb3f &box, v3f pos1, v3f dir,
+		f32 *nearest)
+{
+	f32 t;
+	v3s16 normal;
+	if (!intersectLineBox(box, pos1, dir, &t, &normal) || t >= *nearest)
+		return false;
+	// The line starts inside, e.g. at the eyes of the object itself
+	if (normal == v3s16(0, 0, 0))
+		return false;
+	*nearest = t;
+	return true;
+}
+
+PointedThing Environment::raycast(v3f pos1, v3f pos2, bool objects,
+		bool liquids)
+{
+	ScopeProfiler sp(g_profiler, "Env: raycast avg", SPT_AVG);
+
+	PointedThing result;
+	v3f dir = pos2 - pos1;
+	// Part of the line before the nearest hit so far
+	f32 nearest = 1;
+
+	if (objects)
+		raycastObjects(pos1, dir, &nearest, &result);
+
+	Map &map = getMap();
+	INodeDefManager *ndef = map.getNodeDefManager();
+	MapBlock *block = NULL;
+	v3s16 blockpos;
+
+	voxalgo::VoxelLineIterator iterator(pos1 / BS, dir / BS);
+	for (;;) {
+		v3s16 np = iterator.m_current_node_pos;
+		// Nodes further than a hit object can't be in front of it
+		if (result.type == POINTEDTHING_OBJECT &&
+				intToFloat(np, BS).getDistanceFrom(pos1) - BS >
+				nearest * dir.getLength())
+			break;
+
+		MapNode n = getNodeCached(map, np, block, blockpos);
+		const ContentFeatures &f = ndef->get(n);
+		if (f.pointable || (liquids && f.isLiquid())) {
+			std::vector<aabb3f> boxes = n.getSelectionBoxes(ndef);
+			v3f offset = intToFloat(np, BS);
+			bool hit = false;
+			v3s16 hit_normal;
+			for (std::vector<aabb3f>::iterator b = boxes.begin();
+					b != boxes.end(); ++b) {
+				aabb3f box(b->MinEdge + offset, b->MaxEdge + offset);
+				f32 t;
+				v3s16 normal;
+				if (!intersectLineBox(box, pos1, dir, &t, &normal) ||
+						t >= nearest)
+					continue;
+				nearest = t;
+				hit = true;
+				hit_normal = normal;
+			}
+			if (hit) {
+				result.type = POINTEDTHING_NODE;
+				result.node_undersurface = np;
+				// Inside of the node: use the node the line came from
+				result.node_abovesurface = hit_normal == v3s16(0, 0, 0) ?
+					iterator.m_previous_node_pos : np + hit_normal;
+				break;
+			}
+		}
+
+		if (!iterator.hasNext())
+			break;
+		iterator.next();
+	}
+
+	return result;
+}
+
 /*
 	ABMWithState
 */
@@ -349,8 +533,10 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_game_time(0),
 	m_game_time_fraction_counter(0),
 	m_recommended_send_interval(0.1),
-	m_max_lag_estimate(0.1)
+	m_max_lag_estimate(0.1),
+	m_pathfinder_thread(NULL)
 {
+	m_falling_nodes = new FallingNodeManager(this);
 }
 
 ServerEnvironment::~ServerEnvironment()
@@ -362,6 +548,13 @@ ServerEnvironment::~ServerEnvironment()
 	// Convert all objects to static and delete the active objects
 	deactivateFarObjects(true);
 
+	// Put nodes that are still falling back into the map
+	m_falling_nodes->freezeAll();
+	delete m_falling_nodes;
+
+	// Pending searches work on copies of the map, just drop them
+	delete m_pathfinder_thread;
+
 	// Drop/delete map
 	m_map->drop();
 
@@ -377,36 +570,46 @@ Map & ServerEnvironment::getMap()
 	return *m_map;
 }
 
+PathfinderThread *ServerEnvironment::getPathfinderThread()
+{
+	if (!m_pathfinder_thread) {
+		m_pathfinder_thread = new PathfinderThread();
+		m_pathfinder_thread->start();
+	}
+	return m_pathfinder_thread;
+}
+
 ServerMap & ServerEnvironment::getServerMap()
 {
 	return *m_map;
 }
 
-bool ServerEnvironment::line_of_sight(v3f pos1, v3f pos2, float stepsize, v3s16 *p)
+void ServerEnvironment::raycastObjects(v3f pos1, v3f dir, f32 *nearest,
+		PointedThing *result)
 {
-	float distance = pos1.getDistanceFrom(pos2);
-
-	//calculate normalized direction vector
-	v3f normalized_vector = v3f((pos2.X - pos1.X)/distance,
-				(pos2.Y - pos1.Y)/distance,
-				(pos2.Z - pos1.Z)/distance);
+	// Only look at the objects close enough to the line for their boxes
+	// to reach it
+	std::vector<u16> objects;
+	getObjectsInsideRadius(objects, pos1 + dir * 0.5,
+		dir.getLength() * 0.5 + RAYCAST_MAX_OBJECT_EXTENT * BS);
 
-	//find out if there's a node on path between pos1 and pos2
-	for (float i = 1; i < distance; i += stepsize) {
-		v3s16 pos = floatToInt(v3f(normalized_vector.X * i,
-				normalized_vector.Y * i,
-				normalized_vector.Z * i) +pos1,BS);
-
-		MapNode n = getMap().getNodeNoEx(pos);
-
-		if(n.param0 != CONTENT_AIR) {
-			if (p) {
-				*p = pos;
-			}
-			return false;
-		}
+	for (std::vector<u16>::iterator i = objects.begin();
+			i != objects.end(); ++i) {
+		ServerActiveObject *obj = getActiveObject(*i);
+		if (obj->m_removed)
+			continue;
+		ObjectProperties *prop = obj->accessObjectProperties();
+		if (!prop)
+			continue;
+		aabb3f box(prop->collisionbox.MinEdge * BS,
+			prop->collisionbox.MaxEdge * BS);
+		box.MinEdge += obj->getBasePosition();
+		box.MaxEdge += obj->getBasePosition();
+		if (!raycastObjectBox(box, pos1, dir, nearest))
+			continue;
+		result->type = POINTEDTHING_OBJECT;
+		result->object_id = *i;
 	}
-	return true;
 }
 
 void ServerEnvironment::kickAllPlayers(AccessDeniedCode reason,
@@ -848,6 +1051,40 @@ void ServerEnvironment::getObjectsInsideRadius(std::vector<u16> &objects, v3f po
 	}
 }
 
+void ServerEnvironment::addRestingItem(v3s16 p, u16 id)
+{
+	m_resting_items.insert(std::make_pair(p, id));
+}
+
+void ServerEnvironment::removeRestingItem(v3s16 p, u16 id)
+{
+	std::pair<std::multimap<v3s16, u16>::iterator,
+		std::multimap<v3s16, u16>::iterator> range =
+		m_resting_items.equal_range(p);
+	for (std::multimap<v3s16, u16>::iterator it = range.first;
+			it != range.second; ++it) {
+		if (it->second == id) {
+			m_resting_items.erase(it);
+			return;
+		}
+	}
+}
+
+void ServerEnvironment::getRestingItemsAround(v3s16 p, std::vector<u16> &ids)
+{
+	v3s16 d;
+	for (d.Z = -1; d.Z <= 1; d.Z++)
+	for (d.Y = -1; d.Y <= 1; d.Y++)
+	for (d.X = -1; d.X <= 1; d.X++) {
+		std::pair<std::multimap<v3s16, u16>::iterator,
+			std::multimap<v3s16, u16>::iterator> range =
+			m_resting_items.equal_range(p + d);
+		for (std::multimap<v3s16, u16>::iterator it = range.first;
+				it != range.second; ++it)
+			ids.push_back(it->second);
+	}
+}
+
 void ServerEnvironment::clearAllObjects()
 {
 	infostream<<"ServerEnvironment::clearAllObjects(): "
@@ -1200,6 +1437,11 @@ void ServerEnvironment::step(float dtime)
 	*/
 	m_script->environment_Step(dtime);
 
+	/*
+		Step falling nodes
+	*/
+	m_falling_nodes->step(dtime);
+
 	/*
 		Step active objects
 	*/
@@ -1218,6 +1460,14 @@ void ServerEnvironment::step(float dtime)
 			send_recommended = true;
 		}
 
+		// For entities that run on_step less often away from players
+		std::vector<v3f> player_positions;
+		for(std::vector<Player*>::iterator i = m_players.begin();
+				i != m_players.end(); ++i) {
+			if((*i)->peer_id != 0)
+				player_positions.push_back((*i)->getPosition());
+		}
+
 		for(std::map<u16, ServerActiveObject*>::iterator
 				i = m_active_objects.begin();
 				i != m_active_objects.end(); ++i)
@@ -1226,6 +1476,14 @@ void ServerEnvironment::step(float dtime)
 			// Don't step if is to be removed or stored statically
 			if(obj->m_removed || obj->m_pending_deactivation)
 				continue;
+			if(obj->getType() == ACTIVEOBJECT_TYPE_LUAENTITY &&
+					((LuaEntitySAO*)obj)->hasStepLOD()) {
+				v3f pos = obj->getBasePosition();
+				float d = FLT_MAX;
+				for(size_t j = 0; j < player_positions.size(); j++)
+					d = MYMIN(d, pos.getDistanceFrom(player_positions[j]));
+				((LuaEntitySAO*)obj)->setNearestPlayerDistance(d);
+			}
 			// Step object
 			obj->step(dtime, send_recommended);
 			// Read messages from object
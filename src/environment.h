@@ -40,6 +40,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapnode.h"
 #include "mapblock.h"
 #include "threading/mutex.h"
+#include "collision.h"
+#include "util/pointedthing.h"
 #include "network/networkprotocol.h" // for AccessDeniedCode
 
 class ServerEnvironment;
@@ -51,6 +53,8 @@ class Map;
 class ServerMap;
 class ClientMap;
 class GameScripting;
+class FallingNodeManager;
+class PathfinderThread;
 class Player;
 class RemotePlayer;
 
@@ -98,12 +102,38 @@ class Environment
 		m_day_night_ratio_override = value;
 	}
 
+	// Scratch space of collisionMoveSimple
+	CollisionCandidates &getCollisionCandidates()
+	{ return m_collision_candidates; }
+
+	//check if there's a line of sight between two positions
+	bool line_of_sight(v3f pos1, v3f pos2, float stepsize=1.0, v3s16 *p=NULL);
+
+	/*
+		Returns the first pointable node or, if objects is set, the
+		first object the line from pos1 to pos2 hits. Liquids are
+		pointable if liquids is set. Objects are not hit if pos1 is
+		inside of their box, so that they can look out of themselves.
+	*/
+	PointedThing raycast(v3f pos1, v3f pos2, bool objects, bool liquids);
+
 	// counter used internally when triggering ABMs
 	u32 m_added_objects;
 
 protected:
+	/*
+		Finds the object hit first by the line pos1 + t * dir, for t up
+		to *nearest; sets *nearest to its t and result to the object.
+	*/
+	virtual void raycastObjects(v3f pos1, v3f dir, f32 *nearest,
+			PointedThing *result) {}
+	// Updates *nearest if the line hits box before it, see raycastObjects()
+	static bool raycastObjectBox(const aabb3f &box, v3f pos1, v3f dir,
+			f32 *nearest);
+
 	// peer_ids in here should be unique, except that there may be many 0s
 	std::vector<Player*> m_players;
+	CollisionCandidates m_collision_candidates;
 	// Time of day in milli-hours (0-23999); determines day and night
 	u32 m_time_of_day;
 	// Time of day in 0...1
@@ -308,18 +338,27 @@ class ServerEnvironment : public Environment
 	bool removeNode(v3s16 p);
 	bool swapNode(v3s16 p, const MapNode &n);
 
+	FallingNodeManager *getFallingNodes()
+		{ return m_falling_nodes; }
+
+	// Started on first use
+	PathfinderThread *getPathfinderThread();
+
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius);
 
+	// Dropped items lying still, indexed by the node they are in
+	void addRestingItem(v3s16 p, u16 id);
+	void removeRestingItem(v3s16 p, u16 id);
+	// Finds resting items in the nodes next to and at p
+	void getRestingItemsAround(v3s16 p, std::vector<u16> &ids);
+
 	// Clear all objects, loading and going through every MapBlock
 	void clearAllObjects();
 
 	// This makes stuff happen
 	void step(f32 dtime);
 
-	//check if there's a line of sight between two positions
-	bool line_of_sight(v3f pos1, v3f pos2, float stepsize=1.0, v3s16 *p=NULL);
-
 	u32 getGameTime() { return m_game_time; }
 
 	void reportMaxLagEstimate(float f) { m_max_lag_estimate = f; }
@@ -332,6 +371,10 @@ class ServerEnvironment : public Environment
 	void setStaticForActiveObjectsInBlock(v3s16 blockpos,
 		bool static_exists, v3s16 static_block=v3s16(0,0,0));
 
+protected:
+	void raycastObjects(v3f pos1, v3f dir, f32 *nearest,
+			PointedThing *result);
+
 private:
 
 	/*
@@ -403,6 +446,10 @@ class ServerEnvironment : public Environment
 	// A helper variable for incrementing the latter
 	float m_game_time_fraction_counter;
 	std::vector<ABMWithState> m_abms;
+	// Falling node columns
+	FallingNodeManager *m_falling_nodes;
+	PathfinderThread *m_pathfinder_thread;
+	std::multimap<v3s16, u16> m_resting_items;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval;
 	// Estimate for general maximum lag as determined by server.
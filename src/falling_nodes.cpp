@@ -0,0 +1,230 @@
+/*
+Minetest
+Copyright (C) 2015 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "falling_nodes.h"
+#include "environment.h"
+#include "gamedef.h"
+#include "itemgroup.h"
+#include "map.h"
+#include "nodedef.h"
+#include "player.h"
+#include "profiler.h"
+#include "server.h"
+#include "settings.h"
+#include "scripting_game.h"
+#include <cmath>
+
+// Same as the acceleration the falling node entities used to have
+#define FALLING_NODE_GRAVITY 10.0f
+
+// How far ahead the fall is predicted for the particles sent to clients
+#define FALLING_NODE_PREDICT_RANGE 32
+
+// Most particles sent to each player for a column; taller columns are shown
+// by some of their nodes, spread over the height of the column
+#define FALLING_NODE_MAX_PARTICLES 4
+
+
+FallingNodeManager::FallingNodeManager(ServerEnvironment *env) :
+	m_env(env)
+{
+}
+
+
+u16 FallingNodeManager::spawn(v3s16 p, const MapNode &n)
+{
+	INodeDefManager *ndef = m_env->getGameDef()->ndef();
+	Map &map = m_env->getMap();
+
+	Column col;
+	col.x = p.X;
+	col.z = p.Z;
+	col.y = p.Y;
+	col.cell = p.Y;
+	col.speed = 0;
+	col.shown_until = p.Y;
+	col.nodes.push_back(n);
+
+	// Falling nodes resting on this one would fall right after it, so
+	// take them along now
+	for (s16 y = p.Y + 1; col.nodes.size() < FALLING_COLUMN_MAX_HEIGHT;
+			y++) {
+		v3s16 pa(p.X, y, p.Z);
+		MapNode na = map.getNodeNoEx(pa);
+		if (itemgroup_get(ndef->get(na).groups, "falling_node") == 0)
+			break;
+		col.nodes.push_back(na);
+		m_env->removeNode(pa);
+	}
+
+	m_columns.push_back(col);
+	showFall(m_columns.back());
+	return col.nodes.size();
+}
+
+
+bool FallingNodeManager::stopsFall(v3s16 p, const MapNode &n, bool predict)
+{
+	INodeDefManager *ndef = m_env->getGameDef()->ndef();
+
+	bool valid_position;
+	MapNode nb = m_env->getMap().getNodeNoEx(p, &valid_position);
+	// Don't fall into unloaded or unknown areas
+	if (!valid_position || nb.getContent() == CONTENT_IGNORE)
+		return true;
+
+	const ContentFeatures &f = ndef->get(n);
+	const ContentFeatures &fb = ndef->get(nb);
+	bool floats = itemgroup_get(f.groups, "float") != 0;
+
+	if (!fb.walkable && !(floats && fb.liquid_type != LIQUID_NONE))
+		return false;
+
+	// Leveled nodes of the same kind merge when landing
+	if (fb.leveled && nb.getContent() == n.getContent())
+		return true;
+
+	if (fb.buildable_to && (!floats || fb.liquid_type == LIQUID_NONE)) {
+		if (!predict)
+			m_env->removeNode(p);
+		return false;
+	}
+
+	return true;
+}
+
+
+void FallingNodeManager::showFall(Column &col)
+{
+	// Find where the column is going to land, as far as it can be told
+	s16 until = col.cell;
+	while (until > col.cell - FALLING_NODE_PREDICT_RANGE &&
+			!stopsFall(v3s16(col.x, until - 1, col.z), col.nodes[0], true))
+		until--;
+	col.shown_until = until;
+
+	f32 distance = col.y - until;
+	if (distance <= 0)
+		return;
+
+	// Time to fall the distance, starting at the current speed
+	const f32 g = FALLING_NODE_GRAVITY;
+	f32 time = (-col.speed + sqrt(col.speed * col.speed + 2 * g * distance)) / g;
+
+	INodeDefManager *ndef = m_env->getGameDef()->ndef();
+	Server *server = (Server *)m_env->getGameDef();
+	f32 range = g_settings->getS16("active_object_send_range_blocks") *
+		MAP_BLOCKSIZE * BS;
+	v3f pos(col.x * BS, col.y * BS, col.z * BS);
+
+	// Always includes the bottom and the top node
+	size_t count = col.nodes.size();
+	size_t nparticles = MYMIN(count, FALLING_NODE_MAX_PARTICLES);
+	std::vector<size_t> shown(nparticles);
+	for (size_t k = 0; k < nparticles; k++)
+		shown[k] = nparticles > 1 ? k * (count - 1) / (nparticles - 1) : 0;
+
+	std::vector<Player *> players = m_env->getPlayers(true);
+	for (size_t i = 0; i < players.size(); i++) {
+		if (players[i]->getPosition().getDistanceFrom(pos) > range)
+			continue;
+
+		for (size_t k = 0; k < nparticles; k++) {
+			size_t j = shown[k];
+			const ContentFeatures &f = ndef->get(col.nodes[j]);
+			server->spawnParticle(players[i]->getName(),
+				v3f(col.x, col.y + j, col.z), v3f(0, -col.speed, 0),
+				v3f(0, -g, 0), time, BS, false, false,
+				f.tiledef[0].name);
+		}
+	}
+}
+
+
+void FallingNodeManager::step(float dtime)
+{
+	ScopeProfiler sp(g_profiler, "SEnv: falling nodes avg", SPT_AVG);
+	g_profiler->avg("SEnv: falling columns", m_columns.size());
+
+	for (std::list<Column>::iterator it = m_columns.begin();
+			it != m_columns.end();) {
+		Column &col = *it;
+
+		col.speed += FALLING_NODE_GRAVITY * dtime;
+		f32 new_y = col.y - col.speed * dtime;
+
+		// Move down cell by cell until a node stops the column
+		bool landed = false;
+		while (new_y < col.cell) {
+			if (stopsFall(v3s16(col.x, col.cell - 1, col.z), col.nodes[0],
+					false)) {
+				landed = true;
+				break;
+			}
+			col.cell--;
+		}
+
+		if (!landed) {
+			col.y = new_y;
+			// Falling further than the clients know
+			if (col.cell < col.shown_until)
+				showFall(col);
+			++it;
+			continue;
+		}
+
+		// Landing runs callbacks, which may start new columns at the end
+		// of the list
+		Column landed_col = col;
+		it = m_columns.erase(it);
+		land(landed_col);
+	}
+}
+
+
+void FallingNodeManager::land(Column &col)
+{
+	GameScripting *script = m_env->getScriptIface();
+
+	for (size_t i = 0; i < col.nodes.size(); i++) {
+		v3s16 p(col.x, col.cell + i, col.z);
+		if (!script->node_falling_landed(p, col.nodes[i]))
+			m_env->setNode(p, col.nodes[i]);
+	}
+}
+
+
+void FallingNodeManager::freezeAll()
+{
+	Map &map = m_env->getMap();
+
+	for (std::list<Column>::iterator it = m_columns.begin();
+			it != m_columns.end(); ++it) {
+		for (size_t i = 0; i < it->nodes.size(); i++) {
+			v3s16 p(it->x, it->cell + i, it->z);
+			if (map.getNodeNoEx(p).getContent() != CONTENT_AIR)
+				continue;
+			try {
+				map.setNode(p, it->nodes[i]);
+			} catch (InvalidPositionException &e) {
+			}
+		}
+	}
+	m_columns.clear();
+}
@@ -0,0 +1,82 @@
+/*
+Minetest
+Copyright (C) 2015 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef FALLING_NODES_HEADER
+#define FALLING_NODES_HEADER
+
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include <list>
+#include <vector>
+
+class ServerEnvironment;
+
+// Maximum number of nodes that fall together as one column
+#define FALLING_COLUMN_MAX_HEIGHT 64
+
+/*
+	Falling nodes (sand, gravel...) are simulated here instead of as
+	entities. A node that starts falling takes the falling nodes stacked
+	on it along, and the whole column falls as one. Clients only get sent
+	particles showing the fall; when the column lands, its nodes are
+	placed through core.falling_node_landed().
+*/
+class FallingNodeManager
+{
+public:
+	FallingNodeManager(ServerEnvironment *env);
+
+	// Starts a column at p, whose node n has already been removed from
+	// the map. Returns the height of the column.
+	u16 spawn(v3s16 p, const MapNode &n);
+
+	void step(float dtime);
+
+	// Puts all columns back into the map where they are, without running
+	// any callbacks. Used on shutdown.
+	void freezeAll();
+
+	size_t getColumnCount() const { return m_columns.size(); }
+
+private:
+	struct Column {
+		s16 x;
+		s16 z;
+		// Center height of the bottom node
+		f32 y;
+		// Lowest cell the bottom node may occupy without moving on
+		s16 cell;
+		f32 speed;
+		// Height down to which clients have been sent particles
+		s16 shown_until;
+		// Bottom node first
+		std::vector<MapNode> nodes;
+	};
+
+	// Whether the node at p stops n from falling further. Removes the
+	// node and returns false if n replaces it, unless predict is set.
+	bool stopsFall(v3s16 p, const MapNode &n, bool predict);
+	void showFall(Column &col);
+	void land(Column &col);
+
+	ServerEnvironment *m_env;
+	std::list<Column> m_columns;
+};
+
+#endif
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "genericobject.h"
 #include <sstream>
 #include "util/serialize.h"
+#include "util/numeric.h"
 
 std::string gob_cmd_set_properties(const ObjectProperties &prop)
 {
@@ -65,6 +66,180 @@ std::string gob_cmd_update_position(
 	return os.str();
 }
 
+// Flags of GENERIC_CMD_UPDATE_POSITION_COMPACT
+enum {
+	GOB_POS_KEY_FRAME    = 0x01,
+	GOB_POS_VELOCITY     = 0x02,
+	GOB_POS_ACCELERATION = 0x04,
+	GOB_POS_YAW          = 0x08,
+	GOB_POS_INTERVAL     = 0x10,
+	GOB_POS_INTERPOLATE  = 0x20,
+	GOB_POS_MOVEMENT_END = 0x40,
+	// Velocity and acceleration don't fit the quantized range
+	GOB_POS_WIDE         = 0x80
+};
+
+// Updates sent between two key frames
+#define GOB_POS_KEY_INTERVAL 8
+// Quantization steps per BS of positions and vectors in updates
+#define GOB_POS_QUANT_SCALE 100.0f
+
+static bool quantizeV3F(v3f v, v3s16 &result)
+{
+	v *= GOB_POS_QUANT_SCALE;
+	if (fabs(v.X) > 32767 || fabs(v.Y) > 32767 || fabs(v.Z) > 32767)
+		return false;
+	result = v3s16(myround(v.X), myround(v.Y), myround(v.Z));
+	return true;
+}
+
+static v3f dequantizeV3F(v3s16 v)
+{
+	return v3f(v.X, v.Y, v.Z) / GOB_POS_QUANT_SCALE;
+}
+
+std::string gob_cmd_update_position_compact(ObjectPositionKey &key,
+		const ObjectPositionUpdate &update, bool &is_key_frame)
+{
+	v3s16 position_delta;
+	is_key_frame = !key.valid ||
+			key.updates_since >= GOB_POS_KEY_INTERVAL ||
+			!quantizeV3F(update.position - key.state.position, position_delta);
+
+	u8 flags = 0;
+	if (update.do_interpolate)
+		flags |= GOB_POS_INTERPOLATE;
+	if (update.is_movement_end)
+		flags |= GOB_POS_MOVEMENT_END;
+
+	std::ostringstream os(std::ios::binary);
+	// command
+	writeU8(os, GENERIC_CMD_UPDATE_POSITION_COMPACT);
+
+	if (is_key_frame) {
+		key.valid = true;
+		key.seq++;
+		key.updates_since = 0;
+		key.state = update;
+
+		// Fields left out are zero
+		flags |= GOB_POS_KEY_FRAME;
+		if (update.velocity != v3f(0,0,0))
+			flags |= GOB_POS_VELOCITY;
+		if (update.acceleration != v3f(0,0,0))
+			flags |= GOB_POS_ACCELERATION;
+		if (update.yaw != 0)
+			flags |= GOB_POS_YAW;
+		if (update.update_interval != 0)
+			flags |= GOB_POS_INTERVAL;
+
+		writeU8(os, flags);
+		writeU8(os, key.seq);
+		writeV3F1000(os, update.position);
+		if (flags & GOB_POS_VELOCITY)
+			writeV3F1000(os, update.velocity);
+		if (flags & GOB_POS_ACCELERATION)
+			writeV3F1000(os, update.acceleration);
+		if (flags & GOB_POS_YAW)
+			writeF1000(os, update.yaw);
+		if (flags & GOB_POS_INTERVAL)
+			writeF1000(os, update.update_interval);
+		return os.str();
+	}
+
+	key.updates_since++;
+
+	// Fields left out are the same as in the key frame
+	v3s16 velocity, acceleration;
+	if (update.velocity != key.state.velocity) {
+		flags |= GOB_POS_VELOCITY;
+		if (!quantizeV3F(update.velocity, velocity))
+			flags |= GOB_POS_WIDE;
+	}
+	if (update.acceleration != key.state.acceleration) {
+		flags |= GOB_POS_ACCELERATION;
+		if (!quantizeV3F(update.acceleration, acceleration))
+			flags |= GOB_POS_WIDE;
+	}
+	if (update.yaw != key.state.yaw)
+		flags |= GOB_POS_YAW;
+	if (update.update_interval != key.state.update_interval)
+		flags |= GOB_POS_INTERVAL;
+
+	writeU8(os, flags);
+	writeU8(os, key.seq);
+	writeV3S16(os, position_delta);
+	if (flags & GOB_POS_VELOCITY) {
+		if (flags & GOB_POS_WIDE)
+			writeV3F1000(os, update.velocity);
+		else
+			writeV3S16(os, velocity);
+	}
+	if (flags & GOB_POS_ACCELERATION) {
+		if (flags & GOB_POS_WIDE)
+			writeV3F1000(os, update.acceleration);
+		else
+			writeV3S16(os, acceleration);
+	}
+	if (flags & GOB_POS_YAW)
+		writeU16(os, myround(wrapDegrees_0_360(update.yaw) * 65536 / 360) & 0xffff);
+	if (flags & GOB_POS_INTERVAL)
+		writeU16(os, rangelim(myround(update.update_interval * 1000), 0, 65535));
+	return os.str();
+}
+
+bool gob_read_update_position_compact(std::istream &is,
+		ObjectPositionKey &key, ObjectPositionUpdate &update)
+{
+	u8 flags = readU8(is);
+	u8 seq = readU8(is);
+
+	if (flags & GOB_POS_KEY_FRAME) {
+		update = ObjectPositionUpdate();
+		update.position = readV3F1000(is);
+		if (flags & GOB_POS_VELOCITY)
+			update.velocity = readV3F1000(is);
+		if (flags & GOB_POS_ACCELERATION)
+			update.acceleration = readV3F1000(is);
+		if (flags & GOB_POS_YAW)
+			update.yaw = readF1000(is);
+		if (flags & GOB_POS_INTERVAL)
+			update.update_interval = readF1000(is);
+
+		key.valid = true;
+		key.seq = seq;
+		key.state = update;
+	} else {
+		// Out of order with its key frame, or the key frame was sent before
+		// the object was added on this client
+		if (!key.valid || seq != key.seq)
+			return false;
+
+		update = key.state;
+		update.position += dequantizeV3F(readV3S16(is));
+		if (flags & GOB_POS_VELOCITY) {
+			if (flags & GOB_POS_WIDE)
+				update.velocity = readV3F1000(is);
+			else
+				update.velocity = dequantizeV3F(readV3S16(is));
+		}
+		if (flags & GOB_POS_ACCELERATION) {
+			if (flags & GOB_POS_WIDE)
+				update.acceleration = readV3F1000(is);
+			else
+				update.acceleration = dequantizeV3F(readV3S16(is));
+		}
+		if (flags & GOB_POS_YAW)
+			update.yaw = readU16(is) * 360.0f / 65536;
+		if (flags & GOB_POS_INTERVAL)
+			update.update_interval = readU16(is) / 1000.0f;
+	}
+
+	update.do_interpolate = flags & GOB_POS_INTERPOLATE;
+	update.is_movement_end = flags & GOB_POS_MOVEMENT_END;
+	return true;
+}
+
 std::string gob_cmd_set_texture_mod(const std::string &mod)
 {
 	std::ostringstream os(std::ios::binary);
@@ -35,7 +35,8 @@ enum GenericCMD {
 	GENERIC_CMD_SET_BONE_POSITION,
 	GENERIC_CMD_ATTACH_TO,
 	GENERIC_CMD_SET_PHYSICS_OVERRIDE,
-	GENERIC_CMD_UPDATE_NAMETAG_ATTRIBUTES
+	GENERIC_CMD_UPDATE_NAMETAG_ATTRIBUTES,
+	GENERIC_CMD_UPDATE_POSITION_COMPACT
 };
 
 #include "object_properties.h"
@@ -52,6 +53,53 @@ std::string gob_cmd_update_position(
 	f32 update_interval
 );
 
+struct ObjectPositionUpdate
+{
+	v3f position;
+	v3f velocity;
+	v3f acceleration;
+	f32 yaw;
+	f32 update_interval;
+	bool do_interpolate;
+	bool is_movement_end;
+
+	ObjectPositionUpdate():
+		yaw(0),
+		update_interval(0),
+		do_interpolate(false),
+		is_movement_end(false)
+	{}
+};
+
+/*
+	GENERIC_CMD_UPDATE_POSITION_COMPACT sends a key frame with the full state
+	reliably every few updates. The updates in between are unreliable and
+	contain the quantized position relative to the last key frame, and only
+	the fields that differ from it.
+	The server keeps one key per object to encode the updates, the client one
+	per object to decode them.
+*/
+struct ObjectPositionKey
+{
+	bool valid;
+	u8 seq;
+	u16 updates_since;
+	ObjectPositionUpdate state;
+
+	ObjectPositionKey():
+		valid(false),
+		seq(0),
+		updates_since(0)
+	{}
+};
+
+// Sets is_key_frame if the message has to be sent reliably
+std::string gob_cmd_update_position_compact(ObjectPositionKey &key,
+		const ObjectPositionUpdate &update, bool &is_key_frame);
+// Returns false if the update refers to a key frame that wasn't received
+bool gob_read_update_position_compact(std::istream &is,
+		ObjectPositionKey &key, ObjectPositionUpdate &update);
+
 std::string gob_cmd_set_texture_mod(const std::string &mod);
 
 std::string gob_cmd_set_sprite(
@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "util/directiontables.h"
 #include "util/mathconstants.h"
+#include "voxelalgorithms.h"
 #include "rollback_interface.h"
 #include "environment.h"
 #include "emerge.h"
@@ -81,6 +82,11 @@ Map::~Map()
 	}
 }
 
+INodeDefManager *Map::getNodeDefManager()
+{
+	return m_gamedef->ndef();
+}
+
 void Map::addEventReceiver(MapEventReceiver *event_receiver)
 {
 	m_event_receivers.insert(event_receiver);
@@ -1400,6 +1406,78 @@ bool Map::getDayNightDiff(v3s16 blockpos)
 	return false;
 }
 
+bool Map::isOccluded(v3s16 p0, v3s16 p1, const VoxelArea &target,
+		u32 needed_count)
+{
+	INodeDefManager *nodemgr = m_gamedef->ndef();
+	v3f p0f(p0.X, p0.Y, p0.Z);
+	v3f p1f(p1.X, p1.Y, p1.Z);
+	voxalgo::VoxelLineIterator iterator(p0f, p1f - p0f);
+
+	MapBlock *block = NULL;
+	v3s16 blockpos;
+	u32 count = 0;
+	// The node the line starts in is the camera position itself
+	while (iterator.hasNext()) {
+		iterator.next();
+		v3s16 p = iterator.m_current_node_pos;
+		// Nodes of the block itself can't hide it
+		if (target.contains(p))
+			return false;
+
+		v3s16 bp = getNodeBlockPos(p);
+		if (block == NULL || bp != blockpos) {
+			block = getBlockNoCreateNoEx(bp);
+			blockpos = bp;
+		}
+		// Unknown areas might be transparent
+		if (block == NULL || block->isDummy())
+			continue;
+
+		bool is_valid_position;
+		MapNode n = block->getNodeNoCheck(p - bp * MAP_BLOCKSIZE,
+				&is_valid_position);
+		// Only plain cubes are surely opaque; the solidness values are
+		// not known on the server
+		if (nodemgr->get(n).drawtype == NDT_NORMAL) {
+			count++;
+			if (count >= needed_count)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool Map::isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes)
+{
+	v3s16 pmin = block->getPosRelative();
+	v3s16 pmax = pmin + v3s16(1,1,1) * (MAP_BLOCKSIZE - 1);
+	VoxelArea area(pmin, pmax);
+
+	// Can't be occluded from inside
+	if (area.contains(cam_pos_nodes))
+		return false;
+
+	// Sight lines to the center and the corner nodes; a single solid node
+	// next to the camera must not hide everything, so require two
+	v3s16 targets[9] = {
+		pmin + v3s16(1,1,1) * (MAP_BLOCKSIZE / 2),
+		v3s16(pmin.X, pmin.Y, pmin.Z),
+		v3s16(pmin.X, pmin.Y, pmax.Z),
+		v3s16(pmin.X, pmax.Y, pmin.Z),
+		v3s16(pmin.X, pmax.Y, pmax.Z),
+		v3s16(pmax.X, pmin.Y, pmin.Z),
+		v3s16(pmax.X, pmin.Y, pmax.Z),
+		v3s16(pmax.X, pmax.Y, pmin.Z),
+		v3s16(pmax.X, pmax.Y, pmax.Z),
+	};
+	for (u32 i = 0; i < 9; i++) {
+		if (!isOccluded(cam_pos_nodes, targets[i], area, 2))
+			return false;
+	}
+	return true;
+}
+
 struct TimeOrderedMapBlock {
 	MapSector *sect;
 	MapBlock *block;
@@ -258,6 +258,12 @@ class Map /*: public NodeContainer*/
 	*/
 	bool getDayNightDiff(v3s16 blockpos);
 
+	/*
+		Returns true if the block can't be seen from cam_pos_nodes because
+		solid nodes are in the way of all sight lines to it
+	*/
+	bool isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes);
+
 	//core::aabbox3d<s16> getDisplayedBlockArea();
 
 	//bool updateChangedVisibleArea();
@@ -335,6 +341,8 @@ class Map /*: public NodeContainer*/
 	*/
 	std::map<v2s16, MapSector*> *getSectorsPtr(){return &m_sectors;}
 
+	INodeDefManager *getNodeDefManager();
+
 	/*
 		Variables
 	*/
@@ -361,6 +369,11 @@ class Map /*: public NodeContainer*/
 	UniqueQueue<v3s16> m_transforming_liquid;
 
 private:
+	// Returns true if at least needed_count solid nodes are on the line
+	// from p0 to p1 before it enters target
+	bool isOccluded(v3s16 p0, v3s16 p1, const VoxelArea &target,
+			u32 needed_count);
+
 	f32 m_transforming_liquid_loop_count_multiplier;
 	u32 m_unprocessed_count;
 	u32 m_inc_trending_up_start_time; // milliseconds
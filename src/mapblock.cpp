@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapblock.h"
 
 #include <sstream>
+#include <algorithm>
 #include "map.h"
 #include "light.h"
 #include "nodedef.h"
@@ -77,6 +78,7 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_lighting_expired(true),
 		m_day_night_differs(false),
 		m_day_night_differs_expired(true),
+		m_contents_expired(true),
 		m_generated(false),
 		m_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
 		m_disk_timestamp(BLOCK_TIMESTAMP_UNDEFINED),
@@ -370,6 +372,7 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	m_contents_expired = true;
 }
 
 void MapBlock::actuallyUpdateDayNightDiff()
@@ -418,6 +421,29 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	m_day_night_differs = differs;
 }
 
+void MapBlock::actuallyUpdateContents()
+{
+	m_contents_expired = false;
+	m_contents.clear();
+
+	if (data == NULL)
+		return;
+
+	content_t prev = CONTENT_IGNORE;
+	for (u32 i = 0; i < nodecount; i++) {
+		content_t c = data[i].getContent();
+		// Nodes mostly come in runs of the same content
+		if (c == prev && i != 0)
+			continue;
+		prev = c;
+		m_contents.push_back(c);
+	}
+
+	std::sort(m_contents.begin(), m_contents.end());
+	m_contents.erase(std::unique(m_contents.begin(), m_contents.end()),
+		m_contents.end());
+}
+
 void MapBlock::expireDayNightDiff()
 {
 	//INodeDefManager *nodemgr = m_gamedef->ndef();
@@ -663,6 +689,7 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())<<std::endl);
 
 	m_day_night_differs_expired = false;
+	m_contents_expired = true;
 
 	if(version <= 21)
 	{
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MAPBLOCK_HEADER
 
 #include <set>
+#include <vector>
 #include "debug.h"
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -149,6 +150,7 @@ class MapBlock /*: public NodeContainer*/
 		data = new MapNode[nodecount];
 		for (u32 i = 0; i < nodecount; i++)
 			data[i] = MapNode(CONTENT_IGNORE);
+		m_contents_expired = true;
 
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
@@ -315,6 +317,7 @@ class MapBlock /*: public NodeContainer*/
 			throw InvalidPositionException();
 
 		data[z * zstride + y * ystride + x] = n;
+		m_contents_expired = true;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -347,6 +350,7 @@ class MapBlock /*: public NodeContainer*/
 			throw InvalidPositionException();
 
 		data[z * zstride + y * ystride + x] = n;
+		m_contents_expired = true;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
 
@@ -395,6 +399,16 @@ class MapBlock /*: public NodeContainer*/
 		return m_day_night_differs;
 	}
 
+	// Sorted list of the content types present in the block, so that
+	// searches can skip blocks without looking at every node.
+	// Recomputed when needed after the node data has changed.
+	inline const std::vector<content_t> &getContents()
+	{
+		if (m_contents_expired)
+			actuallyUpdateContents();
+		return m_contents;
+	}
+
 	////
 	//// Miscellaneous stuff
 	////
@@ -520,6 +534,8 @@ class MapBlock /*: public NodeContainer*/
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	void actuallyUpdateContents();
+
 	/*
 		Used only internally, because changes can't be tracked
 	*/
@@ -612,6 +628,9 @@ class MapBlock /*: public NodeContainer*/
 	bool m_day_night_differs;
 	bool m_day_night_differs_expired;
 
+	std::vector<content_t> m_contents;
+	bool m_contents_expired;
+
 	bool m_generated;
 
 	/*
@@ -78,6 +78,8 @@ Mapgen::Mapgen()
 	biomemap  = NULL;
 	heatmap   = NULL;
 	humidmap  = NULL;
+
+	m_have_sunlit = false;
 }
 
 
@@ -97,6 +99,8 @@ Mapgen::Mapgen(int mapgenid, MapgenParams *params, EmergeManager *emerge) :
 	biomemap  = NULL;
 	heatmap   = NULL;
 	humidmap  = NULL;
+
+	m_have_sunlit = false;
 }
 
 
@@ -218,30 +222,6 @@ void Mapgen::setLighting(u8 light, v3s16 nmin, v3s16 nmax)
 }
 
 
-void Mapgen::lightSpread(VoxelArea &a, v3s16 p, u8 light)
-{
-	if (light <= 1 || !a.contains(p))
-		return;
-
-	u32 vi = vm->m_area.index(p);
-	MapNode &nn = vm->m_data[vi];
-
-	light--;
-	// should probably compare masked, but doesn't seem to make a difference
-	if (light <= nn.param1 || !ndef->get(nn).light_propagates)
-		return;
-
-	nn.param1 = light;
-
-	lightSpread(a, p + v3s16(0, 0, 1), light);
-	lightSpread(a, p + v3s16(0, 1, 0), light);
-	lightSpread(a, p + v3s16(1, 0, 0), light);
-	lightSpread(a, p - v3s16(0, 0, 1), light);
-	lightSpread(a, p - v3s16(0, 1, 0), light);
-	lightSpread(a, p - v3s16(1, 0, 0), light);
-}
-
-
 void Mapgen::calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax)
 {
 	ScopeProfiler sp(g_profiler, "EmergeThread: mapgen lighting update", SPT_AVG);
@@ -279,8 +259,17 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax)
 	bool block_is_underground = (water_level >= nmax.Y);
 	v3s16 em = vm->m_area.getExtent();
 
+	m_have_sunlit = true;
+	m_sunlit_min  = nmin;
+	m_sunlit_max  = nmax;
+	m_sunlit_bottom.resize((nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1));
+
+	u32 index2d = 0;
 	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
-		for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++, index2d++) {
+			s16 &bottom = m_sunlit_bottom[index2d];
+			bottom = a.MaxEdge.Y + 1;
+
 			// see if we can get a light value from the overtop
 			u32 i = vm->m_area.index(x, a.MaxEdge.Y + 1, z);
 			if (vm->m_data[i].getContent() == CONTENT_IGNORE) {
@@ -296,6 +285,7 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax)
 				if (!ndef->get(n).sunlight_propagates)
 					break;
 				n.param1 = LIGHT_SUN;
+				bottom = y;
 				vm->m_area.add_y(em, i, -1);
 			}
 		}
@@ -304,34 +294,138 @@ void Mapgen::propagateSunlight(v3s16 nmin, v3s16 nmax)
 }
 
 
+bool Mapgen::isSurroundedBySunlight(v3s16 nmin, v3s16 nmax, v3s16 p)
+{
+	if (p.X < m_sunlit_min.X || p.X > m_sunlit_max.X ||
+			p.Y < m_sunlit_min.Y || p.Y > m_sunlit_max.Y ||
+			p.Z < m_sunlit_min.Z || p.Z > m_sunlit_max.Z)
+		return false;
+
+	s16 sx = m_sunlit_max.X - m_sunlit_min.X + 1;
+	u32 index2d = (p.Z - m_sunlit_min.Z) * sx + (p.X - m_sunlit_min.X);
+	if (p.Y < m_sunlit_bottom[index2d])
+		return false;
+
+	// Vertical neighbours are in the same column
+	if (p.Y + 1 > m_sunlit_max.Y && p.Y + 1 <= nmax.Y)
+		return false;
+	if (p.Y - 1 < m_sunlit_bottom[index2d] && p.Y - 1 >= nmin.Y)
+		return false;
+
+	static const v3s16 dirs[4] = {
+		v3s16( 1, 0,  0),
+		v3s16(-1, 0,  0),
+		v3s16( 0, 0,  1),
+		v3s16( 0, 0, -1),
+	};
+
+	for (size_t k = 0; k != ARRLEN(dirs); k++) {
+		v3s16 p2 = p + dirs[k];
+		if (p2.X < nmin.X || p2.X > nmax.X || p2.Z < nmin.Z || p2.Z > nmax.Z)
+			continue;
+		if (p2.X < m_sunlit_min.X || p2.X > m_sunlit_max.X ||
+				p2.Z < m_sunlit_min.Z || p2.Z > m_sunlit_max.Z)
+			return false;
+		if (p.Y < m_sunlit_bottom[index2d + dirs[k].Z * sx + dirs[k].X])
+			return false;
+	}
+
+	return true;
+}
+
 
 void Mapgen::spreadLight(v3s16 nmin, v3s16 nmax)
 {
 	//TimeTaker t("spreadLight");
 	VoxelArea a(nmin, nmax);
+	v3s16 em = vm->m_area.getExtent();
+	bool have_sunlit = m_have_sunlit;
+	m_have_sunlit = false;
+
+	// Collect the nodes to spread light from, bucketed by their light level
+	// so that every node only ever gets lit by the brightest neighbour.
+	for (u8 l = 0; l <= LIGHT_SUN; l++)
+		m_light_queue[l].clear();
 
 	for (int z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++) {
 		for (int y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
 			u32 i = vm->m_area.index(a.MinEdge.X, y, z);
 			for (int x = a.MinEdge.X; x <= a.MaxEdge.X; x++, i++) {
 				MapNode &n = vm->m_data[i];
-				if (n.getContent() == CONTENT_IGNORE ||
-					!ndef->get(n).light_propagates)
+				if (n.getContent() == CONTENT_IGNORE)
 					continue;
 
-				u8 light_produced = ndef->get(n).light_source & 0x0F;
-				if (light_produced)
+				const ContentFeatures &f = ndef->get(n);
+				if (!f.light_propagates)
+					continue;
+
+				u8 light_produced = f.light_source & 0x0F;
+				if (light_produced > (n.param1 & 0x0F))
 					n.param1 = light_produced;
 
 				u8 light = n.param1 & 0x0F;
-				if (light) {
-					lightSpread(a, v3s16(x,     y,     z + 1), light);
-					lightSpread(a, v3s16(x,     y + 1, z    ), light);
-					lightSpread(a, v3s16(x + 1, y,     z    ), light);
-					lightSpread(a, v3s16(x,     y,     z - 1), light);
-					lightSpread(a, v3s16(x,     y - 1, z    ), light);
-					lightSpread(a, v3s16(x - 1, y,     z    ), light);
+				if (light <= 1)
+					continue;
+
+				// Sunlight surrounded by sunlight has nowhere to go
+				if (light == LIGHT_SUN && have_sunlit && !light_produced &&
+						isSurroundedBySunlight(nmin, nmax, v3s16(x, y, z)))
+					continue;
+
+				LightQueueEntry e;
+				e.i = i;
+				e.p = v3s16(x, y, z);
+				m_light_queue[light].push_back(e);
+			}
+		}
+	}
+
+	// Flood fill from the brightest nodes downwards.  A node is only queued
+	// when its light got raised, so each is visited at most once per level.
+	s32 ystride = em.X;
+	s32 zstride = em.X * em.Y;
+	for (u8 light = LIGHT_SUN; light > 1; light--) {
+		std::vector<LightQueueEntry> &queue = m_light_queue[light];
+		u8 newlight = light - 1;
+
+		for (size_t k = 0; k != queue.size(); k++) {
+			LightQueueEntry e = queue[k];
+
+			// Skip entries which got outdated by a brighter neighbour
+			if ((vm->m_data[e.i].param1 & 0x0F) > light)
+				continue;
+
+			for (u8 dir = 0; dir != 6; dir++) {
+				LightQueueEntry e2 = e;
+				switch (dir) {
+				case 0:
+					if (e.p.Z == a.MaxEdge.Z) continue;
+					e2.p.Z++; e2.i += zstride; break;
+				case 1:
+					if (e.p.Y == a.MaxEdge.Y) continue;
+					e2.p.Y++; e2.i += ystride; break;
+				case 2:
+					if (e.p.X == a.MaxEdge.X) continue;
+					e2.p.X++; e2.i++; break;
+				case 3:
+					if (e.p.Z == a.MinEdge.Z) continue;
+					e2.p.Z--; e2.i -= zstride; break;
+				case 4:
+					if (e.p.Y == a.MinEdge.Y) continue;
+					e2.p.Y--; e2.i -= ystride; break;
+				default:
+					if (e.p.X == a.MinEdge.X) continue;
+					e2.p.X--; e2.i--; break;
 				}
+
+				// should probably compare masked, but doesn't seem to make a difference
+				MapNode &n2 = vm->m_data[e2.i];
+				if (newlight <= n2.param1 || !ndef->get(n2).light_propagates)
+					continue;
+
+				n2.param1 = newlight;
+				if (newlight > 1)
+					m_light_queue[newlight].push_back(e2);
 			}
 		}
 	}
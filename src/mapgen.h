@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "noise.h"
 #include "nodedef.h"
 #include "mapnode.h"
+#include "light.h"
 #include "util/string.h"
 #include "util/container.h"
 
@@ -170,17 +171,34 @@ class Mapgen {
 	void updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nmax);
 
 	void setLighting(u8 light, v3s16 nmin, v3s16 nmax);
-	void lightSpread(VoxelArea &a, v3s16 p, u8 light);
 
 	void calcLighting(v3s16 nmin, v3s16 nmax);
 	void calcLighting(v3s16 nmin, v3s16 nmax,
 		v3s16 full_nmin, v3s16 full_nmax);
 
+	// propagateSunlight() remembers which part of every column it lit up, so
+	// that a spreadLight() following right after it can skip nodes that are
+	// surrounded by sunlight.  Anything else modifying the lighting in
+	// between must call spreadLight() with that information discarded.
 	void propagateSunlight(v3s16 nmin, v3s16 nmax);
 	void spreadLight(v3s16 nmin, v3s16 nmax);
 
 	virtual void makeChunk(BlockMakeData *data) {}
 	virtual int getGroundLevelAtPoint(v2s16 p) { return 0; }
+
+protected:
+	struct LightQueueEntry {
+		u32 i;
+		v3s16 p;
+	};
+
+	bool isSurroundedBySunlight(v3s16 nmin, v3s16 nmax, v3s16 p);
+
+	bool m_have_sunlit;
+	v3s16 m_sunlit_min;
+	v3s16 m_sunlit_max;
+	std::vector<s16> m_sunlit_bottom;
+	std::vector<LightQueueEntry> m_light_queue[LIGHT_SUN + 1];
 };
 
 struct MapgenFactory {
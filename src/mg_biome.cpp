@@ -27,6 +27,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "util/mathconstants.h"
 #include "porting.h"
+#include <algorithm>
+#include <climits>
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -36,6 +38,8 @@ BiomeManager::BiomeManager(IGameDef *gamedef) :
 	ObjDefManager(gamedef, OBJDEF_BIOME)
 {
 	m_gamedef = gamedef;
+	m_lookup_num_objects = 0;
+	m_lookup_valid       = false;
 
 	// Create default biome to be used in case none exist
 	Biome *b = new Biome;
@@ -72,18 +76,38 @@ BiomeManager::~BiomeManager()
 
 
 
-// just a PoC, obviously needs optimization later on (precalculate this)
 void BiomeManager::calcBiomes(s16 sx, s16 sy, float *heat_map,
 	float *humidity_map, s16 *height_map, u8 *biomeid_map)
 {
+	if (!m_lookup_valid || m_lookup_num_objects != m_objects.size()) {
+		for (s32 i = 0; i != sx * sy; i++) {
+			Biome *biome = getBiomeLinear(heat_map[i],
+				humidity_map[i], height_map[i]);
+			biomeid_map[i] = biome->index;
+		}
+		return;
+	}
+
+	// Neighbouring columns are very likely to be in the same band
+	const LookupBand *band = NULL;
 	for (s32 i = 0; i != sx * sy; i++) {
-		Biome *biome = getBiome(heat_map[i], humidity_map[i], height_map[i]);
+		band = getLookupBand(height_map[i], band);
+		Biome *biome = getBiomeFromBand(band, heat_map[i], humidity_map[i]);
 		biomeid_map[i] = biome->index;
 	}
 }
 
 
 Biome *BiomeManager::getBiome(float heat, float humidity, s16 y)
+{
+	if (!m_lookup_valid || m_lookup_num_objects != m_objects.size())
+		return getBiomeLinear(heat, humidity, y);
+
+	return getBiomeFromBand(getLookupBand(y, NULL), heat, humidity);
+}
+
+
+Biome *BiomeManager::getBiomeLinear(float heat, float humidity, s16 y) const
 {
 	Biome *b, *biome_closest = NULL;
 	float dist_min = FLT_MAX;
@@ -106,6 +130,198 @@ Biome *BiomeManager::getBiome(float heat, float humidity, s16 y)
 	return biome_closest ? biome_closest : (Biome *)m_objects[0];
 }
 
+
+void BiomeManager::updateBiomeLookup()
+{
+	m_lookup_bands.clear();
+
+	// Every y_min and y_max + 1 starts a new band; the first band begins
+	// below anything an s16 can hold.
+	std::vector<s32> band_starts;
+	band_starts.push_back(SHRT_MIN);
+	for (size_t i = 1; i < m_objects.size(); i++) {
+		Biome *b = (Biome *)m_objects[i];
+		if (!b || b->y_min > b->y_max)
+			continue;
+		band_starts.push_back(b->y_min);
+		band_starts.push_back((s32)b->y_max + 1);
+	}
+	std::sort(band_starts.begin(), band_starts.end());
+	band_starts.erase(std::unique(band_starts.begin(), band_starts.end()),
+		band_starts.end());
+
+	for (size_t i = 0; i != band_starts.size(); i++) {
+		if (band_starts[i] > SHRT_MAX)
+			break;
+
+		LookupBand band;
+		band.y_min = band_starts[i];
+
+		// Keep the biomes in registration order so that ties are broken
+		// the same way as in the linear search
+		for (size_t j = 1; j < m_objects.size(); j++) {
+			Biome *b = (Biome *)m_objects[j];
+			if (!b || band.y_min < b->y_min || band.y_min > b->y_max)
+				continue;
+			band.biomes.push_back(b);
+		}
+
+		m_lookup_bands.push_back(band);
+		buildLookupBand(&m_lookup_bands.back());
+	}
+
+	m_lookup_num_objects = m_objects.size();
+	m_lookup_valid       = true;
+}
+
+
+void BiomeManager::invalidateBiomeLookup()
+{
+	m_lookup_bands.clear();
+	m_lookup_valid = false;
+}
+
+
+void BiomeManager::buildLookupBand(LookupBand *band)
+{
+	band->cell_start.clear();
+	band->cell_biomes.clear();
+
+	if (band->biomes.size() < 2)
+		return;
+
+	float heat_min     = FLT_MAX;
+	float heat_max     = -FLT_MAX;
+	float humidity_min = FLT_MAX;
+	float humidity_max = -FLT_MAX;
+	for (size_t i = 0; i != band->biomes.size(); i++) {
+		Biome *b = band->biomes[i];
+		heat_min     = MYMIN(heat_min,     b->heat_point);
+		heat_max     = MYMAX(heat_max,     b->heat_point);
+		humidity_min = MYMIN(humidity_min, b->humidity_point);
+		humidity_max = MYMAX(humidity_max, b->humidity_point);
+	}
+
+	// Noise values outside of the grid are still looked up correctly, only
+	// slower, so a margin around the biome points is good enough
+	float heat_margin     = MYMAX(heat_max - heat_min, BIOME_LOOKUP_MARGIN);
+	float humidity_margin = MYMAX(humidity_max - humidity_min, BIOME_LOOKUP_MARGIN);
+	heat_min     -= heat_margin;
+	heat_max     += heat_margin;
+	humidity_min -= humidity_margin;
+	humidity_max += humidity_margin;
+
+	float cell_heat     = (heat_max - heat_min) / BIOME_LOOKUP_GRID_SIZE;
+	float cell_humidity = (humidity_max - humidity_min) / BIOME_LOOKUP_GRID_SIZE;
+
+	band->heat_min       = heat_min;
+	band->humidity_min   = humidity_min;
+	band->heat_scale     = 1.f / cell_heat;
+	band->humidity_scale = 1.f / cell_humidity;
+
+	std::vector<float> dist_min(band->biomes.size());
+	for (u32 z = 0; z != BIOME_LOOKUP_GRID_SIZE; z++)
+	for (u32 x = 0; x != BIOME_LOOKUP_GRID_SIZE; x++) {
+		band->cell_start.push_back(band->cell_biomes.size());
+
+		// Cells are padded a little so that rounding errors in the lookup
+		// can't land a point outside of the area checked here
+		float x0 = heat_min + cell_heat * (x - 0.01f);
+		float x1 = heat_min + cell_heat * (x + 1.01f);
+		float z0 = humidity_min + cell_humidity * (z - 0.01f);
+		float z1 = humidity_min + cell_humidity * (z + 1.01f);
+
+		// A biome can only be the closest one somewhere in this cell if its
+		// distance to the cell does not exceed the smallest distance any
+		// biome is guaranteed to be within for the whole cell
+		float bound = FLT_MAX;
+		for (size_t i = 0; i != band->biomes.size(); i++) {
+			Biome *b = band->biomes[i];
+			float hx = MYMAX(fabs(b->heat_point - x0), fabs(b->heat_point - x1));
+			float hz = MYMAX(fabs(b->humidity_point - z0),
+				fabs(b->humidity_point - z1));
+			bound = MYMIN(bound, hx * hx + hz * hz);
+
+			float dx = b->heat_point < x0 ? x0 - b->heat_point :
+				b->heat_point > x1 ? b->heat_point - x1 : 0.f;
+			float dz = b->humidity_point < z0 ? z0 - b->humidity_point :
+				b->humidity_point > z1 ? b->humidity_point - z1 : 0.f;
+			dist_min[i] = dx * dx + dz * dz;
+		}
+
+		bound = bound * 1.0001f + 0.0001f;
+		for (size_t i = 0; i != band->biomes.size(); i++) {
+			if (dist_min[i] <= bound)
+				band->cell_biomes.push_back(band->biomes[i]);
+		}
+	}
+	band->cell_start.push_back(band->cell_biomes.size());
+}
+
+
+const BiomeManager::LookupBand *BiomeManager::getLookupBand(s16 y,
+	const LookupBand *hint) const
+{
+	if (hint && y >= hint->y_min && (hint == &m_lookup_bands.back() ||
+			y < (hint + 1)->y_min))
+		return hint;
+
+	size_t lo = 0;
+	size_t hi = m_lookup_bands.size();
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (m_lookup_bands[mid].y_min <= y)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return &m_lookup_bands[lo];
+}
+
+
+Biome *BiomeManager::getBiomeFromBand(const LookupBand *band,
+	float heat, float humidity) const
+{
+	if (band->biomes.empty())
+		return (Biome *)m_objects[0];
+	if (band->biomes.size() == 1)
+		return band->biomes[0];
+
+	Biome *const *biomes = &band->biomes[0];
+	size_t nbiomes = band->biomes.size();
+
+	// Also catches NaNs, for which the linear search is what decides
+	float fx = (heat     - band->heat_min)     * band->heat_scale;
+	float fz = (humidity - band->humidity_min) * band->humidity_scale;
+	if (fx >= 0.f && fx < BIOME_LOOKUP_GRID_SIZE &&
+			fz >= 0.f && fz < BIOME_LOOKUP_GRID_SIZE) {
+		u32 cell = (u32)fz * BIOME_LOOKUP_GRID_SIZE + (u32)fx;
+		u32 start = band->cell_start[cell];
+		nbiomes = band->cell_start[cell + 1] - start;
+		biomes = &band->cell_biomes[start];
+		if (nbiomes == 1)
+			return biomes[0];
+	}
+
+	Biome *biome_closest = NULL;
+	float dist_min = FLT_MAX;
+
+	for (size_t i = 0; i != nbiomes; i++) {
+		Biome *b = biomes[i];
+		float d_heat     = heat     - b->heat_point;
+		float d_humidity = humidity - b->humidity_point;
+		float dist = (d_heat * d_heat) +
+					 (d_humidity * d_humidity);
+		if (dist < dist_min) {
+			dist_min = dist;
+			biome_closest = b;
+		}
+	}
+
+	return biome_closest ? biome_closest : (Biome *)m_objects[0];
+}
+
 void BiomeManager::clear()
 {
 	EmergeManager *emerge = m_gamedef->getEmergeManager();
@@ -116,6 +332,7 @@ void BiomeManager::clear()
 		Decoration *deco = (Decoration *)decomgr->getRaw(i);
 		deco->biomes.clear();
 	}
+	decomgr->invalidatePlacementIndex();
 
 	// Don't delete the first biome
 	for (size_t i = 1; i < m_objects.size(); i++) {
@@ -124,6 +341,8 @@ void BiomeManager::clear()
 	}
 
 	m_objects.resize(1);
+
+	invalidateBiomeLookup();
 }
 
 
@@ -140,3 +359,105 @@ void Biome::resolveNodeNames()
 	getIdFromNrBacklog(&c_river_water, "mapgen_river_water_source", CONTENT_AIR);
 	getIdFromNrBacklog(&c_dust,        "air",                       CONTENT_IGNORE);
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
+BiomePlacementIndex::BiomePlacementIndex()
+{
+	m_num_objects = 0;
+	m_valid       = false;
+}
+
+
+void BiomePlacementIndex::clear()
+{
+	for (size_t i = 0; i != BIOME_INDEX_NUM_IDS + 1; i++)
+		m_buckets[i].clear();
+
+	m_num_objects = 0;
+	m_valid       = false;
+}
+
+
+void BiomePlacementIndex::add(u32 index, u32 seed_offset,
+	s16 y_min, s16 y_max, const std::set<u8> &biomes)
+{
+	Entry entry;
+	entry.index       = index;
+	entry.seed_offset = seed_offset;
+	entry.y_min       = y_min;
+	entry.y_max       = y_max;
+
+	if (biomes.empty()) {
+		m_buckets[BIOME_INDEX_NUM_IDS].push_back(entry);
+		return;
+	}
+
+	for (std::set<u8>::const_iterator it = biomes.begin();
+			it != biomes.end(); ++it)
+		m_buckets[*it].push_back(entry);
+}
+
+
+void BiomePlacementIndex::finalize(size_t num_objects)
+{
+	m_num_objects = num_objects;
+	m_valid       = true;
+}
+
+
+static bool cmp_placement_entry(const BiomePlacementIndex::Entry &a,
+	const BiomePlacementIndex::Entry &b)
+{
+	return a.index < b.index;
+}
+
+
+static bool eq_placement_entry(const BiomePlacementIndex::Entry &a,
+	const BiomePlacementIndex::Entry &b)
+{
+	return a.index == b.index;
+}
+
+
+void BiomePlacementIndex::getCandidates(const u8 *biomemap, u32 biomemap_size,
+	s16 y_min, s16 y_max, std::vector<Entry> *entries) const
+{
+	bool present[BIOME_INDEX_NUM_IDS + 1];
+	size_t nbuckets = 0;
+
+	if (biomemap) {
+		memset(present, 0, sizeof(present));
+		for (u32 i = 0; i != biomemap_size; i++)
+			present[biomemap[i]] = true;
+		present[BIOME_INDEX_NUM_IDS] = true;
+	} else {
+		memset(present, 1, sizeof(present));
+	}
+
+	entries->clear();
+
+	for (size_t i = 0; i != BIOME_INDEX_NUM_IDS + 1; i++) {
+		if (!present[i] || m_buckets[i].empty())
+			continue;
+
+		nbuckets++;
+		const std::vector<Entry> &bucket = m_buckets[i];
+		for (size_t j = 0; j != bucket.size(); j++) {
+			const Entry &entry = bucket[j];
+			if (entry.y_max < y_min || entry.y_min > y_max)
+				continue;
+			entries->push_back(entry);
+		}
+	}
+
+	// Objects restricted to several present biomes show up more than once;
+	// keep the original registration order since it determines the seeds.
+	if (nbuckets > 1) {
+		std::sort(entries->begin(), entries->end(), cmp_placement_entry);
+		entries->erase(std::unique(entries->begin(), entries->end(),
+			eq_placement_entry), entries->end());
+	}
+}
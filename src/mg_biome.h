@@ -20,9 +20,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifndef MG_BIOME_HEADER
 #define MG_BIOME_HEADER
 
+#include <set>
 #include "objdef.h"
 #include "nodedef.h"
 
+#define BIOME_INDEX_NUM_IDS 256
+
+#define BIOME_LOOKUP_GRID_SIZE 64
+#define BIOME_LOOKUP_MARGIN 50.f
+
 enum BiomeType
 {
 	BIOME_NORMAL,
@@ -56,6 +62,43 @@ class Biome : public ObjDef, public NodeResolver {
 	virtual void resolveNodeNames();
 };
 
+// Buckets biome- and height-restricted ObjDefs (ores, decorations) by the
+// biome ids they may be placed in, so that a chunk only has to visit the
+// registrations that can possibly generate something in it.
+class BiomePlacementIndex {
+public:
+	struct Entry {
+		u32 index;       // index of the object within its ObjDefManager
+		u32 seed_offset; // offset added to the blockseed for this object
+		s16 y_min;
+		s16 y_max;
+	};
+
+	BiomePlacementIndex();
+
+	void clear();
+	void add(u32 index, u32 seed_offset, s16 y_min, s16 y_max,
+		const std::set<u8> &biomes);
+	void finalize(size_t num_objects);
+
+	bool isValidFor(size_t num_objects) const
+	{
+		return m_valid && m_num_objects == num_objects;
+	}
+
+	// Gets the entries which may place something within [y_min, y_max] in
+	// at least one of the biomes present in biomemap (or in any biome, if
+	// biomemap is NULL), sorted by object index.
+	void getCandidates(const u8 *biomemap, u32 biomemap_size,
+		s16 y_min, s16 y_max, std::vector<Entry> *entries) const;
+
+private:
+	// The last bucket holds the entries without biome restrictions
+	std::vector<Entry> m_buckets[BIOME_INDEX_NUM_IDS + 1];
+	size_t m_num_objects;
+	bool m_valid;
+};
+
 class BiomeManager : public ObjDefManager {
 public:
 	static const char *OBJECT_TITLE;
@@ -75,12 +118,43 @@ class BiomeManager : public ObjDefManager {
 
 	virtual void clear();
 
+	// Precomputes the heat/humidity lookup grids used by getBiome().  Must be
+	// called again whenever biomes are added or changed afterwards; until
+	// then, getBiome() falls back to checking every registered biome.
+	void updateBiomeLookup();
+	void invalidateBiomeLookup();
+
 	void calcBiomes(s16 sx, s16 sy, float *heat_map, float *humidity_map,
 		s16 *height_map, u8 *biomeid_map);
 	Biome *getBiome(float heat, float humidity, s16 y);
 
 private:
+	// A range of y within which the same set of biomes applies, along with
+	// a grid over the heat/humidity plane holding, for each cell, the only
+	// biomes that can be the closest one to a point inside of that cell.
+	struct LookupBand {
+		s32 y_min;
+		std::vector<Biome *> biomes;
+
+		float heat_min;
+		float humidity_min;
+		float heat_scale;
+		float humidity_scale;
+		std::vector<u32> cell_start;
+		std::vector<Biome *> cell_biomes;
+	};
+
+	void buildLookupBand(LookupBand *band);
+	const LookupBand *getLookupBand(s16 y, const LookupBand *hint) const;
+	Biome *getBiomeFromBand(const LookupBand *band,
+		float heat, float humidity) const;
+	Biome *getBiomeLinear(float heat, float humidity, s16 y) const;
+
 	IGameDef *m_gamedef;
+
+	std::vector<LookupBand> m_lookup_bands;
+	size_t m_lookup_num_objects;
+	bool m_lookup_valid;
 };
 
 #endif
@@ -43,18 +43,82 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 }
 
 
-size_t DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
-	v3s16 nmin, v3s16 nmax)
+void DecorationManager::clear()
 {
-	size_t nplaced = 0;
+	ObjDefManager::clear();
+	invalidatePlacementIndex();
+}
 
+
+void DecorationManager::updatePlacementIndex()
+{
+	m_placement_index.clear();
+
+	u32 seed_offset = 0;
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		nplaced += deco->placeDeco(mg, blockseed, nmin, nmax);
-		blockseed++;
+		m_placement_index.add(i, seed_offset,
+			deco->y_min, deco->y_max, deco->biomes);
+		seed_offset++;
+	}
+
+	m_placement_index.finalize(m_objects.size());
+}
+
+
+void DecorationManager::invalidatePlacementIndex()
+{
+	m_placement_index.clear();
+}
+
+
+size_t DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
+	v3s16 nmin, v3s16 nmax)
+{
+	size_t nplaced = 0;
+
+	if (!m_placement_index.isValidFor(m_objects.size())) {
+		for (size_t i = 0; i != m_objects.size(); i++) {
+			Decoration *deco = (Decoration *)m_objects[i];
+			if (!deco)
+				continue;
+
+			nplaced += deco->placeDeco(mg, blockseed, nmin, nmax);
+			blockseed++;
+		}
+
+		return nplaced;
+	}
+
+	// Decorations are only ever placed on the heightmap surface, so the
+	// height band to look at can be narrowed down to what it spans
+	s16 y_min = nmin.Y;
+	s16 y_max = nmax.Y;
+	u32 mapsize = (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1);
+	if (mg->heightmap) {
+		s16 hmin = MAX_MAP_GENERATION_LIMIT;
+		s16 hmax = -MAX_MAP_GENERATION_LIMIT;
+		for (u32 i = 0; i != mapsize; i++) {
+			hmin = MYMIN(hmin, mg->heightmap[i]);
+			hmax = MYMAX(hmax, mg->heightmap[i]);
+		}
+		y_min = MYMAX(y_min, hmin);
+		y_max = MYMIN(y_max, hmax);
+		if (y_min > y_max)
+			return 0;
+	}
+
+	std::vector<BiomePlacementIndex::Entry> candidates;
+	m_placement_index.getCandidates(mg->biomemap, mapsize,
+		y_min, y_max, &candidates);
+
+	for (size_t i = 0; i != candidates.size(); i++) {
+		Decoration *deco = (Decoration *)m_objects[candidates[i].index];
+		nplaced += deco->placeDeco(mg,
+			blockseed + candidates[i].seed_offset, nmin, nmax);
 	}
 
 	return nplaced;
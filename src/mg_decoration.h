@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
+#include "mg_biome.h"
 
 class Mapgen;
 class MMVManip;
@@ -145,7 +146,18 @@ class DecorationManager : public ObjDefManager {
 		}
 	}
 
+	virtual void clear();
+
+	// Must be called again whenever decorations are added or changed after
+	// the index was built; placeAllDecos() falls back to visiting every
+	// decoration as long as the index is out of date.
+	void updatePlacementIndex();
+	void invalidatePlacementIndex();
+
 	size_t placeAllDecos(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+
+private:
+	BiomePlacementIndex m_placement_index;
 };
 
 #endif
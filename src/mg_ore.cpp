@@ -45,13 +45,29 @@ size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nma
 {
 	size_t nplaced = 0;
 
-	for (size_t i = 0; i != m_objects.size(); i++) {
-		Ore *ore = (Ore *)m_objects[i];
-		if (!ore)
-			continue;
+	if (!m_placement_index.isValidFor(m_objects.size())) {
+		for (size_t i = 0; i != m_objects.size(); i++) {
+			Ore *ore = (Ore *)m_objects[i];
+			if (!ore)
+				continue;
+
+			nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+			blockseed++;
+		}
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
-		blockseed++;
+		return nplaced;
+	}
+
+	u32 mapsize = (nmax.X - nmin.X + 1) * (nmax.Z - nmin.Z + 1);
+
+	std::vector<BiomePlacementIndex::Entry> candidates;
+	m_placement_index.getCandidates(mg->biomemap, mapsize,
+		nmin.Y, nmax.Y, &candidates);
+
+	for (size_t i = 0; i != candidates.size(); i++) {
+		Ore *ore = (Ore *)m_objects[candidates[i].index];
+		nplaced += ore->placeOre(mg,
+			blockseed + candidates[i].seed_offset, nmin, nmax);
 	}
 
 	return nplaced;
@@ -65,6 +81,39 @@ void OreManager::clear()
 		delete ore;
 	}
 	m_objects.clear();
+	invalidatePlacementIndex();
+}
+
+
+void OreManager::updatePlacementIndex()
+{
+	m_placement_index.clear();
+
+	u32 seed_offset = 0;
+	for (size_t i = 0; i != m_objects.size(); i++) {
+		Ore *ore = (Ore *)m_objects[i];
+		if (!ore)
+			continue;
+
+		// Ores with OREFLAG_ABSHEIGHT are also placed in the mirrored range
+		s16 y_min = ore->y_min;
+		s16 y_max = ore->y_max;
+		if (ore->flags & OREFLAG_ABSHEIGHT) {
+			y_min = MYMIN(y_min, -ore->y_max);
+			y_max = MYMAX(y_max, -ore->y_min);
+		}
+
+		m_placement_index.add(i, seed_offset, y_min, y_max, ore->biomes);
+		seed_offset++;
+	}
+
+	m_placement_index.finalize(m_objects.size());
+}
+
+
+void OreManager::invalidatePlacementIndex()
+{
+	m_placement_index.clear();
 }
 
 
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
+#include "mg_biome.h"
 
 class Noise;
 class Mapgen;
@@ -164,7 +165,16 @@ class OreManager : public ObjDefManager {
 
 	void clear();
 
+	// Must be called again whenever ores are added or changed after the
+	// index was built; placeAllOres() falls back to visiting every ore as
+	// long as the index is out of date.
+	void updatePlacementIndex();
+	void invalidatePlacementIndex();
+
 	size_t placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+
+private:
+	BiomePlacementIndex m_placement_index;
 };
 
 #endif
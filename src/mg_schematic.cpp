@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "serialization.h"
 #include "filesys.h"
+#include "threading/mutex_auto_lock.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -71,11 +72,16 @@ Schematic::Schematic()
 	slice_probs = NULL;
 	flags       = 0;
 	size        = v3s16(0, 0, 0);
+
+	for (size_t i = 0; i != ARRLEN(m_rotated); i++)
+		m_rotated[i] = NULL;
 }
 
 
 Schematic::~Schematic()
 {
+	clearRotationCache();
+
 	delete []schemdata;
 	delete []slice_probs;
 }
@@ -91,12 +97,28 @@ void Schematic::resolveNodeNames()
 		content_t c_new = c_nodes[c_original];
 		schemdata[i].setContent(c_new);
 	}
+
+	clearRotationCache();
 }
 
 
-void Schematic::blitToVManip(v3s16 p, MMVManip *vm, Rotation rot, bool force_place)
+void Schematic::clearRotationCache()
 {
-	sanity_check(m_ndef != NULL);
+	MutexAutoLock lock(m_rotated_mutex);
+
+	for (size_t i = 0; i != ARRLEN(m_rotated); i++) {
+		delete m_rotated[i];
+		m_rotated[i] = NULL;
+	}
+}
+
+
+const RotatedSchematic *Schematic::getRotated(Rotation rot)
+{
+	MutexAutoLock lock(m_rotated_mutex);
+
+	if (m_rotated[rot])
+		return m_rotated[rot];
 
 	int xstride = 1;
 	int ystride = size.X;
@@ -131,28 +153,100 @@ void Schematic::blitToVManip(v3s16 p, MMVManip *vm, Rotation rot, bool force_pla
 			i_step_z = zstride;
 	}
 
+	RotatedSchematic *rs = new RotatedSchematic;
+	rs->size = v3s16(sx, sy, sz);
+	rs->nodes.resize(sx * sy * sz);
+	rs->flags.resize(sx * sy * sz);
+
+	u32 ri = 0;
+	for (s16 y = 0; y != sy; y++)
+	for (s16 z = 0; z != sz; z++) {
+		u32 i = z * i_step_z + y * ystride + i_start;
+		for (s16 x = 0; x != sx; x++, i += i_step_x, ri++) {
+			MapNode n = schemdata[i];
+
+			if (n.getContent() == CONTENT_IGNORE)
+				rs->flags[ri] = MTSCHEM_PROB_NEVER;
+			else
+				rs->flags[ri] = n.param1;
+
+			n.param1 = 0;
+			if (rot)
+				n.rotateAlongYAxisFull(m_ndef, rot);
+			rs->nodes[ri] = n;
+		}
+	}
+
+	m_rotated[rot] = rs;
+	return rs;
+}
+
+
+void Schematic::blitToVManip(v3s16 p, MMVManip *vm, Rotation rot, bool force_place)
+{
+	sanity_check(m_ndef != NULL);
+
+	if (rot > ROTATE_270)
+		rot = ROTATE_0;
+
+	const RotatedSchematic *rs = getRotated(rot);
+	if (rs->nodes.empty())
+		return;
+
+	const MapNode *nodes = &rs->nodes[0];
+	const u8 *flags = &rs->flags[0];
+
+	s16 sx = rs->size.X;
+	s16 sy = rs->size.Y;
+	s16 sz = rs->size.Z;
+
+	const VoxelArea &area = vm->m_area;
+	s16 x_begin = MYMAX(0, area.MinEdge.X - p.X);
+	s16 x_end   = MYMIN(sx, area.MaxEdge.X - p.X + 1);
+
+	// Nodes that are placed no matter what is there already
+	u8 unconditional_mask = force_place ? 0 : MTSCHEM_FORCE_PLACE;
+
 	s16 y_map = p.Y;
 	for (s16 y = 0; y != sy; y++) {
 		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
 			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 			continue;
 
-		for (s16 z = 0; z != sz; z++) {
-			u32 i = z * i_step_z + y * ystride + i_start;
-			for (s16 x = 0; x != sx; x++, i += i_step_x) {
-				u32 vi = vm->m_area.index(p.X + x, y_map, p.Z + z);
-				if (!vm->m_area.contains(vi))
-					continue;
+		if (y_map < area.MinEdge.Y || y_map > area.MaxEdge.Y) {
+			y_map++;
+			continue;
+		}
 
-				if (schemdata[i].getContent() == CONTENT_IGNORE)
-					continue;
+		for (s16 z = 0; z != sz; z++) {
+			if (p.Z + z < area.MinEdge.Z || p.Z + z > area.MaxEdge.Z)
+				continue;
 
-				u8 placement_prob     = schemdata[i].param1 & MTSCHEM_PROB_MASK;
-				bool force_place_node = schemdata[i].param1 & MTSCHEM_FORCE_PLACE;
+			u32 i  = (y * sz + z) * sx + x_begin;
+			u32 vi = area.index(p.X + x_begin, y_map, p.Z + z);
+			for (s16 x = x_begin; x < x_end; x++, i++, vi++) {
+				u8 placement_prob     = flags[i] & MTSCHEM_PROB_MASK;
+				bool force_place_node = flags[i] & MTSCHEM_FORCE_PLACE;
 
 				if (placement_prob == MTSCHEM_PROB_NEVER)
 					continue;
 
+				// Copy whole runs of nodes that are always placed at once
+				if (placement_prob == MTSCHEM_PROB_ALWAYS &&
+						(flags[i] & unconditional_mask) == unconditional_mask) {
+					s16 run = 1;
+					while (x + run < x_end &&
+							(flags[i + run] & MTSCHEM_PROB_MASK) == MTSCHEM_PROB_ALWAYS &&
+							(flags[i + run] & unconditional_mask) == unconditional_mask)
+						run++;
+
+					memcpy(&vm->m_data[vi], &nodes[i], run * sizeof(MapNode));
+					x  += run - 1;
+					i  += run - 1;
+					vi += run - 1;
+					continue;
+				}
+
 				if (!force_place && !force_place_node) {
 					content_t c = vm->m_data[vi].getContent();
 					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
@@ -163,11 +257,7 @@ void Schematic::blitToVManip(v3s16 p, MMVManip *vm, Rotation rot, bool force_pla
 					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 					continue;
 
-				vm->m_data[vi] = schemdata[i];
-				vm->m_data[vi].param1 = 0;
-
-				if (rot)
-					vm->m_data[vi].rotateAlongYAxisFull(m_ndef, rot);
+				vm->m_data[vi] = nodes[i];
 			}
 		}
 		y_map++;
@@ -520,6 +610,8 @@ void Schematic::applyProbabilities(v3s16 p0,
 		s16 y = (*splist)[i].first - p0.Y;
 		slice_probs[y] = (*splist)[i].second;
 	}
+
+	clearRotationCache();
 }
 
 
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include "mg_decoration.h"
 #include "util/string.h"
+#include "threading/mutex.h"
 
 class Map;
 class Mapgen;
@@ -89,6 +90,17 @@ enum SchematicFormatType {
 	SCHEM_FMT_LUA,
 };
 
+// Copy of a schematic's node data rotated about the Y axis, laid out in
+// (y, z, x) order of the rotated schematic so that rows can be blitted
+// at once.  Nodes have their param1 cleared and param2 already rotated;
+// flags holds the placement probability and force placement bit, or
+// MTSCHEM_PROB_NEVER for nodes that are never placed.
+struct RotatedSchematic {
+	v3s16 size;
+	std::vector<MapNode> nodes;
+	std::vector<u8> flags;
+};
+
 class Schematic : public ObjDef, public NodeResolver {
 public:
 	Schematic();
@@ -113,11 +125,20 @@ class Schematic : public ObjDef, public NodeResolver {
 		std::vector<std::pair<v3s16, u8> > *plist,
 		std::vector<std::pair<s16, u8> > *splist);
 
+	// Must be called whenever schemdata is modified after a blit
+	void clearRotationCache();
+
 	std::vector<content_t> c_nodes;
 	u32 flags;
 	v3s16 size;
 	MapNode *schemdata;
 	u8 *slice_probs;
+
+private:
+	const RotatedSchematic *getRotated(Rotation rot);
+
+	RotatedSchematic *m_rotated[ROTATE_270 + 1];
+	Mutex m_rotated_mutex;
 };
 
 class SchematicManager : public ObjDefManager {
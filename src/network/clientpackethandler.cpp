@@ -277,6 +277,47 @@ void Client::handleCommand_AddNode(NetworkPacket* pkt)
 
 	addNode(p, n, remove_metadata);
 }
+
+void Client::handleCommand_NodesChanged(NetworkPacket* pkt)
+{
+	v3s16 blockpos;
+	u16 count;
+	*pkt >> blockpos >> count;
+
+	v3s16 blockpos_nodes = blockpos * MAP_BLOCKSIZE;
+
+	// Meshes are updated once for all changes
+	std::map<v3s16, MapBlock*> modified_blocks;
+	for (u16 i = 0; i < count; i++) {
+		u16 index;
+		u8 flags;
+		*pkt >> index >> flags;
+
+		v3s16 p = blockpos_nodes + v3s16(
+			index % MAP_BLOCKSIZE,
+			(index / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+			index / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+
+		try {
+			if (flags & NODE_CHANGE_REMOVE) {
+				m_env.getMap().removeNodeAndUpdate(p, modified_blocks);
+			} else {
+				MapNode n;
+				*pkt >> n.param0 >> n.param1 >> n.param2;
+				m_env.getMap().addNodeAndUpdate(p, n, modified_blocks,
+					!(flags & NODE_CHANGE_KEEP_METADATA));
+			}
+		} catch (InvalidPositionException &e) {
+		}
+	}
+
+	for (std::map<v3s16, MapBlock *>::iterator
+			i = modified_blocks.begin();
+			i != modified_blocks.end(); ++i) {
+		addUpdateMeshTaskWithEdge(i->first, false, true);
+	}
+}
+
 void Client::handleCommand_BlockData(NetworkPacket* pkt)
 {
 	// Ignore too small packet
@@ -205,108 +205,73 @@ SharedBuffer<u8> makeReliablePacket(
 	ReliablePacketBuffer
 */
 
-ReliablePacketBuffer::ReliablePacketBuffer(): m_list_size(0) {}
+ReliablePacketBuffer::ReliablePacketBuffer(u16 window_size) :
+	m_packets(window_size),
+	m_window_size(window_size)
+{
+}
 
 void ReliablePacketBuffer::print()
 {
 	MutexAutoLock listlock(m_list_mutex);
 	LOG(dout_con<<"Dump of ReliablePacketBuffer:" << std::endl);
 	unsigned int index = 0;
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end();
-		++i)
+	u16 first = m_packets.first();
+	for (u32 i = 0; i < m_packets.span(); i++)
 	{
-		u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		LOG(dout_con<<index<< ":" << s << std::endl);
+		if (!m_packets.get(first + i))
+			continue;
+		LOG(dout_con<<index<< ":" << (u16)(first + i) << std::endl);
 		index++;
 	}
 }
 bool ReliablePacketBuffer::empty()
 {
 	MutexAutoLock listlock(m_list_mutex);
-	return m_list.empty();
+	return m_packets.empty();
 }
 
 u32 ReliablePacketBuffer::size()
 {
-	return m_list_size;
+	return m_packets.size();
 }
 
 bool ReliablePacketBuffer::containsPacket(u16 seqnum)
 {
-	return !(findPacket(seqnum) == m_list.end());
+	MutexAutoLock listlock(m_list_mutex);
+	return m_packets.get(seqnum) != NULL;
 }
 
-RPBSearchResult ReliablePacketBuffer::findPacket(u16 seqnum)
-{
-	std::list<BufferedPacket>::iterator i = m_list.begin();
-	for(; i != m_list.end(); ++i)
-	{
-		u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		/*dout_con<<"findPacket(): finding seqnum="<<seqnum
-				<<", comparing to s="<<s<<std::endl;*/
-		if (s == seqnum)
-			break;
-	}
-	return i;
-}
-RPBSearchResult ReliablePacketBuffer::notFound()
-{
-	return m_list.end();
-}
 bool ReliablePacketBuffer::getFirstSeqnum(u16& result)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_packets.empty())
 		return false;
-	BufferedPacket p = *m_list.begin();
-	result = readU16(&p.data[BASE_HEADER_SIZE+1]);
+	result = m_packets.first();
 	return true;
 }
 
 BufferedPacket ReliablePacketBuffer::popFirst()
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_packets.empty())
 		throw NotFoundException("Buffer is empty");
-	BufferedPacket p = *m_list.begin();
-	m_list.erase(m_list.begin());
-	--m_list_size;
-
-	if (m_list_size == 0) {
-		m_oldest_non_answered_ack = 0;
-	} else {
-		m_oldest_non_answered_ack =
-				readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);
-	}
+	u16 seqnum = m_packets.first();
+	BufferedPacket p = *m_packets.get(seqnum);
+	m_packets.remove(seqnum);
 	return p;
 }
 BufferedPacket ReliablePacketBuffer::popSeqnum(u16 seqnum)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	RPBSearchResult r = findPacket(seqnum);
-	if (r == notFound()) {
+	BufferedPacket *r = m_packets.get(seqnum);
+	if (r == NULL) {
 		LOG(dout_con<<"Sequence number: " << seqnum
 				<< " not found in reliable buffer"<<std::endl);
 		throw NotFoundException("seqnum not found in buffer");
 	}
 	BufferedPacket p = *r;
-
-
-	RPBSearchResult next = r;
-	++next;
-	if (next != notFound()) {
-		u16 s = readU16(&(next->data[BASE_HEADER_SIZE+1]));
-		m_oldest_non_answered_ack = s;
-	}
-
-	m_list.erase(r);
-	--m_list_size;
-
-	if (m_list_size == 0)
-	{ m_oldest_non_answered_ack = 0; }
-	else
-	{ m_oldest_non_answered_ack = readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);	}
+	m_packets.remove(seqnum);
 	return p;
 }
 void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
@@ -325,7 +290,8 @@ void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 	}
 	u16 seqnum = readU16(&p.data[BASE_HEADER_SIZE + 1]);
 
-	if (!seqnum_in_window(seqnum, next_expected, MAX_RELIABLE_WINDOW_SIZE)) {
+	if (!seqnum_in_window(seqnum, next_expected, m_window_size) ||
+			!m_packets.fits(seqnum)) {
 		errorstream << "ReliablePacketBuffer::insert(): seqnum is outside of "
 			"expected window " << std::endl;
 		return;
@@ -336,85 +302,41 @@ void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 		return;
 	}
 
-	++m_list_size;
-	sanity_check(m_list_size <= SEQNUM_MAX+1);	// FIXME: Handle the error?
-
-	// Find the right place for the packet and insert it there
-	// If list is empty, just add it
-	if (m_list.empty())
-	{
-		m_list.push_back(p);
-		m_oldest_non_answered_ack = seqnum;
-		// Done.
+	BufferedPacket *i = m_packets.get(seqnum);
+	if (i == NULL) {
+		m_packets.insert(seqnum) = p;
 		return;
 	}
 
-	// Otherwise find the right place
-	std::list<BufferedPacket>::iterator i = m_list.begin();
-	// Find the first packet in the list which has a higher seqnum
-	u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-
-	/* case seqnum is smaller then next_expected seqnum */
-	/* this is true e.g. on wrap around */
-	if (seqnum < next_expected) {
-		while(((s < seqnum) || (s >= next_expected)) && (i != m_list.end())) {
-			++i;
-			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		}
-	}
-	/* non wrap around case (at least for incoming and next_expected */
-	else
+	if ((i->data.getSize() != p.data.getSize()) ||
+			(i->address != p.address))
 	{
-		while(((s < seqnum) && (s >= next_expected)) && (i != m_list.end())) {
-			++i;
-			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		}
+		/* if this happens your maximum transfer window may be to big */
+		fprintf(stderr,
+				"Duplicated seqnum %d non matching packet detected:\n",
+				seqnum);
+		fprintf(stderr, "Old: seqnum: %05d size: %04d, address: %s\n",
+				readU16(&(i->data[BASE_HEADER_SIZE+1])),i->data.getSize(),
+				i->address.serializeString().c_str());
+		fprintf(stderr, "New: seqnum: %05d size: %04u, address: %s\n",
+				readU16(&(p.data[BASE_HEADER_SIZE+1])),p.data.getSize(),
+				p.address.serializeString().c_str());
+		throw IncomingDataCorruption("duplicated packet isn't same as original one");
 	}
 
-	if (s == seqnum) {
-		if (
-			(readU16(&(i->data[BASE_HEADER_SIZE+1])) != seqnum) ||
-			(i->data.getSize() != p.data.getSize()) ||
-			(i->address != p.address)
-			)
-		{
-			/* if this happens your maximum transfer window may be to big */
-			fprintf(stderr,
-					"Duplicated seqnum %d non matching packet detected:\n",
-					seqnum);
-			fprintf(stderr, "Old: seqnum: %05d size: %04d, address: %s\n",
-					readU16(&(i->data[BASE_HEADER_SIZE+1])),i->data.getSize(),
-					i->address.serializeString().c_str());
-			fprintf(stderr, "New: seqnum: %05d size: %04u, address: %s\n",
-					readU16(&(p.data[BASE_HEADER_SIZE+1])),p.data.getSize(),
-					p.address.serializeString().c_str());
-			throw IncomingDataCorruption("duplicated packet isn't same as original one");
-		}
-
-		/* nothing to do this seems to be a resent packet */
-		/* for paranoia reason data should be compared */
-		--m_list_size;
-	}
-	/* insert or push back */
-	else if (i != m_list.end()) {
-		m_list.insert(i, p);
-	}
-	else {
-		m_list.push_back(p);
-	}
-
-	/* update last packet number */
-	m_oldest_non_answered_ack = readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);
+	/* nothing to do this seems to be a resent packet */
+	/* for paranoia reason data should be compared */
 }
 
 void ReliablePacketBuffer::incrementTimeouts(float dtime)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end(); ++i)
+	u16 first = m_packets.first();
+	for (u32 n = 0; n < m_packets.span(); n++)
 	{
+		BufferedPacket *i = m_packets.get(first + n);
+		if (i == NULL)
+			continue;
 		i->time += dtime;
 		i->totaltime += dtime;
 	}
@@ -425,9 +347,12 @@ std::list<BufferedPacket> ReliablePacketBuffer::getTimedOuts(float timeout,
 {
 	MutexAutoLock listlock(m_list_mutex);
 	std::list<BufferedPacket> timed_outs;
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end(); ++i)
+	u16 first = m_packets.first();
+	for (u32 n = 0; n < m_packets.span(); n++)
 	{
+		BufferedPacket *i = m_packets.get(first + n);
+		if (i == NULL)
+			continue;
 		if (i->time >= timeout) {
 			timed_outs.push_back(*i);
 
@@ -444,15 +369,11 @@ std::list<BufferedPacket> ReliablePacketBuffer::getTimedOuts(float timeout,
 	IncomingSplitBuffer
 */
 
-IncomingSplitBuffer::~IncomingSplitBuffer()
+IncomingSplitBuffer::IncomingSplitBuffer() :
+	m_buf(SPLIT_BUFFER_SPAN)
 {
-	MutexAutoLock listlock(m_map_mutex);
-	for(std::map<u16, IncomingSplitPacket*>::iterator i = m_buf.begin();
-		i != m_buf.end(); ++i)
-	{
-		delete i->second;
-	}
 }
+
 /*
 	This will throw a GotSplitPacketException when a full
 	split packet is constructed.
@@ -476,22 +397,40 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacket &p, bool reliable)
 		return SharedBuffer<u8>();
 	}
 
+	if (chunk_num >= chunk_count) {
+		errorstream << "IncomingSplitBuffer::insert(): chunk_num="
+			<< chunk_num << " >= chunk_count=" << chunk_count << std::endl;
+		return SharedBuffer<u8>();
+	}
+
 	// Add if doesn't exist
-	if (m_buf.find(seqnum) == m_buf.end())
+	IncomingSplitPacket *sp = m_buf.get(seqnum);
+	if (sp == NULL)
 	{
-		IncomingSplitPacket *sp = new IncomingSplitPacket();
+		// Drop the oldest ones for a newer split packet that doesn't fit
+		while (!m_buf.fits(seqnum) && !seqnum_higher(m_buf.first(), seqnum)) {
+			LOG(derr_con<<"Connection: WARNING: dropping incomplete split "
+					"packet seqnum="<<m_buf.first()<<std::endl);
+			m_buf.remove(m_buf.first());
+		}
+		if (!m_buf.fits(seqnum)) {
+			LOG(derr_con<<"Connection: WARNING: split packet seqnum="
+					<<seqnum<<" is too old"<<std::endl);
+			return SharedBuffer<u8>();
+		}
+		sp = &m_buf.insert(seqnum);
 		sp->chunk_count = chunk_count;
 		sp->reliable = reliable;
-		m_buf[seqnum] = sp;
 	}
 
-	IncomingSplitPacket *sp = m_buf[seqnum];
-
 	// TODO: These errors should be thrown or something? Dunno.
-	if (chunk_count != sp->chunk_count)
+	if (chunk_count != sp->chunk_count) {
 		LOG(derr_con<<"Connection: WARNING: chunk_count="<<chunk_count
 				<<" != sp->chunk_count="<<sp->chunk_count
 				<<std::endl);
+		if (chunk_num >= sp->chunk_count)
+			return SharedBuffer<u8>();
+	}
 	if (reliable != sp->reliable)
 		LOG(derr_con<<"Connection: WARNING: reliable="<<reliable
 				<<" != sp->reliable="<<sp->reliable
@@ -537,35 +476,30 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacket &p, bool reliable)
 	}
 
 	// Remove sp from buffer
-	m_buf.erase(seqnum);
-	delete sp;
+	m_buf.remove(seqnum);
 
 	return fulldata;
 }
 void IncomingSplitBuffer::removeUnreliableTimedOuts(float dtime, float timeout)
 {
+	MutexAutoLock listlock(m_map_mutex);
 	std::list<u16> remove_queue;
+	u16 first = m_buf.first();
+	for (u32 n = 0; n < m_buf.span(); n++)
 	{
-		MutexAutoLock listlock(m_map_mutex);
-		for(std::map<u16, IncomingSplitPacket*>::iterator i = m_buf.begin();
-			i != m_buf.end(); ++i)
-		{
-			IncomingSplitPacket *p = i->second;
-			// Reliable ones are not removed by timeout
-			if (p->reliable == true)
-				continue;
-			p->time += dtime;
-			if (p->time >= timeout)
-				remove_queue.push_back(i->first);
-		}
+		IncomingSplitPacket *p = m_buf.get(first + n);
+		// Reliable ones are not removed by timeout
+		if (p == NULL || p->reliable == true)
+			continue;
+		p->time += dtime;
+		if (p->time >= timeout)
+			remove_queue.push_back(first + n);
 	}
 	for(std::list<u16>::iterator j = remove_queue.begin();
 		j != remove_queue.end(); ++j)
 	{
-		MutexAutoLock listlock(m_map_mutex);
 		LOG(dout_con<<"NOTE: Removing timed out unreliable split packet"<<std::endl);
-		delete m_buf[*j];
-		m_buf.erase(*j);
+		m_buf.remove(*j);
 	}
 }
 
@@ -574,6 +508,8 @@ void IncomingSplitBuffer::removeUnreliableTimedOuts(float dtime, float timeout)
 */
 
 Channel::Channel() :
+		incoming_reliables(RELIABLE_RECEIVE_WINDOW_SIZE),
+		outgoing_reliables_sent(MAX_RELIABLE_WINDOW_SIZE),
 		window_size(MIN_RELIABLE_WINDOW_SIZE),
 		next_incoming_seqnum(SEQNUM_INITIAL),
 		next_outgoing_seqnum(SEQNUM_INITIAL),
@@ -597,6 +533,9 @@ Channel::Channel() :
 		bpm_counter(0.0),
 		rate_samples(0)
 {
+	outgoing_bundle_size = 0;
+	bundling = false;
+	send_budget = 0;
 }
 
 Channel::~Channel()
@@ -1014,6 +953,13 @@ UDPPeer::UDPPeer(u16 a_id, Address a_address, Connection* connection) :
 	Peer(a_address,a_id,connection),
 	m_pending_disconnect(false),
 	resend_timeout(0.5),
+	m_srtt(-1.0),
+	m_send_rate(SEND_RATE_INITIAL),
+	m_send_budget(0),
+	m_rate_timer(0),
+	m_rate_losses(0),
+	m_rate_bytes(0),
+	m_slow_start(true),
 	m_legacy_peer(true)
 {
 }
@@ -1029,6 +975,12 @@ bool UDPPeer::getAddress(MTProtocols type,Address& toset)
 	return false;
 }
 
+void UDPPeer::enableBundling()
+{
+	for (unsigned int i = 0; i < CHANNEL_COUNT; i++)
+		channels[i].bundling = true;
+}
+
 void UDPPeer::setNonLegacyPeer()
 {
 	m_legacy_peer = false;
@@ -1053,6 +1005,72 @@ void UDPPeer::reportRTT(float rtt)
 
 	MutexAutoLock usage_lock(m_exclusive_access_mutex);
 	resend_timeout = timeout;
+
+	// Unlike avg_rtt this follows the current queueing delay
+	if (m_srtt < 0)
+		m_srtt = rtt;
+	else
+		m_srtt = m_srtt * 0.875 + rtt * 0.125;
+}
+
+/*
+	Share of the send rate each channel may use. Channel 0 carries
+	chat, movement and other general data, channel 1 the unreliable
+	object updates and channel 2 the map blocks, which must leave room
+	for the others.
+*/
+static const float g_channel_send_share[CHANNEL_COUNT] = { 1.0, 1.0, 0.75 };
+
+void UDPPeer::updateSendRate(float dtime, unsigned int max_packet_size)
+{
+	float srtt;
+	{
+		MutexAutoLock lock(m_exclusive_access_mutex);
+		srtt = m_srtt;
+	}
+
+	m_rate_timer += dtime;
+	float interval = MYMAX(srtt, SEND_RATE_UPDATE_MIN);
+	if (srtt >= 0 && m_rate_timer >= interval) {
+		bool delayed = srtt > getStat(MIN_RTT) * SEND_RTT_INFLATION_FACTOR
+				+ SEND_RTT_INFLATION_SLACK;
+
+		if (m_rate_losses > 0) {
+			m_send_rate *= 0.75;
+			m_slow_start = false;
+		} else if (delayed) {
+			// Queues are building up somewhere on the way
+			m_send_rate *= 0.9;
+			m_slow_start = false;
+		} else if (m_rate_bytes >= m_send_rate * m_rate_timer / 2) {
+			// Only grow if the rate was actually used
+			if (m_slow_start)
+				m_send_rate *= 2;
+			else
+				m_send_rate += max_packet_size / interval;
+		}
+		m_send_rate = rangelim(m_send_rate, SEND_RATE_MIN, SEND_RATE_MAX);
+
+		m_rate_timer = 0;
+		m_rate_losses = 0;
+		m_rate_bytes = 0;
+	}
+
+	float burst = MYMAX(m_send_rate * SEND_BURST_TIME, max_packet_size * 4);
+	m_send_budget = MYMIN(m_send_budget + m_send_rate * dtime, burst);
+	for (unsigned int i = 0; i < CHANNEL_COUNT; i++) {
+		float share = g_channel_send_share[i];
+		channels[i].send_budget = MYMIN(
+				channels[i].send_budget + m_send_rate * share * dtime,
+				burst * share);
+	}
+}
+
+void UDPPeer::consumeSendBudget(u8 channelnum, unsigned int bytes)
+{
+	m_send_budget -= bytes;
+	channels[channelnum].send_budget -= bytes;
+	m_rate_bytes += bytes;
 }
 
 bool UDPPeer::Ping(float dtime,SharedBuffer<u8>& data)
@@ -1263,7 +1281,8 @@ ConnectionSendThread::ConnectionSendThread(unsigned int max_packet_size,
 	m_timeout(timeout),
 	m_max_commands_per_iteration(1),
 	m_max_data_packets_per_iteration(g_settings->getU16("max_packets_per_iteration")),
-	m_max_packets_requeued(256)
+	m_max_packets_requeued(256),
+	m_send_rate_limited(false)
 {
 }
 
@@ -1288,8 +1307,9 @@ void * ConnectionSendThread::run()
 
 		m_iteration_packets_avaialble = m_max_data_packets_per_iteration;
 
-		/* wait for trigger or timeout */
-		m_send_sleep_semaphore.wait(50);
+		/* wait for trigger or timeout, or until the send budget
+		 * allows for the next packets */
+		m_send_sleep_semaphore.wait(m_send_rate_limited ? 5 : 50);
 
 		/* remove all triggers */
 		while(m_send_sleep_semaphore.wait(0)) {}
@@ -1424,6 +1444,7 @@ void ConnectionSendThread::runTimeouts(float dtime)
 							(m_max_data_packets_per_iteration/numpeers));
 
 			channel->UpdatePacketLossCounter(timed_outs.size());
+			dynamic_cast<UDPPeer*>(&peer)->reportPacketLoss(timed_outs.size());
 			g_profiler->graphAdd("packets_lost", timed_outs.size());
 
 			m_iteration_packets_avaialble -= timed_outs.size();
@@ -1447,7 +1468,9 @@ void ConnectionSendThread::runTimeouts(float dtime)
 						<<", seqnum="<<seqnum
 						<<std::endl);
 
-				rawSend(*k);
+				bundleSend(*k, channel);
+				dynamic_cast<UDPPeer*>(&peer)->consumeSendBudget(i,
+						k->data.getSize());
 
 				// do not handle rtt here as we can't decide if this packet was
 				// lost or really takes more time to transmit
@@ -1455,6 +1478,8 @@ void ConnectionSendThread::runTimeouts(float dtime)
 			channel->UpdateTimers(dtime,dynamic_cast<UDPPeer*>(&peer)->getLegacyPeer());
 		}
 
+		dynamic_cast<UDPPeer*>(&peer)->updateSendRate(dtime, m_max_packet_size);
+
 		/* send ping if necessary */
 		if (dynamic_cast<UDPPeer*>(&peer)->Ping(dtime,data)) {
 			LOG(dout_con<<m_connection->getDesc()
@@ -1486,7 +1511,7 @@ void ConnectionSendThread::runTimeouts(float dtime)
 void ConnectionSendThread::rawSend(const BufferedPacket &packet)
 {
 	try{
-		m_connection->m_udpSocket.Send(packet.address, *packet.data,
+		m_connection->m_udpSocket.QueueSend(packet.address, *packet.data,
 				packet.data.getSize());
 		LOG(dout_con <<m_connection->getDesc()
 				<< " rawSend: " << packet.data.getSize()
@@ -1498,6 +1523,83 @@ void ConnectionSendThread::rawSend(const BufferedPacket &packet)
 	}
 }
 
+void ConnectionSendThread::bundleSend(const BufferedPacket &packet,
+		Channel *channel)
+{
+	u32 size = 2 + packet.data.getSize() - BASE_HEADER_SIZE;
+	if (!channel->bundling ||
+			BASE_HEADER_SIZE + BUNDLE_HEADER_SIZE + size > m_max_packet_size) {
+		rawSend(packet);
+		return;
+	}
+
+	if (channel->outgoing_bundle_size + size > m_max_packet_size)
+		flushBundle(channel);
+
+	if (channel->outgoing_bundle.empty())
+		channel->outgoing_bundle_size = BASE_HEADER_SIZE + BUNDLE_HEADER_SIZE;
+	channel->outgoing_bundle.push_back(packet);
+	channel->outgoing_bundle_size += size;
+}
+
+void ConnectionSendThread::flushBundle(Channel *channel)
+{
+	std::vector<BufferedPacket> &bundle = channel->outgoing_bundle;
+
+	if (bundle.empty())
+		return;
+
+	// Not worth a bundle header
+	if (bundle.size() == 1) {
+		rawSend(bundle[0]);
+		bundle.clear();
+		return;
+	}
+
+	BufferedPacket p(channel->outgoing_bundle_size);
+	p.address = bundle[0].address;
+
+	// The base header is the same for all packets of a channel
+	memcpy(*p.data, *bundle[0].data, BASE_HEADER_SIZE);
+	writeU8(&p.data[BASE_HEADER_SIZE], TYPE_BUNDLE);
+
+	u32 offset = BASE_HEADER_SIZE + BUNDLE_HEADER_SIZE;
+	for (std::vector<BufferedPacket>::iterator i = bundle.begin();
+			i != bundle.end(); ++i) {
+		u32 size = i->data.getSize() - BASE_HEADER_SIZE;
+		writeU16(&p.data[offset], size);
+		memcpy(&p.data[offset + 2], &i->data[BASE_HEADER_SIZE], size);
+		offset += 2 + size;
+	}
+
+	LOG(dout_con<<m_connection->getDesc()
+			<<" sending bundle of " << bundle.size() << " packets"
+			<< std::endl);
+
+	rawSend(p);
+	bundle.clear();
+}
+
+void ConnectionSendThread::flushBundles()
+{
+	std::list<u16> peerIds = m_connection->getPeerIDs();
+
+	for(std::list<u16>::iterator j = peerIds.begin();
+			j != peerIds.end(); ++j)
+	{
+		PeerHelper peer = m_connection->getPeerNoEx(*j);
+
+		if (!peer)
+			continue;
+
+		if (dynamic_cast<UDPPeer*>(&peer) == 0)
+			continue;
+
+		for(u16 i=0; i < CHANNEL_COUNT; i++)
+			flushBundle(&dynamic_cast<UDPPeer*>(&peer)->channels[i]);
+	}
+}
+
 void ConnectionSendThread::sendAsPacketReliable(BufferedPacket& p, Channel* channel)
 {
 	try{
@@ -1515,7 +1617,7 @@ void ConnectionSendThread::sendAsPacketReliable(BufferedPacket& p, Channel* chan
 	}
 
 	// Send the packet
-	rawSend(p);
+	bundleSend(p, channel);
 }
 
 bool ConnectionSendThread::rawSendAsPacket(u16 peer_id, u8 channelnum,
@@ -1557,6 +1659,8 @@ bool ConnectionSendThread::rawSendAsPacket(u16 peer_id, u8 channelnum,
 					<<" channel: " << channelnum
 					<<" seqnum: " << seqnum << std::endl);
 			sendAsPacketReliable(p,channel);
+			dynamic_cast<UDPPeer*>(&peer)->consumeSendBudget(channelnum,
+					p.data.getSize());
 			return true;
 		}
 		else {
@@ -1580,7 +1684,9 @@ bool ConnectionSendThread::rawSendAsPacket(u16 peer_id, u8 channelnum,
 					channelnum);
 
 			// Send the packet
-			rawSend(p);
+			bundleSend(p, channel);
+			dynamic_cast<UDPPeer*>(&peer)->consumeSendBudget(channelnum,
+					p.data.getSize());
 			return true;
 		}
 		else {
@@ -1869,6 +1975,8 @@ void ConnectionSendThread::sendPackets(float dtime)
 	std::list<u16> pendingDisconnect;
 	std::map<u16,bool> pending_unreliable;
 
+	m_send_rate_limited = false;
+
 	for(std::list<u16>::iterator
 			j = peerIds.begin();
 			j != peerIds.end(); ++j)
@@ -1932,6 +2040,12 @@ void ConnectionSendThread::sendPackets(float dtime)
 							< dynamic_cast<UDPPeer*>(&peer)->channels[i].getWindowSize())&&
 							(peer->m_increment_packets_remaining > 0))
 			{
+				if (!dynamic_cast<UDPPeer*>(&peer)->hasSendBudget(i) &&
+						!stopRequested()) {
+					m_send_rate_limited = true;
+					break;
+				}
+
 				BufferedPacket p = dynamic_cast<UDPPeer*>(&peer)->channels[i].queued_reliables.front();
 				dynamic_cast<UDPPeer*>(&peer)->channels[i].queued_reliables.pop();
 				Channel* channel = &(dynamic_cast<UDPPeer*>(&peer)->channels[i]);
@@ -1941,6 +2055,8 @@ void ConnectionSendThread::sendPackets(float dtime)
 						<<", seqnum: " << readU16(&p.data[BASE_HEADER_SIZE+1])
 						<< std::endl);
 				sendAsPacketReliable(p,channel);
+				dynamic_cast<UDPPeer*>(&peer)->consumeSendBudget(i,
+						p.data.getSize());
 				peer->m_increment_packets_remaining--;
 			}
 		}
@@ -1980,7 +2096,8 @@ void ConnectionSendThread::sendPackets(float dtime)
 					MYMIN(0,peer->m_increment_packets_remaining--);
 		}
 		else if (
-			( peer->m_increment_packets_remaining > 0) ||
+			(( peer->m_increment_packets_remaining > 0) &&
+			dynamic_cast<UDPPeer*>(&peer)->hasSendBudget(packet.channelnum)) ||
 			(stopRequested())) {
 			rawSendAsPacket(packet.peer_id, packet.channelnum,
 					packet.data, packet.reliable);
@@ -1989,9 +2106,20 @@ void ConnectionSendThread::sendPackets(float dtime)
 		else {
 			m_outgoing_queue.push(packet);
 			pending_unreliable[packet.peer_id] = true;
+			m_send_rate_limited = true;
 		}
 	}
 
+	// Everything of this iteration has been queued, send it
+	flushBundles();
+	try {
+		m_connection->m_udpSocket.FlushSend();
+	} catch(SendFailedException &e) {
+		LOG(derr_con<<m_connection->getDesc()
+				<<"Connection::sendPackets(): SendFailedException"
+				<<std::endl);
+	}
+
 	for(std::list<u16>::iterator
 				k = pendingDisconnect.begin();
 				k != pendingDisconnect.end(); ++k)
@@ -2010,10 +2138,42 @@ void ConnectionSendThread::sendAsPacket(u16 peer_id, u8 channelnum,
 	m_outgoing_queue.push(packet);
 }
 
+ConnectionReceiveWorker::ConnectionReceiveWorker(ConnectionReceiveThread *parent) :
+	Thread("ConnectionReceiveWorker"),
+	m_parent(parent)
+{
+}
+
+void * ConnectionReceiveWorker::run()
+{
+	while(!stopRequested()) {
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		IncomingPacket packet = m_incoming_queue.pop_frontNoEx(50);
+		if (packet.peer_id != PEER_ID_INEXISTENT)
+			m_parent->processIncoming(packet.peer_id, packet.channelnum,
+					SharedBuffer<u8>(*packet.data, packet.data.getSize()));
+
+		END_DEBUG_EXCEPTION_HANDLER(errorstream);
+	}
+	return NULL;
+}
+
 ConnectionReceiveThread::ConnectionReceiveThread(unsigned int max_packet_size) :
 	Thread("ConnectionReceive"),
 	m_connection(NULL)
 {
+	u16 num_workers = g_settings->getU16("num_receive_threads");
+	if (num_workers > 1) {
+		for (u16 i = 0; i < num_workers; i++)
+			m_workers.push_back(new ConnectionReceiveWorker(this));
+	}
+}
+
+ConnectionReceiveThread::~ConnectionReceiveThread()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
 }
 
 void * ConnectionReceiveThread::run()
@@ -2026,6 +2186,9 @@ void * ConnectionReceiveThread::run()
 	PROFILE(std::stringstream ThreadIdentifier);
 	PROFILE(ThreadIdentifier << "ConnectionReceive: [" << m_connection->getDesc() << "]");
 
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->start();
+
 #ifdef DEBUG_CONNECTION_KBPS
 	u32 curtime = porting::getTimeMs();
 	u32 lasttime = curtime;
@@ -2078,6 +2241,7 @@ void * ConnectionReceiveThread::run()
 				output << "OUT to Peer " << *i << " RATES (good / loss) " << std::endl;
 				output << "\tcurrent (sum): " << peer_current << "kb/s "<< peer_loss << "kb/s" << std::endl;
 				output << "\taverage (sum): " << avg_rate << "kb/s "<< avg_loss << "kb/s" << std::endl;
+				output << "\tsend rate: " << peer->getSendRate() / 1024 << "kb/s" << std::endl;
 				output << std::setfill(' ');
 				for(u16 j=0; j<CHANNEL_COUNT; j++)
 				{
@@ -2099,6 +2263,12 @@ void * ConnectionReceiveThread::run()
 #endif
 		END_DEBUG_EXCEPTION_HANDLER(errorstream);
 	}
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->stop();
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->wait();
+
 	PROFILE(g_profiler->remove(ThreadIdentifier.str()));
 	return NULL;
 }
@@ -2112,8 +2282,6 @@ void ConnectionReceiveThread::receive()
 	unsigned int packet_maxsize = 1500;
 	SharedBuffer<u8> packetdata(packet_maxsize);
 
-	bool packet_queued = true;
-
 	unsigned int loop_count = 0;
 
 	/* first of all read packets from socket */
@@ -2122,26 +2290,6 @@ void ConnectionReceiveThread::receive()
 			(m_connection->m_udpSocket.WaitData(50))) {
 		loop_count++;
 		try {
-			if (packet_queued) {
-				bool data_left = true;
-				u16 peer_id;
-				SharedBuffer<u8> resultdata;
-				while(data_left) {
-					try {
-						data_left = getFromBuffers(peer_id, resultdata);
-						if (data_left) {
-							ConnectionEvent e;
-							e.dataReceived(peer_id, resultdata);
-							m_connection->putEvent(e);
-						}
-					}
-					catch(ProcessedSilentlyException &e) {
-						/* try reading again */
-					}
-				}
-				packet_queued = false;
-			}
-
 			Address sender;
 			s32 received_size = m_connection->m_udpSocket.Receive(sender, *packetdata, packet_maxsize);
 
@@ -2231,31 +2379,17 @@ void ConnectionReceiveThread::receive()
 				channel->UpdateBytesReceived(received_size);
 			}
 
-			// Throw the received packet to channel->processPacket()
-
-			// Make a new SharedBuffer from the data without the base headers
-			SharedBuffer<u8> strippeddata(received_size - BASE_HEADER_SIZE);
-			memcpy(*strippeddata, &packetdata[BASE_HEADER_SIZE],
-					strippeddata.getSize());
-
-			try{
-				// Process it (the result is some data with no headers made by us)
-				SharedBuffer<u8> resultdata = processPacket
-						(channel, strippeddata, peer_id, channelnum, false);
-
-				LOG(dout_con<<m_connection->getDesc()
-						<<" ProcessPacket from peer_id: " << peer_id
-						<< ",channel: " << (channelnum & 0xFF) << ", returned "
-						<< resultdata.getSize() << " bytes" <<std::endl);
-
-				ConnectionEvent e;
-				e.dataReceived(peer_id, resultdata);
-				m_connection->putEvent(e);
-			}
-			catch(ProcessedSilentlyException &e) {
-			}
-			catch(ProcessedQueued &e) {
-				packet_queued = true;
+			// Pass on the data without the base headers
+			if (m_workers.empty()) {
+				SharedBuffer<u8> strippeddata(&packetdata[BASE_HEADER_SIZE],
+						received_size - BASE_HEADER_SIZE);
+				processIncoming(peer_id, channelnum, strippeddata);
+			} else {
+				// All packets of a peer go to the same worker to keep their order
+				m_workers[peer_id % m_workers.size()]->queuePacket(
+						IncomingPacket(peer_id, channelnum,
+						&packetdata[BASE_HEADER_SIZE],
+						received_size - BASE_HEADER_SIZE));
 			}
 		}
 		catch(InvalidIncomingDataException &e) {
@@ -2265,30 +2399,92 @@ void ConnectionReceiveThread::receive()
 	}
 }
 
-bool ConnectionReceiveThread::getFromBuffers(u16 &peer_id, SharedBuffer<u8> &dst)
+void ConnectionReceiveThread::handlePacket(Channel *channel,
+		SharedBuffer<u8> packetdata, u16 peer_id, u8 channelnum)
 {
-	std::list<u16> peerids = m_connection->getPeerIDs();
+	if (packetdata.getSize() > BUNDLE_HEADER_SIZE &&
+			readU8(&packetdata[0]) == TYPE_BUNDLE) {
+		u32 offset = BUNDLE_HEADER_SIZE;
+		while (offset + 2 <= packetdata.getSize()) {
+			u32 size = readU16(&packetdata[offset]);
+			offset += 2;
+			if (size == 0 || offset + size > packetdata.getSize()) {
+				LOG(derr_con<<m_connection->getDesc()
+						<<"Receive(): Invalid bundle from peer_id: "
+						<< peer_id << std::endl);
+				break;
+			}
 
-	for(std::list<u16>::iterator j = peerids.begin();
-		j != peerids.end(); ++j)
-	{
-		PeerHelper peer = m_connection->getPeerNoEx(*j);
-		if (!peer)
-			continue;
+			// Bundles can't be nested
+			if (readU8(&packetdata[offset]) != TYPE_BUNDLE) {
+				SharedBuffer<u8> data(&packetdata[offset], size);
+				handlePacket(channel, data, peer_id, channelnum);
+			}
+			offset += size;
+		}
+		return;
+	}
 
-		if (dynamic_cast<UDPPeer*>(&peer) == 0)
-			continue;
+	try{
+		// Process it (the result is some data with no headers made by us)
+		SharedBuffer<u8> resultdata = processPacket
+				(channel, packetdata, peer_id, channelnum, false);
 
-		for(u16 i=0; i<CHANNEL_COUNT; i++)
-		{
-			Channel *channel = &(dynamic_cast<UDPPeer*>(&peer))->channels[i];
+		LOG(dout_con<<m_connection->getDesc()
+				<<" ProcessPacket from peer_id: " << peer_id
+				<< ",channel: " << (channelnum & 0xFF) << ", returned "
+				<< resultdata.getSize() << " bytes" <<std::endl);
 
-			if (checkIncomingBuffers(channel, peer_id, dst)) {
-				return true;
+		ConnectionEvent e;
+		e.dataReceived(peer_id, resultdata);
+		m_connection->putEvent(e);
+	}
+	catch(ProcessedSilentlyException &e) {
+	}
+	catch(ProcessedQueued &e) {
+	}
+}
+
+void ConnectionReceiveThread::processIncoming(u16 peer_id, u8 channelnum,
+		SharedBuffer<u8> packetdata)
+{
+	PeerHelper peer = m_connection->getPeerNoEx(peer_id);
+	if (!peer)
+		return;
+
+	Channel *channel = 0;
+	if (dynamic_cast<UDPPeer*>(&peer) != 0)
+		channel = &(dynamic_cast<UDPPeer*>(&peer)->channels[channelnum]);
+
+	try {
+		handlePacket(channel, packetdata, peer_id, channelnum);
+	}
+	catch(InvalidIncomingDataException &e) {
+	}
+	catch(ProcessedSilentlyException &e) {
+	}
+
+	if (channel == 0)
+		return;
+
+	// The packet may have completed a sequence of buffered reliables
+	bool data_left = true;
+	SharedBuffer<u8> resultdata;
+	while(data_left) {
+		try {
+			data_left = checkIncomingBuffers(channel, peer_id, resultdata);
+			if (data_left) {
+				ConnectionEvent e;
+				e.dataReceived(peer_id, resultdata);
+				m_connection->putEvent(e);
 			}
 		}
+		catch(InvalidIncomingDataException &e) {
+		}
+		catch(ProcessedSilentlyException &e) {
+			/* try reading again */
+		}
 	}
-	return false;
 }
 
 bool ConnectionReceiveThread::checkIncomingBuffers(Channel *channel,
@@ -2433,11 +2629,16 @@ SharedBuffer<u8> ConnectionReceiveThread::processPacket(Channel *channel,
 				m_connection->SetPeerID(peer_id_new);
 			}
 
+			if (packetdata.getSize() >= 5 &&
+					(readU8(&packetdata[4]) & CONNFLAG_BUNDLE))
+				dynamic_cast<UDPPeer*>(&peer)->enableBundling();
+
 			ConnectionCommand cmd;
 
-			SharedBuffer<u8> reply(2);
+			SharedBuffer<u8> reply(3);
 			writeU8(&reply[0], TYPE_CONTROL);
 			writeU8(&reply[1], CONTROLTYPE_ENABLE_BIG_SEND_WINDOW);
+			writeU8(&reply[2], CONNFLAG_BUNDLE);
 			cmd.disableLegacy(PEER_ID_SERVER,reply);
 			m_connection->putCommand(cmd);
 
@@ -2468,6 +2669,9 @@ SharedBuffer<u8> ConnectionReceiveThread::processPacket(Channel *channel,
 		else if (controltype == CONTROLTYPE_ENABLE_BIG_SEND_WINDOW)
 		{
 			dynamic_cast<UDPPeer*>(&peer)->setNonLegacyPeer();
+			if (packetdata.getSize() >= 3 &&
+					(readU8(&packetdata[2]) & CONNFLAG_BUNDLE))
+				dynamic_cast<UDPPeer*>(&peer)->enableBundling();
 			throw ProcessedSilentlyException("Got non legacy control");
 		}
 		else{
@@ -2540,7 +2744,7 @@ SharedBuffer<u8> ConnectionReceiveThread::processPacket(Channel *channel,
 		bool is_old_packet = false;
 
 		/* packet is within our receive window send ack */
-		if (seqnum_in_window(seqnum, channel->readNextIncomingSeqNum(),MAX_RELIABLE_WINDOW_SIZE))
+		if (seqnum_in_window(seqnum, channel->readNextIncomingSeqNum(),RELIABLE_RECEIVE_WINDOW_SIZE))
 		{
 			m_connection->sendAck(peer_id,channelnum,seqnum);
 		}
@@ -3014,10 +3218,11 @@ u16 Connection::createPeer(Address& sender, MTProtocols protocol, int fd)
 			<< "createPeer(): giving peer_id=" << peer_id_new << std::endl);
 
 	ConnectionCommand cmd;
-	SharedBuffer<u8> reply(4);
+	SharedBuffer<u8> reply(5);
 	writeU8(&reply[0], TYPE_CONTROL);
 	writeU8(&reply[1], CONTROLTYPE_SET_PEER_ID);
 	writeU16(&reply[2], peer_id_new);
+	writeU8(&reply[4], CONNFLAG_BUNDLE);
 	cmd.createPeer(peer_id_new,reply);
 	putCommand(cmd);
 
@@ -33,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <fstream>
 #include <list>
 #include <map>
+#include <vector>
 
 class NetworkPacket;
 
@@ -164,6 +165,9 @@ inline bool seqnum_in_window(u16 seqnum, u16 next,u16 window_size)
 
 struct BufferedPacket
 {
+	BufferedPacket():
+		time(0.0), totaltime(0.0), absolute_send_time(-1), resend_count(0)
+	{}
 	BufferedPacket(u8 *a_data, u32 a_size):
 		data(a_data, a_size), time(0.0), totaltime(0.0), absolute_send_time(-1),
 		resend_count(0)
@@ -212,6 +216,7 @@ struct IncomingSplitPacket
 {
 	IncomingSplitPacket()
 	{
+		chunk_count = 0;
 		time = 0.0;
 		reliable = false;
 	}
@@ -260,10 +265,13 @@ controltype and data description:
 		[2] u16 seqnum
 	CONTROLTYPE_SET_PEER_ID
 		[2] u16 peer_id_new
+		[4] u8 connection flags (optional)
 	CONTROLTYPE_PING
 	- There is no actual reply, but this can be sent in a reliable
 	  packet to get a reply
 	CONTROLTYPE_DISCO
+	CONTROLTYPE_ENABLE_BIG_SEND_WINDOW
+		[2] u8 connection flags (optional)
 */
 #define TYPE_CONTROL 0
 #define CONTROLTYPE_ACK 0
@@ -272,6 +280,13 @@ controltype and data description:
 #define CONTROLTYPE_DISCO 3
 #define CONTROLTYPE_ENABLE_BIG_SEND_WINDOW 4
 
+/*
+Connection flags tell the other side which features are supported.
+Peers not sending them (older versions) support none.
+	CONNFLAG_BUNDLE: TYPE_BUNDLE packets can be received
+*/
+#define CONNFLAG_BUNDLE 0x01
+
 /*
 ORIGINAL: This is a plain packet with no control and no error
 checking at all.
@@ -312,17 +327,170 @@ with a buffer in the receiving and transmitting end.
 #define RELIABLE_HEADER_SIZE 3
 #define SEQNUM_INITIAL 65500
 
+/*
+BUNDLE: Several packets for the same peer and channel sent in one
+datagram, to save headers and system calls on small packets. Only sent
+to peers that set CONNFLAG_BUNDLE.
+- Each contained packet is processed as if it was received on its own.
+	Header (1 byte):
+	[0] u8 type
+	Followed by any number of:
+	[0] u16 size
+	[2] packet data (with no base headers)
+*/
+#define TYPE_BUNDLE 4
+#define BUNDLE_HEADER_SIZE 1
+
 /*
 	A buffer which stores reliable packets and sorts them internally
 	for fast access to the smallest one.
 */
 
-typedef std::list<BufferedPacket>::iterator RPBSearchResult;
+/*
+	Reliable packets are only buffered up to this many sequence numbers
+	ahead of the next expected one. Later ones are not acked and have to
+	be resent, so that peers can't make the buffer grow any further.
+*/
+#define RELIABLE_RECEIVE_WINDOW_SIZE 0x400
+
+/*
+	Maximum range of sequence numbers of incomplete split packets kept,
+	the oldest ones are dropped to make room for newer ones
+*/
+#define SPLIT_BUFFER_SPAN 0x100
+
+/*
+	Slots for the entries of a sequence number window, indexed by the
+	sequence number. The capacity is a power of two and is only grown
+	when the stored range doesn't fit anymore, so adding and removing
+	entries doesn't allocate nodes like a list or map would. The range
+	never gets longer than max_span, a power of two of at least 64 and
+	at most 0x8000.
+*/
+template<typename T>
+class SeqnumRing
+{
+public:
+	SeqnumRing(u32 max_span):
+		m_first(0),
+		m_end(0),
+		m_count(0),
+		m_slots(64),
+		m_used(64, false),
+		m_mask(63),
+		m_max_span(max_span)
+	{}
+
+	u32 size() const
+	{ return m_count; }
+
+	bool empty() const
+	{ return m_count == 0; }
+
+	// Oldest stored sequence number, if not empty
+	u16 first() const
+	{ return m_first; }
+
+	// Number of sequence numbers from the oldest to the newest entry
+	u32 span() const
+	{ return (u16)(m_end - m_first); }
+
+	// Returns NULL if nothing is stored for the sequence number
+	T *get(u16 seqnum)
+	{
+		if (m_count == 0 || (u16)(seqnum - m_first) >= span() ||
+				!m_used[seqnum & m_mask])
+			return NULL;
+		return &m_slots[seqnum & m_mask];
+	}
+
+	// Whether the sequence number can be stored within max_span
+	bool fits(u16 seqnum) const
+	{
+		if (m_count == 0)
+			return true;
+		if (seqnum_higher(m_first, seqnum))
+			return (u32)(u16)(m_end - seqnum) <= m_max_span;
+		if (!seqnum_higher(m_end, seqnum))
+			return (u32)(u16)(seqnum - m_first) + 1 <= m_max_span;
+		return true;
+	}
+
+	// Returns the slot of a sequence number that isn't stored yet and fits
+	T &insert(u16 seqnum)
+	{
+		if (m_count == 0) {
+			m_first = seqnum;
+			m_end = seqnum + 1;
+		} else if (seqnum_higher(m_first, seqnum)) {
+			reserve((u16)(m_end - seqnum));
+			m_first = seqnum;
+		} else if (!seqnum_higher(m_end, seqnum)) {
+			reserve((u16)(seqnum - m_first) + 1);
+			m_end = seqnum + 1;
+		}
+		u32 i = seqnum & m_mask;
+		m_used[i] = true;
+		m_count++;
+		return m_slots[i];
+	}
+
+	// The sequence number has to be stored
+	void remove(u16 seqnum)
+	{
+		u32 i = seqnum & m_mask;
+		m_slots[i] = T();
+		m_used[i] = false;
+		m_count--;
+
+		if (m_count == 0) {
+			m_first = m_end;
+			return;
+		}
+		while (!m_used[m_first & m_mask])
+			m_first++;
+		while (!m_used[(u16)(m_end - 1) & m_mask])
+			m_end--;
+	}
+
+private:
+	void reserve(u32 span)
+	{
+		u32 capacity = m_slots.size();
+		if (span <= capacity)
+			return;
+		while (capacity < span)
+			capacity *= 2;
+
+		std::vector<T> slots(capacity);
+		std::vector<bool> used(capacity, false);
+		u32 mask = capacity - 1;
+		for (u16 seqnum = m_first; seqnum != m_end; seqnum++) {
+			if (!m_used[seqnum & m_mask])
+				continue;
+			slots[seqnum & mask] = m_slots[seqnum & m_mask];
+			used[seqnum & mask] = true;
+		}
+		m_slots.swap(slots);
+		m_used.swap(used);
+		m_mask = mask;
+	}
+
+	u16 m_first;
+	// One after the newest sequence number
+	u16 m_end;
+	u32 m_count;
+	std::vector<T> m_slots;
+	std::vector<bool> m_used;
+	u32 m_mask;
+	u32 m_max_span;
+};
 
 class ReliablePacketBuffer
 {
 public:
-	ReliablePacketBuffer();
+	// Only packets less than window_size after next_expected are stored
+	ReliablePacketBuffer(u16 window_size);
 
 	bool getFirstSeqnum(u16& result);
 
@@ -337,17 +505,12 @@ class ReliablePacketBuffer
 	void print();
 	bool empty();
 	bool containsPacket(u16 seqnum);
-	RPBSearchResult notFound();
 	u32 size();
 
 
 private:
-	RPBSearchResult findPacket(u16 seqnum);
-
-	std::list<BufferedPacket> m_list;
-	u32 m_list_size;
-
-	u16 m_oldest_non_answered_ack;
+	SeqnumRing<BufferedPacket> m_packets;
+	u16 m_window_size;
 
 	Mutex m_list_mutex;
 };
@@ -359,7 +522,8 @@ class ReliablePacketBuffer
 class IncomingSplitBuffer
 {
 public:
-	~IncomingSplitBuffer();
+	IncomingSplitBuffer();
+
 	/*
 		Returns a reference counted buffer of length != 0 when a full split
 		packet is constructed. If not, returns one of length 0.
@@ -369,8 +533,8 @@ class IncomingSplitBuffer
 	void removeUnreliableTimedOuts(float dtime, float timeout);
 
 private:
-	// Key is seqnum
-	std::map<u16, IncomingSplitPacket*> m_buf;
+	// Incomplete split packets by seqnum
+	SeqnumRing<IncomingSplitPacket> m_buf;
 
 	Mutex m_map_mutex;
 };
@@ -394,6 +558,33 @@ struct OutgoingPacket
 	}
 };
 
+/*
+	A packet read from the socket, with the base header stripped, waiting
+	to be processed by the receive worker its peer is assigned to.
+	The data is a Buffer as the reference count of a SharedBuffer must not
+	be shared between threads.
+*/
+struct IncomingPacket
+{
+	u16 peer_id;
+	u8 channelnum;
+	Buffer<u8> data;
+
+	IncomingPacket():
+		peer_id(PEER_ID_INEXISTENT),
+		channelnum(0)
+	{
+	}
+
+	IncomingPacket(u16 peer_id_, u8 channelnum_, const u8 *data_,
+			u32 size):
+		peer_id(peer_id_),
+		channelnum(channelnum_),
+		data(data_, size)
+	{
+	}
+};
+
 enum ConnectionCommandType{
 	CONNCMD_NONE,
 	CONNCMD_SERVE,
@@ -507,6 +698,16 @@ class Channel
 
 	IncomingSplitBuffer incoming_splits;
 
+	// Small packets to be sent together in one TYPE_BUNDLE datagram
+	std::vector<BufferedPacket> outgoing_bundle;
+	// Size of that datagram, including headers
+	u32 outgoing_bundle_size;
+	// The peer can receive TYPE_BUNDLE packets
+	bool bundling;
+
+	// Bytes this channel may still send, see UDPPeer::updateSendRate()
+	float send_budget;
+
 	Channel();
 	~Channel();
 
@@ -802,6 +1003,9 @@ class UDPPeer : public Peer
 
 	void setNonLegacyPeer();
 
+	// The peer set CONNFLAG_BUNDLE
+	void enableBundling();
+
 	bool getLegacyPeer()
 	{ return m_legacy_peer; }
 
@@ -828,6 +1032,22 @@ class UDPPeer : public Peer
 	float getResendTimeout()
 		{ MutexAutoLock lock(m_exclusive_access_mutex); return resend_timeout; }
 
+	/*
+		Congestion control: adapts the send rate to the measured rtt and
+		packet loss about once per rtt, and refills the send budgets
+		of the peer and its channels by the time passed.
+	*/
+	void updateSendRate(float dtime, unsigned int max_packet_size);
+	// Number of reliable packets that had to be resent
+	void reportPacketLoss(unsigned int count)
+		{ m_rate_losses += count; }
+	// Whether the channel may send another packet now
+	bool hasSendBudget(u8 channelnum)
+		{ return m_send_budget > 0 && channels[channelnum].send_budget > 0; }
+	void consumeSendBudget(u8 channelnum, unsigned int bytes);
+	float getSendRate()
+		{ return m_send_rate; }
+
 	void setResendTimeout(float timeout)
 		{ MutexAutoLock lock(m_exclusive_access_mutex); resend_timeout = timeout; }
 	bool Ping(float dtime,SharedBuffer<u8>& data);
@@ -838,6 +1058,19 @@ class UDPPeer : public Peer
 	// This is changed dynamically
 	float resend_timeout;
 
+	// Smoothed rtt, -1 until measured
+	float m_srtt;
+	// Bytes per second this peer is sent at most
+	float m_send_rate;
+	// Bytes that may be sent right now
+	float m_send_budget;
+	// Seconds, packets lost and bytes sent since the last rate update
+	float m_rate_timer;
+	unsigned int m_rate_losses;
+	unsigned int m_rate_bytes;
+	// The rate is doubled each rtt until the first congestion
+	bool m_slow_start;
+
 	bool processReliableSendCommand(
 					ConnectionCommand &c,
 					unsigned int max_packet_size);
@@ -932,6 +1165,11 @@ class ConnectionSendThread : public Thread {
 private:
 	void runTimeouts    (float dtime);
 	void rawSend        (const BufferedPacket &packet);
+	// Sends small packets together with others on the channel, if the
+	// peer supports it; they go out on flushBundles()
+	void bundleSend     (const BufferedPacket &packet, Channel *channel);
+	void flushBundle    (Channel *channel);
+	void flushBundles   ();
 	bool rawSendAsPacket(u16 peer_id, u8 channelnum,
 							SharedBuffer<u8> data, bool reliable);
 
@@ -967,11 +1205,36 @@ class ConnectionSendThread : public Thread {
 	unsigned int          m_max_commands_per_iteration;
 	unsigned int          m_max_data_packets_per_iteration;
 	unsigned int          m_max_packets_requeued;
+	// Packets were held back by the send budget in the last iteration
+	bool                  m_send_rate_limited;
+};
+
+class ConnectionReceiveThread;
+
+/*
+	Processes the packets of the peers with
+	peer_id % number of workers == index of the worker
+*/
+class ConnectionReceiveWorker : public Thread {
+public:
+	ConnectionReceiveWorker(ConnectionReceiveThread *parent);
+
+	void *run();
+
+	void queuePacket(const IncomingPacket &packet)
+		{ m_incoming_queue.push_back(packet); }
+
+private:
+	ConnectionReceiveThread *m_parent;
+	MutexedQueue<IncomingPacket> m_incoming_queue;
 };
 
 class ConnectionReceiveThread : public Thread {
 public:
+	friend class ConnectionReceiveWorker;
+
 	ConnectionReceiveThread(unsigned int max_packet_size);
+	~ConnectionReceiveThread();
 
 	void *run();
 
@@ -983,10 +1246,13 @@ class ConnectionReceiveThread : public Thread {
 private:
 	void receive();
 
-	// Returns next data from a buffer if possible
-	// If found, returns true; if not, false.
-	// If found, sets peer_id and dst
-	bool getFromBuffers(u16 &peer_id, SharedBuffer<u8> &dst);
+	/*
+		Processes a packet of a peer and queues the resulting data, including
+		reliable packets of the channel that are now in order, for the user.
+		Called by the workers if there are any, else by this thread.
+	*/
+	void processIncoming(u16 peer_id, u8 channelnum,
+							SharedBuffer<u8> packetdata);
 
 	bool checkIncomingBuffers(Channel *channel, u16 &peer_id,
 							SharedBuffer<u8> &dst);
@@ -1003,8 +1269,17 @@ class ConnectionReceiveThread : public Thread {
 							SharedBuffer<u8> packetdata, u16 peer_id,
 							u8 channelnum, bool reliable);
 
+	/*
+		Processes a received packet (with no base headers) and queues the
+		resulting data for the user; unpacks TYPE_BUNDLE packets.
+	*/
+	void handlePacket(Channel *channel, SharedBuffer<u8> packetdata,
+							u16 peer_id, u8 channelnum);
+
 
 	Connection*           m_connection;
+	// Empty if packets are processed by this thread
+	std::vector<ConnectionReceiveWorker*> m_workers;
 };
 
 class Connection
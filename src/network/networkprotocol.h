@@ -132,9 +132,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 		Rename GENERIC_CMD_SET_ATTACHMENT to GENERIC_CMD_ATTACH_TO
 	PROTOCOL_VERSION 26:
 		Add TileDef tileable_horizontal, tileable_vertical flags
+	PROTOCOL_VERSION 27:
+		Add TOCLIENT_NODES_CHANGED for the node changes of a block in
+			one packet
+	PROTOCOL_VERSION 28:
+		Add GENERIC_CMD_UPDATE_POSITION_COMPACT, sent instead of
+			GENERIC_CMD_UPDATE_POSITION
 */
 
-#define LATEST_PROTOCOL_VERSION 26
+#define LATEST_PROTOCOL_VERSION 28
 
 // Server's supported network protocol range
 #define SERVER_PROTOCOL_VERSION_MIN 13
@@ -584,6 +590,19 @@ enum ToClientCommand
 		u32 id
 	*/
 
+	TOCLIENT_NODES_CHANGED = 0x54,
+	/*
+		v3s16 blockpos
+		u16 count
+		foreach count:
+			u16 index // z * MAP_BLOCKSIZE^2 + y * MAP_BLOCKSIZE + x
+			u8 flags // NODE_CHANGE_*
+			if not NODE_CHANGE_REMOVE:
+				u16 param0
+				u8 param1
+				u8 param2
+	*/
+
 	TOCLIENT_SRP_BYTES_S_B = 0x60,
 	/*
 		Belonging to AUTH_MECHANISM_LEGACY_PASSWORD and AUTH_MECHANISM_SRP.
@@ -880,6 +899,11 @@ enum AuthMechanism
 	AUTH_MECHANISM_FIRST_SRP = 1 << 2,
 };
 
+enum NodeChangeFlags {
+	NODE_CHANGE_REMOVE = 0x01, // Node was removed, no node data follows
+	NODE_CHANGE_KEEP_METADATA = 0x02, // Swapped node, metadata is kept
+};
+
 enum AccessDeniedCode {
 	SERVER_ACCESSDENIED_WRONG_PASSWORD,
 	SERVER_ACCESSDENIED_UNEXPECTED_DATA,
@@ -196,6 +196,9 @@ void ContentFeatures::reset()
 	backface_culling = true;
 
 #endif
+	collision_boxes_cache.clear();
+	collision_boxes_index.clear();
+	bouncy = 0;
 	has_on_construct = false;
 	has_on_destruct = false;
 	has_after_destruct = false;
@@ -428,6 +431,7 @@ class CNodeDefManager: public IWritableNodeDefManager {
 
 private:
 	void addNameIdMapping(content_t i, std::string name);
+	void updateCollisionCache(content_t c);
 #ifndef SERVER
 	void fillTileAttribs(ITextureSource *tsrc, TileSpec *tile, TileDef *tiledef,
 		u32 shader_id, bool use_normal_texture, bool backface_culling,
@@ -506,6 +510,7 @@ void CNodeDefManager::clear()
 		content_t c = CONTENT_UNKNOWN;
 		m_content_features[c] = f;
 		addNameIdMapping(c, f.name);
+		updateCollisionCache(c);
 	}
 
 	// Set CONTENT_AIR
@@ -671,6 +676,7 @@ content_t CNodeDefManager::set(const std::string &name, const ContentFeatures &d
 		addNameIdMapping(id, name);
 	}
 	m_content_features[id] = def;
+	updateCollisionCache(id);
 	verbosestream << "NodeDefManager: registering content id \"" << id
 		<< "\": name=\"" << def.name << "\""<<std::endl;
 
@@ -695,6 +701,43 @@ content_t CNodeDefManager::set(const std::string &name, const ContentFeatures &d
 }
 
 
+void CNodeDefManager::updateCollisionCache(content_t c)
+{
+	ContentFeatures &f = m_content_features[c];
+	f.collision_boxes_cache.clear();
+	f.collision_boxes_index.clear();
+	f.bouncy = itemgroup_get(f.groups, "bouncy");
+	if (!f.walkable)
+		return;
+
+	// Only rotated and leveled node boxes depend on param2, and only on
+	// the bits of it that hold the rotation or the level
+	const NodeBox &box = f.collision_box.fixed.empty() ?
+		f.node_box : f.collision_box;
+	u32 param2_mask = 0;
+	if (box.type != NODEBOX_REGULAR) {
+		if (f.param_type_2 == CPT2_FACEDIR)
+			param2_mask |= 0x1F;
+		if (f.param_type_2 == CPT2_WALLMOUNTED)
+			param2_mask |= 0x07;
+		if (f.param_type_2 == CPT2_LEVELED || f.leveled)
+			param2_mask |= LEVELED_MASK;
+		if (f.param_type_2 == CPT2_FLOWINGLIQUID ||
+				f.liquid_type == LIQUID_FLOWING)
+			param2_mask |= LIQUID_LEVEL_MASK;
+	}
+
+	for (u32 param2 = 0; param2 <= param2_mask; param2++) {
+		f.collision_boxes_index.push_back(f.collision_boxes_cache.size());
+		std::vector<aabb3f> boxes =
+			MapNode(c, 0, param2).getCollisionBoxes(this);
+		f.collision_boxes_cache.insert(f.collision_boxes_cache.end(),
+			boxes.begin(), boxes.end());
+	}
+	f.collision_boxes_index.push_back(f.collision_boxes_cache.size());
+}
+
+
 content_t CNodeDefManager::allocateDummy(const std::string &name)
 {
 	assert(name != "");	// Pre-condition
@@ -1135,6 +1178,7 @@ void CNodeDefManager::deSerialize(std::istream &is)
 			m_content_features.resize((u32)(i) + 1);
 		m_content_features[i] = f;
 		addNameIdMapping(i, f.name);
+		updateCollisionCache(i);
 		verbosestream << "deserialized " << f.name << std::endl;
 	}
 }
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <iostream>
 #include <map>
 #include <list>
+#include <vector>
 #include "util/numeric.h"
 #include "mapnode.h"
 #ifndef SERVER
@@ -186,6 +187,16 @@ struct ContentFeatures
 	bool has_on_destruct;
 	bool has_after_destruct;
 
+	// Collision boxes for each param2 and the bouncy group, for collision
+	// detection. Filled in by the node definition manager.
+	std::vector<aabb3f> collision_boxes_cache;
+	// Start of the boxes of each param2 in collision_boxes_cache, followed
+	// by the end. Only the low bits of param2 that the boxes depend on are
+	// indexed, so param2 is masked with size() - 2; has a single range if
+	// the boxes don't depend on param2.
+	std::vector<u32> collision_boxes_index;
+	int bouncy;
+
 	/*
 		Actual data
 	*/
@@ -24,7 +24,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "pathfinder.h"
 #include "environment.h"
 #include "map.h"
+#include "mapblock.h"
+#include "voxel.h"
 #include "log.h"
+#include "profiler.h"
+#include "debug.h"
+#include <algorithm>
 
 #ifdef PATHFINDER_DEBUG
 #include <iomanip>
@@ -42,8 +47,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /** shortcut to print a 3d pos */
 #define PPOS(pos) "(" << pos.X << "," << pos.Y << "," << pos.Z << ")"
 
-#define LVL "(" << level << ")" <<
-
 #ifdef PATHFINDER_DEBUG
 #define DEBUG_OUT(a)     std::cout << a
 #define INFO_TARGET      std::cout
@@ -68,7 +71,9 @@ std::vector<v3s16> get_Path(ServerEnvironment* env,
 							unsigned int max_drop,
 							algorithm algo) {
 
-	pathfinder searchclass;
+	// Only used from the server thread, keeping the instance keeps the
+	// memory of the search area for the next search
+	static pathfinder searchclass;
 
 	return searchclass.get_Path(env,
 				source,destination,
@@ -79,121 +84,61 @@ std::vector<v3s16> get_Path(ServerEnvironment* env,
 path_cost::path_cost()
 :	valid(false),
 	value(0),
-	direction(0),
-	updated(false)
+	direction(0)
 {
 	//intentionaly empty
 }
 
-/******************************************************************************/
-path_cost::path_cost(const path_cost& b) {
-	valid     = b.valid;
-	direction = b.direction;
-	value     = b.value;
-	updated   = b.updated;
-}
-
-/******************************************************************************/
-path_cost& path_cost::operator= (const path_cost& b) {
-	valid     = b.valid;
-	direction = b.direction;
-	value     = b.value;
-	updated   = b.updated;
-
-	return *this;
-}
-
 /******************************************************************************/
 path_gridnode::path_gridnode()
-:	valid(false),
-	target(false),
-	source(false),
+:	search(0),
 	totalcost(-1),
 	sourcedir(v3s16(0,0,0)),
-	surfaces(0),
-	pos(v3s16(0,0,0)),
-	is_element(false),
-	type('u')
+	closed(false)
 {
 	//intentionaly empty
 }
 
 /******************************************************************************/
-path_gridnode::path_gridnode(const path_gridnode& b)
-:	valid(b.valid),
-	target(b.target),
-	source(b.source),
-	totalcost(b.totalcost),
-	sourcedir(b.sourcedir),
-	surfaces(b.surfaces),
-	pos(b.pos),
-	is_element(b.is_element),
-	type(b.type)
-	{
-
-	directions[DIR_XP] = b.directions[DIR_XP];
-	directions[DIR_XM] = b.directions[DIR_XM];
-	directions[DIR_ZP] = b.directions[DIR_ZP];
-	directions[DIR_ZM] = b.directions[DIR_ZM];
-}
+std::vector<v3s16> pathfinder::get_Path(ServerEnvironment* env,
+							v3s16 source,
+							v3s16 destination,
+							unsigned int searchdistance,
+							unsigned int max_jump,
+							unsigned int max_drop,
+							algorithm algo) {
+	//check parameters
+	if (env == 0) {
+		ERROR_TARGET << "missing environment pointer" << std::endl;
+		return std::vector<v3s16>();
+	}
 
-/******************************************************************************/
-path_gridnode& path_gridnode::operator= (const path_gridnode& b) {
-	valid      = b.valid;
-	target     = b.target;
-	source     = b.source;
-	is_element = b.is_element;
-	totalcost  = b.totalcost;
-	sourcedir  = b.sourcedir;
-	surfaces   = b.surfaces;
-	pos        = b.pos;
-	type       = b.type;
-
-	directions[DIR_XP] = b.directions[DIR_XP];
-	directions[DIR_XM] = b.directions[DIR_XM];
-	directions[DIR_ZP] = b.directions[DIR_ZP];
-	directions[DIR_ZM] = b.directions[DIR_ZM];
-
-	return *this;
-}
+	m_map    = &env->getMap();
+	m_block  = NULL;
+	m_vmanip = NULL;
 
-/******************************************************************************/
-path_cost path_gridnode::get_cost(v3s16 dir) {
-	if (dir.X > 0) {
-		return directions[DIR_XP];
-	}
-	if (dir.X < 0) {
-		return directions[DIR_XM];
-	}
-	if (dir.Z > 0) {
-		return directions[DIR_ZP];
-	}
-	if (dir.Z < 0) {
-		return directions[DIR_ZM];
-	}
-	path_cost retval;
-	return retval;
+	return find_path(source,destination,
+				searchdistance,max_jump,max_drop,algo);
 }
 
 /******************************************************************************/
-void path_gridnode::set_cost(v3s16 dir,path_cost cost) {
-	if (dir.X > 0) {
-		directions[DIR_XP] = cost;
-	}
-	if (dir.X < 0) {
-		directions[DIR_XM] = cost;
-	}
-	if (dir.Z > 0) {
-		directions[DIR_ZP] = cost;
-	}
-	if (dir.Z < 0) {
-		directions[DIR_ZM] = cost;
-	}
+std::vector<v3s16> pathfinder::get_Path(VoxelManipulator* vmanip,
+							v3s16 source,
+							v3s16 destination,
+							unsigned int searchdistance,
+							unsigned int max_jump,
+							unsigned int max_drop,
+							algorithm algo) {
+	m_map    = NULL;
+	m_block  = NULL;
+	m_vmanip = vmanip;
+
+	return find_path(source,destination,
+				searchdistance,max_jump,max_drop,algo);
 }
 
 /******************************************************************************/
-std::vector<v3s16> pathfinder::get_Path(ServerEnvironment* env,
-							v3s16 source,
+std::vector<v3s16> pathfinder::find_path(v3s16 source,
 							v3s16 destination,
 							unsigned int searchdistance,
 							unsigned int max_jump,
@@ -203,26 +148,15 @@ std::vector<v3s16> pathfinder::get_Path(ServerEnvironment* env,
 	timespec ts;
 	clock_gettime(CLOCK_REALTIME, &ts);
 #endif
+	ScopeProfiler sp(g_profiler, "pathfinder: find path avg", SPT_AVG);
 	std::vector<v3s16> retval;
 
-	//check parameters
-	if (env == 0) {
-		ERROR_TARGET << "missing environment pointer" << std::endl;
-		return retval;
-	}
-
 	m_searchdistance = searchdistance;
-	m_env = env;
 	m_maxjump = max_jump;
 	m_maxdrop = max_drop;
 	m_start       = source;
 	m_destination = destination;
-	m_min_target_distance = -1;
-	m_prefetch = true;
-
-	if (algo == A_PLAIN_NP) {
-		m_prefetch = false;
-	}
+	m_heuristic   = (algo != DIJKSTRA);
 
 	int min_x = MYMIN(source.X,destination.X);
 	int max_x = MYMAX(source.X,destination.X);
@@ -240,110 +174,65 @@ std::vector<v3s16> pathfinder::get_Path(ServerEnvironment* env,
 	m_limits.Z.min = min_z - searchdistance;
 	m_limits.Z.max = max_z + searchdistance;
 
-	m_max_index_x = m_limits.X.max - m_limits.X.min;
-	m_max_index_y = m_limits.Y.max - m_limits.Y.min;
-	m_max_index_z = m_limits.Z.max - m_limits.Z.min;
+	m_max_index_x = m_limits.X.max - m_limits.X.min + 1;
+	m_max_index_y = m_limits.Y.max - m_limits.Y.min + 1;
+	m_max_index_z = m_limits.Z.max - m_limits.Z.min + 1;
 
-	//build data map
-	if (!build_costmap()) {
-		ERROR_TARGET << "failed to build costmap" << std::endl;
+	//validate start and end pos
+	if (!is_surface(source)) {
+		VERBOSE_TARGET << "invalid startpos " << PPOS(source) << std::endl;
 		return retval;
 	}
-#ifdef PATHFINDER_DEBUG
-	print_type();
-	print_cost();
-	print_ydir();
-#endif
-
-	//validate and mark start and end pos
-	v3s16 StartIndex  = getIndexPos(source);
-	v3s16 EndIndex    = getIndexPos(destination);
-
-	path_gridnode& startpos = getIndexElement(StartIndex);
-	path_gridnode& endpos   = getIndexElement(EndIndex);
-
-	if (!startpos.valid) {
-		VERBOSE_TARGET << "invalid startpos" <<
-				"Index: " << PPOS(StartIndex) <<
-				"Realpos: " << PPOS(getRealPos(StartIndex)) << std::endl;
+	if (!is_surface(destination)) {
+		VERBOSE_TARGET << "invalid stoppos " << PPOS(destination) << std::endl;
 		return retval;
 	}
-	if (!endpos.valid) {
-		VERBOSE_TARGET << "invalid stoppos" <<
-				"Index: " << PPOS(EndIndex) <<
-				"Realpos: " << PPOS(getRealPos(EndIndex)) << std::endl;
-		return retval;
-	}
-
-	endpos.target      = true;
-	startpos.source    = true;
-	startpos.totalcost = 0;
 
-	bool update_cost_retval = false;
-
-	switch (algo) {
-		case DIJKSTRA:
-			update_cost_retval = update_all_costs(StartIndex,v3s16(0,0,0),0,0);
-			break;
-		case A_PLAIN_NP:
-		case A_PLAIN:
-			update_cost_retval = update_cost_heuristic(StartIndex,v3s16(0,0,0),0,0);
-			break;
-		default:
-			ERROR_TARGET << "missing algorithm"<< std::endl;
-			break;
+	//grow search area if needed, older gridnodes are reset when used
+	size_t size = (size_t)m_max_index_x * m_max_index_y * m_max_index_z;
+	if (m_data.size() < size)
+		m_data.resize(size);
+	m_search++;
+	if (m_search == 0) {
+		// wrapped around, gridnodes of old searches would look current
+		std::fill(m_data.begin(), m_data.end(), path_gridnode());
+		m_search = 1;
 	}
 
-	if (update_cost_retval) {
-
-#ifdef PATHFINDER_DEBUG
-		std::cout << "Path to target found!" << std::endl;
-		print_pathlen();
-#endif
+	u32 start_index;
+	path_gridnode& startpos = getGridnode(source, &start_index);
+	startpos.totalcost = 0;
 
-		//find path
-		std::vector<v3s16> path;
-		build_path(path,EndIndex,0);
+	m_open.clear();
+	path_openentry entry;
+	entry.estimate  = m_heuristic ? get_manhattandistance(source) : 0;
+	entry.totalcost = 0;
+	entry.index     = start_index;
+	m_open.push_back(entry);
 
-#ifdef PATHFINDER_DEBUG
-		std::cout << "Full index path:" << std::endl;
-		print_path(path);
-#endif
+	if (!update_costs()) {
+		VERBOSE_TARGET << "no path found" << std::endl;
+		return retval;
+	}
 
-		//finalize path
-		std::vector<v3s16> full_path;
-		for (std::vector<v3s16>::iterator i = path.begin();
-					i != path.end(); ++i) {
-			full_path.push_back(getIndexElement(*i).pos);
-		}
+	build_path(retval);
 
 #ifdef PATHFINDER_DEBUG
-		std::cout << "full path:" << std::endl;
-		print_path(full_path);
+	std::cout << "full path:" << std::endl;
+	print_path(retval);
 #endif
 #ifdef PATHFINDER_CALC_TIME
-		timespec ts2;
-		clock_gettime(CLOCK_REALTIME, &ts2);
+	timespec ts2;
+	clock_gettime(CLOCK_REALTIME, &ts2);
 
-		int ms = (ts2.tv_nsec - ts.tv_nsec)/(1000*1000);
-		int us = ((ts2.tv_nsec - ts.tv_nsec) - (ms*1000*1000))/1000;
-		int ns = ((ts2.tv_nsec - ts.tv_nsec) - ( (ms*1000*1000) + (us*1000)));
+	int ms = (ts2.tv_nsec - ts.tv_nsec)/(1000*1000);
+	int us = ((ts2.tv_nsec - ts.tv_nsec) - (ms*1000*1000))/1000;
+	int ns = ((ts2.tv_nsec - ts.tv_nsec) - ( (ms*1000*1000) + (us*1000)));
 
 
-		std::cout << "Calculating path took: " << (ts2.tv_sec - ts.tv_sec) <<
-				"s " << ms << "ms " << us << "us " << ns << "ns " << std::endl;
+	std::cout << "Calculating path took: " << (ts2.tv_sec - ts.tv_sec) <<
+			"s " << ms << "ms " << us << "us " << ns << "ns " << std::endl;
 #endif
-		return full_path;
-	}
-	else {
-#ifdef PATHFINDER_DEBUG
-		print_pathlen();
-#endif
-		ERROR_TARGET << "failed to update cost map"<< std::endl;
-	}
-
-
-	//return
 	return retval;
 }
 
@@ -355,131 +244,103 @@ pathfinder::pathfinder() :
 	m_searchdistance(0),
 	m_maxdrop(0),
 	m_maxjump(0),
-	m_min_target_distance(0),
-	m_prefetch(true),
+	m_heuristic(true),
 	m_start(0,0,0),
 	m_destination(0,0,0),
 	m_limits(),
 	m_data(),
-	m_env(0)
+	m_search(0),
+	m_open(),
+	m_map(0),
+	m_block(0),
+	m_blockpos(0,0,0),
+	m_vmanip(0)
 {
 	//intentionaly empty
 }
 
 /******************************************************************************/
-v3s16 pathfinder::getRealPos(v3s16 ipos) {
-
-	v3s16 retval = ipos;
+MapNode pathfinder::getNode(v3s16 pos) {
+	if (m_vmanip)
+		return m_vmanip->getNodeNoExNoEmerge(pos);
 
-	retval.X += m_limits.X.min;
-	retval.Y += m_limits.Y.min;
-	retval.Z += m_limits.Z.min;
+	//consecutive reads are mostly within the same block
+	v3s16 blockpos = getNodeBlockPos(pos);
+	if (!m_block || blockpos != m_blockpos) {
+		m_block = m_map->getBlockNoCreateNoEx(blockpos);
+		m_blockpos = blockpos;
+	}
+	if (!m_block)
+		return MapNode(CONTENT_IGNORE);
 
-	return retval;
+	bool valid_position;
+	return m_block->getNodeNoCheck(pos - blockpos * MAP_BLOCKSIZE,
+			&valid_position);
 }
 
 /******************************************************************************/
-bool pathfinder::build_costmap()
-{
-	INFO_TARGET << "Pathfinder build costmap: (" << m_limits.X.min << ","
-												<< m_limits.Z.min << ") ("
-												<< m_limits.X.max << ","
-												<< m_limits.Z.max << ")"
-												<< std::endl;
-	m_data.resize(m_max_index_x);
-	for (int x = 0; x < m_max_index_x; x++) {
-		m_data[x].resize(m_max_index_z);
-		for (int z = 0; z < m_max_index_z; z++) {
-			m_data[x][z].resize(m_max_index_y);
-
-			int surfaces = 0;
-			for (int y = 0; y < m_max_index_y; y++) {
-				v3s16 ipos(x,y,z);
-
-				v3s16 realpos = getRealPos(ipos);
-
-				MapNode current = m_env->getMap().getNodeNoEx(realpos);
-				MapNode below   = m_env->getMap().getNodeNoEx(realpos + v3s16(0,-1,0));
-
-
-				if ((current.param0 == CONTENT_IGNORE) ||
-						(below.param0 == CONTENT_IGNORE)) {
-					DEBUG_OUT("Pathfinder: " << PPOS(realpos) <<
-							" current or below is invalid element" << std::endl);
-					if (current.param0 == CONTENT_IGNORE) {
-						m_data[x][z][y].type = 'i';
-						DEBUG_OUT(x << "," << y << "," << z << ": " << 'i' << std::endl);
-					}
-					continue;
-				}
+bool pathfinder::is_surface(v3s16 pos) {
+	if (!valid_pos(pos))
+		return false;
 
-				//don't add anything if it isn't an air node
-				if ((current.param0 != CONTENT_AIR) ||
-						(below.param0 == CONTENT_AIR )) {
-						DEBUG_OUT("Pathfinder: " << PPOS(realpos)
-								<< " not on surface" << std::endl);
-						if (current.param0 != CONTENT_AIR) {
-							m_data[x][z][y].type = 's';
-							DEBUG_OUT(x << "," << y << "," << z << ": " << 's' << std::endl);
-						}
-						else {
-							m_data[x][z][y].type   = '-';
-							DEBUG_OUT(x << "," << y << "," << z << ": " << '-' << std::endl);
-						}
-						continue;
-				}
+	MapNode current = getNode(pos);
+	MapNode below   = getNode(pos + v3s16(0,-1,0));
 
-				surfaces++;
-
-				m_data[x][z][y].valid  = true;
-				m_data[x][z][y].pos    = realpos;
-				m_data[x][z][y].type   = 'g';
-				DEBUG_OUT(x << "," << y << "," << z << ": " << 'a' << std::endl);
-
-				if (m_prefetch) {
-				m_data[x][z][y].directions[DIR_XP] =
-											calc_cost(realpos,v3s16( 1,0, 0));
-				m_data[x][z][y].directions[DIR_XM] =
-											calc_cost(realpos,v3s16(-1,0, 0));
-				m_data[x][z][y].directions[DIR_ZP] =
-											calc_cost(realpos,v3s16( 0,0, 1));
-				m_data[x][z][y].directions[DIR_ZM] =
-											calc_cost(realpos,v3s16( 0,0,-1));
-				}
+	return (current.param0 == CONTENT_AIR) &&
+			(below.param0 != CONTENT_AIR) &&
+			(below.param0 != CONTENT_IGNORE);
+}
 
-			}
+/******************************************************************************/
+path_gridnode& pathfinder::getGridnode(v3s16 pos, u32 *index) {
+	*index = ((pos.X - m_limits.X.min) * m_max_index_z +
+			(pos.Z - m_limits.Z.min)) * m_max_index_y +
+			(pos.Y - m_limits.Y.min);
 
-			if (surfaces >= 1 ) {
-				for (int y = 0; y < m_max_index_y; y++) {
-					if (m_data[x][z][y].valid) {
-						m_data[x][z][y].surfaces = surfaces;
-					}
-				}
-			}
-		}
+	path_gridnode& g_pos = m_data[*index];
+	if (g_pos.search != m_search) {
+		g_pos = path_gridnode();
+		g_pos.search = m_search;
 	}
-	return true;
+	return g_pos;
+}
+
+/******************************************************************************/
+v3s16 pathfinder::getRealPos(u32 index) {
+	v3s16 retval;
+
+	retval.Y = index % m_max_index_y + m_limits.Y.min;
+	index /= m_max_index_y;
+	retval.Z = index % m_max_index_z + m_limits.Z.min;
+	retval.X = index / m_max_index_z + m_limits.X.min;
+
+	return retval;
+}
+
+/******************************************************************************/
+bool pathfinder::valid_pos(v3s16 pos) {
+	return (pos.X >= m_limits.X.min) && (pos.X <= m_limits.X.max) &&
+			(pos.Y >= m_limits.Y.min) && (pos.Y <= m_limits.Y.max) &&
+			(pos.Z >= m_limits.Z.min) && (pos.Z <= m_limits.Z.max);
 }
 
 /******************************************************************************/
 path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 	path_cost retval;
 
-	retval.updated = true;
-
 	v3s16 pos2 = pos + dir;
 
 	//check limits
 	if (    (pos2.X < m_limits.X.min) ||
-			(pos2.X >= m_limits.X.max) ||
+			(pos2.X > m_limits.X.max) ||
 			(pos2.Z < m_limits.Z.min) ||
-			(pos2.Z >= m_limits.Z.max)) {
+			(pos2.Z > m_limits.Z.max)) {
 		DEBUG_OUT("Pathfinder: " << PPOS(pos2) <<
 				" no cost -> out of limits" << std::endl);
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_env->getMap().getNodeNoEx(pos2);
+	MapNode node_at_pos2 = getNode(pos2);
 
 	//did we get information about node?
 	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
@@ -489,8 +350,7 @@ path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 	}
 
 	if (node_at_pos2.param0 == CONTENT_AIR) {
-		MapNode node_below_pos2 =
-							m_env->getMap().getNodeNoEx(pos2 + v3s16(0,-1,0));
+		MapNode node_below_pos2 = getNode(pos2 + v3s16(0,-1,0));
 
 		//did we get information about node?
 		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
@@ -508,13 +368,13 @@ path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 		}
 		else {
 			v3s16 testpos = pos2 - v3s16(0,-1,0);
-			MapNode node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+			MapNode node_at_pos = getNode(testpos);
 
 			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
 					(node_at_pos.param0 == CONTENT_AIR) &&
 					(testpos.Y > m_limits.Y.min)) {
 				testpos += v3s16(0,-1,0);
-				node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+				node_at_pos = getNode(testpos);
 			}
 
 			//did we find surface?
@@ -529,10 +389,10 @@ path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 					DEBUG_OUT("Pathfinder cost below height found" << std::endl);
 				}
 				else {
-					INFO_TARGET << "Pathfinder:"
+					DEBUG_OUT("Pathfinder:"
 							" distance to surface below to big: "
 							<< (testpos.Y - pos2.Y) << " max: " << m_maxdrop
-							<< std::endl;
+							<< std::endl);
 				}
 			}
 			else {
@@ -542,13 +402,13 @@ path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 	}
 	else {
 		v3s16 testpos = pos2;
-		MapNode node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+		MapNode node_at_pos = getNode(testpos);
 
 		while ((node_at_pos.param0 != CONTENT_IGNORE) &&
 				(node_at_pos.param0 != CONTENT_AIR) &&
 				(testpos.Y < m_limits.Y.max)) {
 			testpos += v3s16(0,1,0);
-			node_at_pos = m_env->getMap().getNodeNoEx(testpos);
+			node_at_pos = getNode(testpos);
 		}
 
 		//did we find surface?
@@ -574,135 +434,6 @@ path_cost pathfinder::calc_cost(v3s16 pos,v3s16 dir) {
 	return retval;
 }
 
-/******************************************************************************/
-v3s16 pathfinder::getIndexPos(v3s16 pos) {
-
-	v3s16 retval = pos;
-	retval.X -= m_limits.X.min;
-	retval.Y -= m_limits.Y.min;
-	retval.Z -= m_limits.Z.min;
-
-	return retval;
-}
-
-/******************************************************************************/
-path_gridnode& pathfinder::getIndexElement(v3s16 ipos) {
-	return m_data[ipos.X][ipos.Z][ipos.Y];
-}
-
-/******************************************************************************/
-bool pathfinder::valid_index(v3s16 index) {
-	if (	(index.X < m_max_index_x) &&
-			(index.Y < m_max_index_y) &&
-			(index.Z < m_max_index_z) &&
-			(index.X >= 0) &&
-			(index.Y >= 0) &&
-			(index.Z >= 0))
-		return true;
-
-	return false;
-}
-
-/******************************************************************************/
-v3s16 pathfinder::invert(v3s16 pos) {
-	v3s16 retval = pos;
-
-	retval.X *=-1;
-	retval.Y *=-1;
-	retval.Z *=-1;
-
-	return retval;
-}
-
-/******************************************************************************/
-bool pathfinder::update_all_costs(	v3s16 ipos,
-									v3s16 srcdir,
-									int current_cost,
-									int level) {
-
-	path_gridnode& g_pos = getIndexElement(ipos);
-	g_pos.totalcost = current_cost;
-	g_pos.sourcedir = srcdir;
-
-	level ++;
-
-	//check if target has been found
-	if (g_pos.target) {
-		m_min_target_distance = current_cost;
-		DEBUG_OUT(LVL " Pathfinder: target found!" << std::endl);
-		return true;
-	}
-
-	bool retval = false;
-
-	std::vector<v3s16> directions;
-
-	directions.push_back(v3s16( 1,0, 0));
-	directions.push_back(v3s16(-1,0, 0));
-	directions.push_back(v3s16( 0,0, 1));
-	directions.push_back(v3s16( 0,0,-1));
-
-	for (unsigned int i=0; i < directions.size(); i++) {
-		if (directions[i] != srcdir) {
-			path_cost cost = g_pos.get_cost(directions[i]);
-
-			if (cost.valid) {
-				directions[i].Y = cost.direction;
-
-				v3s16 ipos2 = ipos + directions[i];
-
-				if (!valid_index(ipos2)) {
-					DEBUG_OUT(LVL " Pathfinder: " << PPOS(ipos2) <<
-							" out of range (" << m_limits.X.max << "," <<
-							m_limits.Y.max << "," << m_limits.Z.max
-							<<")" << std::endl);
-					continue;
-				}
-
-				path_gridnode& g_pos2 = getIndexElement(ipos2);
-
-				if (!g_pos2.valid) {
-					VERBOSE_TARGET << LVL "Pathfinder: no data for new position: "
-												<< PPOS(ipos2) << std::endl;
-					continue;
-				}
-
-				assert(cost.value > 0);
-
-				int new_cost = current_cost + cost.value;
-
-				// check if there already is a smaller path
-				if ((m_min_target_distance > 0) &&
-						(m_min_target_distance < new_cost)) {
-					return false;
-				}
-
-				if ((g_pos2.totalcost < 0) ||
-						(g_pos2.totalcost > new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder: updating path at: "<<
-							PPOS(ipos2) << " from: " << g_pos2.totalcost << " to "<<
-							new_cost << std::endl);
-					if (update_all_costs(ipos2,invert(directions[i]),
-											new_cost,level)) {
-						retval = true;
-						}
-					}
-				else {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already found shorter path to: "
-							<< PPOS(ipos2) << std::endl);
-				}
-			}
-			else {
-				DEBUG_OUT(LVL "Pathfinder:"
-						" not moving to invalid direction: "
-						<< PPOS(directions[i]) << std::endl);
-			}
-		}
-	}
-	return retval;
-}
-
 /******************************************************************************/
 int pathfinder::get_manhattandistance(v3s16 pos) {
 
@@ -715,349 +446,198 @@ int pathfinder::get_manhattandistance(v3s16 pos) {
 }
 
 /******************************************************************************/
-v3s16 pathfinder::get_dir_heuristic(std::vector<v3s16>& directions,path_gridnode& g_pos) {
-	int   minscore = -1;
-	v3s16 retdir   = v3s16(0,0,0);
-	v3s16 srcpos = g_pos.pos;
-	DEBUG_OUT("Pathfinder: remaining dirs at beginning:"
-				<< directions.size() << std::endl);
+bool pathfinder::update_costs() {
+	static const v3s16 directions[4] = {
+		v3s16( 1,0, 0),
+		v3s16(-1,0, 0),
+		v3s16( 0,0, 1),
+		v3s16( 0,0,-1)
+	};
 
-	for (std::vector<v3s16>::iterator iter = directions.begin();
-			iter != directions.end();
-			++iter) {
+	while (!m_open.empty()) {
+		std::pop_heap(m_open.begin(), m_open.end());
+		path_openentry current = m_open.back();
+		m_open.pop_back();
 
-		v3s16 pos1 =  v3s16(srcpos.X + iter->X,0,srcpos.Z+iter->Z);
+		path_gridnode& g_pos = m_data[current.index];
 
-		int cur_manhattan = get_manhattandistance(pos1);
-		path_cost cost    = g_pos.get_cost(*iter);
-
-		if (!cost.updated) {
-			cost = calc_cost(g_pos.pos,*iter);
-			g_pos.set_cost(*iter,cost);
-		}
+		//skip entries superseded by a cheaper path to the same position
+		if (g_pos.closed || current.totalcost != g_pos.totalcost)
+			continue;
+		g_pos.closed = true;
 
-		if (cost.valid) {
-			int score = cost.value + cur_manhattan;
+		v3s16 pos = getRealPos(current.index);
 
-			if ((minscore < 0)|| (score < minscore)) {
-				minscore = score;
-				retdir = *iter;
-			}
+		//check if target has been found
+		if (pos == m_destination) {
+			DEBUG_OUT("Pathfinder: target found!" << std::endl);
+			return true;
 		}
-	}
 
-	if (retdir != v3s16(0,0,0)) {
-		for (std::vector<v3s16>::iterator iter = directions.begin();
-					iter != directions.end();
-					++iter) {
-			if(*iter == retdir) {
-				DEBUG_OUT("Pathfinder: removing return direction" << std::endl);
-				directions.erase(iter);
-				break;
-			}
-		}
-	}
-	else {
-		DEBUG_OUT("Pathfinder: didn't find any valid direction clearing"
-					<< std::endl);
-		directions.clear();
-	}
-	DEBUG_OUT("Pathfinder: remaining dirs at end:" << directions.size()
-				<< std::endl);
-	return retdir;
-}
-
-/******************************************************************************/
-bool pathfinder::update_cost_heuristic(	v3s16 ipos,
-									v3s16 srcdir,
-									int current_cost,
-									int level) {
-
-	path_gridnode& g_pos = getIndexElement(ipos);
-	g_pos.totalcost = current_cost;
-	g_pos.sourcedir = srcdir;
-
-	level ++;
-
-	//check if target has been found
-	if (g_pos.target) {
-		m_min_target_distance = current_cost;
-		DEBUG_OUT(LVL " Pathfinder: target found!" << std::endl);
-		return true;
-	}
-
-	bool retval = false;
-
-	std::vector<v3s16> directions;
-
-	directions.push_back(v3s16( 1,0, 0));
-	directions.push_back(v3s16(-1,0, 0));
-	directions.push_back(v3s16( 0,0, 1));
-	directions.push_back(v3s16( 0,0,-1));
+		for (unsigned int i = 0; i < 4; i++) {
+			path_cost cost = calc_cost(pos,directions[i]);
 
-	v3s16 direction = get_dir_heuristic(directions,g_pos);
+			if (!cost.valid)
+				continue;
 
-	while (direction != v3s16(0,0,0) && (!retval)) {
+			v3s16 dir = directions[i];
+			dir.Y = cost.direction;
+			v3s16 pos2 = pos + dir;
 
-		if (direction != srcdir) {
-			path_cost cost = g_pos.get_cost(direction);
-
-			if (cost.valid) {
-				direction.Y = cost.direction;
+			if (!valid_pos(pos2)) {
+				DEBUG_OUT("Pathfinder: " << PPOS(pos2) <<
+						" out of range" << std::endl);
+				continue;
+			}
 
-				v3s16 ipos2 = ipos + direction;
+			assert(cost.value > 0);
 
-				if (!valid_index(ipos2)) {
-					DEBUG_OUT(LVL " Pathfinder: " << PPOS(ipos2) <<
-							" out of range (" << m_limits.X.max << "," <<
-							m_limits.Y.max << "," << m_limits.Z.max
-							<<")" << std::endl);
-					direction = get_dir_heuristic(directions,g_pos);
-					continue;
-				}
+			int new_cost = g_pos.totalcost + cost.value;
 
-				path_gridnode& g_pos2 = getIndexElement(ipos2);
+			u32 index2;
+			path_gridnode& g_pos2 = getGridnode(pos2, &index2);
 
-				if (!g_pos2.valid) {
-					VERBOSE_TARGET << LVL "Pathfinder: no data for new position: "
-												<< PPOS(ipos2) << std::endl;
-					direction = get_dir_heuristic(directions,g_pos);
-					continue;
-				}
+			if ((g_pos2.totalcost >= 0) && (g_pos2.totalcost <= new_cost))
+				continue;
 
-				assert(cost.value > 0);
+			DEBUG_OUT("Pathfinder: updating path at: "<<
+					PPOS(pos2) << " from: " << g_pos2.totalcost << " to "<<
+					new_cost << std::endl);
 
-				int new_cost = current_cost + cost.value;
+			g_pos2.totalcost = new_cost;
+			g_pos2.sourcedir = -dir;
 
-				// check if there already is a smaller path
-				if ((m_min_target_distance > 0) &&
-						(m_min_target_distance < new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already longer than best already found path "
-							<< PPOS(ipos2) << std::endl);
-					return false;
-				}
-
-				if ((g_pos2.totalcost < 0) ||
-						(g_pos2.totalcost > new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder: updating path at: "<<
-							PPOS(ipos2) << " from: " << g_pos2.totalcost << " to "<<
-							new_cost << " srcdir=" <<
-							PPOS(invert(direction))<< std::endl);
-					if (update_cost_heuristic(ipos2,invert(direction),
-											new_cost,level)) {
-						retval = true;
-						}
-					}
-				else {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already found shorter path to: "
-							<< PPOS(ipos2) << std::endl);
-				}
-			}
-			else {
-				DEBUG_OUT(LVL "Pathfinder:"
-						" not moving to invalid direction: "
-						<< PPOS(direction) << std::endl);
-			}
+			path_openentry entry;
+			entry.estimate  = new_cost +
+					(m_heuristic ? get_manhattandistance(pos2) : 0);
+			entry.totalcost = new_cost;
+			entry.index     = index2;
+			m_open.push_back(entry);
+			std::push_heap(m_open.begin(), m_open.end());
 		}
-		else {
-			DEBUG_OUT(LVL "Pathfinder:"
-							" skipping srcdir: "
-							<< PPOS(direction) << std::endl);
-		}
-		direction = get_dir_heuristic(directions,g_pos);
 	}
-	return retval;
+	return false;
 }
 
 /******************************************************************************/
-void pathfinder::build_path(std::vector<v3s16>& path,v3s16 pos, int level) {
-	level ++;
-	if (level > 700) {
-		ERROR_TARGET
-		<< LVL "Pathfinder: path is too long aborting" << std::endl;
-		return;
-	}
-
-	path_gridnode& g_pos = getIndexElement(pos);
-	if (!g_pos.valid) {
-		ERROR_TARGET
-		<< LVL "Pathfinder: invalid next pos detected aborting" << std::endl;
-		return;
-	}
-
-	g_pos.is_element = true;
+void pathfinder::build_path(std::vector<v3s16>& path) {
+	v3s16 pos = m_destination;
 
-	//check if source reached
-	if (g_pos.source) {
+	while (pos != m_start) {
 		path.push_back(pos);
-		return;
-	}
-
-	build_path(path,pos + g_pos.sourcedir,level);
-	path.push_back(pos);
-}
 
-/******************************************************************************/
-v3f pathfinder::tov3f(v3s16 pos) {
-	return v3f(BS*pos.X,BS*pos.Y,BS*pos.Z);
-}
-
-#ifdef PATHFINDER_DEBUG
+		u32 index;
+		path_gridnode& g_pos = getGridnode(pos, &index);
+		if (g_pos.totalcost < 0 || path.size() > m_data.size()) {
+			ERROR_TARGET << "Pathfinder: invalid next pos detected aborting"
+					<< std::endl;
+			path.clear();
+			return;
+		}
+		pos += g_pos.sourcedir;
+	}
+	path.push_back(m_start);
 
-/******************************************************************************/
-void pathfinder::print_cost() {
-	print_cost(DIR_XP);
-	print_cost(DIR_XM);
-	print_cost(DIR_ZP);
-	print_cost(DIR_ZM);
+	std::reverse(path.begin(), path.end());
 }
 
 /******************************************************************************/
-void pathfinder::print_ydir() {
-	print_ydir(DIR_XP);
-	print_ydir(DIR_XM);
-	print_ydir(DIR_ZP);
-	print_ydir(DIR_ZM);
+PathfinderThread::PathfinderThread() :
+	Thread("Pathfinder"),
+	m_next_id(1)
+{
 }
 
 /******************************************************************************/
-void pathfinder::print_cost(path_directions dir) {
-
-	std::cout << "Cost in direction: " << dir_to_name(dir) << std::endl;
-	std::cout << std::setfill('-') << std::setw(80) << "-" << std::endl;
-	std::cout << std::setfill(' ');
-	for (int y = 0; y < m_max_index_y; y++) {
+PathfinderThread::~PathfinderThread() {
+	stop();
+	// Wake the thread up in case it waits for jobs
+	m_jobs.push_back(NULL);
+	wait();
 
-		std::cout << "Level: " << y << std::endl;
-
-		std::cout << std::setw(4) << " " << "  ";
-		for (int x = 0; x < m_max_index_x; x++) {
-			std::cout << std::setw(4) << x;
+	while (!m_jobs.empty()) {
+		PathfinderJob *job = m_jobs.pop_frontNoEx();
+		if (job) {
+			delete job->vmanip;
+			delete job;
 		}
-		std::cout << std::endl;
-
-		for (int z = 0; z < m_max_index_z; z++) {
-			std::cout << std::setw(4) << z <<": ";
-			for (int x = 0; x < m_max_index_x; x++) {
-				if (m_data[x][z][y].directions[dir].valid)
-					std::cout << std::setw(4)
-						<< m_data[x][z][y].directions[dir].value;
-				else
-					std::cout << std::setw(4) << "-";
-				}
-			std::cout << std::endl;
-		}
-		std::cout << std::endl;
 	}
+	while (!m_results.empty())
+		delete m_results.pop_frontNoEx();
 }
 
 /******************************************************************************/
-void pathfinder::print_ydir(path_directions dir) {
-
-	std::cout << "Height difference in direction: " << dir_to_name(dir) << std::endl;
-	std::cout << std::setfill('-') << std::setw(80) << "-" << std::endl;
-	std::cout << std::setfill(' ');
-	for (int y = 0; y < m_max_index_y; y++) {
-
-		std::cout << "Level: " << y << std::endl;
-
-		std::cout << std::setw(4) << " " << "  ";
-		for (int x = 0; x < m_max_index_x; x++) {
-			std::cout << std::setw(4) << x;
-		}
-		std::cout << std::endl;
-
-		for (int z = 0; z < m_max_index_z; z++) {
-			std::cout << std::setw(4) << z <<": ";
-			for (int x = 0; x < m_max_index_x; x++) {
-				if (m_data[x][z][y].directions[dir].valid)
-					std::cout << std::setw(4)
-						<< m_data[x][z][y].directions[dir].direction;
-				else
-					std::cout << std::setw(4) << "-";
-				}
-			std::cout << std::endl;
-		}
-		std::cout << std::endl;
-	}
+u32 PathfinderThread::queueJob(ServerEnvironment* env,
+							v3s16 source,
+							v3s16 destination,
+							unsigned int searchdistance,
+							unsigned int max_jump,
+							unsigned int max_drop,
+							algorithm algo) {
+	ScopeProfiler sp(g_profiler, "pathfinder: copy area avg", SPT_AVG);
+
+	PathfinderJob *job = new PathfinderJob;
+	job->id             = m_next_id++;
+	job->source         = source;
+	job->destination    = destination;
+	job->searchdistance = searchdistance;
+	job->max_jump       = max_jump;
+	job->max_drop       = max_drop;
+	job->algo           = algo;
+
+	//copy the search area, including the nodes below and above it
+	v3s16 distance(searchdistance, searchdistance + 1, searchdistance);
+	v3s16 pmin(MYMIN(source.X, destination.X),
+			MYMIN(source.Y, destination.Y),
+			MYMIN(source.Z, destination.Z));
+	v3s16 pmax(MYMAX(source.X, destination.X),
+			MYMAX(source.Y, destination.Y),
+			MYMAX(source.Z, destination.Z));
+	MMVManip *vmanip = new MMVManip(&env->getMap());
+	vmanip->initialEmerge(getNodeBlockPos(pmin - distance),
+			getNodeBlockPos(pmax + distance), false);
+	job->vmanip = vmanip;
+
+	m_jobs.push_back(job);
+	return job->id;
+}
+
+/******************************************************************************/
+bool PathfinderThread::getResult(u32 *id, std::vector<v3s16> *path) {
+	if (m_results.empty())
+		return false;
+
+	PathfinderJob *job = m_results.pop_frontNoEx();
+	*id = job->id;
+	path->swap(job->path);
+	delete job;
+	return true;
 }
 
 /******************************************************************************/
-void pathfinder::print_type() {
-	std::cout << "Type of node:" << std::endl;
-	std::cout << std::setfill('-') << std::setw(80) << "-" << std::endl;
-	std::cout << std::setfill(' ');
-	for (int y = 0; y < m_max_index_y; y++) {
+void *PathfinderThread::run() {
+	DSTACK(__FUNCTION_NAME);
+	BEGIN_DEBUG_EXCEPTION_HANDLER
 
-		std::cout << "Level: " << y << std::endl;
+	while (!stopRequested()) {
+		PathfinderJob *job = m_jobs.pop_frontNoEx();
+		if (!job)
+			continue;
 
-		std::cout << std::setw(3) << " " << "  ";
-		for (int x = 0; x < m_max_index_x; x++) {
-			std::cout << std::setw(3) << x;
-		}
-		std::cout << std::endl;
+		job->path = m_pathfinder.get_Path(job->vmanip,
+				job->source, job->destination, job->searchdistance,
+				job->max_jump, job->max_drop, job->algo);
 
-		for (int z = 0; z < m_max_index_z; z++) {
-			std::cout << std::setw(3) << z <<": ";
-			for (int x = 0; x < m_max_index_x; x++) {
-				char toshow = m_data[x][z][y].type;
-				std::cout << std::setw(3) << toshow;
-			}
-			std::cout << std::endl;
-		}
-		std::cout << std::endl;
+		delete job->vmanip;
+		job->vmanip = NULL;
+		m_results.push_back(job);
 	}
-	std::cout << std::endl;
-}
-
-/******************************************************************************/
-void pathfinder::print_pathlen() {
-	std::cout << "Pathlen:" << std::endl;
-		std::cout << std::setfill('-') << std::setw(80) << "-" << std::endl;
-		std::cout << std::setfill(' ');
-		for (int y = 0; y < m_max_index_y; y++) {
-
-			std::cout << "Level: " << y << std::endl;
-
-			std::cout << std::setw(3) << " " << "  ";
-			for (int x = 0; x < m_max_index_x; x++) {
-				std::cout << std::setw(3) << x;
-			}
-			std::cout << std::endl;
 
-			for (int z = 0; z < m_max_index_z; z++) {
-				std::cout << std::setw(3) << z <<": ";
-				for (int x = 0; x < m_max_index_x; x++) {
-					std::cout << std::setw(3) << m_data[x][z][y].totalcost;
-				}
-				std::cout << std::endl;
-			}
-			std::cout << std::endl;
-		}
-		std::cout << std::endl;
+	END_DEBUG_EXCEPTION_HANDLER(errorstream)
+	return NULL;
 }
 
-/******************************************************************************/
-std::string pathfinder::dir_to_name(path_directions dir) {
-	switch (dir) {
-	case DIR_XP:
-		return "XP";
-		break;
-	case DIR_XM:
-		return "XM";
-		break;
-	case DIR_ZP:
-		return "ZP";
-		break;
-	case DIR_ZM:
-		return "ZM";
-		break;
-	default:
-		return "UKN";
-	}
-}
+#ifdef PATHFINDER_DEBUG
 
 /******************************************************************************/
 void pathfinder::print_path(std::vector<v3s16> path) {
@@ -26,6 +26,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <vector>
 
 #include "irr_v3d.h"
+#include "mapnode.h"
+#include "threading/thread.h"
+#include "util/container.h"
 
 
 /******************************************************************************/
@@ -33,6 +36,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /******************************************************************************/
 
 class ServerEnvironment;
+class Map;
+class MapBlock;
+class VoxelManipulator;
 
 /******************************************************************************/
 /* Typedefs and macros                                                        */
@@ -40,18 +46,11 @@ class ServerEnvironment;
 
 //#define PATHFINDER_DEBUG
 
-typedef enum {
-	DIR_XP,
-	DIR_XM,
-	DIR_ZP,
-	DIR_ZM
-} path_directions;
-
 /** List of supported algorithms */
 typedef enum {
 	DIJKSTRA,           /**< Dijkstra shortest path algorithm             */
 	A_PLAIN,            /**< A* algorithm using heuristics to find a path */
-	A_PLAIN_NP          /**< A* algorithm without prefetching of map data */
+	A_PLAIN_NP          /**< same as A_PLAIN, map data is always read lazily */
 } algorithm;
 
 /******************************************************************************/
@@ -74,61 +73,37 @@ class path_cost {
 	/** default constructor */
 	path_cost();
 
-	/** copy constructor */
-	path_cost(const path_cost& b);
-
-	/** assignment operator */
-	path_cost& operator= (const path_cost& b);
-
 	bool valid;              /**< movement is possible         */
 	int  value;              /**< cost of movement             */
 	int  direction;          /**< y-direction of movement      */
-	bool updated;            /**< this cost has ben calculated */
-
 };
 
 
-/** representation of a mapnode to be used for pathfinding */
-class path_gridnode {
-
-public:
+/**
+ * search state of a position of the search area, only meaningful if
+ * search matches the search currently running
+ */
+struct path_gridnode {
 	/** default constructor */
 	path_gridnode();
 
-	/** copy constructor */
-	path_gridnode(const path_gridnode& b);
-
-	/**
-	 * assignment operator
-	 * @param b node to copy
-	 */
-	path_gridnode& operator= (const path_gridnode& b);
-
-	/**
-	 * read cost in a specific direction
-	 * @param dir direction of cost to fetch
-	 */
-	path_cost get_cost(v3s16 dir);
-
-	/**
-	 * set cost value for movement
-	 * @param dir direction to set cost for
-	 * @cost cost to set
-	 */
-	void      set_cost(v3s16 dir,path_cost cost);
-
-	bool      valid;               /**< node is on surface                    */
-	bool      target;              /**< node is target position               */
-	bool      source;              /**< node is stating position              */
+	u32       search;              /**< search the data belongs to            */
 	int       totalcost;           /**< cost to move here from starting point */
 	v3s16     sourcedir;           /**< origin of movement for current cost   */
-	int       surfaces;            /**< number of surfaces with same x,z value*/
-	v3s16     pos;                 /**< real position of node                 */
-	path_cost directions[4];       /**< cost in different directions          */
+	bool      closed;              /**< cheapest path to here is known        */
+};
 
-	/* debug values */
-	bool      is_element;          /**< node is element of path detected      */
-	char      type;                /**< type of node                          */
+/** entry of the open list, ordered by estimated total cost */
+struct path_openentry {
+	int   estimate;                /**< cost so far plus heuristic            */
+	int   totalcost;               /**< cost when the entry was added         */
+	u32   index;                   /**< index of gridnode                     */
+
+	bool operator< (const path_openentry &b) const
+	{
+		// std::push_heap builds a max-heap, the cheapest entry has to be on top
+		return estimate > b.estimate;
+	}
 };
 
 /** class doing pathfinding */
@@ -158,6 +133,19 @@ class pathfinder {
 			unsigned int max_drop,
 			algorithm algo);
 
+	/**
+	 * path evaluation function working on a copy of the map
+	 * @param vmanip map data, positions it has no data for are unloaded
+	 * other parameters same as above
+	 */
+	std::vector<v3s16> get_Path(VoxelManipulator* vmanip,
+			v3s16 source,
+			v3s16 destination,
+			unsigned int searchdistance,
+			unsigned int max_jump,
+			unsigned int max_drop,
+			algorithm algo);
+
 private:
 	/** data struct for storing internal information */
 	struct limits {
@@ -174,47 +162,51 @@ class pathfinder {
 	/* helper functions */
 
 	/**
-	 * transform index pos to mappos
-	 * @param ipos a index position
-	 * @return map position
+	 * run search on the node source set up by get_Path
 	 */
-	v3s16          getRealPos(v3s16 ipos);
+	std::vector<v3s16> find_path(v3s16 source,
+			v3s16 destination,
+			unsigned int searchdistance,
+			unsigned int max_jump,
+			unsigned int max_drop,
+			algorithm algo);
 
 	/**
-	 * transform mappos to index pos
-	 * @param pos a real pos
-	 * @return index position
+	 * read a node from the map or map copy
+	 * @param pos real position of node
+	 * @return node, CONTENT_IGNORE if not loaded
 	 */
-	v3s16          getIndexPos(v3s16 pos);
+	MapNode        getNode(v3s16 pos);
 
 	/**
-	 * get gridnode at a specific index position
-	 * @param ipos index position
-	 * @return gridnode for index
+	 * check if a position can be stood on
+	 * @param pos real position
+	 * @return true/false
 	 */
-	path_gridnode& getIndexElement(v3s16 ipos);
+	bool           is_surface(v3s16 pos);
 
 	/**
-	 * invert a 3d position
-	 * @param pos 3d position
-	 * @return pos *-1
+	 * get gridnode at a real position, resetting it if left over from
+	 * an older search
+	 * @param pos real position within limits
+	 * @param index returns index of gridnode
+	 * @return gridnode for position
 	 */
-	v3s16          invert(v3s16 pos);
+	path_gridnode& getGridnode(v3s16 pos, u32 *index);
 
 	/**
-	 * check if a index is within current search area
-	 * @param index position to validate
+	 * check if a real position is within current search area
+	 * @param pos position to validate
 	 * @return true/false
 	 */
-	bool           valid_index(v3s16 index);
+	bool           valid_pos(v3s16 pos);
 
 	/**
-	 * translate position to float position
-	 * @param pos integer position
-	 * @return float position
+	 * translate gridnode index back to real position
+	 * @param index index of gridnode
+	 * @return real position
 	 */
-	v3f            tov3f(v3s16 pos);
-
+	v3s16          getRealPos(u32 index);
 
 	/* algorithm functions */
 
@@ -225,20 +217,6 @@ class pathfinder {
 	 */
 	int           get_manhattandistance(v3s16 pos);
 
-	/**
-	 * get best direction based uppon heuristics
-	 * @param directions list of unchecked directions
-	 * @param g_pos mapnode to start from
-	 * @return direction to check
-	 */
-	v3s16         get_dir_heuristic(std::vector<v3s16>& directions,path_gridnode& g_pos);
-
-	/**
-	 * build internal data representation of search area
-	 * @return true/false if costmap creation was successfull
-	 */
-	bool          build_costmap();
-
 	/**
 	 * calculate cost of movement
 	 * @param pos real world position to start movement
@@ -248,32 +226,16 @@ class pathfinder {
 	path_cost     calc_cost(v3s16 pos,v3s16 dir);
 
 	/**
-	 * recursive update whole search areas total cost information
-	 * @param ipos position to check next
-	 * @param srcdir positionc checked last time
-	 * @param total_cost cost of moving to ipos
-	 * @param level current recursion depth
-	 * @return true/false path to destination has been found
-	 */
-	bool          update_all_costs(v3s16 ipos,v3s16 srcdir,int total_cost,int level);
-
-	/**
-	 * recursive try to find a patrh to destionation
-	 * @param ipos position to check next
-	 * @param srcdir positionc checked last time
-	 * @param total_cost cost of moving to ipos
-	 * @param level current recursion depth
+	 * expand cheapest open positions until destination is reached
 	 * @return true/false path to destination has been found
 	 */
-	bool          update_cost_heuristic(v3s16 ipos,v3s16 srcdir,int current_cost,int level);
+	bool          update_costs();
 
 	/**
-	 * recursive build a vector containing all nodes from source to destination
+	 * build a vector containing all nodes from source to destination
 	 * @param path vector to add nodes to
-	 * @param pos pos to check next
-	 * @param level recursion depth
 	 */
-	void          build_path(std::vector<v3s16>& path,v3s16 pos, int level);
+	void          build_path(std::vector<v3s16>& path);
 
 	/* variables */
 	int m_max_index_x;          /**< max index of search area in x direction  */
@@ -284,67 +246,90 @@ class pathfinder {
 	int m_searchdistance;       /**< max distance to search in each direction */
 	int m_maxdrop;              /**< maximum number of blocks a path may drop */
 	int m_maxjump;              /**< maximum number of blocks a path may jump */
-	int m_min_target_distance;  /**< current smalest path to target           */
 
-	bool m_prefetch;            /**< prefetch cost data                       */
+	bool m_heuristic;           /**< use heuristics (A*) or not (Dijkstra)    */
 
 	v3s16 m_start;              /**< source position                          */
 	v3s16 m_destination;        /**< destination position                     */
 
 	limits m_limits;            /**< position limits in real map coordinates  */
 
-	/** 3d grid containing all map data already collected and analyzed */
-	std::vector<std::vector<std::vector<path_gridnode> > > m_data;
-
-	ServerEnvironment* m_env;   /**< minetest environment pointer             */
-
-#ifdef PATHFINDER_DEBUG
-
 	/**
-	 * print collected cost information
+	 * search area, allocated lazily and kept for the next search;
+	 * gridnodes belong to the search numbered m_search only
 	 */
-	void print_cost();
+	std::vector<path_gridnode> m_data;
+	u32 m_search;
 
-	/**
-	 * print collected cost information in a specific direction
-	 * @param dir direction to print
-	 */
-	void print_cost(path_directions dir);
+	/** binary heap of positions to expand, kept for the next search */
+	std::vector<path_openentry> m_open;
 
-	/**
-	 * print type of node as evaluated
-	 */
-	void print_type();
-
-	/**
-	 * print pathlenght for all nodes in search area
-	 */
-	void print_pathlen();
+	Map* m_map;                 /**< map to read nodes from, or NULL          */
+	MapBlock* m_block;          /**< last MapBlock read from                  */
+	v3s16 m_blockpos;           /**< position of m_block                      */
+	VoxelManipulator* m_vmanip; /**< map copy to read nodes from, or NULL     */
 
+#ifdef PATHFINDER_DEBUG
 	/**
 	 * print a path
 	 * @param path path to show
 	 */
 	void print_path(std::vector<v3s16> path);
+#endif
+};
 
-	/**
-	 * print y direction for all movements
-	 */
-	void print_ydir();
+/** search to be done by the pathfinder thread */
+struct PathfinderJob {
+	u32 id;
+	v3s16 source;
+	v3s16 destination;
+	unsigned int searchdistance;
+	unsigned int max_jump;
+	unsigned int max_drop;
+	algorithm algo;
+	/** copy of the search area, owned by the job */
+	VoxelManipulator* vmanip;
+	/** result, empty if no path was found */
+	std::vector<v3s16> path;
+};
+
+/**
+ * Thread running searches for minetest.find_path_async. The search area
+ * is copied from the map when a search is queued, so searches neither
+ * stall the server step nor touch the map from another thread.
+ */
+class PathfinderThread : public Thread {
+public:
+	PathfinderThread();
+	~PathfinderThread();
 
 	/**
-	 * print y direction for moving in a specific direction
-	 * @param dir direction to show data
+	 * copy the search area from the map and queue a search
+	 * @return id the result is delivered with
 	 */
-	void print_ydir(path_directions dir);
+	u32 queueJob(ServerEnvironment* env,
+			v3s16 source,
+			v3s16 destination,
+			unsigned int searchdistance,
+			unsigned int max_jump,
+			unsigned int max_drop,
+			algorithm algo);
 
 	/**
-	 * helper function to translate a direction to speaking text
-	 * @param dir direction to translate
-	 * @return textual name of direction
+	 * fetch a finished search without waiting
+	 * @return false if no search has finished
 	 */
-	std::string dir_to_name(path_directions dir);
-#endif
+	bool getResult(u32 *id, std::vector<v3s16> *path);
+
+protected:
+	void *run();
+
+private:
+	MutexedQueue<PathfinderJob*> m_jobs;
+	MutexedQueue<PathfinderJob*> m_results;
+	u32 m_next_id;
+
+	pathfinder m_pathfinder;
 };
 
 #endif /* PATHFINDER_H_ */
@@ -284,7 +284,12 @@ void* AsyncWorkerThread::run()
 
 		int result = lua_pcall(L, 2, 1, error_handler);
 		if (result) {
-			PCALL_RES(result);
+			// Throwing here would end the worker thread and the server
+			// with it; the callback is still run, with nil as result
+			const char *err_descr = lua_tostring(L, -1);
+			errorstream << "Error in async job " << toProcess.id << ": "
+				<< (err_descr ? err_descr : "<no description>")
+				<< std::endl;
 			toProcess.serializedResult = "";
 		} else {
 			// Fetch result
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_base.h"
 #include "cpp_api/s_internal.h"
 #include "cpp_api/s_security.h"
+#include "cpp_api/s_profiler.h"
 #include "lua_api/l_object.h"
 #include "common/c_converter.h"
 #include "serverobject.h"
@@ -109,6 +110,7 @@ ScriptApiBase::ScriptApiBase()
 	// Default to false otherwise
 	m_secure = false;
 
+	m_profiler = NULL;
 	m_server = NULL;
 	m_environment = NULL;
 	m_guiengine = NULL;
@@ -117,6 +119,7 @@ ScriptApiBase::ScriptApiBase()
 ScriptApiBase::~ScriptApiBase()
 {
 	lua_close(m_luastack);
+	delete m_profiler;
 }
 
 bool ScriptApiBase::loadMod(const std::string &script_path,
@@ -240,6 +243,8 @@ void ScriptApiBase::stackDump(std::ostream &o)
 void ScriptApiBase::setOriginDirect(const char *origin)
 {
 	m_last_run_mod = origin ? origin : "??";
+	if (m_profiler)
+		m_profiler->setMod(m_last_run_mod);
 }
 
 void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
@@ -250,6 +255,8 @@ void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
 	m_last_run_mod = lua_istable(L, index) ?
 		getstringfield_default(L, index, "mod_origin", "") : "";
 	//printf(">>>> running %s for mod: %s\n", fxn, m_last_run_mod.c_str());
+	if (m_profiler)
+		m_profiler->setMod(m_last_run_mod);
 #endif
 }
 
@@ -57,6 +57,7 @@ class Server;
 class Environment;
 class GUIEngine;
 class ServerActiveObject;
+class ScriptProfiler;
 
 class ScriptApiBase {
 public:
@@ -80,6 +81,9 @@ class ScriptApiBase {
 	void setOriginDirect(const char *origin);
 	void setOriginFromTableRaw(int index, const char *fxn);
 
+	// NULL unless mod profiling is enabled
+	ScriptProfiler *getProfiler() { return m_profiler; }
+
 protected:
 	friend class LuaABM;
 	friend class InvRef;
@@ -110,6 +114,7 @@ class ScriptApiBase {
 	Mutex           m_luastackmutex;
 	std::string     m_last_run_mod;
 	bool            m_secure;
+	ScriptProfiler *m_profiler;
 #ifdef SCRIPTAPI_LOCK_DEBUG
 	bool            m_locked;
 #endif
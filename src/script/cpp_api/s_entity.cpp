@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_internal.h"
 #include "log.h"
 #include "object_properties.h"
+#include "content_sao.h"
 #include "common/c_converter.h"
 #include "common/c_content.h"
 
@@ -195,6 +196,31 @@ void ScriptApiEntity::luaentity_GetProperties(u16 id,
 	lua_pop(L, 1);
 }
 
+void ScriptApiEntity::luaentity_GetStepLOD(u16 id,
+		std::vector<StepLODTier> *tiers)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+
+	lua_getfield(L, -1, "step_lod");
+	if (!lua_istable(L, -1))
+		return;
+	int table = lua_gettop(L);
+	lua_pushnil(L);
+	while (lua_next(L, table)) {
+		// key at index -2 and value at index -1
+		if (lua_istable(L, -1)) {
+			StepLODTier tier;
+			tier.distance = getfloatfield_default(L, -1, "distance", 0);
+			tier.interval = getfloatfield_default(L, -1, "interval", 0);
+			tiers->push_back(tier);
+		}
+		lua_pop(L, 1);
+	}
+}
+
 void ScriptApiEntity::luaentity_Step(u16 id, float dtime)
 {
 	SCRIPTAPI_PRECHECKHEADER
@@ -288,3 +314,65 @@ void ScriptApiEntity::luaentity_Rightclick(u16 id,
 	lua_pop(L, 2); // Pop object and error handler
 }
 
+
+bool ScriptApiEntity::luaentity_HasLuaFunctionField(u16 id,
+		const char *field)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+	if (!lua_istable(L, -1))
+		return false;
+	lua_getfield(L, -1, field);
+	return lua_isfunction(L, -1) && !lua_iscfunction(L, -1);
+}
+
+std::string ScriptApiEntity::luaentity_GetStringField(u16 id,
+		const char *field)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+	if (!lua_istable(L, -1))
+		return "";
+	return getstringfield_default(L, -1, field, "");
+}
+
+void ScriptApiEntity::luaentity_SetStringField(u16 id, const char *field,
+		const std::string &value)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+	if (!lua_istable(L, -1))
+		return;
+	lua_pushlstring(L, value.c_str(), value.size());
+	lua_setfield(L, -2, field);
+}
+
+float ScriptApiEntity::luaentity_GetFloatField(u16 id, const char *field,
+		float default_value)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+	if (!lua_istable(L, -1))
+		return default_value;
+	return getfloatfield_default(L, -1, field, default_value);
+}
+
+void ScriptApiEntity::luaentity_SetFloatField(u16 id, const char *field,
+		float value)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.luaentities[id]
+	luaentity_get(L, id);
+	if (!lua_istable(L, -1))
+		return;
+	setfloatfield(L, -1, field, value);
+}
@@ -23,8 +23,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "cpp_api/s_base.h"
 #include "irr_v3d.h"
 
+#include <vector>
+
 struct ObjectProperties;
 struct ToolCapabilities;
+struct StepLODTier;
 
 class ScriptApiEntity
 		: virtual public ScriptApiBase
@@ -37,12 +40,24 @@ class ScriptApiEntity
 	std::string luaentity_GetStaticdata(u16 id);
 	void luaentity_GetProperties(u16 id,
 			ObjectProperties *prop);
+	void luaentity_GetStepLOD(u16 id, std::vector<StepLODTier> *tiers);
 	void luaentity_Step(u16 id, float dtime);
 	void luaentity_Punch(u16 id,
 			ServerActiveObject *puncher, float time_from_last_punch,
 			const ToolCapabilities *toolcap, v3f dir);
 	void luaentity_Rightclick(u16 id,
 			ServerActiveObject *clicker);
+
+	// Access to the fields of an entity, for entities partly implemented
+	// in C++
+	// Whether the field is a function written in Lua, not a C one
+	bool luaentity_HasLuaFunctionField(u16 id, const char *field);
+	std::string luaentity_GetStringField(u16 id, const char *field);
+	void luaentity_SetStringField(u16 id, const char *field,
+			const std::string &value);
+	float luaentity_GetFloatField(u16 id, const char *field,
+			float default_value);
+	void luaentity_SetFloatField(u16 id, const char *field, float value);
 };
 
 
@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "common/c_internal.h"
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_profiler.h"
 
 #ifdef SCRIPTAPI_LOCK_DEBUG
 #include "debug.h" // assert()
@@ -58,7 +59,9 @@ class LockChecker {
 		realityCheck();                                                        \
 		lua_State *L = getStack();                                             \
 		assert(lua_checkstack(L, 20));                                         \
-		StackUnroller stack_unroller(L);
+		StackUnroller stack_unroller(L);                                       \
+		ScriptCallProfiler call_profiler(m_profiler, __FUNCTION__,             \
+				m_last_run_mod);
 
 #endif /* S_INTERNAL_H_ */
 
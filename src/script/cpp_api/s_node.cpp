@@ -270,3 +270,25 @@ void ScriptApiNode::node_falling_update_single(v3s16 p)
 	PCALL_RES(lua_pcall(L, 1, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
+
+bool ScriptApiNode::node_falling_landed(v3s16 p, MapNode node)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	int error_handler = PUSH_ERROR_HANDLER(L);
+
+	INodeDefManager *ndef = getServer()->ndef();
+
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "falling_node_landed");
+	if (!lua_isfunction(L, -1))
+		return false;
+
+	push_v3s16(L, p);
+	pushnode(L, node, ndef);
+	lua_pushinteger(L, node.getLevel(ndef));
+	lua_setfield(L, -2, "level");
+	PCALL_RES(lua_pcall(L, 2, 0, error_handler));
+	lua_pop(L, 2);  // Pop core and error handler
+	return true;
+}
@@ -50,6 +50,8 @@ class ScriptApiNode
 			ServerActiveObject *sender);
 	void node_falling_update(v3s16 p);
 	void node_falling_update_single(v3s16 p);
+	// Returns false if there is no Lua handler for landing falling nodes
+	bool node_falling_landed(v3s16 p, MapNode node);
 public:
 	static struct EnumString es_DrawType[];
 	static struct EnumString es_ContentParamType[];
@@ -0,0 +1,274 @@
+/*
+Minetest
+Copyright (C) 2015 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "cpp_api/s_profiler.h"
+#include "porting.h"
+#include "profiler.h"
+#include <iomanip>
+
+// Address used as registry key for the profiler of a lua_State
+static char profiler_registry_key;
+
+ScriptProfiler::ScriptProfiler(bool detailed) :
+	m_detailed(detailed),
+	m_last_flush_us(porting::getTimeUs())
+{
+}
+
+ScriptProfiler::~ScriptProfiler()
+{
+}
+
+void ScriptProfiler::addModPath(const std::string &path,
+		const std::string &mod_name)
+{
+	// Sources of files loaded with luaL_loadfile are prefixed with '@'
+	m_mod_paths.push_back(std::make_pair("@" + path, mod_name));
+}
+
+void ScriptProfiler::startSampling(lua_State *L, int interval)
+{
+	if (interval <= 0)
+		return;
+
+	lua_pushlightuserdata(L, &profiler_registry_key);
+	lua_pushlightuserdata(L, this);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	lua_sethook(L, hook, LUA_MASKCOUNT, interval);
+}
+
+void ScriptProfiler::setEntry(Frame &frame, const std::string &mod)
+{
+	// No origin has been set yet, e.g. before the first callback ran
+	EntryKey key(mod.empty() ? "??" : mod, frame.type);
+
+	std::map<EntryKey, Entry>::iterator it = m_entries.find(key);
+	if (it == m_entries.end())
+		it = m_entries.insert(std::make_pair(key, Entry())).first;
+
+	frame.mod = &it->first.first;
+	frame.entry = &it->second;
+}
+
+void ScriptProfiler::charge(Frame &frame, u32 now)
+{
+	// Unsigned difference stays valid across a wraparound of getTimeUs()
+	u32 dtime = now - frame.start_us;
+	frame.entry->time_us += dtime;
+	frame.entry->pending_us += dtime;
+	frame.start_us = now;
+}
+
+void ScriptProfiler::enter(const char *type, const std::string &mod)
+{
+	u32 now = porting::getTimeUs();
+
+	// Pause the caller
+	if (!m_frames.empty())
+		charge(m_frames.back(), now);
+
+	Frame frame;
+	frame.type = type;
+	frame.start_us = now;
+	frame.counted = false;
+	setEntry(frame, mod);
+	m_frames.push_back(frame);
+}
+
+void ScriptProfiler::leave()
+{
+	if (m_frames.empty())
+		return;
+
+	u32 now = porting::getTimeUs();
+
+	Frame &frame = m_frames.back();
+	charge(frame, now);
+	if (!frame.counted)
+		frame.entry->calls++;
+	m_frames.pop_back();
+
+	if (m_frames.empty())
+		flush();
+	else
+		m_frames.back().start_us = now;
+}
+
+void ScriptProfiler::setMod(const std::string &mod)
+{
+	if (m_frames.empty())
+		return;
+
+	// Callbacks of several mods may run within one entry point, as with
+	// core.run_callbacks(); each of them counts as a call.
+	Frame &frame = m_frames.back();
+	charge(frame, porting::getTimeUs());
+	if (*frame.mod != mod)
+		setEntry(frame, mod);
+	frame.entry->calls++;
+	frame.counted = true;
+}
+
+void ScriptProfiler::hook(lua_State *L, lua_Debug *ar)
+{
+	lua_pushlightuserdata(L, &profiler_registry_key);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	ScriptProfiler *profiler = (ScriptProfiler *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+
+	if (profiler)
+		profiler->sample(L, ar);
+}
+
+void ScriptProfiler::sample(lua_State *L, lua_Debug *ar)
+{
+	if (m_frames.empty() || !lua_getinfo(L, "S", ar))
+		return;
+
+	Frame &frame = m_frames.back();
+
+	std::string source = ar->source ? ar->source : "";
+	std::map<std::string, std::string>::iterator it =
+		m_source_mods.find(source);
+	if (it == m_source_mods.end()) {
+		std::string mod;
+		for (size_t i = 0; i < m_mod_paths.size(); i++) {
+			const std::string &path = m_mod_paths[i].first;
+			// Prefer the longest matching path, so nested mods win
+			if (source.compare(0, path.size(), path) == 0 &&
+					path.size() > mod.size())
+				mod = m_mod_paths[i].second;
+		}
+		it = m_source_mods.insert(std::make_pair(source, mod)).first;
+	}
+
+	// Code outside of any mod directory (e.g. loadstring) is attributed
+	// to the mod running the callback
+	if (it->second.empty() || it->second == *frame.mod) {
+		frame.entry->samples++;
+		return;
+	}
+
+	std::map<EntryKey, Entry>::iterator entry = m_entries.find(
+		EntryKey(it->second, frame.type));
+	if (entry == m_entries.end())
+		entry = m_entries.insert(std::make_pair(
+			EntryKey(it->second, frame.type), Entry())).first;
+	entry->second.samples++;
+}
+
+void ScriptProfiler::flush(bool force)
+{
+	u32 now = porting::getTimeUs();
+	if (!force && now - m_last_flush_us < 1000000)
+		return;
+	m_last_flush_us = now;
+
+	std::map<std::string, float> mod_ms;
+	for (std::map<EntryKey, Entry>::iterator it = m_entries.begin();
+			it != m_entries.end(); ++it) {
+		Entry &entry = it->second;
+		if (entry.pending_us == 0)
+			continue;
+
+		float ms = entry.pending_us / 1000.0f;
+		entry.pending_us = 0;
+		mod_ms[it->first.first] += ms;
+		if (m_detailed)
+			g_profiler->add("Mod: " + it->first.first + " " +
+				it->first.second + " [ms]", ms);
+	}
+
+	for (std::map<std::string, float>::iterator it = mod_ms.begin();
+			it != mod_ms.end(); ++it)
+		g_profiler->add("Mod: " + it->first + " [ms]", it->second);
+}
+
+void ScriptProfiler::clear()
+{
+	// Running frames keep their attribution
+	std::vector<std::string> mods;
+	for (size_t i = 0; i < m_frames.size(); i++)
+		mods.push_back(*m_frames[i].mod);
+
+	m_entries.clear();
+	for (size_t i = 0; i < m_frames.size(); i++)
+		setEntry(m_frames[i], mods[i]);
+}
+
+void ScriptProfiler::printText(std::ostream &os)
+{
+	std::map<std::string, Entry> mods;
+	Entry total;
+	for (std::map<EntryKey, Entry>::iterator it = m_entries.begin();
+			it != m_entries.end(); ++it) {
+		Entry &mod = mods[it->first.first];
+		mod.calls += it->second.calls;
+		mod.time_us += it->second.time_us;
+		mod.samples += it->second.samples;
+		total.time_us += it->second.time_us;
+		total.samples += it->second.samples;
+	}
+
+	os << std::setw(16) << "modname" << " | " << std::setw(25) << "type"
+		<< " | " << std::setw(10) << "calls" << " | " << std::setw(10) << "ms"
+		<< " | " << std::setw(5) << "%" << " | " << std::setw(8) << "samples"
+		<< std::endl;
+
+	for (std::map<std::string, Entry>::iterator it = mods.begin();
+			it != mods.end(); ++it) {
+		const Entry &mod = it->second;
+		os << std::setw(16) << it->first << " | " << std::setw(25) << ""
+			<< " | " << std::setw(10) << mod.calls << " | " << std::setw(10)
+			<< mod.time_us / 1000 << " | " << std::setw(5)
+			<< (total.time_us ? mod.time_us * 100 / total.time_us : 0)
+			<< " | " << std::setw(8) << mod.samples << std::endl;
+
+		if (!m_detailed)
+			continue;
+
+		for (std::map<EntryKey, Entry>::iterator e =
+				m_entries.lower_bound(EntryKey(it->first, ""));
+				e != m_entries.end() && e->first.first == it->first; ++e) {
+			os << std::setw(16) << "" << " | " << std::setw(25)
+				<< e->first.second << " | " << std::setw(10)
+				<< e->second.calls << " | " << std::setw(10)
+				<< e->second.time_us / 1000 << " | " << std::setw(5)
+				<< (total.time_us ? e->second.time_us * 100 / total.time_us : 0)
+				<< " | " << std::setw(8) << e->second.samples << std::endl;
+		}
+	}
+
+	os << std::setw(16) << "total" << " | " << std::setw(25) << ""
+		<< " | " << std::setw(10) << "" << " | " << std::setw(10)
+		<< total.time_us / 1000 << " | " << std::setw(5) << 100
+		<< " | " << std::setw(8) << total.samples << std::endl;
+}
+
+void ScriptProfiler::printCSV(std::ostream &os)
+{
+	os << "mod,type,calls,time_us,samples" << std::endl;
+	for (std::map<EntryKey, Entry>::iterator it = m_entries.begin();
+			it != m_entries.end(); ++it) {
+		os << it->first.first << "," << it->first.second << ","
+			<< it->second.calls << "," << it->second.time_us << ","
+			<< it->second.samples << std::endl;
+	}
+}
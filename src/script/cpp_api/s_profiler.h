@@ -0,0 +1,127 @@
+/*
+Minetest
+Copyright (C) 2015 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef S_PROFILER_H_
+#define S_PROFILER_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "irrlichttypes.h"
+
+extern "C" {
+#include <lua.h>
+}
+
+/*
+	Native mod profiler
+
+	Every entry point of the scripting API opens a call frame named after the
+	C++ function.  Time spent in a frame is charged to the mod that was last
+	set as origin (ScriptApiBase::setOriginDirect/setOriginFromTable), minus
+	the time spent in nested frames.  Optionally, a count hook samples the
+	running Lua function every sample_interval VM instructions and charges
+	the sample to the mod whose directory contains the function's source.
+*/
+class ScriptProfiler {
+public:
+	struct Entry {
+		Entry() : calls(0), time_us(0), samples(0), pending_us(0) {}
+
+		u32 calls;
+		u64 time_us;
+		u32 samples;
+		// Time not yet passed to g_profiler
+		u32 pending_us;
+	};
+
+	ScriptProfiler(bool detailed);
+	~ScriptProfiler();
+
+	// Sources below path are attributed to mod_name by the sampler
+	void addModPath(const std::string &path, const std::string &mod_name);
+	// Installs the sampling hook; interval is in Lua VM instructions
+	void startSampling(lua_State *L, int interval);
+
+	void enter(const char *type, const std::string &mod);
+	void leave();
+	void setMod(const std::string &mod);
+
+	// Sums timings into g_profiler, at most once per second
+	void flush(bool force = false);
+	void clear();
+
+	void printText(std::ostream &os);
+	void printCSV(std::ostream &os);
+
+private:
+	typedef std::pair<std::string, std::string> EntryKey;
+
+	struct Frame {
+		const char *type;
+		const std::string *mod;
+		Entry *entry;
+		u32 start_us;
+		bool counted;
+	};
+
+	// Points frame at the entry for (mod, frame.type)
+	void setEntry(Frame &frame, const std::string &mod);
+	void charge(Frame &frame, u32 now);
+	void sample(lua_State *L, lua_Debug *ar);
+
+	static void hook(lua_State *L, lua_Debug *ar);
+
+	bool m_detailed;
+
+	std::map<EntryKey, Entry> m_entries;
+	u32 m_last_flush_us;
+
+	std::vector<Frame> m_frames;
+
+	std::vector<std::pair<std::string, std::string> > m_mod_paths;
+	std::map<std::string, std::string> m_source_mods;
+};
+
+/*
+	Opens a profiler frame for the lifetime of the object.
+	Does nothing if profiling is disabled.
+*/
+class ScriptCallProfiler {
+public:
+	ScriptCallProfiler(ScriptProfiler *profiler, const char *type,
+			const std::string &mod) :
+		m_profiler(profiler)
+	{
+		if (m_profiler)
+			m_profiler->enter(type, mod);
+	}
+
+	~ScriptCallProfiler()
+	{
+		if (m_profiler)
+			m_profiler->leave();
+	}
+
+private:
+	ScriptProfiler *m_profiler;
+};
+
+#endif /* S_PROFILER_H_ */
@@ -22,11 +22,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "lua_api/l_nodemeta.h"
 #include "lua_api/l_nodetimer.h"
 #include "lua_api/l_noise.h"
+#include "lua_api/l_object.h"
 #include "lua_api/l_vmanip.h"
 #include "common/c_converter.h"
 #include "common/c_content.h"
+#include "cpp_api/s_profiler.h"
 #include "scripting_game.h"
 #include "environment.h"
+#include "falling_nodes.h"
 #include "server.h"
 #include "nodedef.h"
 #include "daynightratio.h"
@@ -51,6 +54,8 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 	lua_State *L = scriptIface->getStack();
 	sanity_check(lua_checkstack(L, 20));
 	StackUnroller stack_unroller(L);
+	ScriptCallProfiler call_profiler(scriptIface->m_profiler, "abm_trigger",
+			scriptIface->m_last_run_mod);
 
 	int error_handler = PUSH_ERROR_HANDLER(L);
 
@@ -174,6 +179,88 @@ int ModApiEnvMod::l_get_node_or_nil(lua_State *L)
 	return 1;
 }
 
+// Reads the coordinates of the *_node_raw functions, which take them as
+// separate numbers so that no position table has to be created
+static v3s16 read_raw_pos(lua_State *L, int index)
+{
+	return v3s16(
+		myround(luaL_checknumber(L, index)),
+		myround(luaL_checknumber(L, index + 1)),
+		myround(luaL_checknumber(L, index + 2)));
+}
+
+// Raises a Lua error for content IDs that no node was registered with
+static MapNode read_raw_node(lua_State *L, int index, INodeDefManager *ndef)
+{
+	int c = luaL_checkint(L, index);
+	if (c < 0 || c > 0xffff)
+		luaL_error(L, "content ID %d is out of range", c);
+
+	// IDs past the registered ones get the features of "unknown"
+	const ContentFeatures &f = ndef->get((content_t)c);
+	if (f.name.empty() ||
+			(c != CONTENT_UNKNOWN && &f == &ndef->get(CONTENT_UNKNOWN)))
+		luaL_error(L, "content ID %d is not registered", c);
+
+	return MapNode(c,
+		luaL_optint(L, index + 1, 0),
+		luaL_optint(L, index + 2, 0));
+}
+
+// get_node_raw(x, y, z)
+// Returns content_id, param1, param2, pos_ok
+int ModApiEnvMod::l_get_node_raw(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos = read_raw_pos(L, 1);
+	bool pos_ok;
+	MapNode n = env->getMap().getNodeNoEx(pos, &pos_ok);
+
+	lua_pushinteger(L, n.getContent());
+	lua_pushinteger(L, n.getParam1());
+	lua_pushinteger(L, n.getParam2());
+	lua_pushboolean(L, pos_ok);
+	return 4;
+}
+
+// set_node_raw(x, y, z, content_id, param1, param2)
+int ModApiEnvMod::l_set_node_raw(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos = read_raw_pos(L, 1);
+	MapNode n = read_raw_node(L, 4, env->getGameDef()->ndef());
+	lua_pushboolean(L, env->setNode(pos, n));
+	return 1;
+}
+
+// swap_node_raw(x, y, z, content_id, param1, param2)
+int ModApiEnvMod::l_swap_node_raw(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos = read_raw_pos(L, 1);
+	MapNode n = read_raw_node(L, 4, env->getGameDef()->ndef());
+	lua_pushboolean(L, env->swapNode(pos, n));
+	return 1;
+}
+
+// spawn_falling_node(pos, node)
+// The node has to be removed from the map by the caller. Falling nodes
+// stacked on it fall with it; returns the number of nodes falling.
+int ModApiEnvMod::l_spawn_falling_node(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = env->getGameDef()->ndef();
+	v3s16 pos = read_v3s16(L, 1);
+	MapNode n = readnode(L, 2, ndef);
+
+	lua_pushinteger(L, env->getFallingNodes()->spawn(pos, n));
+	return 1;
+}
+
 // get_node_light(pos, timeofday)
 // pos = {x=num, y=num, z=num}
 // timeofday: nil = current time, 0 = night, 0.5 = day
@@ -388,7 +475,7 @@ int ModApiEnvMod::l_add_entity(lua_State *L)
 	// content
 	const char *name = luaL_checkstring(L, 2);
 	// Do it
-	ServerActiveObject *obj = new LuaEntitySAO(env, pos, name, "");
+	ServerActiveObject *obj = LuaEntitySAO::createEntity(env, pos, name, "");
 	int objectid = env->addActiveObject(obj);
 	// If failed to add, return nothing (reads as nil)
 	if(objectid == 0)
@@ -428,6 +515,44 @@ int ModApiEnvMod::l_add_item(lua_State *L)
 	return 1;
 }
 
+// Gets the ItemSAO of a __builtin:item luaentity, NULL for other entities
+static ItemSAO *get_item_sao(lua_State *L, int index)
+{
+	luaL_checktype(L, index, LUA_TTABLE);
+	lua_getfield(L, index, "object");
+	ObjectRef *ref = ObjectRef::checkobject(L, -1);
+	lua_pop(L, 1);
+	return dynamic_cast<ItemSAO *>(ObjectRef::getobject(ref));
+}
+
+// item_entity_on_step(self, dtime)
+// The engine steps items on its own; this only makes it check the item
+// right away, for mods calling it from the on_step they replaced it with
+int ModApiEnvMod::l_item_entity_on_step(lua_State *L)
+{
+	ItemSAO *item = get_item_sao(L, 1);
+	if (!item)
+		return 0;
+
+	item->update();
+	setfloatfield(L, 1, "age", item->getAge());
+	return 0;
+}
+
+// item_entity_try_merge_with(self, own_stack, object, entity) -> bool
+// Merges the stack of self into the one of object; returns true if self
+// was used up and removed
+int ModApiEnvMod::l_item_entity_try_merge_with(lua_State *L)
+{
+	ItemSAO *item = get_item_sao(L, 1);
+	ObjectRef *ref = ObjectRef::checkobject(L, 3);
+	ItemSAO *other = dynamic_cast<ItemSAO *>(ObjectRef::getobject(ref));
+
+	lua_pushboolean(L, item && other && item != other &&
+		item->mergeInto(other));
+	return 1;
+}
+
 // get_player_by_name(name)
 int ModApiEnvMod::l_get_player_by_name(lua_State *L)
 {
@@ -552,45 +677,169 @@ int ModApiEnvMod::l_find_node_near(lua_State *L)
 	return 0;
 }
 
-// find_nodes_in_area(minp, maxp, nodenames) -> list of positions
-// nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
-int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
+// Reads a node name, group or list of them into a set of content ids
+static void read_content_filter(lua_State *L, int index,
+		INodeDefManager *ndef, std::set<content_t> &filter)
 {
-	GET_ENV_PTR;
-
-	INodeDefManager *ndef = getServer(L)->ndef();
-	v3s16 minp = read_v3s16(L, 1);
-	v3s16 maxp = read_v3s16(L, 2);
-	std::set<content_t> filter;
-	if(lua_istable(L, 3)) {
-		int table = 3;
+	if (lua_istable(L, index)) {
 		lua_pushnil(L);
-		while(lua_next(L, table) != 0) {
+		while (lua_next(L, index) != 0) {
 			// key at index -2 and value at index -1
 			luaL_checktype(L, -1, LUA_TSTRING);
 			ndef->getIds(lua_tostring(L, -1), filter);
 			// removes value, keeps key for next iteration
 			lua_pop(L, 1);
 		}
-	} else if(lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
+	} else if (lua_isstring(L, index)) {
+		ndef->getIds(lua_tostring(L, index), filter);
+	}
+}
+
+/*
+	Calls visitor(block, relpos, pos, c) for every node in the area whose
+	content is set in filter, until it returns false.  The area is walked
+	block by block: blocks that don't contain any of the wanted content are
+	skipped as a whole, and the nodes of the others are read directly.
+	Nodes of unloaded blocks are CONTENT_IGNORE, with block == NULL.
+	Returns false if the visitor stopped the search.
+*/
+template <typename Visitor>
+static bool find_nodes_by_block(Map &map, v3s16 minp, v3s16 maxp,
+		const std::vector<bool> &filter, Visitor &visitor)
+{
+	v3s16 bpmin = getNodeBlockPos(minp);
+	v3s16 bpmax = getNodeBlockPos(maxp);
+
+	v3s16 bp;
+	for (bp.Z = bpmin.Z; bp.Z <= bpmax.Z; bp.Z++)
+	for (bp.Y = bpmin.Y; bp.Y <= bpmax.Y; bp.Y++)
+	for (bp.X = bpmin.X; bp.X <= bpmax.X; bp.X++) {
+		MapBlock *block = map.getBlockNoCreateNoEx(bp);
+		if (block && block->isDummy())
+			block = NULL;
+
+		if (block) {
+			const std::vector<content_t> &contents = block->getContents();
+			bool wanted = false;
+			for (size_t i = 0; i < contents.size() && !wanted; i++)
+				wanted = filter[contents[i]];
+			if (!wanted)
+				continue;
+		} else if (!filter[CONTENT_IGNORE]) {
+			continue;
+		}
+
+		v3s16 base = bp * MAP_BLOCKSIZE;
+		v3s16 from(
+			MYMAX(minp.X, base.X) - base.X,
+			MYMAX(minp.Y, base.Y) - base.Y,
+			MYMAX(minp.Z, base.Z) - base.Z);
+		v3s16 to(
+			MYMIN(maxp.X, base.X + MAP_BLOCKSIZE - 1) - base.X,
+			MYMIN(maxp.Y, base.Y + MAP_BLOCKSIZE - 1) - base.Y,
+			MYMIN(maxp.Z, base.Z + MAP_BLOCKSIZE - 1) - base.Z);
+
+		bool valid;
+		v3s16 rel;
+		for (rel.Z = from.Z; rel.Z <= to.Z; rel.Z++)
+		for (rel.Y = from.Y; rel.Y <= to.Y; rel.Y++)
+		for (rel.X = from.X; rel.X <= to.X; rel.X++) {
+			content_t c = block ?
+				block->getNodeNoCheck(rel, &valid).getContent() :
+				CONTENT_IGNORE;
+			if (filter[c] && !visitor(block, rel, base + rel, c))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Pushes the found positions to the table on top of the stack
+class FindNodesVisitor {
+public:
+	FindNodesVisitor(lua_State *L, u32 limit, std::vector<u32> &counts) :
+		m_L(L), m_limit(limit), m_found(0), m_counts(counts)
+	{}
+
+	bool operator()(MapBlock *block, v3s16 relpos, v3s16 p, content_t c)
+	{
+		push_v3s16(m_L, p);
+		lua_rawseti(m_L, -2, ++m_found);
+		m_counts[c]++;
+		return m_found != m_limit;
 	}
 
-	std::map<content_t, u16> individual_count;
+private:
+	lua_State *m_L;
+	u32 m_limit;
+	u32 m_found;
+	std::vector<u32> &m_counts;
+};
+
+// Like FindNodesVisitor, for nodes that have air above them
+class FindNodesUnderAirVisitor {
+public:
+	FindNodesUnderAirVisitor(lua_State *L, Map &map, u32 limit) :
+		m_L(L), m_map(map), m_limit(limit), m_found(0)
+	{}
+
+	bool operator()(MapBlock *block, v3s16 relpos, v3s16 p, content_t c)
+	{
+		if (c == CONTENT_AIR)
+			return true;
+
+		content_t above;
+		bool valid;
+		if (block && relpos.Y < MAP_BLOCKSIZE - 1)
+			above = block->getNodeNoCheck(relpos + v3s16(0, 1, 0),
+				&valid).getContent();
+		else
+			above = m_map.getNodeNoEx(p + v3s16(0, 1, 0)).getContent();
+		if (above != CONTENT_AIR)
+			return true;
+
+		push_v3s16(m_L, p);
+		lua_rawseti(m_L, -2, ++m_found);
+		return m_found != m_limit;
+	}
+
+private:
+	lua_State *m_L;
+	Map &m_map;
+	u32 m_limit;
+	u32 m_found;
+};
+
+// find_nodes_in_area(minp, maxp, nodenames, [limit]) -> list of positions
+// nodenames: eg. {"ignore", "group:tree"} or "default:dirt"
+// limit: stop after finding this many nodes; nil or 0 = no limit
+int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = getServer(L)->ndef();
+	v3s16 minp = read_v3s16(L, 1);
+	v3s16 maxp = read_v3s16(L, 2);
+	std::set<content_t> filter;
+	read_content_filter(L, 3, ndef, filter);
+	u32 limit = luaL_optinteger(L, 4, 0);
+
+	// One entry for every possible content_t value
+	std::vector<bool> filter_map(1 << 16, false);
+	content_t max_c = 0;
+	for (std::set<content_t>::iterator it = filter.begin();
+			it != filter.end(); ++it) {
+		filter_map[*it] = true;
+		max_c = MYMAX(max_c, *it);
+	}
+	std::vector<u32> individual_count(max_c + 1, 0);
 
 	lua_newtable(L);
-	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-		for (s16 y = minp.Y; y <= maxp.Y; y++)
-			for (s16 z = minp.Z; z <= maxp.Z; z++) {
-				v3s16 p(x, y, z);
-				content_t c = env->getMap().getNodeNoEx(p).getContent();
-				if (filter.count(c) != 0) {
-					push_v3s16(L, p);
-					lua_rawseti(L, -2, ++i);
-					individual_count[c]++;
-				}
+	if (!filter.empty()) {
+		FindNodesVisitor visitor(L, limit, individual_count);
+		find_nodes_by_block(env->getMap(), minp, maxp, filter_map, visitor);
 	}
+
 	lua_newtable(L);
 	for (std::set<content_t>::iterator it = filter.begin();
 			it != filter.end(); ++it) {
@@ -600,8 +849,10 @@ int ModApiEnvMod::l_find_nodes_in_area(lua_State *L)
 	return 2;
 }
 
-// find_nodes_in_area_under_air(minp, maxp, nodenames) -> list of positions
+// find_nodes_in_area_under_air(minp, maxp, nodenames, [limit])
+// -> list of positions
 // nodenames: e.g. {"ignore", "group:tree"} or "default:dirt"
+// limit: stop after finding this many nodes; nil or 0 = no limit
 int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 {
 	/* Note: A similar but generalized (and therefore slower) version of this
@@ -617,38 +868,19 @@ int ModApiEnvMod::l_find_nodes_in_area_under_air(lua_State *L)
 	v3s16 minp = read_v3s16(L, 1);
 	v3s16 maxp = read_v3s16(L, 2);
 	std::set<content_t> filter;
+	read_content_filter(L, 3, ndef, filter);
+	u32 limit = luaL_optinteger(L, 4, 0);
 
-	if (lua_istable(L, 3)) {
-		int table = 3;
-		lua_pushnil(L);
-		while(lua_next(L, table) != 0) {
-			// key at index -2 and value at index -1
-			luaL_checktype(L, -1, LUA_TSTRING);
-			ndef->getIds(lua_tostring(L, -1), filter);
-			// removes value, keeps key for next iteration
-			lua_pop(L, 1);
-		}
-	} else if (lua_isstring(L, 3)) {
-		ndef->getIds(lua_tostring(L, 3), filter);
-	}
+	// One entry for every possible content_t value
+	std::vector<bool> filter_map(1 << 16, false);
+	for (std::set<content_t>::iterator it = filter.begin();
+			it != filter.end(); ++it)
+		filter_map[*it] = true;
 
 	lua_newtable(L);
-	u64 i = 0;
-	for (s16 x = minp.X; x <= maxp.X; x++)
-	for (s16 z = minp.Z; z <= maxp.Z; z++) {
-		s16 y = minp.Y;
-		v3s16 p(x, y, z);
-		content_t c = env->getMap().getNodeNoEx(p).getContent();
-		for (; y <= maxp.Y; y++) {
-			v3s16 psurf(x, y + 1, z);
-			content_t csurf = env->getMap().getNodeNoEx(psurf).getContent();
-			if(c != CONTENT_AIR && csurf == CONTENT_AIR &&
-					filter.count(c) != 0) {
-				push_v3s16(L, v3s16(x, y, z));
-				lua_rawseti(L, -2, ++i);
-			}
-			c = csurf;
-		}
+	if (!filter.empty()) {
+		FindNodesUnderAirVisitor visitor(L, env->getMap(), limit);
+		find_nodes_by_block(env->getMap(), minp, maxp, filter_map, visitor);
 	}
 	return 1;
 }
@@ -751,6 +983,44 @@ int ModApiEnvMod::l_line_of_sight(lua_State *L)
 	return 1;
 }
 
+// raycast(pos1, pos2, objects, liquids) -> pointed_thing or nil
+int ModApiEnvMod::l_raycast(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3f pos1 = checkFloatPos(L, 1);
+	v3f pos2 = checkFloatPos(L, 2);
+	bool objects = true;
+	if (!lua_isnoneornil(L, 3))
+		objects = lua_toboolean(L, 3);
+	bool liquids = false;
+	if (!lua_isnoneornil(L, 4))
+		liquids = lua_toboolean(L, 4);
+
+	PointedThing pointed = env->raycast(pos1, pos2, objects, liquids);
+	if (pointed.type == POINTEDTHING_NODE) {
+		lua_newtable(L);
+		lua_pushstring(L, "node");
+		lua_setfield(L, -2, "type");
+		push_v3s16(L, pointed.node_undersurface);
+		lua_setfield(L, -2, "under");
+		push_v3s16(L, pointed.node_abovesurface);
+		lua_setfield(L, -2, "above");
+		return 1;
+	}
+	if (pointed.type == POINTEDTHING_OBJECT) {
+		lua_newtable(L);
+		lua_pushstring(L, "object");
+		lua_setfield(L, -2, "type");
+		getScriptApiBase(L)->objectrefGetOrCreate(L,
+			env->getActiveObject(pointed.object_id));
+		lua_setfield(L, -2, "ref");
+		return 1;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
 // delete_area(p1, p2)
 // delete mapblocks in area p1..p2
 int ModApiEnvMod::l_delete_area(lua_State *L)
@@ -784,6 +1054,35 @@ int ModApiEnvMod::l_delete_area(lua_State *L)
 	return 1;
 }
 
+static algorithm read_path_algorithm(lua_State *L, int index)
+{
+	algorithm algo = A_PLAIN_NP;
+	if (!lua_isnil(L, index)) {
+		std::string algorithm = luaL_checkstring(L, index);
+
+		if (algorithm == "A*")
+			algo = A_PLAIN;
+
+		if (algorithm == "Dijkstra")
+			algo = DIJKSTRA;
+	}
+	return algo;
+}
+
+static void push_path(lua_State *L, const std::vector<v3s16> &path)
+{
+	lua_newtable(L);
+	int top = lua_gettop(L);
+	unsigned int index = 1;
+	for (std::vector<v3s16>::const_iterator i = path.begin(); i != path.end(); ++i)
+	{
+		lua_pushnumber(L,index);
+		push_v3s16(L, *i);
+		lua_settable(L, top);
+		index++;
+	}
+}
+
 // find_path(pos1, pos2, searchdistance,
 //     max_jump, max_drop, algorithm) -> table containing path
 int ModApiEnvMod::l_find_path(lua_State *L)
@@ -795,38 +1094,64 @@ int ModApiEnvMod::l_find_path(lua_State *L)
 	unsigned int searchdistance = luaL_checkint(L, 3);
 	unsigned int max_jump       = luaL_checkint(L, 4);
 	unsigned int max_drop       = luaL_checkint(L, 5);
-	algorithm algo              = A_PLAIN_NP;
-	if (!lua_isnil(L, 6)) {
-		std::string algorithm = luaL_checkstring(L,6);
-
-		if (algorithm == "A*")
-			algo = A_PLAIN;
-
-		if (algorithm == "Dijkstra")
-			algo = DIJKSTRA;
-	}
+	algorithm algo              = read_path_algorithm(L, 6);
 
 	std::vector<v3s16> path =
 			get_Path(env,pos1,pos2,searchdistance,max_jump,max_drop,algo);
 
 	if (path.size() > 0)
 	{
-		lua_newtable(L);
-		int top = lua_gettop(L);
-		unsigned int index = 1;
-		for (std::vector<v3s16>::iterator i = path.begin(); i != path.end();i++)
-		{
-			lua_pushnumber(L,index);
-			push_v3s16(L, *i);
-			lua_settable(L, top);
-			index++;
-		}
+		push_path(L, path);
 		return 1;
 	}
 
 	return 0;
 }
 
+// queue_path_search(pos1, pos2, searchdistance,
+//     max_jump, max_drop, algorithm) -> search id
+int ModApiEnvMod::l_queue_path_search(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	v3s16 pos1                  = read_v3s16(L, 1);
+	v3s16 pos2                  = read_v3s16(L, 2);
+	unsigned int searchdistance = luaL_checkint(L, 3);
+	unsigned int max_jump       = luaL_checkint(L, 4);
+	unsigned int max_drop       = luaL_checkint(L, 5);
+	algorithm algo              = read_path_algorithm(L, 6);
+
+	lua_pushinteger(L, env->getPathfinderThread()->queueJob(env,
+			pos1, pos2, searchdistance, max_jump, max_drop, algo));
+	return 1;
+}
+
+// get_finished_path_searches() -> {{id=, path=}, ...}
+int ModApiEnvMod::l_get_finished_path_searches(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	lua_newtable(L);
+	int top = lua_gettop(L);
+	unsigned int index = 1;
+
+	u32 id;
+	std::vector<v3s16> path;
+	PathfinderThread *thread = env->getPathfinderThread();
+	while (thread->getResult(&id, &path)) {
+		lua_newtable(L);
+		lua_pushinteger(L, id);
+		lua_setfield(L, -2, "id");
+		if (path.size() > 0) {
+			push_path(L, path);
+			lua_setfield(L, -2, "path");
+		}
+		lua_rawseti(L, top, index++);
+		path.clear();
+	}
+	return 1;
+}
+
 // spawn_tree(pos, treedef)
 int ModApiEnvMod::l_spawn_tree(lua_State *L)
 {
@@ -931,9 +1256,15 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(add_node);
 	API_FCT(swap_node);
 	API_FCT(add_item);
+	API_FCT(item_entity_on_step);
+	API_FCT(item_entity_try_merge_with);
 	API_FCT(remove_node);
 	API_FCT(get_node);
 	API_FCT(get_node_or_nil);
+	API_FCT(get_node_raw);
+	API_FCT(set_node_raw);
+	API_FCT(swap_node_raw);
+	API_FCT(spawn_falling_node);
 	API_FCT(get_node_light);
 	API_FCT(place_node);
 	API_FCT(dig_node);
@@ -961,7 +1292,10 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(clear_objects);
 	API_FCT(spawn_tree);
 	API_FCT(find_path);
+	API_FCT(queue_path_search);
+	API_FCT(get_finished_path_searches);
 	API_FCT(line_of_sight);
+	API_FCT(raycast);
 	API_FCT(transforming_liquid_add);
 	API_FCT(forceload_block);
 	API_FCT(forceload_free_block);
@@ -47,6 +47,18 @@ class ModApiEnvMod : public ModApiBase {
 	// pos = {x=num, y=num, z=num}
 	static int l_get_node_or_nil(lua_State *L);
 
+	// get_node_raw(x, y, z) -> content_id, param1, param2, pos_ok
+	static int l_get_node_raw(lua_State *L);
+
+	// set_node_raw(x, y, z, content_id, param1, param2)
+	static int l_set_node_raw(lua_State *L);
+
+	// swap_node_raw(x, y, z, content_id, param1, param2)
+	static int l_swap_node_raw(lua_State *L);
+
+	// spawn_falling_node(pos, node) -> height of the column
+	static int l_spawn_falling_node(lua_State *L);
+
 	// get_node_light(pos, timeofday)
 	// pos = {x=num, y=num, z=num}
 	// timeofday: nil = current time, 0 = night, 0.5 = day
@@ -97,6 +109,14 @@ class ModApiEnvMod : public ModApiBase {
 	// pos = {x=num, y=num, z=num}
 	static int l_add_item(lua_State *L);
 
+	// item_entity_on_step(self, dtime)
+	// on_step of __builtin:item
+	static int l_item_entity_on_step(lua_State *L);
+
+	// item_entity_try_merge_with(self, own_stack, object, entity) -> bool
+	// try_merge_with of __builtin:item
+	static int l_item_entity_try_merge_with(lua_State *L);
+
 	// get_player_by_name(name)
 	static int l_get_player_by_name(lua_State *L);
 
@@ -150,10 +170,20 @@ class ModApiEnvMod : public ModApiBase {
 	// line_of_sight(pos1, pos2, stepsize) -> true/false
 	static int l_line_of_sight(lua_State *L);
 
+	// raycast(pos1, pos2, objects, liquids) -> pointed_thing or nil
+	static int l_raycast(lua_State *L);
+
 	// find_path(pos1, pos2, searchdistance,
 	//     max_jump, max_drop, algorithm) -> table containing path
 	static int l_find_path(lua_State *L);
 
+	// queue_path_search(pos1, pos2, searchdistance,
+	//     max_jump, max_drop, algorithm) -> search id
+	static int l_queue_path_search(lua_State *L);
+
+	// get_finished_path_searches() -> {{id=, path=}, ...}
+	static int l_get_finished_path_searches(lua_State *L);
+
 	// transforming_liquid_add(pos)
 	static int l_transforming_liquid_add(lua_State *L);
 
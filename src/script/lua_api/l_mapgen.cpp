@@ -540,7 +540,9 @@ int ModApiMapgen::l_get_mapgen_object(lua_State *L)
 		std::map<std::string, std::vector<v3s16> >event_map;
 		std::map<std::string, std::vector<v3s16> >::iterator it;
 
-		mg->gennotify.getEvents(event_map);
+		// Leave the events to the on_generated callbacks of the game
+		// environment when called from a mapgen script
+		mg->gennotify.getEvents(event_map, getEnv(L) == NULL);
 
 		lua_newtable(L);
 		for (it = event_map.begin(); it != event_map.end(); ++it) {
@@ -1255,6 +1257,32 @@ int ModApiMapgen::l_serialize_schematic(lua_State *L)
 }
 
 
+// register_mapgen_script(path)
+int ModApiMapgen::l_register_mapgen_script(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	std::string path = luaL_checkstring(L, 1);
+	CHECK_SECURE_PATH_OPTIONAL(L, path.c_str());
+
+	EmergeManager *emerge = getServer(L)->getEmergeManager();
+	if (emerge->mapgen.size())
+		throw LuaError("register_mapgen_script() can only be called "
+			"while loading mods");
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, CUSTOM_RIDX_CURRENT_MOD_NAME);
+	const char *mod_name = lua_tostring(L, -1);
+
+	MapgenScriptSpec spec;
+	spec.mod_name = mod_name ? mod_name : "";
+	spec.path     = path;
+	emerge->mapgen_scripts.push_back(spec);
+
+	lua_pop(L, 1);
+	return 0;
+}
+
+
 void ModApiMapgen::Initialize(lua_State *L, int top)
 {
 	API_FCT(get_mapgen_object);
@@ -1281,4 +1309,16 @@ void ModApiMapgen::Initialize(lua_State *L, int top)
 	API_FCT(create_schematic);
 	API_FCT(place_schematic);
 	API_FCT(serialize_schematic);
+
+	API_FCT(register_mapgen_script);
+}
+
+
+void ModApiMapgen::InitializeMapgen(lua_State *L, int top)
+{
+	API_FCT(get_mapgen_object);
+	API_FCT(get_mapgen_params);
+
+	API_FCT(generate_ores);
+	API_FCT(generate_decorations);
 }
@@ -87,8 +87,12 @@ class ModApiMapgen : public ModApiBase {
 	// serialize_schematic(schematic, format, options={...})
 	static int l_serialize_schematic(lua_State *L);
 
+	// register_mapgen_script(path)
+	static int l_register_mapgen_script(lua_State *L);
+
 public:
 	static void Initialize(lua_State *L, int top);
+	static void InitializeMapgen(lua_State *L, int top);
 
 	static struct EnumString es_BiomeTerrainType[];
 	static struct EnumString es_DecorationType[];
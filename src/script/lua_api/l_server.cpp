@@ -22,6 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/c_converter.h"
 #include "common/c_content.h"
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_profiler.h"
+#include "scripting_game.h"
 #include "server.h"
 #include "environment.h"
 #include "player.h"
@@ -463,6 +465,38 @@ int ModApiServer::l_set_last_run_mod(lua_State *L)
 	return 0;
 }
 
+// get_mod_profile([format])
+// format is "text" (default) or "csv"; returns nil if mod profiling is off
+int ModApiServer::l_get_mod_profile(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ScriptProfiler *profiler = getScriptApiBase(L)->getProfiler();
+	if (!profiler)
+		return 0;
+
+	std::string format = luaL_optstring(L, 1, "text");
+	std::ostringstream os(std::ios_base::binary);
+	if (format == "csv")
+		profiler->printCSV(os);
+	else if (format == "text")
+		profiler->printText(os);
+	else
+		throw LuaError("get_mod_profile: unknown format \"" + format + "\"");
+
+	lua_pushstring(L, os.str().c_str());
+	return 1;
+}
+
+// clear_mod_profile()
+int ModApiServer::l_clear_mod_profile(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ScriptProfiler *profiler = getScriptApiBase(L)->getProfiler();
+	if (profiler)
+		profiler->clear();
+	return 0;
+}
+
 #ifndef NDEBUG
 // cause_error(type_of_error)
 int ModApiServer::l_cause_error(lua_State *L)
@@ -493,6 +527,31 @@ int ModApiServer::l_cause_error(lua_State *L)
 }
 #endif
 
+// do_async_callback(serialized_func, serialized_param) -> jobid
+int ModApiServer::l_do_async_callback(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	size_t func_length, param_length;
+	const char *serialized_func = luaL_checklstring(L, 1, &func_length);
+	const char *serialized_param = luaL_checklstring(L, 2, &param_length);
+
+	GameScripting *script = getScriptApi<GameScripting>(L);
+	lua_pushinteger(L, script->queueAsync(
+		std::string(serialized_func, func_length),
+		std::string(serialized_param, param_length)));
+	return 1;
+}
+
+// get_finished_jobs() -> {{jobid=, retval=}, ...}
+int ModApiServer::l_get_finished_jobs(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	getScriptApi<GameScripting>(L)->pushFinishedAsyncJobs(L);
+	return 1;
+}
+
 void ModApiServer::Initialize(lua_State *L, int top)
 {
 	API_FCT(request_shutdown);
@@ -522,7 +581,15 @@ void ModApiServer::Initialize(lua_State *L, int top)
 
 	API_FCT(get_last_run_mod);
 	API_FCT(set_last_run_mod);
+	API_FCT(get_mod_profile);
+	API_FCT(clear_mod_profile);
 #ifndef NDEBUG
 	API_FCT(cause_error);
 #endif
 }
+
+void ModApiServer::InitializeAsyncJobs(lua_State *L, int top)
+{
+	API_FCT(do_async_callback);
+	API_FCT(get_finished_jobs);
+}
@@ -94,13 +94,26 @@ class ModApiServer : public ModApiBase {
 	// set_last_run_mod(modname)
 	static int l_set_last_run_mod(lua_State *L);
 
+	// get_mod_profile([format])
+	static int l_get_mod_profile(lua_State *L);
+
+	// clear_mod_profile()
+	static int l_clear_mod_profile(lua_State *L);
+
 #ifndef NDEBUG
 	//  cause_error(type_of_error)
 	static int l_cause_error(lua_State *L);
 #endif
 
+	// do_async_callback(serialized_func, serialized_param) -> jobid
+	static int l_do_async_callback(lua_State *L);
+
+	// get_finished_jobs() -> {{jobid=, retval=}, ...}
+	static int l_get_finished_jobs(lua_State *L);
+
 public:
 	static void Initialize(lua_State *L, int top);
+	static void InitializeAsyncJobs(lua_State *L, int top);
 
 };
 
@@ -445,3 +445,21 @@ void ModApiUtil::InitializeAsync(AsyncEngine& engine)
 	ASYNC_API_FCT(get_dir_list);
 }
 
+void ModApiUtil::InitializeMapgen(lua_State *L, int top)
+{
+	API_FCT(debug);
+	API_FCT(log);
+
+	API_FCT(setting_get);
+	API_FCT(setting_getbool);
+
+	API_FCT(parse_json);
+	API_FCT(write_json);
+
+	API_FCT(is_yes);
+
+	API_FCT(get_builtin_path);
+
+	API_FCT(compress);
+	API_FCT(decompress);
+}
@@ -101,6 +101,8 @@ class ModApiUtil : public ModApiBase {
 
 	static void InitializeAsync(AsyncEngine& engine);
 
+	static void InitializeMapgen(lua_State *L, int top);
+
 };
 
 #endif /* L_UTIL_H_ */
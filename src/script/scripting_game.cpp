@@ -57,6 +57,9 @@ GameScripting::GameScripting(Server* server)
 		initializeSecurity();
 	}
 
+	if (g_settings->getBool("mod_profiling"))
+		initializeProfiler(L);
+
 	lua_getglobal(L, "core");
 	int top = lua_gettop(L);
 
@@ -77,6 +80,25 @@ GameScripting::GameScripting(Server* server)
 	infostream << "SCRIPTAPI: Initialized game modules" << std::endl;
 }
 
+void GameScripting::initializeProfiler(lua_State *L)
+{
+	m_profiler = new ScriptProfiler(g_settings->getBool("detailed_profiling"));
+
+	Server *server = getServer();
+	m_profiler->addModPath(server->getBuiltinLuaPath(), BUILTIN_MOD_NAME);
+
+	std::vector<std::string> modnames;
+	server->getModNames(modnames);
+	for (size_t i = 0; i < modnames.size(); i++) {
+		const ModSpec *spec = server->getModSpec(modnames[i]);
+		if (spec)
+			m_profiler->addModPath(spec->path, spec->name);
+	}
+
+	m_profiler->startSampling(L,
+		g_settings->getS32("mod_profiling_sample_interval"));
+}
+
 void GameScripting::InitializeModApi(lua_State *L, int top)
 {
 	// Initialize mod api modules
@@ -103,6 +125,31 @@ void GameScripting::InitializeModApi(lua_State *L, int top)
 	NodeTimerRef::Register(L);
 	ObjectRef::Register(L);
 	LuaSettings::Register(L);
+
+	// The async workers load bytecode dumped from the mod functions,
+	// which mod security prohibits
+	u16 num_async_threads = g_settings->getU16("num_async_threads");
+	if (num_async_threads == 0 || m_secure)
+		return;
+
+	ModApiServer::InitializeAsyncJobs(L, top);
+
+	// Register functions to async environment
+	ModApiUtil::InitializeAsync(asyncEngine);
+
+	// Initialize async environment
+	asyncEngine.initialize(num_async_threads);
+}
+
+unsigned int GameScripting::queueAsync(const std::string &serialized_func,
+	const std::string &serialized_param)
+{
+	return asyncEngine.queueAsyncJob(serialized_func, serialized_param);
+}
+
+void GameScripting::pushFinishedAsyncJobs(lua_State *L)
+{
+	asyncEngine.pushFinishedJobs(L);
 }
 
 void log_deprecated(const std::string &message)
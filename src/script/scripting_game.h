@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SCRIPTING_GAME_H_
 
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_async.h"
 #include "cpp_api/s_entity.h"
 #include "cpp_api/s_env.h"
 #include "cpp_api/s_inventory.h"
@@ -48,8 +49,18 @@ class GameScripting :
 
 	// use ScriptApiBase::loadMod() to load mods
 
+	// Pass async jobs from minetest.handle_async() to the worker threads
+	unsigned int queueAsync(const std::string &serialized_func,
+		const std::string &serialized_param);
+
+	// Push a table of the finished async jobs
+	void pushFinishedAsyncJobs(lua_State *L);
+
 private:
 	void InitializeModApi(lua_State *L, int top);
+	void initializeProfiler(lua_State *L);
+
+	AsyncEngine asyncEngine;
 };
 
 void log_deprecated(const std::string &message);
@@ -0,0 +1,96 @@
+/*
+Minetest
+Copyright (C) 2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "scripting_mapgen.h"
+#include "emerge.h"
+#include "server.h"
+#include "filesys.h"
+#include "log.h"
+#include "settings.h"
+#include "cpp_api/s_internal.h"
+#include "common/c_converter.h"
+#include "lua_api/l_item.h"
+#include "lua_api/l_mapgen.h"
+#include "lua_api/l_noise.h"
+#include "lua_api/l_util.h"
+#include "lua_api/l_vmanip.h"
+
+MapgenScripting::MapgenScripting(Server *server)
+{
+	setServer(server);
+
+	SCRIPTAPI_PRECHECKHEADER
+
+	if (g_settings->getBool("secure.enable_security")) {
+		initializeSecurity();
+	}
+
+	lua_getglobal(L, "core");
+	int top = lua_gettop(L);
+
+	InitializeModApi(L, top);
+	lua_pop(L, 1);
+
+	// Push builtin initialization type
+	lua_pushstring(L, "mapgen");
+	lua_setglobal(L, "INIT");
+}
+
+void MapgenScripting::InitializeModApi(lua_State *L, int top)
+{
+	ModApiItemMod::InitializeMapgen(L, top);
+	ModApiMapgen::InitializeMapgen(L, top);
+	ModApiUtil::InitializeMapgen(L, top);
+
+	LuaPerlinNoise::Register(L);
+	LuaPerlinNoiseMap::Register(L);
+	LuaPseudoRandom::Register(L);
+	LuaPcgRandom::Register(L);
+	LuaVoxelManip::Register(L);
+}
+
+bool MapgenScripting::loadScripts(const std::vector<MapgenScriptSpec> &scripts,
+	std::string *error)
+{
+	std::string builtin_path = getServer()->getBuiltinLuaPath() +
+		DIR_DELIM "init.lua";
+	if (!loadMod(builtin_path, BUILTIN_MOD_NAME, error))
+		return false;
+
+	for (size_t i = 0; i != scripts.size(); i++) {
+		if (!loadMod(scripts[i].path, scripts[i].mod_name, error))
+			return false;
+	}
+
+	return true;
+}
+
+void MapgenScripting::on_generated(v3s16 minp, v3s16 maxp, u32 blockseed)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.registered_on_generateds
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "registered_on_generateds");
+	// Call callbacks
+	push_v3s16(L, minp);
+	push_v3s16(L, maxp);
+	lua_pushnumber(L, blockseed);
+	runCallbacks(3, RUN_CALLBACKS_MODE_FIRST);
+}
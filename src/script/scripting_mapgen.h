@@ -0,0 +1,57 @@
+/*
+Minetest
+Copyright (C) 2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef SCRIPTING_MAPGEN_H_
+#define SCRIPTING_MAPGEN_H_
+
+#include <vector>
+#include "cpp_api/s_base.h"
+#include "cpp_api/s_security.h"
+#include "irr_v3d.h"
+
+struct MapgenScriptSpec;
+
+/*****************************************************************************/
+/* Scripting <-> Mapgen Interface                                            */
+/*****************************************************************************/
+
+/*
+	A Lua environment owned by a single EmergeThread.  It only has access to
+	the chunk being generated and read-only game data, so the mapgen scripts
+	can run in parallel and without holding the environment lock.
+*/
+class MapgenScripting :
+		virtual public ScriptApiBase,
+		public ScriptApiSecurity
+{
+public:
+	MapgenScripting(Server *server);
+
+	// Runs builtin and then the given scripts
+	bool loadScripts(const std::vector<MapgenScriptSpec> &scripts,
+		std::string *error=NULL);
+
+	// Called on the emerge thread before the chunk is written to the map
+	void on_generated(v3s16 minp, v3s16 maxp, u32 blockseed);
+
+private:
+	void InitializeModApi(lua_State *L, int top);
+};
+
+#endif /* SCRIPTING_MAPGEN_H_ */
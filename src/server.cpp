@@ -836,6 +836,9 @@ void Server::AsyncRunStep(bool initial_step)
 						k = list->begin(); k != list->end(); ++k) {
 					// Compose the full new data with header
 					ActiveObjectMessage aom = *k;
+					if (client->net_proto_version < aom.min_proto_version ||
+							client->net_proto_version > aom.max_proto_version)
+						continue;
 					std::string new_data;
 					// Add object id
 					char buf[2];
@@ -879,42 +882,51 @@ void Server::AsyncRunStep(bool initial_step)
 		// We will be accessing the environment
 		MutexAutoLock lock(m_env_mutex);
 
-		// Don't send too many at a time
-		//u32 count = 0;
-
-		// Single change sending is disabled if queue size is not small
-		bool disable_single_change_sending = false;
-		if(m_unsent_map_edit_queue.size() >= 4)
-			disable_single_change_sending = true;
-
 		int event_count = m_unsent_map_edit_queue.size();
 
 		// We'll log the amount of each
 		Profiler prof;
 
+		/*
+			Node changes are collected per block and sent together
+			after all events have been handled
+		*/
+		std::map<v3s16, NodeChangeBatch> node_changes;
+
 		while(m_unsent_map_edit_queue.size() != 0)
 		{
 			MapEditEvent* event = m_unsent_map_edit_queue.front();
 			m_unsent_map_edit_queue.pop();
 
-			// Players far away from the change are stored here.
-			// Instead of sending the changes, MapBlocks are set not sent
-			// for them.
-			std::vector<u16> far_players;
-
 			switch (event->type) {
 			case MEET_ADDNODE:
 			case MEET_SWAPNODE:
-				prof.add("MEET_ADDNODE", 1);
-				sendAddNode(event->p, event->n, event->already_known_by_peer,
-						&far_players, disable_single_change_sending ? 5 : 30,
-						event->type == MEET_ADDNODE);
-				break;
-			case MEET_REMOVENODE:
-				prof.add("MEET_REMOVENODE", 1);
-				sendRemoveNode(event->p, event->already_known_by_peer,
-						&far_players, disable_single_change_sending ? 5 : 30);
+			case MEET_REMOVENODE: {
+				if (event->type == MEET_REMOVENODE)
+					prof.add("MEET_REMOVENODE", 1);
+				else
+					prof.add("MEET_ADDNODE", 1);
+
+				v3s16 blockpos = getNodeBlockPos(event->p);
+				v3s16 relpos = event->p - blockpos * MAP_BLOCKSIZE;
+				NodeChangeBatch &batch = node_changes[blockpos];
+
+				NodeChangeBatch::Change change;
+				change.index = relpos.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+						relpos.Y * MAP_BLOCKSIZE + relpos.X;
+				change.flags = 0;
+				if (event->type == MEET_REMOVENODE)
+					change.flags |= NODE_CHANGE_REMOVE;
+				else if (event->type == MEET_SWAPNODE)
+					change.flags |= NODE_CHANGE_KEEP_METADATA;
+				change.n = event->n;
+				batch.changes.push_back(change);
+
+				batch.modified_blocks.insert(blockpos);
+				batch.modified_blocks.insert(event->modified_blocks.begin(),
+						event->modified_blocks.end());
 				break;
+			}
 			case MEET_BLOCK_NODE_METADATA_CHANGED:
 				infostream << "Server: MEET_BLOCK_NODE_METADATA_CHANGED" << std::endl;
 						prof.add("MEET_BLOCK_NODE_METADATA_CHANGED", 1);
@@ -936,34 +948,14 @@ void Server::AsyncRunStep(bool initial_step)
 				break;
 			}
 
-			/*
-				Set blocks not sent to far players
-			*/
-			if(!far_players.empty()) {
-				// Convert list format to that wanted by SetBlocksNotSent
-				std::map<v3s16, MapBlock*> modified_blocks2;
-				for(std::set<v3s16>::iterator
-						i = event->modified_blocks.begin();
-						i != event->modified_blocks.end(); ++i) {
-					modified_blocks2[*i] =
-							m_env->getMap().getBlockNoCreateNoEx(*i);
-				}
-
-				// Set blocks not sent
-				for(std::vector<u16>::iterator
-						i = far_players.begin();
-						i != far_players.end(); ++i) {
-					if(RemoteClient *client = getClient(*i))
-						client->SetBlocksNotSent(modified_blocks2);
-				}
-			}
-
 			delete event;
+		}
 
-			/*// Don't send too many at a time
-			count++;
-			if(count >= 1 && m_unsent_map_edit_queue.size() < 100)
-				break;*/
+		for(std::map<v3s16, NodeChangeBatch>::iterator
+				i = node_changes.begin();
+				i != node_changes.end(); ++i) {
+			// Players far away from the changes get the blocks resent
+			sendNodeChanges(i->first, i->second, 30);
 		}
 
 		if(event_count >= 5){
@@ -2031,79 +2023,87 @@ void Server::stopSound(s32 handle)
 	m_playing_sounds.erase(i);
 }
 
-void Server::sendRemoveNode(v3s16 p, u16 ignore_id,
-	std::vector<u16> *far_players, float far_d_nodes)
+void Server::sendNodeChanges(v3s16 blockpos, const NodeChangeBatch &batch,
+		float far_d_nodes)
 {
 	float maxd = far_d_nodes*BS;
-	v3f p_f = intToFloat(p, BS);
+	v3f blockpos_f = intToFloat(blockpos * MAP_BLOCKSIZE +
+			v3s16(1,1,1) * (MAP_BLOCKSIZE / 2), BS);
+	v3s16 blockpos_nodes = blockpos * MAP_BLOCKSIZE;
+	bool resend = batch.changes.size() >
+			g_settings->getU16("node_change_resend_threshold");
 
-	NetworkPacket pkt(TOCLIENT_REMOVENODE, 6);
-	pkt << p;
+	// Built for the first client that understands it
+	NetworkPacket pkt(TOCLIENT_NODES_CHANGED, 0);
 
 	std::vector<u16> clients = m_clients.getClientIDs();
+	m_clients.lock();
 	for(std::vector<u16>::iterator i = clients.begin();
-		i != clients.end(); ++i) {
-		if (far_players) {
-			// Get player
-			if(Player *player = m_env->getPlayer(*i)) {
-				// If player is far away, only set modified blocks not sent
-				v3f player_pos = player->getPosition();
-				if(player_pos.getDistanceFrom(p_f) > maxd) {
-					far_players->push_back(*i);
-					continue;
-				}
-			}
-		}
-
-		// Send as reliable
-		m_clients.send(*i, 0, &pkt, true);
-	}
-}
+			i != clients.end(); ++i) {
+		RemoteClient* client = m_clients.lockedGetClientNoEx(*i);
+		if (client == NULL)
+			continue;
 
-void Server::sendAddNode(v3s16 p, MapNode n, u16 ignore_id,
-		std::vector<u16> *far_players, float far_d_nodes,
-		bool remove_metadata)
-{
-	float maxd = far_d_nodes*BS;
-	v3f p_f = intToFloat(p, BS);
+		// If player is far away, only set modified blocks not sent
+		bool far = false;
+		if(Player *player = m_env->getPlayer(*i))
+			far = player->getPosition().getDistanceFrom(blockpos_f) > maxd;
 
-	std::vector<u16> clients = m_clients.getClientIDs();
-	for(std::vector<u16>::iterator i = clients.begin();
-			i != clients.end(); ++i) {
+		if (far || resend) {
+			for(std::set<v3s16>::const_iterator
+					j = batch.modified_blocks.begin();
+					j != batch.modified_blocks.end(); ++j)
+				client->SetBlockNotSent(*j);
+			continue;
+		}
 
-		if(far_players) {
-			// Get player
-			if(Player *player = m_env->getPlayer(*i)) {
-				// If player is far away, only set modified blocks not sent
-				v3f player_pos = player->getPosition();
-				if(player_pos.getDistanceFrom(p_f) > maxd) {
-					far_players->push_back(*i);
-					continue;
+		if (client->net_proto_version >= 27) {
+			if (pkt.getSize() == 0) {
+				pkt << blockpos << (u16)batch.changes.size();
+				for(std::vector<NodeChangeBatch::Change>::const_iterator
+						j = batch.changes.begin();
+						j != batch.changes.end(); ++j) {
+					pkt << j->index << j->flags;
+					if (!(j->flags & NODE_CHANGE_REMOVE))
+						pkt << j->n.param0 << j->n.param1 << j->n.param2;
 				}
 			}
+
+			// Send as reliable
+			m_clients.send(*i, 0, &pkt, true);
+			continue;
 		}
 
-		NetworkPacket pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
-		m_clients.lock();
-		RemoteClient* client = m_clients.lockedGetClientNoEx(*i);
-		if (client != 0) {
-			pkt << p << n.param0 << n.param1 << n.param2
+		// Older clients get one packet per node
+		for(std::vector<NodeChangeBatch::Change>::const_iterator
+				j = batch.changes.begin();
+				j != batch.changes.end(); ++j) {
+			v3s16 p = blockpos_nodes + v3s16(
+				j->index % MAP_BLOCKSIZE,
+				(j->index / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+				j->index / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+
+			if (j->flags & NODE_CHANGE_REMOVE) {
+				NetworkPacket legacy_pkt(TOCLIENT_REMOVENODE, 6);
+				legacy_pkt << p;
+				m_clients.send(*i, 0, &legacy_pkt, true);
+				continue;
+			}
+
+			bool remove_metadata = !(j->flags & NODE_CHANGE_KEEP_METADATA);
+			NetworkPacket legacy_pkt(TOCLIENT_ADDNODE, 6 + 2 + 1 + 1 + 1);
+			legacy_pkt << p << j->n.param0 << j->n.param1 << j->n.param2
 					<< (u8) (remove_metadata ? 0 : 1);
+			m_clients.send(*i, 0, &legacy_pkt, true);
 
-			if (!remove_metadata) {
-				if (client->net_proto_version <= 21) {
-					// Old clients always clear metadata; fix it
-					// by sending the full block again.
-					client->SetBlockNotSent(getNodeBlockPos(p));
-				}
+			if (!remove_metadata && client->net_proto_version <= 21) {
+				// Old clients always clear metadata; fix it
+				// by sending the full block again.
+				client->SetBlockNotSent(blockpos);
 			}
 		}
-		m_clients.unlock();
-
-		// Send as reliable
-		if (pkt.getSize() > 0)
-			m_clients.send(*i, 0, &pkt, true);
 	}
+	m_clients.unlock();
 }
 
 void Server::setBlockNotSent(v3s16 p)
@@ -2144,30 +2144,75 @@ void Server::SendBlocks(float dtime)
 {
 	DSTACK(__FUNCTION_NAME);
 
-	MutexAutoLock envlock(m_env_mutex);
-	//TODO check if one big lock could be faster then multiple small ones
-
 	ScopeProfiler sp(g_profiler, "Server: sel and send blocks to clients");
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
 	s32 total_sending = 0;
 
+	std::vector<u16> clients = m_clients.getClientIDs();
+	std::vector<std::vector<PrioritySortedBlockTransfer> > candidates(clients.size());
+	std::vector<s16> candidates_d_max(clients.size(), -1);
+
+	/*
+		Players can be moved by Lua in the emerge threads too, so where
+		they are is copied while the environment is locked.
+	*/
+	std::vector<PlayerViewpoint> views(clients.size());
+	std::vector<bool> have_view(clients.size(), false);
 	{
-		ScopeProfiler sp(g_profiler, "Server: selecting blocks for sending");
+		MutexAutoLock envlock(m_env_mutex);
+		for (u32 i = 0; i < clients.size(); i++) {
+			Player *player = m_env->getPlayer(clients[i]);
+			// This can happen sometimes; clients and players are not in perfect sync.
+			if (player == NULL)
+				continue;
 
-		std::vector<u16> clients = m_clients.getClientIDs();
+			views[i].position = player->getPosition();
+			views[i].speed = player->getSpeed();
+			views[i].eye_position = player->getEyePosition();
+			views[i].pitch = player->getPitch();
+			views[i].yaw = player->getYaw();
+			have_view[i] = true;
+		}
+	}
+
+	{
+		ScopeProfiler sp(g_profiler, "Server: finding blocks in sight");
 
+		/*
+			Walking the view cones doesn't need the map, so it is done
+			without the environment lock, leaving it to the emerge threads.
+		*/
 		m_clients.lock();
-		for(std::vector<u16>::iterator i = clients.begin();
-			i != clients.end(); ++i) {
-			RemoteClient *client = m_clients.lockedGetClientNoEx(*i, CS_Active);
+		for (u32 i = 0; i < clients.size(); i++) {
+			RemoteClient *client = m_clients.lockedGetClientNoEx(clients[i], CS_Active);
+
+			if (client == NULL)
+				continue;
+
+			candidates_d_max[i] = client->GetBlockCandidates(
+					have_view[i] ? &views[i] : NULL, dtime, candidates[i]);
+		}
+		m_clients.unlock();
+	}
+
+	MutexAutoLock envlock(m_env_mutex);
+	//TODO check if one big lock could be faster then multiple small ones
+
+	{
+		ScopeProfiler sp(g_profiler, "Server: selecting blocks for sending");
+
+		m_clients.lock();
+		for (u32 i = 0; i < clients.size(); i++) {
+			RemoteClient *client = m_clients.lockedGetClientNoEx(clients[i], CS_Active);
 
 			if (client == NULL)
 				continue;
 
 			total_sending += client->SendingCount();
-			client->GetNextBlocks(m_env,m_emerge, dtime, queue);
+			client->GetNextBlocks(m_env, m_emerge, candidates[i],
+					candidates_d_max[i], queue);
 		}
 		m_clients.unlock();
 	}
@@ -159,6 +159,21 @@ struct ServerPlayingSound
 	std::set<u16> clients; // peer ids
 };
 
+// Node changes of one MapBlock collected during a server step
+struct NodeChangeBatch
+{
+	struct Change
+	{
+		u16 index; // position within the block
+		u8 flags; // NODE_CHANGE_* flags
+		MapNode n;
+	};
+
+	std::vector<Change> changes;
+	// Blocks to resend when the changes are not sent one by one
+	std::set<v3s16> modified_blocks;
+};
+
 class Server : public con::PeerHandler, public MapEventReceiver,
 		public InventoryManager, public IGameDef
 {
@@ -414,16 +429,14 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void SendOverrideDayNightRatio(u16 peer_id, bool do_override, float ratio);
 
 	/*
-		Send a node removal/addition event to all clients except ignore_id.
-		Additionally, if far_players!=NULL, players further away than
-		far_d_nodes are ignored and their peer_ids are added to far_players
+		Send the node changes of a block to all clients.
+		Players further away than far_d_nodes, and all players if there
+		are more changes than node_change_resend_threshold, get the
+		modified blocks resent instead.
 	*/
-	// Envlock and conlock should be locked when calling these
-	void sendRemoveNode(v3s16 p, u16 ignore_id=0,
-			std::vector<u16> *far_players=NULL, float far_d_nodes=100);
-	void sendAddNode(v3s16 p, MapNode n, u16 ignore_id=0,
-			std::vector<u16> *far_players=NULL, float far_d_nodes=100,
-			bool remove_metadata=true);
+	// Envlock should be locked when calling this
+	void sendNodeChanges(v3s16 blockpos, const NodeChangeBatch &batch,
+			float far_d_nodes);
 	void setBlockNotSent(v3s16 p);
 
 	// Environment and Connection must be locked when called
@@ -312,7 +312,63 @@ void Address::print(std::ostream *s) const
 	UDPSocket
 */
 
-UDPSocket::UDPSocket(bool ipv6)
+// Datagrams per batched system call
+#define SOCKET_BATCH_SIZE 32
+// Batched I/O is only used for datagrams up to this size
+#define SOCKET_BATCH_PACKET_SIZE 1500
+
+struct UDPSocket::PacketBatch
+{
+#if USE_BATCHED_SOCKET_IO
+	PacketBatch():
+		count(0),
+		next(0)
+	{}
+
+	u8 data[SOCKET_BATCH_SIZE][SOCKET_BATCH_PACKET_SIZE];
+	struct iovec iov[SOCKET_BATCH_SIZE];
+	struct sockaddr_storage addresses[SOCKET_BATCH_SIZE];
+	struct mmsghdr msgs[SOCKET_BATCH_SIZE];
+	// Number of datagrams in the batch
+	unsigned int count;
+	// Next received datagram to return
+	unsigned int next;
+#endif
+};
+
+static socklen_t toSockAddr(const Address &addr, struct sockaddr_storage *dst)
+{
+	memset(dst, 0, sizeof(*dst));
+	if (addr.getFamily() == AF_INET6) {
+		struct sockaddr_in6 *address = (struct sockaddr_in6 *)dst;
+		*address = addr.getAddress6();
+		address->sin6_port = htons(addr.getPort());
+		return sizeof(struct sockaddr_in6);
+	} else {
+		struct sockaddr_in *address = (struct sockaddr_in *)dst;
+		*address = addr.getAddress();
+		address->sin_port = htons(addr.getPort());
+		return sizeof(struct sockaddr_in);
+	}
+}
+
+static Address fromSockAddr(const struct sockaddr_storage &src, int family)
+{
+	if (family == AF_INET6) {
+		const struct sockaddr_in6 *address = (const struct sockaddr_in6 *)&src;
+		IPv6AddressBytes bytes;
+		memcpy(bytes.bytes, address->sin6_addr.s6_addr, 16);
+		return Address(&bytes, ntohs(address->sin6_port));
+	} else {
+		const struct sockaddr_in *address = (const struct sockaddr_in *)&src;
+		return Address(ntohl(address->sin_addr.s_addr),
+				ntohs(address->sin_port));
+	}
+}
+
+UDPSocket::UDPSocket(bool ipv6):
+	m_recv_batch(NULL),
+	m_send_batch(NULL)
 {
 	init(ipv6, false);
 }
@@ -345,6 +401,13 @@ bool UDPSocket::init(bool ipv6, bool noExceptions)
 
 	setTimeoutMs(0);
 
+#if USE_BATCHED_SOCKET_IO
+	if (!m_recv_batch)
+		m_recv_batch = new PacketBatch();
+	if (!m_send_batch)
+		m_send_batch = new PacketBatch();
+#endif
+
 	return true;
 }
 
@@ -361,6 +424,9 @@ UDPSocket::~UDPSocket()
 #else
 	close(m_handle);
 #endif
+
+	delete m_recv_batch;
+	delete m_send_batch;
 }
 
 void UDPSocket::Bind(Address addr)
@@ -408,7 +474,8 @@ void UDPSocket::Bind(Address addr)
 	}
 }
 
-void UDPSocket::Send(const Address & destination, const void * data, int size)
+bool UDPSocket::dumpPacket(const Address & destination, const void * data,
+		int size)
 {
 	bool dumping_packet = false; // for INTERNET_SIMULATOR
 
@@ -443,67 +510,179 @@ void UDPSocket::Send(const Address & destination, const void * data, int size)
 		// Lol let's forget it
 		dstream << "UDPSocket::Send(): INTERNET_SIMULATOR: dumping packet."
 				<< std::endl;
-		return;
 	}
 
+	return dumping_packet;
+}
+
+void UDPSocket::Send(const Address & destination, const void * data, int size)
+{
+	if(dumpPacket(destination, data, size))
+		return;
+
 	if(destination.getFamily() != m_addr_family)
 		throw SendFailedException("Address family mismatch");
 
-	int sent;
-	if(m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address = destination.getAddress6();
-		address.sin6_port = htons(destination.getPort());
-		sent = sendto(m_handle, (const char *)data, size,
-				0, (struct sockaddr *)&address, sizeof(struct sockaddr_in6));
-	} else {
-		struct sockaddr_in address = destination.getAddress();
-		address.sin_port = htons(destination.getPort());
-		sent = sendto(m_handle, (const char *)data, size,
-				0, (struct sockaddr *)&address, sizeof(struct sockaddr_in));
-	}
+	struct sockaddr_storage address;
+	socklen_t address_len = toSockAddr(destination, &address);
+
+	int sent = sendto(m_handle, (const char *)data, size,
+			0, (struct sockaddr *)&address, address_len);
 
 	if(sent != size)
 		throw SendFailedException("Failed to send packet");
 }
 
+void UDPSocket::QueueSend(const Address & destination, const void * data,
+		int size)
+{
+#if USE_BATCHED_SOCKET_IO
+	PacketBatch *batch = m_send_batch;
+	if (batch && size <= SOCKET_BATCH_PACKET_SIZE) {
+		if(dumpPacket(destination, data, size))
+			return;
+
+		if(destination.getFamily() != m_addr_family)
+			throw SendFailedException("Address family mismatch");
+
+		// Make room, but don't lose this packet if sending the others fails
+		bool failed = false;
+		if (batch->count == SOCKET_BATCH_SIZE) {
+			try {
+				FlushSend();
+			} catch (SendFailedException &e) {
+				failed = true;
+			}
+		}
+
+		unsigned int i = batch->count++;
+		memcpy(batch->data[i], data, size);
+		batch->iov[i].iov_base = batch->data[i];
+		batch->iov[i].iov_len = size;
+
+		memset(&batch->msgs[i], 0, sizeof(batch->msgs[i]));
+		batch->msgs[i].msg_hdr.msg_name = &batch->addresses[i];
+		batch->msgs[i].msg_hdr.msg_namelen =
+				toSockAddr(destination, &batch->addresses[i]);
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+
+		if (failed)
+			throw SendFailedException("Failed to send packet");
+		return;
+	}
+#endif
+	Send(destination, data, size);
+}
+
+void UDPSocket::FlushSend()
+{
+#if USE_BATCHED_SOCKET_IO
+	PacketBatch *batch = m_send_batch;
+	if (!batch || batch->count == 0)
+		return;
+
+	bool failed = false;
+	bool unsupported = false;
+	unsigned int sent = 0;
+	while (sent < batch->count) {
+		if (unsupported) {
+			// Kernel without sendmmsg()
+			struct msghdr *hdr = &batch->msgs[sent].msg_hdr;
+			int size = hdr->msg_iov->iov_len;
+			if (sendto(m_handle, (const char *)hdr->msg_iov->iov_base, size,
+					0, (struct sockaddr *)hdr->msg_name,
+					hdr->msg_namelen) != size)
+				failed = true;
+			sent++;
+			continue;
+		}
+
+		int result = sendmmsg(m_handle, &batch->msgs[sent],
+				batch->count - sent, 0);
+		if (result > 0) {
+			sent += result;
+		} else if (result < 0 && errno == EINTR) {
+			continue;
+		} else if (result < 0 && errno == ENOSYS) {
+			unsupported = true;
+		} else {
+			// Skip the packet that could not be sent
+			failed = true;
+			sent++;
+		}
+	}
+	batch->count = 0;
+
+	if (unsupported) {
+		delete m_send_batch;
+		m_send_batch = NULL;
+	}
+
+	if (failed)
+		throw SendFailedException("Failed to send packet");
+#endif
+}
+
 int UDPSocket::Receive(Address & sender, void *data, int size)
 {
 	// Return on timeout
 	if(WaitData(m_timeout_ms) == false)
 		return -1;
 
-	int received;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address;
-		memset(&address, 0, sizeof(address));
-		socklen_t address_len = sizeof(address);
-
-		received = recvfrom(m_handle, (char *) data,
-				size, 0, (struct sockaddr *) &address, &address_len);
+	int received = -1;
+
+#if USE_BATCHED_SOCKET_IO
+	PacketBatch *batch = m_recv_batch;
+	if (batch && batch->next == batch->count &&
+			size <= SOCKET_BATCH_PACKET_SIZE) {
+		// Read all pending datagrams, up to the batch size
+		batch->count = 0;
+		batch->next = 0;
+		for (unsigned int i = 0; i < SOCKET_BATCH_SIZE; i++) {
+			batch->iov[i].iov_base = batch->data[i];
+			batch->iov[i].iov_len = SOCKET_BATCH_PACKET_SIZE;
+
+			memset(&batch->msgs[i], 0, sizeof(batch->msgs[i]));
+			batch->msgs[i].msg_hdr.msg_name = &batch->addresses[i];
+			batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addresses[i]);
+			batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+			batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 
-		if(received < 0)
+		int result = recvmmsg(m_handle, batch->msgs, SOCKET_BATCH_SIZE,
+				MSG_DONTWAIT, NULL);
+		if (result < 0 && errno == ENOSYS) {
+			// Kernel without recvmmsg()
+			delete m_recv_batch;
+			m_recv_batch = batch = NULL;
+		} else if (result < 0) {
 			return -1;
+		} else {
+			batch->count = result;
+		}
+	}
 
-		u16 address_port = ntohs(address.sin6_port);
-		IPv6AddressBytes bytes;
-		memcpy(bytes.bytes, address.sin6_addr.s6_addr, 16);
-		sender = Address(&bytes, address_port);
-	} else {
-		struct sockaddr_in address;
-		memset(&address, 0, sizeof(address));
+	if (batch && batch->next < batch->count) {
+		unsigned int i = batch->next++;
+		received = MYMIN((int)batch->msgs[i].msg_len, size);
+		memcpy(data, batch->data[i], received);
+		sender = fromSockAddr(batch->addresses[i], m_addr_family);
+	}
+#endif
 
+	if (received < 0) {
+		struct sockaddr_storage address;
+		memset(&address, 0, sizeof(address));
 		socklen_t address_len = sizeof(address);
 
-		received = recvfrom(m_handle, (char *)data,
-				size, 0, (struct sockaddr *)&address, &address_len);
+		received = recvfrom(m_handle, (char *) data,
+				size, 0, (struct sockaddr *) &address, &address_len);
 
 		if(received < 0)
 			return -1;
 
-		u32 address_ip = ntohl(address.sin_addr.s_addr);
-		u16 address_port = ntohs(address.sin_port);
-
-		sender = Address(address_ip, address_port);
+		sender = fromSockAddr(address, m_addr_family);
 	}
 
 	if (socket_enable_debug_output) {
@@ -541,6 +720,12 @@ void UDPSocket::setTimeoutMs(int timeout_ms)
 
 bool UDPSocket::WaitData(int timeout_ms)
 {
+#if USE_BATCHED_SOCKET_IO
+	// Datagrams left over from the last batch
+	if (m_recv_batch && m_recv_batch->next < m_recv_batch->count)
+		return true;
+#endif
+
 	fd_set readset;
 	int result;
 
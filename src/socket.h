@@ -40,6 +40,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes.h"
 #include "exceptions.h"
 
+// Read and write several datagrams per system call where possible
+#if defined(__linux__) && !defined(__ANDROID__) && defined(MSG_WAITFORONE)
+	#define USE_BATCHED_SOCKET_IO 1
+#else
+	#define USE_BATCHED_SOCKET_IO 0
+#endif
+
 extern bool socket_enable_debug_output;
 
 class SocketException : public BaseException
@@ -115,7 +122,7 @@ class Address
 class UDPSocket
 {
 public:
-	UDPSocket() { }
+	UDPSocket() : m_recv_batch(NULL), m_send_batch(NULL) { }
 	UDPSocket(bool ipv6);
 	~UDPSocket();
 	void Bind(Address addr);
@@ -125,6 +132,13 @@ class UDPSocket
 	//void Close();
 	//bool IsOpen();
 	void Send(const Address & destination, const void * data, int size);
+	/*
+		Like Send(), but the packet may be held back until FlushSend() so
+		that several packets go out in one system call.
+	*/
+	void QueueSend(const Address & destination, const void * data, int size);
+	// Throws SendFailedException if any of the queued packets failed
+	void FlushSend();
 	// Returns -1 if there is no data
 	int Receive(Address & sender, void * data, int size);
 	int GetHandle(); // For debugging purposes only
@@ -132,9 +146,17 @@ class UDPSocket
 	// Returns true if there is data, false if timeout occurred
 	bool WaitData(int timeout_ms);
 private:
+	// Prints debug output; returns true if the packet is to be dropped
+	bool dumpPacket(const Address & destination, const void * data, int size);
+
 	int m_handle;
 	int m_timeout_ms;
 	int m_addr_family;
+
+	// Preallocated datagram buffers for batched I/O, NULL if not used
+	struct PacketBatch;
+	PacketBatch *m_recv_batch;
+	PacketBatch *m_send_batch;
 };
 
 #endif
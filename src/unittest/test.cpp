@@ -18,12 +18,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "test.h"
+#include "testenvironment.h"
 
 #include "debug.h"
 #include "log.h"
 #include "nodedef.h"
 #include "itemdef.h"
 #include "gamedef.h"
+#include "mapblock.h"
+#include "mapsector.h"
 
 content_t t_CONTENT_STONE;
 content_t t_CONTENT_GRASS;
@@ -212,6 +215,31 @@ void TestGameDef::defineSomeNodes()
 	t_CONTENT_BRICK = ndef->set(f.name, f);
 }
 
+////
+//// TestEnvironment
+////
+
+TestEnvironment::TestEnvironment(IGameDef *gamedef) :
+	m_map(dstream, gamedef)
+{
+	MapSector *sector = new ServerMapSector(&m_map, v2s16(0, 0), gamedef);
+	(*m_map.getSectorsPtr())[v2s16(0, 0)] = sector;
+	m_block = sector->createBlankBlock(0);
+
+	v3s16 p;
+	for (p.Z = 0; p.Z < MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = 0; p.Y < MAP_BLOCKSIZE; p.Y++)
+	for (p.X = 0; p.X < MAP_BLOCKSIZE; p.X++) {
+		MapNode n(p.Y == 0 ? t_CONTENT_STONE : CONTENT_AIR);
+		m_block->setNodeNoCheck(p, n);
+	}
+}
+
+void TestEnvironment::setNode(v3s16 p, MapNode n)
+{
+	m_block->setNodeNoCheck(p, n);
+}
+
 ////
 //// run_tests
 ////
@@ -0,0 +1,98 @@
+/*
+Minetest
+Copyright (C) 2013 sapier, <sapier AT gmx DOT net>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "porting.h"
+#include "cpp_api/s_async.h"
+#include "lua_api/l_util.h"
+
+class TestAsyncEngine : public TestBase {
+public:
+	TestAsyncEngine() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestAsyncEngine"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFailingJob();
+};
+
+static TestAsyncEngine g_test_instance;
+
+void TestAsyncEngine::runTests(IGameDef *gamedef)
+{
+	TEST(testFailingJob);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Collects the results of finished jobs into results, by job id
+static void get_finished_test_jobs(AsyncEngine &engine, lua_State *L,
+		std::map<unsigned int, std::string> &results)
+{
+	engine.pushFinishedJobs(L);
+	for (int i = 1; ; i++) {
+		lua_rawgeti(L, -1, i);
+		if (lua_isnil(L, -1)) {
+			lua_pop(L, 1);
+			break;
+		}
+		lua_getfield(L, -1, "jobid");
+		lua_getfield(L, -2, "retval");
+		size_t length;
+		const char *retval = lua_tolstring(L, -1, &length);
+		results[lua_tointeger(L, -2)] = std::string(retval, length);
+		lua_pop(L, 3);
+	}
+	lua_pop(L, 1);
+}
+
+void TestAsyncEngine::testFailingJob()
+{
+	lua_State *L = luaL_newstate();
+	std::map<unsigned int, std::string> results;
+	unsigned int failing, working;
+
+	{
+		AsyncEngine engine;
+		ModApiUtil::InitializeAsync(engine);
+		engine.initialize(1);
+
+		// Jobs are run in order, so the second one only completes if the
+		// worker survived the first one
+		failing = engine.queueAsyncJob("error('test error')", "return nil");
+		working = engine.queueAsyncJob("return 2 * ...", "return 21");
+
+		for (int i = 0; i < 500 && results.size() < 2; i++) {
+			sleep_ms(10);
+			get_finished_test_jobs(engine, L, results);
+		}
+	}
+
+	lua_close(L);
+
+	UASSERTEQ(size_t, results.size(), 2);
+	UASSERT(results[failing].empty());
+	UASSERT(results[working] == "return 42");
+}
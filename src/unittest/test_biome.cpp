@@ -0,0 +1,126 @@
+/*
+Minetest
+Copyright (C) 2010-2015 kwolekr, Ryan Kwolek <kwolekr@minetest.net>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mg_biome.h"
+#include "noise.h"
+
+class TestBiome : public TestBase {
+public:
+	TestBiome() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestBiome"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBiomeLookup(IGameDef *gamedef);
+	void testBiomeLookupEmptyBands(IGameDef *gamedef);
+};
+
+static TestBiome g_test_instance;
+
+void TestBiome::runTests(IGameDef *gamedef)
+{
+	TEST(testBiomeLookup, gamedef);
+	TEST(testBiomeLookupEmptyBands, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static Biome *make_test_biome(const char *name, s16 y_min, s16 y_max,
+	float heat_point, float humidity_point)
+{
+	Biome *b = new Biome;
+	b->name           = name;
+	b->flags          = 0;
+	b->y_min          = y_min;
+	b->y_max          = y_max;
+	b->heat_point     = heat_point;
+	b->humidity_point = humidity_point;
+	return b;
+}
+
+
+void TestBiome::testBiomeLookup(IGameDef *gamedef)
+{
+	BiomeManager bmgr(gamedef);
+	PseudoRandom pr(1337);
+
+	for (u32 i = 0; i != 40; i++) {
+		s16 y_min = pr.range(-200, 100);
+		s16 y_max = y_min + pr.range(0, 300);
+		bmgr.add(make_test_biome("test", y_min, y_max,
+			pr.range(-20, 120), pr.range(-20, 120)));
+	}
+
+	// Duplicate points, so that ties must be broken the same way
+	bmgr.add(make_test_biome("twin_a", -50, 50, 50, 50));
+	bmgr.add(make_test_biome("twin_b", -50, 50, 50, 50));
+
+	const u32 nsamples = 20000;
+	float heat[nsamples];
+	float humidity[nsamples];
+	s16 height[nsamples];
+	u8 expected[nsamples];
+	u8 actual[nsamples];
+
+	for (u32 i = 0; i != nsamples; i++) {
+		heat[i]     = pr.range(-1000, 2000) / 10.f;
+		humidity[i] = pr.range(-1000, 2000) / 10.f;
+		height[i]   = pr.range(-300, 500);
+	}
+	heat[0]     = 50.f;
+	humidity[0] = 50.f;
+	height[0]   = 0;
+
+	// Before the lookup is built, biomes are searched for linearly
+	bmgr.calcBiomes(nsamples, 1, heat, humidity, height, expected);
+
+	bmgr.updateBiomeLookup();
+	bmgr.calcBiomes(nsamples, 1, heat, humidity, height, actual);
+
+	for (u32 i = 0; i != nsamples; i++) {
+		UASSERTEQ(u32, actual[i], expected[i]);
+		UASSERTEQ(u32, bmgr.getBiome(heat[i], humidity[i], height[i])->index,
+			expected[i]);
+	}
+
+	UASSERTEQ(std::string, bmgr.getRaw(expected[0])->name, "twin_a");
+}
+
+
+void TestBiome::testBiomeLookupEmptyBands(IGameDef *gamedef)
+{
+	BiomeManager bmgr(gamedef);
+
+	bmgr.add(make_test_biome("low", -100, -1, 50, 50));
+	bmgr.add(make_test_biome("high", 10, 100, 50, 50));
+	bmgr.updateBiomeLookup();
+
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, -50)->name, "low");
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, 5)->name, "Default");
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, 100)->name, "high");
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, 101)->name, "Default");
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, -32768)->name, "Default");
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, 32767)->name, "Default");
+
+	// Biomes added later are picked up even without rebuilding the lookup
+	bmgr.add(make_test_biome("middle", 0, 9, 50, 50));
+	UASSERTEQ(std::string, bmgr.getBiome(0, 0, 5)->name, "middle");
+}
@@ -18,8 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "test.h"
+#include "testenvironment.h"
 
 #include "collision.h"
+#include "gamedef.h"
+#include "nodedef.h"
 
 class TestCollision : public TestBase {
 public:
@@ -29,6 +32,23 @@ class TestCollision : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testAxisAlignedCollision();
+	void testCollisionBoxCache(IGameDef *gamedef);
+	void testMoveEntity(IGameDef *gamedef);
+	void testMovePlayer(IGameDef *gamedef);
+};
+
+/*
+	The test environment with a stone wall at x = 8, up to y = 2
+*/
+class CollisionTestEnvironment : public TestEnvironment {
+public:
+	CollisionTestEnvironment(IGameDef *gamedef) :
+		TestEnvironment(gamedef)
+	{
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 1; y <= 2; y++)
+			setNode(v3s16(8, y, z), MapNode(t_CONTENT_STONE));
+	}
 };
 
 static TestCollision g_test_instance;
@@ -36,6 +56,9 @@ static TestCollision g_test_instance;
 void TestCollision::runTests(IGameDef *gamedef)
 {
 	TEST(testAxisAlignedCollision);
+	TEST(testCollisionBoxCache, gamedef);
+	TEST(testMoveEntity, gamedef);
+	TEST(testMovePlayer, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -178,3 +201,101 @@ void TestCollision::testAxisAlignedCollision()
 		}
 	}
 }
+
+// Checks the cached boxes of every param2 against getCollisionBoxes()
+static void check_collision_box_cache(INodeDefManager *ndef, content_t c)
+{
+	const ContentFeatures &f = ndef->get(c);
+	u32 mask = f.collision_boxes_index.size() - 2;
+	for (u32 param2 = 0; param2 < 256; param2++) {
+		std::vector<aabb3f> boxes =
+			MapNode(c, 0, param2).getCollisionBoxes(ndef);
+		u32 begin = f.collision_boxes_index[param2 & mask];
+		UASSERTEQ(u32, f.collision_boxes_index[(param2 & mask) + 1] - begin,
+			boxes.size());
+		for (u32 i = 0; i < boxes.size(); i++)
+			UASSERT(f.collision_boxes_cache[begin + i] == boxes[i]);
+	}
+}
+
+void TestCollision::testCollisionBoxCache(IGameDef *gamedef)
+{
+	IWritableNodeDefManager *ndef =
+		(IWritableNodeDefManager *)gamedef->getNodeDefManager();
+
+	// Stairs, indexed by the 5 bits of param2 that hold the facedir
+	ContentFeatures f;
+	f.name = "test_collision:stair";
+	f.drawtype = NDT_NODEBOX;
+	f.param_type_2 = CPT2_FACEDIR;
+	f.node_box.type = NODEBOX_FIXED;
+	f.node_box.fixed.push_back(aabb3f(-BS/2, -BS/2, -BS/2, BS/2, 0, BS/2));
+	f.node_box.fixed.push_back(aabb3f(-BS/2, 0, 0, BS/2, BS/2, BS/2));
+	content_t c = ndef->set(f.name, f);
+	UASSERTEQ(size_t, ndef->get(c).collision_boxes_index.size(), 33);
+	check_collision_box_cache(ndef, c);
+
+	// A leveled slab, indexed by the level
+	f.name = "test_collision:slab";
+	f.param_type_2 = CPT2_LEVELED;
+	f.leveled = 16;
+	f.node_box.type = NODEBOX_LEVELED;
+	f.node_box.fixed.pop_back();
+	c = ndef->set(f.name, f);
+	UASSERTEQ(size_t, ndef->get(c).collision_boxes_index.size(),
+		LEVELED_MASK + 2);
+	check_collision_box_cache(ndef, c);
+
+	// Regular nodes have a single set of boxes
+	const ContentFeatures &stone = ndef->get(t_CONTENT_STONE);
+	UASSERTEQ(size_t, stone.collision_boxes_index.size(), 2);
+	UASSERTEQ(size_t, stone.collision_boxes_cache.size(), 1);
+
+	// Nothing for nodes that don't collide
+	UASSERT(ndef->get(CONTENT_AIR).collision_boxes_index.empty());
+}
+
+void TestCollision::testMoveEntity(IGameDef *gamedef)
+{
+	CollisionTestEnvironment env(gamedef);
+	aabb3f box(-0.3 * BS, -0.3 * BS, -0.3 * BS, 0.3 * BS, 0.3 * BS, 0.3 * BS);
+
+	// Drop an entity on the floor over and over
+	for (int i = 0; i < 50; i++) {
+		v3f pos(3 * BS, 5 * BS, 3 * BS);
+		v3f speed(0, 0, 0);
+		v3f accel(0, -10 * BS, 0);
+		collisionMoveResult result;
+		for (int j = 0; j < 200; j++)
+			result = collisionMoveSimple(&env, gamedef, BS * 0.25, box,
+				0, 0.05, pos, speed, accel, NULL, false);
+
+		UASSERT(result.touching_ground);
+		UASSERT(fabs(pos.Y - 0.8 * BS) < 0.01 * BS);
+		UASSERT(speed.Y == 0);
+	}
+}
+
+void TestCollision::testMovePlayer(IGameDef *gamedef)
+{
+	CollisionTestEnvironment env(gamedef);
+	aabb3f box(-0.3 * BS, 0, -0.3 * BS, 0.3 * BS, 1.75 * BS, 0.3 * BS);
+
+	// Walk into the wall over and over
+	for (int i = 0; i < 50; i++) {
+		v3f pos(3 * BS, 0.5 * BS, 3 * BS);
+		v3f speed(4 * BS, 0, 0);
+		v3f accel(0, -10 * BS, 0);
+		collisionMoveResult result;
+		for (int j = 0; j < 200; j++) {
+			speed.X = 4 * BS;
+			result = collisionMoveSimple(&env, gamedef, BS * 0.25, box,
+				0.6 * BS, 0.05, pos, speed, accel, NULL, false);
+		}
+
+		UASSERT(result.touching_ground);
+		UASSERT(result.collides_xz);
+		UASSERT(fabs(pos.X - 7.2 * BS) < 0.01 * BS);
+		UASSERT(fabs(pos.Y - 0.5 * BS) < 0.01 * BS);
+	}
+}
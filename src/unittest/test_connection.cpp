@@ -38,7 +38,12 @@ class TestConnection : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testHelpers();
+	void testReliablePacketBuffer();
+	void testIncomingSplitBuffer();
+	void testFarApartSeqnums();
 	void testConnectSendReceive();
+	void testShardedReceive();
+	void testBundleNegotiation();
 };
 
 static TestConnection g_test_instance;
@@ -46,7 +51,12 @@ static TestConnection g_test_instance;
 void TestConnection::runTests(IGameDef *gamedef)
 {
 	TEST(testHelpers);
+	TEST(testReliablePacketBuffer);
+	TEST(testIncomingSplitBuffer);
+	TEST(testFarApartSeqnums);
 	TEST(testConnectSendReceive);
+	TEST(testShardedReceive);
+	TEST(testBundleNegotiation);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -124,6 +134,186 @@ void TestConnection::testHelpers()
 	UASSERT(readU8(&p2[3]) == data1[0]);
 }
 
+static con::BufferedPacket makeTestReliable(Address &a, u16 seqnum, u8 value)
+{
+	SharedBuffer<u8> data(1);
+	data[0] = value;
+	SharedBuffer<u8> reliable = con::makeReliablePacket(data, seqnum);
+	return con::makePacket(a, reliable, 0x12345678, 123, 0);
+}
+
+void TestConnection::testReliablePacketBuffer()
+{
+	Address a(127, 0, 0, 1, 10);
+	con::ReliablePacketBuffer buf(RELIABLE_RECEIVE_WINDOW_SIZE);
+	// Window wrapping around the highest sequence number
+	const u16 next_expected = 65530;
+	const u16 seqnums[] = { 65533, 2, 65531, 0, 300, 65535 };
+
+	for (u32 i = 0; i < ARRLEN(seqnums); i++) {
+		con::BufferedPacket p = makeTestReliable(a, seqnums[i], i);
+		buf.insert(p, next_expected);
+	}
+	UASSERTEQ(u32, buf.size(), ARRLEN(seqnums));
+
+	// Resent packets are ignored
+	con::BufferedPacket dup = makeTestReliable(a, 2, 1);
+	buf.insert(dup, next_expected);
+	UASSERTEQ(u32, buf.size(), ARRLEN(seqnums));
+	UASSERT(buf.containsPacket(300));
+	UASSERT(!buf.containsPacket(301));
+
+	// Packets outside of the window are dropped
+	con::BufferedPacket outside = makeTestReliable(a, 40000, 0);
+	buf.insert(outside, next_expected);
+	UASSERTEQ(u32, buf.size(), ARRLEN(seqnums));
+
+	con::BufferedPacket p = buf.popSeqnum(0);
+	UASSERTEQ(u8, readU8(&p.data[BASE_HEADER_SIZE + 3]), 3);
+
+	// The rest comes out in sequence order
+	const u16 expected[] = { 65531, 65533, 65535, 2, 300 };
+	for (u32 i = 0; i < ARRLEN(expected); i++) {
+		u16 seqnum = 0;
+		UASSERT(buf.getFirstSeqnum(seqnum));
+		UASSERTEQ(u16, seqnum, expected[i]);
+		p = buf.popFirst();
+		UASSERTEQ(u16, readU16(&p.data[BASE_HEADER_SIZE + 1]), expected[i]);
+	}
+	UASSERT(buf.empty());
+
+	// Timeouts
+	for (u16 i = 0; i < 200; i++) {
+		con::BufferedPacket p = makeTestReliable(a, i, 0);
+		buf.insert(p, 65535);
+	}
+	buf.incrementTimeouts(1.0);
+	UASSERTEQ(size_t, buf.getTimedOuts(0.5, 10).size(), 10);
+	UASSERTEQ(size_t, buf.getTimedOuts(0.5, 1000).size(), 190);
+	UASSERTEQ(size_t, buf.getTimedOuts(0.5, 1000).size(), 0);
+}
+
+void TestConnection::testIncomingSplitBuffer()
+{
+	Address a(127, 0, 0, 1, 10);
+	con::IncomingSplitBuffer buf;
+
+	SharedBuffer<u8> data(100);
+	for (u32 i = 0; i < data.getSize(); i++)
+		data[i] = i;
+
+	std::list<SharedBuffer<u8> > chunks = con::makeSplitPacket(data, 32, 65535);
+	UASSERTEQ(size_t, chunks.size(), 4);
+
+	// Insert in reverse order, with a second split packet in between
+	SharedBuffer<u8> result;
+	for (std::list<SharedBuffer<u8> >::reverse_iterator i = chunks.rbegin();
+			i != chunks.rend(); ++i) {
+		UASSERTEQ(u32, result.getSize(), 0);
+		con::BufferedPacket p = con::makePacket(a, *i, 0x12345678, 123, 0);
+		result = buf.insert(p, true);
+
+		std::list<SharedBuffer<u8> > other =
+				con::makeSplitPacket(data, 32, 2);
+		con::BufferedPacket q = con::makePacket(a, other.front(),
+				0x12345678, 123, 0);
+		buf.insert(q, false);
+	}
+	UASSERTEQ(u32, result.getSize(), data.getSize());
+	UASSERT(memcmp(*result, *data, data.getSize()) == 0);
+
+	// The unreliable split packet times out
+	buf.removeUnreliableTimedOuts(10.0, 5.0);
+	std::list<SharedBuffer<u8> > other = con::makeSplitPacket(data, 32, 2);
+	other.pop_front();
+	for (std::list<SharedBuffer<u8> >::iterator i = other.begin();
+			i != other.end(); ++i) {
+		con::BufferedPacket p = con::makePacket(a, *i, 0x12345678, 123, 0);
+		UASSERTEQ(u32, buf.insert(p, false).getSize(), 0);
+	}
+}
+
+void TestConnection::testFarApartSeqnums()
+{
+	Address a(127, 0, 0, 1, 10);
+
+	// The ring never stores a range longer than its maximum span
+	con::SeqnumRing<u32> ring(64);
+	const u16 seqnums[] = { 0, 20000, 40000, 60000, 10000, 32768, 65535,
+		63, 65473, 64, 65472 };
+	for (u32 i = 0; i < ARRLEN(seqnums); i++) {
+		if (ring.fits(seqnums[i]) && ring.get(seqnums[i]) == NULL)
+			ring.insert(seqnums[i]) = i;
+		UASSERT(ring.span() <= 64);
+	}
+	UASSERTEQ(u32, ring.size(), 3);
+	UASSERTEQ(u16, ring.first(), 65473);
+	UASSERTEQ(u32, *ring.get(65473), 8);
+	UASSERTEQ(u32, *ring.get(65535), 6);
+	UASSERTEQ(u32, *ring.get(0), 0);
+	UASSERT(ring.get(63) == NULL && ring.get(20000) == NULL);
+
+	// Removing the oldest one makes room at the other end
+	ring.remove(65473);
+	UASSERTEQ(u16, ring.first(), 65535);
+	UASSERTEQ(u32, ring.span(), 2);
+	UASSERT(ring.fits(62) && !ring.fits(63));
+	ring.insert(62) = 11;
+	UASSERTEQ(u32, ring.span(), 64);
+	UASSERTEQ(u32, ring.size(), 3);
+	UASSERTEQ(u32, *ring.get(62), 11);
+
+	// Reliable packets far ahead are dropped, and not acked either
+	con::ReliablePacketBuffer reliables(RELIABLE_RECEIVE_WINDOW_SIZE);
+	const u16 next_expected = 100;
+	const u16 reliable_seqnums[] = { 40000, 101, 60000,
+		next_expected + RELIABLE_RECEIVE_WINDOW_SIZE,
+		next_expected + RELIABLE_RECEIVE_WINDOW_SIZE - 1, 20000, 99 };
+	for (u32 i = 0; i < ARRLEN(reliable_seqnums); i++) {
+		con::BufferedPacket p = makeTestReliable(a, reliable_seqnums[i], i);
+		reliables.insert(p, next_expected);
+	}
+	UASSERTEQ(u32, reliables.size(), 2);
+	UASSERTEQ(u16, readU16(&reliables.popFirst().data[BASE_HEADER_SIZE + 1]),
+		101);
+	UASSERTEQ(u16, readU16(&reliables.popFirst().data[BASE_HEADER_SIZE + 1]),
+		next_expected + RELIABLE_RECEIVE_WINDOW_SIZE - 1);
+
+	// Split packets started all over the sequence number space make room
+	// for each other, only the last ones close together are completed
+	con::IncomingSplitBuffer splits;
+	SharedBuffer<u8> data(100);
+	for (u32 i = 0; i < data.getSize(); i++)
+		data[i] = i;
+	const u16 split_seqnums[] = { 0, 20000, 40000, 60000, 10000, 30000,
+		50000, 65535 - SPLIT_BUFFER_SPAN, 65535, 1, 2 };
+	for (u32 i = 0; i < ARRLEN(split_seqnums); i++) {
+		std::list<SharedBuffer<u8> > chunks =
+				con::makeSplitPacket(data, 32, split_seqnums[i]);
+		con::BufferedPacket p = con::makePacket(a, chunks.front(),
+				0x12345678, 123, 0);
+		UASSERTEQ(u32, splits.insert(p, false).getSize(), 0);
+	}
+	for (u32 i = ARRLEN(split_seqnums); i-- > 0;) {
+		std::list<SharedBuffer<u8> > chunks =
+				con::makeSplitPacket(data, 32, split_seqnums[i]);
+		chunks.pop_front();
+		SharedBuffer<u8> result;
+		for (std::list<SharedBuffer<u8> >::iterator j = chunks.begin();
+				j != chunks.end(); ++j) {
+			con::BufferedPacket p = con::makePacket(a, *j,
+					0x12345678, 123, 0);
+			result = splits.insert(p, false);
+		}
+		if (i >= ARRLEN(split_seqnums) - 3) {
+			UASSERTEQ(u32, result.getSize(), data.getSize());
+			UASSERT(memcmp(*result, *data, data.getSize()) == 0);
+		} else {
+			UASSERTEQ(u32, result.getSize(), 0);
+		}
+	}
+}
+
 
 void TestConnection::testConnectSendReceive()
 {
@@ -340,9 +530,395 @@ void TestConnection::testConnectSendReceive()
 		UASSERT(peer_id == PEER_ID_SERVER);
 	}
 
+	/*
+		Send many small packets
+	*/
+	{
+		const u32 packet_count = 1000;
+		u32 timems0 = porting::getTimeMs();
+
+		for (u32 i = 0; i < packet_count; i++) {
+			NetworkPacket pkt(0, 4);
+			pkt << i;
+			client.Send(PEER_ID_SERVER, 0, &pkt, true);
+		}
+
+		u32 received = 0;
+		for (;;) {
+			if (porting::getTimeMs() - timems0 > 10000 ||
+					received == packet_count)
+				break;
+			try {
+				NetworkPacket pkt;
+				server.Receive(&pkt);
+				u32 i;
+				pkt >> i;
+				// Reliable packets arrive in order
+				UASSERT(i == received);
+				received++;
+			} catch (con::NoIncomingDataException &e) {
+				sleep_ms(1);
+			}
+		}
+		UASSERT(received == packet_count);
+		infostream << "** Server received " << received
+			<< " small packets in " << porting::getTimeMs() - timems0
+			<< "ms" << std::endl;
+	}
+
 	// Check peer handlers
 	UASSERT(hand_client.count == 1);
 	UASSERT(hand_client.last_id == 1);
 	UASSERT(hand_server.count == 1);
 	UASSERT(hand_server.last_id == 2);
 }
+
+void TestConnection::testShardedReceive()
+{
+	/*
+		Several clients sending to a server which processes the incoming
+		packets with multiple receive threads
+	*/
+
+	u32 proto_id = 0xad26846a;
+	const u32 client_count = 3;
+	const u32 packet_count = 300;
+
+	Address address(0, 0, 0, 0, 30002);
+	Address bind_addr(0, 0, 0, 0, 30002);
+	std::string bind_str = g_settings->get("bind_address");
+	try {
+		bind_addr.Resolve(bind_str.c_str());
+
+		if (!bind_addr.isIPv6()) {
+			address = bind_addr;
+		}
+	} catch (ResolveError &e) {
+	}
+
+	Address server_address(127, 0, 0, 1, 30002);
+	if (address != Address(0, 0, 0, 0, 30002)) {
+		server_address = bind_addr;
+	}
+
+	u16 num_receive_threads = g_settings->getU16("num_receive_threads");
+	g_settings->setU16("num_receive_threads", 4);
+	Handler hand_server("server");
+	con::Connection server(proto_id, 512, 5.0, false, &hand_server);
+	g_settings->setU16("num_receive_threads", num_receive_threads);
+	server.Serve(address);
+
+	Handler *hand_clients[client_count];
+	con::Connection *clients[client_count];
+	for (u32 c = 0; c < client_count; c++) {
+		hand_clients[c] = new Handler("client");
+		clients[c] = new con::Connection(proto_id, 512, 5.0, false,
+				hand_clients[c]);
+		clients[c]->Connect(server_address);
+	}
+
+	// Every client sends its numbered packets once it is connected, the
+	// packets of each client must arrive completely and in order
+	u32 timems0 = porting::getTimeMs();
+	bool sent[client_count] = {};
+	u32 received[client_count] = {};
+	u32 received_count = 0;
+	std::map<u16, u32> client_of_peer;
+	while (received_count < client_count * packet_count &&
+			porting::getTimeMs() - timems0 < 10000) {
+		for (u32 c = 0; c < client_count; c++) {
+			try {
+				NetworkPacket pkt;
+				clients[c]->Receive(&pkt);
+			} catch (con::NoIncomingDataException &e) {
+			}
+			if (sent[c] || !clients[c]->Connected())
+				continue;
+			for (u32 i = 0; i < packet_count; i++) {
+				NetworkPacket pkt(0, 8);
+				pkt << c << i;
+				clients[c]->Send(PEER_ID_SERVER, 0, &pkt, true);
+			}
+			sent[c] = true;
+		}
+		try {
+			NetworkPacket pkt;
+			server.Receive(&pkt);
+			// Skip the empty packet sent on connect
+			if (pkt.getSize() == 0)
+				continue;
+			u32 c, i;
+			pkt >> c >> i;
+			UASSERT(c < client_count);
+			UASSERT(i == received[c]);
+			// A peer id always belongs to the same client
+			if (client_of_peer.find(pkt.getPeerId()) == client_of_peer.end())
+				client_of_peer[pkt.getPeerId()] = c;
+			UASSERT(client_of_peer[pkt.getPeerId()] == c);
+			received[c]++;
+			received_count++;
+		} catch (con::NoIncomingDataException &e) {
+			sleep_ms(1);
+		}
+	}
+	UASSERT(received_count == client_count * packet_count);
+	UASSERT(hand_server.count == (int)client_count);
+	infostream << "** Server received " << received_count << " packets from "
+		<< client_count << " clients in " << porting::getTimeMs() - timems0
+		<< "ms" << std::endl;
+
+	for (u32 c = 0; c < client_count; c++) {
+		delete clients[c];
+		delete hand_clients[c];
+	}
+}
+
+/*
+	A peer speaking the protocol over a bare socket, to see what the
+	other side puts on the wire. Acks everything reliable it gets, and
+	only sets connection flags if asked to, like newer versions do.
+*/
+struct RawTestPeer
+{
+	RawTestPeer(u32 a_proto_id, const Address &a_server_address) :
+		socket(a_server_address.isIPv6()),
+		server_address(a_server_address),
+		proto_id(a_proto_id),
+		peer_id(PEER_ID_INEXISTENT),
+		next_seqnum(SEQNUM_INITIAL),
+		bundles_received(0)
+	{
+	}
+
+	void send(const std::string &data, bool reliable)
+	{
+		std::string packet(BASE_HEADER_SIZE, '\0');
+		writeU32((u8 *)&packet[0], proto_id);
+		writeU16((u8 *)&packet[4], peer_id);
+		writeU8((u8 *)&packet[6], 0);
+		if (reliable) {
+			packet += std::string(RELIABLE_HEADER_SIZE, '\0');
+			writeU8((u8 *)&packet[BASE_HEADER_SIZE], TYPE_RELIABLE);
+			writeU16((u8 *)&packet[BASE_HEADER_SIZE + 1], next_seqnum++);
+		}
+		packet += data;
+		socket.Send(server_address, packet.c_str(), packet.size());
+	}
+
+	// Sends the empty reliable packet Connection::Connect() starts with
+	void connect()
+	{
+		send(std::string(1, (char)TYPE_ORIGINAL), true);
+	}
+
+	void sendConnFlags(u8 flags)
+	{
+		std::string data(3, '\0');
+		writeU8((u8 *)&data[0], TYPE_CONTROL);
+		writeU8((u8 *)&data[1], CONTROLTYPE_ENABLE_BIG_SEND_WINDOW);
+		writeU8((u8 *)&data[2], flags);
+		send(data, true);
+	}
+
+	void receive(u32 timeout_ms)
+	{
+		u8 packet[1500];
+		while (socket.WaitData(timeout_ms)) {
+			Address sender;
+			int size = socket.Receive(sender, packet, sizeof(packet));
+			if (size < BASE_HEADER_SIZE || readU32(packet) != proto_id)
+				continue;
+			handle(std::string((char *)packet + BASE_HEADER_SIZE,
+				size - BASE_HEADER_SIZE), readU8(&packet[6]), -1);
+			timeout_ms = 0;
+		}
+	}
+
+	void handle(const std::string &data, u8 channel, s32 seqnum)
+	{
+		const u8 *p = (const u8 *)data.c_str();
+		if (data.empty())
+			return;
+
+		switch (p[0]) {
+		case TYPE_BUNDLE:
+			bundles_received++;
+			for (size_t offset = BUNDLE_HEADER_SIZE;
+					offset + 2 <= data.size();) {
+				u16 size = readU16(&p[offset]);
+				handle(data.substr(offset + 2, size), channel, -1);
+				offset += 2 + size;
+			}
+			break;
+		case TYPE_RELIABLE: {
+			u16 packet_seqnum = readU16(&p[1]);
+			std::string ack(4, '\0');
+			writeU8((u8 *)&ack[0], TYPE_CONTROL);
+			writeU8((u8 *)&ack[1], CONTROLTYPE_ACK);
+			writeU16((u8 *)&ack[2], packet_seqnum);
+			send(ack, false);
+			// Count from the first seqnum so that order survives wrapping
+			handle(data.substr(RELIABLE_HEADER_SIZE), channel,
+				(u16)(packet_seqnum - SEQNUM_INITIAL));
+			break;
+		}
+		case TYPE_CONTROL:
+			if (data.size() >= 4 && p[1] == CONTROLTYPE_SET_PEER_ID)
+				peer_id = readU16(&p[2]);
+			else if (data.size() >= 4 && p[1] == CONTROLTYPE_ACK)
+				acked.insert(readU16(&p[2]));
+			break;
+		case TYPE_ORIGINAL:
+			// Resent packets come again with the same seqnum
+			if (seqnum >= 0)
+				reliables[seqnum] = data.substr(ORIGINAL_HEADER_SIZE);
+			break;
+		}
+	}
+
+	UDPSocket socket;
+	Address server_address;
+	u32 proto_id;
+	u16 peer_id;
+	u16 next_seqnum;
+	u32 bundles_received;
+	std::set<u16> acked;
+	// Data of the reliable packets received, by their order
+	std::map<u16, std::string> reliables;
+};
+
+static std::string make_bundle_test_data(u32 i)
+{
+	return std::string(1 + i % 23, 'a' + i % 26);
+}
+
+void TestConnection::testBundleNegotiation()
+{
+	/*
+		Small reliable packets sent by a server get bundled for a peer
+		that set CONNFLAG_BUNDLE but not for one that didn't, and arrive
+		intact and in order either way
+	*/
+
+	u32 proto_id = 0xad26846a;
+	const u32 packet_count = 40;
+
+	Address address(0, 0, 0, 0, 30003);
+	Address bind_addr(0, 0, 0, 0, 30003);
+	std::string bind_str = g_settings->get("bind_address");
+	try {
+		bind_addr.Resolve(bind_str.c_str());
+
+		if (!bind_addr.isIPv6()) {
+			address = bind_addr;
+		}
+	} catch (ResolveError &e) {
+	}
+
+	Address server_address(127, 0, 0, 1, 30003);
+	if (address != Address(0, 0, 0, 0, 30003)) {
+		server_address = bind_addr;
+	}
+
+	Handler hand_server("server");
+	con::Connection server(proto_id, 512, 5.0, false, &hand_server);
+	server.Serve(address);
+
+	Handler hand_client("client");
+	con::Connection client(proto_id, 512, 5.0, false, &hand_client);
+	client.Connect(server_address);
+
+	// A peer that sets the flags, and one that doesn't know about them
+	RawTestPeer bundling_peer(proto_id, server_address);
+	RawTestPeer legacy_peer(proto_id, server_address);
+	RawTestPeer *raw_peers[2] = {&bundling_peer, &legacy_peer};
+	for (u32 r = 0; r < 2; r++)
+		raw_peers[r]->connect();
+
+	u32 timems0 = porting::getTimeMs();
+	while ((hand_server.count < 3 || !client.Connected() ||
+			bundling_peer.peer_id == PEER_ID_INEXISTENT ||
+			legacy_peer.peer_id == PEER_ID_INEXISTENT) &&
+			porting::getTimeMs() - timems0 < 5000) {
+		try {
+			NetworkPacket pkt;
+			server.Receive(&pkt);
+		} catch (con::NoIncomingDataException &e) {
+		}
+		try {
+			NetworkPacket pkt;
+			client.Receive(&pkt);
+		} catch (con::NoIncomingDataException &e) {
+		}
+		for (u32 r = 0; r < 2; r++)
+			raw_peers[r]->receive(1);
+	}
+	UASSERT(hand_server.count == 3);
+	UASSERT(client.Connected());
+
+	// Wait for the flags to be acked, so that the server knows them
+	bundling_peer.sendConnFlags(CONNFLAG_BUNDLE);
+	u16 flags_seqnum = bundling_peer.next_seqnum - 1;
+	timems0 = porting::getTimeMs();
+	while (bundling_peer.acked.count(flags_seqnum) == 0 &&
+			porting::getTimeMs() - timems0 < 5000)
+		bundling_peer.receive(10);
+	UASSERT(bundling_peer.acked.count(flags_seqnum) == 1);
+	sleep_ms(50);
+
+	// The server gave out peer ids 2, 3 and 4 in the order it heard of us
+	u16 peer_ids[3] = {bundling_peer.peer_id, legacy_peer.peer_id, 0};
+	peer_ids[2] = 2 + 3 + 4 - peer_ids[0] - peer_ids[1];
+	for (u32 i = 0; i < packet_count; i++) {
+		for (u32 c = 0; c < 3; c++) {
+			NetworkPacket pkt(0, 0);
+			pkt << i;
+			pkt.putRawString(make_bundle_test_data(i).c_str(),
+				make_bundle_test_data(i).size());
+			server.Send(peer_ids[c], 0, &pkt, true);
+		}
+	}
+
+	u32 client_received = 0;
+	timems0 = porting::getTimeMs();
+	while ((client_received < packet_count ||
+			bundling_peer.reliables.size() < packet_count ||
+			legacy_peer.reliables.size() < packet_count) &&
+			porting::getTimeMs() - timems0 < 5000) {
+		try {
+			NetworkPacket pkt;
+			client.Receive(&pkt);
+			u32 i;
+			pkt >> i;
+			UASSERT(i == client_received);
+			std::string expected = make_bundle_test_data(i);
+			UASSERT(pkt.getSize() == 4 + expected.size());
+			UASSERT(memcmp(pkt.getU8Ptr(4), expected.c_str(),
+				expected.size()) == 0);
+			client_received++;
+		} catch (con::NoIncomingDataException &e) {
+		}
+		for (u32 r = 0; r < 2; r++)
+			raw_peers[r]->receive(1);
+	}
+	UASSERT(client_received == packet_count);
+
+	for (u32 r = 0; r < 2; r++) {
+		// SET_PEER_ID was the first reliable packet, the data follows it
+		std::map<u16, std::string> &reliables = raw_peers[r]->reliables;
+		UASSERTEQ(size_t, reliables.size(), packet_count);
+		u32 i = 0;
+		for (std::map<u16, std::string>::iterator it = reliables.begin();
+				it != reliables.end(); ++it, i++) {
+			UASSERTEQ(u16, it->first, i + 1);
+			// Command, packet number and data
+			std::string expected(2 + 4, '\0');
+			writeU32((u8 *)&expected[2], i);
+			expected += make_bundle_test_data(i);
+			UASSERT(it->second == expected);
+		}
+	}
+
+	UASSERT(bundling_peer.bundles_received > 0);
+	UASSERT(legacy_peer.bundles_received == 0);
+}
@@ -0,0 +1,170 @@
+/*
+Minetest
+Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "genericobject.h"
+#include "util/serialize.h"
+#include "util/numeric.h"
+
+class TestGenericObject : public TestBase {
+public:
+	TestGenericObject() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestGenericObject"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testPositionCompactRoundTrip();
+	void testPositionCompactOmitsUnchanged();
+	void testPositionCompactKeyFrames();
+	void testPositionCompactMissingKeyFrame();
+};
+
+static TestGenericObject g_test_instance;
+
+void TestGenericObject::runTests(IGameDef *gamedef)
+{
+	TEST(testPositionCompactRoundTrip);
+	TEST(testPositionCompactOmitsUnchanged);
+	TEST(testPositionCompactKeyFrames);
+	TEST(testPositionCompactMissingKeyFrame);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static ObjectPositionUpdate makeTestUpdate(int i)
+{
+	ObjectPositionUpdate update;
+	update.position = v3f(1000.5 + i * 3.37, -20.25 + i, 300 - i * 0.11);
+	update.velocity = v3f(33.7, i % 3 == 0 ? -500 : 10, 0);
+	update.acceleration = v3f(0, -98.1, 0);
+	update.yaw = 10.5 * i;
+	update.update_interval = 0.09;
+	update.do_interpolate = i % 2 == 0;
+	update.is_movement_end = i % 5 == 0;
+	return update;
+}
+
+// Sends the update from the server to the client, returns whether it decoded
+static bool sendTestUpdate(ObjectPositionKey &server_key,
+		ObjectPositionKey &client_key, const ObjectPositionUpdate &update,
+		ObjectPositionUpdate &result, std::string *data = NULL)
+{
+	bool is_key_frame;
+	std::string s = gob_cmd_update_position_compact(server_key, update,
+			is_key_frame);
+	if (data)
+		*data = s;
+
+	std::istringstream is(s, std::ios::binary);
+	UASSERT(readU8(is) == GENERIC_CMD_UPDATE_POSITION_COMPACT);
+	return gob_read_update_position_compact(is, client_key, result);
+}
+
+void TestGenericObject::testPositionCompactRoundTrip()
+{
+	ObjectPositionKey server_key, client_key;
+
+	for (int i = 0; i < 40; i++) {
+		ObjectPositionUpdate update = makeTestUpdate(i);
+		ObjectPositionUpdate result;
+		UASSERT(sendTestUpdate(server_key, client_key, update, result));
+
+		UASSERT(result.position.getDistanceFrom(update.position) < 0.01);
+		UASSERT(result.velocity.getDistanceFrom(update.velocity) < 0.01);
+		UASSERT(result.acceleration.getDistanceFrom(update.acceleration) < 0.01);
+		UASSERT(fabs(wrapDegrees_180(result.yaw - update.yaw)) < 0.01);
+		UASSERT(fabs(result.update_interval - update.update_interval) < 0.001);
+		UASSERT(result.do_interpolate == update.do_interpolate);
+		UASSERT(result.is_movement_end == update.is_movement_end);
+	}
+}
+
+void TestGenericObject::testPositionCompactOmitsUnchanged()
+{
+	ObjectPositionKey server_key, client_key;
+	ObjectPositionUpdate update = makeTestUpdate(1);
+	ObjectPositionUpdate result;
+	std::string data;
+
+	UASSERT(sendTestUpdate(server_key, client_key, update, result, &data));
+	// cmd, flags, seq, position, velocity, acceleration, yaw, interval
+	UASSERTEQ(size_t, data.size(), 3 + 12 + 12 + 12 + 4 + 4);
+
+	// Only the position changed: cmd, flags, seq, quantized position delta
+	update.position += v3f(1.5, 0, -2);
+	UASSERT(sendTestUpdate(server_key, client_key, update, result, &data));
+	UASSERTEQ(size_t, data.size(), 3 + 6);
+	UASSERT(result.position.getDistanceFrom(update.position) < 0.01);
+	UASSERT(result.velocity == update.velocity);
+	UASSERT(result.yaw == update.yaw);
+}
+
+void TestGenericObject::testPositionCompactKeyFrames()
+{
+	ObjectPositionKey server_key;
+	ObjectPositionUpdate update = makeTestUpdate(0);
+	bool is_key_frame;
+
+	// The first update and every few ones after are key frames
+	gob_cmd_update_position_compact(server_key, update, is_key_frame);
+	UASSERT(is_key_frame);
+	u32 key_frames = 0;
+	for (int i = 0; i < 80; i++) {
+		update.position.X += 0.5;
+		gob_cmd_update_position_compact(server_key, update, is_key_frame);
+		if (is_key_frame)
+			key_frames++;
+	}
+	UASSERT(key_frames > 0 && key_frames <= 10);
+
+	// Positions out of the quantized range need a key frame
+	update.position.Y += 1000;
+	gob_cmd_update_position_compact(server_key, update, is_key_frame);
+	UASSERT(is_key_frame);
+
+	// So does the next update once the key was reset
+	server_key.valid = false;
+	gob_cmd_update_position_compact(server_key, update, is_key_frame);
+	UASSERT(is_key_frame);
+}
+
+void TestGenericObject::testPositionCompactMissingKeyFrame()
+{
+	ObjectPositionKey server_key, client_key;
+	ObjectPositionUpdate result;
+
+	// Key frame sent before the client knew the object
+	ObjectPositionKey late_key;
+	UASSERT(sendTestUpdate(server_key, late_key, makeTestUpdate(0), result));
+
+	// Updates can't be decoded until the next key frame
+	for (int i = 1; i < 20 && !client_key.valid; i++) {
+		bool is_key_frame;
+		std::string s = gob_cmd_update_position_compact(server_key,
+				makeTestUpdate(i), is_key_frame);
+		std::istringstream is(s, std::ios::binary);
+		readU8(is);
+		UASSERT(gob_read_update_position_compact(is, client_key, result) ==
+				is_key_frame);
+	}
+	UASSERT(client_key.valid);
+	UASSERT(client_key.seq == server_key.seq);
+}
@@ -0,0 +1,150 @@
+/*
+Minetest
+Copyright (C) 2013 kwolekr, Ryan Kwolek <kwolekr@minetest.net>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "map.h"
+#include "lua_api/l_vmanip.h"
+
+extern "C" {
+#include <lualib.h>
+}
+
+class TestLuaVoxelManip : public TestBase {
+public:
+	TestLuaVoxelManip() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLuaVoxelManip"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testDataRoundTrip();
+	void testDataReusedBuffer();
+};
+
+static TestLuaVoxelManip g_test_instance;
+
+void TestLuaVoxelManip::runTests(IGameDef *gamedef)
+{
+	TEST(testDataRoundTrip);
+	TEST(testDataReusedBuffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static MapNode make_test_node(u32 i)
+{
+	return MapNode(i % 1000, i % 256, (i * 7) % 256);
+}
+
+
+// Runs script with the VoxelManip as global "vm", returns false on errors
+static bool run_vmanip_script(MMVManip *vm, const char *script)
+{
+	lua_State *L = luaL_newstate();
+	luaL_openlibs(L);
+	LuaVoxelManip::Register(L);
+
+	// Same as a mapgen object, so that vm isn't deleted with the userdata
+	LuaVoxelManip *o = new LuaVoxelManip(vm, true);
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, "VoxelManip");
+	lua_setmetatable(L, -2);
+	lua_setglobal(L, "vm");
+
+	lua_pushinteger(L, vm->m_area.getVolume());
+	lua_setglobal(L, "volume");
+
+	bool success = luaL_dostring(L, script) == 0;
+	if (!success)
+		dstream << "Script error: " << lua_tostring(L, -1) << std::endl;
+
+	lua_close(L);
+	return success;
+}
+
+
+void TestLuaVoxelManip::testDataRoundTrip()
+{
+	MMVManip vm(NULL);
+	vm.addArea(VoxelArea(v3s16(-3, -2, -1), v3s16(4, 5, 6)));
+
+	u32 volume = vm.m_area.getVolume();
+	for (u32 i = 0; i != volume; i++)
+		vm.m_data[i] = make_test_node(i);
+
+	// Every getter returns a table of the whole volume, the setters take
+	// the same format back
+	UASSERT(run_vmanip_script(&vm,
+		"local data = vm:get_data()\n"
+		"local light = vm:get_light_data()\n"
+		"local param2 = vm:get_param2_data()\n"
+		"assert(#data == volume and #light == volume and #param2 == volume)\n"
+		"for i = 1, volume do\n"
+		"	assert(data[i] == (i - 1) % 1000)\n"
+		"	assert(light[i] == (i - 1) % 256)\n"
+		"	assert(param2[i] == ((i - 1) * 7) % 256)\n"
+		"	data[i] = (data[i] + 1) % 1000\n"
+		"	light[i] = (light[i] + 2) % 256\n"
+		"	param2[i] = (param2[i] + 3) % 256\n"
+		"end\n"
+		"vm:set_data(data)\n"
+		"vm:set_light_data(light)\n"
+		"vm:set_param2_data(param2)\n"));
+
+	for (u32 i = 0; i != volume; i++) {
+		MapNode n = make_test_node(i);
+		UASSERTEQ(u32, vm.m_data[i].getContent(), (n.getContent() + 1) % 1000);
+		UASSERTEQ(u32, vm.m_data[i].param1, (n.param1 + 2) % 256);
+		UASSERTEQ(u32, vm.m_data[i].param2, (n.param2 + 3) % 256);
+	}
+}
+
+
+void TestLuaVoxelManip::testDataReusedBuffer()
+{
+	MMVManip vm(NULL);
+	vm.addArea(VoxelArea(v3s16(0, 0, 0), v3s16(7, 7, 7)));
+
+	u32 volume = vm.m_area.getVolume();
+	for (u32 i = 0; i != volume; i++)
+		vm.m_data[i] = make_test_node(i);
+
+	// Tables passed to the getters are refilled and returned, whatever
+	// they held before
+	UASSERT(run_vmanip_script(&vm,
+		"local data, light, param2 = {}, {}, {}\n"
+		"for i = 1, volume do\n"
+		"	data[i], light[i], param2[i] = -1, -1, -1\n"
+		"end\n"
+		"for round = 1, 3 do\n"
+		"	assert(vm:get_data(data) == data)\n"
+		"	assert(vm:get_light_data(light) == light)\n"
+		"	assert(vm:get_param2_data(param2) == param2)\n"
+		"	for i = 1, volume do\n"
+		"		assert(data[i] == (i - 1 + round - 1) % 1000)\n"
+		"		assert(light[i] == (i - 1) % 256)\n"
+		"		assert(param2[i] == ((i - 1) * 7) % 256)\n"
+		"		data[i] = (data[i] + 1) % 1000\n"
+		"	end\n"
+		"	vm:set_data(data)\n"
+		"end\n"));
+
+	for (u32 i = 0; i != volume; i++)
+		UASSERTEQ(u32, vm.m_data[i].getContent(), (i + 3) % 1000);
+}
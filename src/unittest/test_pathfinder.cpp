@@ -0,0 +1,235 @@
+/*
+Minetest
+Copyright (C) 2013 sapier, sapier at gmx dot net
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "pathfinder.h"
+#include "voxel.h"
+#include "noise.h"
+#include "util/numeric.h"
+
+class TestPathfinder : public TestBase {
+public:
+	TestPathfinder() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testAStarMatchesDijkstra();
+	void testJumpAndDrop();
+	void testWalledOff();
+	void testSearchReuse();
+};
+
+static TestPathfinder g_test_instance;
+
+void TestPathfinder::runTests(IGameDef *gamedef)
+{
+	TEST(testAStarMatchesDijkstra);
+	TEST(testJumpAndDrop);
+	TEST(testWalledOff);
+	TEST(testSearchReuse);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define TEST_MAP_SIDE 16
+#define TEST_MAP_HEIGHT 8
+
+// Stone up to below height, air above; paths run on top at y = height
+static void set_test_column(VoxelManipulator &vm, s16 x, s16 z, s16 height)
+{
+	for (s16 y = 0; y < TEST_MAP_HEIGHT; y++)
+		vm.setNode(v3s16(x, y, z),
+			MapNode(y < height ? t_CONTENT_STONE : CONTENT_AIR));
+}
+
+static void make_flat_test_map(VoxelManipulator &vm, s16 height)
+{
+	for (s16 z = 0; z < TEST_MAP_SIDE; z++)
+	for (s16 x = 0; x < TEST_MAP_SIDE; x++)
+		set_test_column(vm, x, z, height);
+}
+
+// Cost of a path as the pathfinder counts it, or -1 if it isn't walkable
+static int get_test_path_cost(const std::vector<v3s16> &path,
+		int max_jump, int max_drop)
+{
+	int cost = 0;
+	for (size_t i = 1; i < path.size(); i++) {
+		v3s16 d = path[i] - path[i - 1];
+		if (abs(d.X) + abs(d.Z) != 1 || d.Y > max_jump || -d.Y > max_drop)
+			return -1;
+		cost += d.Y == 0 ? 1 : 2;
+	}
+	return cost;
+}
+
+
+void TestPathfinder::testAStarMatchesDijkstra()
+{
+	VoxelManipulator vm;
+	PseudoRandom pr(13);
+	s16 heights[TEST_MAP_SIDE][TEST_MAP_SIDE];
+
+	// Hills with walls nothing can get over
+	for (s16 z = 0; z < TEST_MAP_SIDE; z++)
+	for (s16 x = 0; x < TEST_MAP_SIDE; x++) {
+		heights[x][z] = pr.range(0, 9) == 0 ?
+			TEST_MAP_HEIGHT : pr.range(1, 3);
+		set_test_column(vm, x, z, heights[x][z]);
+	}
+
+	pathfinder finder;
+	u32 num_found = 0;
+	for (u32 i = 0; i != 50; i++) {
+		s16 x1 = pr.range(0, TEST_MAP_SIDE - 1);
+		s16 z1 = pr.range(0, TEST_MAP_SIDE - 1);
+		s16 x2 = pr.range(0, TEST_MAP_SIDE - 1);
+		s16 z2 = pr.range(0, TEST_MAP_SIDE - 1);
+		if (heights[x1][z1] == TEST_MAP_HEIGHT ||
+				heights[x2][z2] == TEST_MAP_HEIGHT)
+			continue;
+		v3s16 source(x1, heights[x1][z1], z1);
+		v3s16 destination(x2, heights[x2][z2], z2);
+
+		std::vector<v3s16> dijkstra = finder.get_Path(&vm, source,
+			destination, TEST_MAP_SIDE, 1, 1, DIJKSTRA);
+		std::vector<v3s16> astar = finder.get_Path(&vm, source,
+			destination, TEST_MAP_SIDE, 1, 1, A_PLAIN);
+
+		UASSERTEQ(bool, astar.empty(), dijkstra.empty());
+		if (dijkstra.empty())
+			continue;
+
+		UASSERT(astar.front() == source && astar.back() == destination);
+		int cost = get_test_path_cost(dijkstra, 1, 1);
+		UASSERT(cost >= 0);
+		UASSERTEQ(int, get_test_path_cost(astar, 1, 1), cost);
+		num_found++;
+	}
+
+	// Pairs on a wall or without a path are skipped above; with one column
+	// in ten being a wall most pairs should still have been compared
+	UASSERT(num_found > 10);
+}
+
+
+void TestPathfinder::testJumpAndDrop()
+{
+	VoxelManipulator vm;
+
+	// A step two nodes high across the whole map
+	for (s16 z = 0; z < TEST_MAP_SIDE; z++)
+	for (s16 x = 0; x < TEST_MAP_SIDE; x++)
+		set_test_column(vm, x, z, x < 8 ? 1 : 3);
+
+	pathfinder finder;
+	v3s16 low(2, 1, 5);
+	v3s16 high(12, 3, 5);
+
+	UASSERT(finder.get_Path(&vm, low, high, 4, 1, 4, A_PLAIN).empty());
+	std::vector<v3s16> path = finder.get_Path(&vm, low, high, 4, 2, 0,
+		A_PLAIN);
+	UASSERT(!path.empty());
+	UASSERT(get_test_path_cost(path, 2, 0) >= 0);
+
+	UASSERT(finder.get_Path(&vm, high, low, 4, 4, 1, DIJKSTRA).empty());
+	path = finder.get_Path(&vm, high, low, 4, 0, 2, DIJKSTRA);
+	UASSERT(!path.empty());
+	UASSERT(get_test_path_cost(path, 0, 2) >= 0);
+	UASSERTEQ(int, get_test_path_cost(path, 0, 2), 11);
+}
+
+
+void TestPathfinder::testWalledOff()
+{
+	VoxelManipulator vm;
+	make_flat_test_map(vm, 1);
+
+	// A ring of walls too high to jump over around the destination
+	for (s16 z = 9; z <= 13; z++)
+	for (s16 x = 9; x <= 13; x++) {
+		if (x == 9 || x == 13 || z == 9 || z == 13)
+			set_test_column(vm, x, z, 4);
+	}
+
+	pathfinder finder;
+	v3s16 source(2, 1, 2);
+	v3s16 destination(11, 1, 11);
+
+	UASSERT(finder.get_Path(&vm, source, destination, 8, 2, 2,
+		DIJKSTRA).empty());
+	UASSERT(finder.get_Path(&vm, source, destination, 8, 2, 2,
+		A_PLAIN).empty());
+
+	// Or the destination itself can't be stood on
+	set_test_column(vm, 11, 11, TEST_MAP_HEIGHT);
+	UASSERT(finder.get_Path(&vm, source, destination, 8, 3, 3,
+		A_PLAIN).empty());
+
+	// Once there is an opening the walls are walked around
+	set_test_column(vm, 11, 11, 1);
+	set_test_column(vm, 11, 9, 1);
+	std::vector<v3s16> path = finder.get_Path(&vm, source, destination, 8,
+		2, 2, A_PLAIN);
+	UASSERT(!path.empty());
+	UASSERT(std::find(path.begin(), path.end(), v3s16(11, 1, 9)) !=
+		path.end());
+}
+
+
+void TestPathfinder::testSearchReuse()
+{
+	VoxelManipulator vm;
+	make_flat_test_map(vm, 1);
+	for (s16 z = 0; z < 12; z++)
+		set_test_column(vm, 7, z, 4);
+
+	// Searches of different sizes and outcomes, in an order that makes
+	// each one run over the state left behind by the one before
+	struct {
+		v3s16 source;
+		v3s16 destination;
+		unsigned int searchdistance;
+	} searches[] = {
+		{v3s16(2, 1, 2), v3s16(12, 1, 2), 10},
+		{v3s16(5, 1, 5), v3s16(6, 1, 5), 1},
+		{v3s16(2, 1, 2), v3s16(12, 1, 2), 6},
+		{v3s16(12, 1, 2), v3s16(2, 1, 2), 12},
+		{v3s16(3, 1, 14), v3s16(8, 1, 10), 2},
+		{v3s16(2, 1, 2), v3s16(12, 1, 2), 10},
+	};
+
+	pathfinder reused;
+	for (size_t i = 0; i != ARRLEN(searches); i++) {
+		pathfinder fresh;
+		std::vector<v3s16> expected = fresh.get_Path(&vm,
+			searches[i].source, searches[i].destination,
+			searches[i].searchdistance, 1, 1, A_PLAIN);
+		std::vector<v3s16> path = reused.get_Path(&vm,
+			searches[i].source, searches[i].destination,
+			searches[i].searchdistance, 1, 1, A_PLAIN);
+
+		UASSERT(path == expected);
+		// Only the search too small to get around the wall fails
+		UASSERTEQ(bool, path.empty(), i == 2);
+	}
+}
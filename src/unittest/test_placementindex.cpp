@@ -0,0 +1,236 @@
+/*
+Minetest
+Copyright (C) 2010-2015 kwolekr, Ryan Kwolek <kwolekr@minetest.net>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapgen.h"
+#include "mg_ore.h"
+#include "mg_decoration.h"
+#include "map.h"
+#include "noise.h"
+
+class TestPlacementIndex : public TestBase {
+public:
+	TestPlacementIndex() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPlacementIndex"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testOrePlacementIndex(IGameDef *gamedef);
+	void testDecoPlacementIndex(IGameDef *gamedef);
+};
+
+static TestPlacementIndex g_test_instance;
+
+void TestPlacementIndex::runTests(IGameDef *gamedef)
+{
+	TEST(testOrePlacementIndex, gamedef);
+	TEST(testDecoPlacementIndex, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+#define TEST_CHUNK_SIDE 16
+#define TEST_CHUNK_HEIGHT 80
+#define TEST_CHUNK_AREA (TEST_CHUNK_SIDE * TEST_CHUNK_SIDE)
+#define TEST_NUM_BIOMES 6
+
+// Something placed by one of the test ores or decorations
+struct TestPlacement {
+	u32 index;
+	u32 blockseed;
+	v3s16 p;
+
+	bool operator==(const TestPlacement &other) const
+	{
+		return index == other.index && blockseed == other.blockseed &&
+			p == other.p;
+	}
+};
+
+static std::vector<TestPlacement> g_placements;
+
+// Only has an effect where one of its biomes is present, like the real ores
+class TestOre : public Ore {
+public:
+	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
+		v3s16 nmin, v3s16 nmax, u8 *biomemap)
+	{
+		bool in_biome = !biomemap || biomes.empty();
+		for (u32 i = 0; i != TEST_CHUNK_AREA && !in_biome; i++)
+			in_biome = biomes.count(biomemap[i]);
+		if (!in_biome)
+			return;
+
+		TestPlacement placement = {index, blockseed, nmin};
+		g_placements.push_back(placement);
+	}
+};
+
+class TestDeco : public Decoration {
+public:
+	virtual size_t generate(MMVManip *vm, PseudoRandom *pr, v3s16 p)
+	{
+		TestPlacement placement = {index, 0, p};
+		g_placements.push_back(placement);
+		return 1;
+	}
+
+	virtual int getHeight()
+	{
+		return 0;
+	}
+};
+
+
+static void make_test_biomes(PseudoRandom &pr, std::set<u8> *biomes)
+{
+	if (pr.range(0, 2) == 0)
+		return;
+
+	s32 n = pr.range(1, 3);
+	for (s32 i = 0; i != n; i++)
+		biomes->insert(pr.range(0, TEST_NUM_BIOMES - 1));
+}
+
+
+static void make_test_biomemap(PseudoRandom &pr, u32 kind, u8 *biomemap)
+{
+	u8 biome = pr.range(0, TEST_NUM_BIOMES - 1);
+	for (u32 i = 0; i != TEST_CHUNK_AREA; i++) {
+		// Either one biome for the whole chunk, two halves or a mix of all
+		if (kind == 0)
+			biomemap[i] = biome;
+		else if (kind == 1)
+			biomemap[i] = i < TEST_CHUNK_AREA / 2 ?
+				biome : (biome + 1) % TEST_NUM_BIOMES;
+		else
+			biomemap[i] = pr.range(0, TEST_NUM_BIOMES - 1);
+	}
+}
+
+
+void TestPlacementIndex::testOrePlacementIndex(IGameDef *gamedef)
+{
+	OreManager oremgr(gamedef);
+	PseudoRandom pr(1337);
+
+	for (u32 i = 0; i != 60; i++) {
+		TestOre *ore = new TestOre;
+		ore->clust_size = 1;
+		ore->y_min      = pr.range(-600, 300);
+		ore->y_max      = ore->y_min + pr.range(0, 400);
+		// Mirrored ores are placed both above and below y = 0
+		ore->flags      = pr.range(0, 2) == 0 ? OREFLAG_ABSHEIGHT : 0;
+		make_test_biomes(pr, &ore->biomes);
+		oremgr.add(ore);
+	}
+
+	Mapgen mg;
+	u8 biomemap[TEST_CHUNK_AREA];
+	u32 nplaced_total = 0;
+
+	for (s16 y = -800; y <= 800; y += TEST_CHUNK_HEIGHT / 2)
+	for (u32 kind = 0; kind != 4; kind++) {
+		v3s16 nmin(-32, y, 48);
+		v3s16 nmax = nmin + v3s16(TEST_CHUNK_SIDE - 1,
+			TEST_CHUNK_HEIGHT - 1, TEST_CHUNK_SIDE - 1);
+		u32 blockseed = pr.next();
+
+		make_test_biomemap(pr, kind, biomemap);
+		mg.biomemap = kind == 3 ? NULL : biomemap;
+
+		// The full scan gives every ore its own seed offset in turn
+		oremgr.invalidatePlacementIndex();
+		g_placements.clear();
+		oremgr.placeAllOres(&mg, blockseed, nmin, nmax);
+		std::vector<TestPlacement> expected = g_placements;
+
+		oremgr.updatePlacementIndex();
+		g_placements.clear();
+		oremgr.placeAllOres(&mg, blockseed, nmin, nmax);
+
+		UASSERTEQ(size_t, g_placements.size(), expected.size());
+		UASSERT(g_placements == expected);
+		nplaced_total += expected.size();
+	}
+
+	// Make sure the comparison covered something at all
+	UASSERT(nplaced_total > 100);
+}
+
+
+void TestPlacementIndex::testDecoPlacementIndex(IGameDef *gamedef)
+{
+	DecorationManager decomgr(gamedef);
+	PseudoRandom pr(4242);
+
+	for (u32 i = 0; i != 60; i++) {
+		TestDeco *deco = new TestDeco;
+		deco->sidelen    = TEST_CHUNK_SIDE / 2;
+		deco->fill_ratio = 0.05;
+		deco->y_min      = pr.range(-400, 300);
+		deco->y_max      = deco->y_min + pr.range(0, 200);
+		make_test_biomes(pr, &deco->biomes);
+		decomgr.add(deco);
+	}
+
+	MMVManip vm(NULL);
+	vm.m_area = VoxelArea(v3s16(-32, -1000, 48), v3s16(-17, 1000, 63));
+
+	Mapgen mg;
+	mg.vm = &vm;
+	u8 biomemap[TEST_CHUNK_AREA];
+	s16 heightmap[TEST_CHUNK_AREA];
+	u32 nplaced_total = 0;
+
+	for (s16 y = -480; y <= 480; y += TEST_CHUNK_HEIGHT)
+	for (u32 kind = 0; kind != 4; kind++) {
+		v3s16 nmin(-32, y, 48);
+		v3s16 nmax = nmin + v3s16(TEST_CHUNK_SIDE - 1,
+			TEST_CHUNK_HEIGHT - 1, TEST_CHUNK_SIDE - 1);
+		u32 blockseed = pr.next();
+
+		// The surface may be flat, hilly, or partly out of the chunk
+		s16 base = y + pr.range(-20, TEST_CHUNK_HEIGHT + 20);
+		s16 hills = kind == 0 ? 0 : pr.range(1, 40);
+		for (u32 i = 0; i != TEST_CHUNK_AREA; i++)
+			heightmap[i] = base + pr.range(0, hills);
+		mg.heightmap = heightmap;
+
+		make_test_biomemap(pr, kind, biomemap);
+		mg.biomemap = kind == 3 ? NULL : biomemap;
+
+		decomgr.invalidatePlacementIndex();
+		g_placements.clear();
+		decomgr.placeAllDecos(&mg, blockseed, nmin, nmax);
+		std::vector<TestPlacement> expected = g_placements;
+
+		// Decorations are placed at the same spots, so the seeds match too
+		decomgr.updatePlacementIndex();
+		g_placements.clear();
+		decomgr.placeAllDecos(&mg, blockseed, nmin, nmax);
+
+		UASSERTEQ(size_t, g_placements.size(), expected.size());
+		UASSERT(g_placements == expected);
+		nplaced_total += expected.size();
+	}
+
+	UASSERT(nplaced_total > 100);
+}
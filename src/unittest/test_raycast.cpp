@@ -0,0 +1,170 @@
+/*
+Minetest
+Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+#include "testenvironment.h"
+
+#include "nodedef.h"
+
+class TestRaycast : public TestBase {
+public:
+	TestRaycast() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestRaycast"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testLineOfSight(IGameDef *gamedef);
+	void testRaycastNodes(IGameDef *gamedef);
+	void testRaycastObjects(IGameDef *gamedef);
+};
+
+/*
+	The test environment with a stone pillar at x = 8, z = 8, up to y = 3.
+	Objects are just boxes.
+*/
+class RaycastTestEnvironment : public TestEnvironment {
+public:
+	RaycastTestEnvironment(IGameDef *gamedef) :
+		TestEnvironment(gamedef)
+	{
+		for (s16 y = 1; y <= 3; y++)
+			setNode(v3s16(8, y, 8), MapNode(t_CONTENT_STONE));
+	}
+
+	// Adds an object with a box of the given half size, in nodes
+	void addObject(u16 id, v3f pos, v3f half_size)
+	{
+		m_objects[id] = aabb3f((pos - half_size) * BS, (pos + half_size) * BS);
+	}
+
+protected:
+	void raycastObjects(v3f pos1, v3f dir, f32 *nearest,
+			PointedThing *result)
+	{
+		for (std::map<u16, aabb3f>::iterator i = m_objects.begin();
+				i != m_objects.end(); ++i) {
+			if (!raycastObjectBox(i->second, pos1, dir, nearest))
+				continue;
+			result->type = POINTEDTHING_OBJECT;
+			result->object_id = i->first;
+		}
+	}
+
+private:
+	std::map<u16, aabb3f> m_objects;
+};
+
+static TestRaycast g_test_instance;
+
+void TestRaycast::runTests(IGameDef *gamedef)
+{
+	TEST(testLineOfSight, gamedef);
+	TEST(testRaycastNodes, gamedef);
+	TEST(testRaycastObjects, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestRaycast::testLineOfSight(IGameDef *gamedef)
+{
+	RaycastTestEnvironment env(gamedef);
+	v3s16 p;
+
+	UASSERT(env.line_of_sight(v3f(2, 2, 2) * BS, v3f(6, 4, 5) * BS));
+
+	UASSERT(!env.line_of_sight(v3f(2, 2, 8) * BS, v3f(12, 2, 8) * BS,
+		1.0, &p));
+	UASSERT(p == v3s16(8, 2, 8));
+
+	// Over the top of the pillar
+	UASSERT(env.line_of_sight(v3f(2, 4, 8) * BS, v3f(12, 4, 8) * BS));
+
+	UASSERT(!env.line_of_sight(v3f(4, 3, 4) * BS, v3f(5, 0.2, 4) * BS,
+		1.0, &p));
+	UASSERT(p == v3s16(5, 0, 4));
+
+	// Objects are not in the way
+	env.addObject(1, v3f(4, 2, 2), v3f(0.5, 0.5, 0.5));
+	UASSERT(env.line_of_sight(v3f(2, 2, 2) * BS, v3f(6, 2, 2) * BS));
+}
+
+void TestRaycast::testRaycastNodes(IGameDef *gamedef)
+{
+	RaycastTestEnvironment env(gamedef);
+
+	PointedThing pointed = env.raycast(v3f(2, 2, 8) * BS,
+		v3f(12, 2, 8) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_NODE);
+	UASSERT(pointed.node_undersurface == v3s16(8, 2, 8));
+	UASSERT(pointed.node_abovesurface == v3s16(7, 2, 8));
+
+	// From the other side
+	pointed = env.raycast(v3f(12, 3, 8) * BS, v3f(2, 3, 8) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_NODE);
+	UASSERT(pointed.node_undersurface == v3s16(8, 3, 8));
+	UASSERT(pointed.node_abovesurface == v3s16(9, 3, 8));
+
+	// Looking down at the floor at an angle
+	pointed = env.raycast(v3f(3, 4, 4) * BS, v3f(6, 0, 5) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_NODE);
+	UASSERT(pointed.node_undersurface.Y == 0);
+	UASSERT(pointed.node_abovesurface ==
+		pointed.node_undersurface + v3s16(0, 1, 0));
+
+	// Too short to reach anything
+	pointed = env.raycast(v3f(2, 2, 8) * BS, v3f(6, 2, 8) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_NOTHING);
+}
+
+void TestRaycast::testRaycastObjects(IGameDef *gamedef)
+{
+	RaycastTestEnvironment env(gamedef);
+	env.addObject(1, v3f(5, 2, 8), v3f(0.3, 0.3, 0.3));
+	env.addObject(2, v3f(10, 2, 8), v3f(0.3, 0.3, 0.3));
+
+	// The first object is in front of the pillar, the second one behind it
+	PointedThing pointed = env.raycast(v3f(2, 2, 8) * BS,
+		v3f(12, 2, 8) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_OBJECT);
+	UASSERT(pointed.object_id == 1);
+
+	pointed = env.raycast(v3f(2, 2, 8) * BS, v3f(12, 2, 8) * BS, false, false);
+	UASSERT(pointed.type == POINTEDTHING_NODE);
+	UASSERT(pointed.node_undersurface == v3s16(8, 2, 8));
+
+	pointed = env.raycast(v3f(14, 2, 8) * BS, v3f(2, 2, 8) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_OBJECT);
+	UASSERT(pointed.object_id == 2);
+
+	// Looking out of an object does not hit the object itself
+	env.addObject(3, v3f(2, 1.5, 4), v3f(0.3, 1, 0.3));
+	pointed = env.raycast(v3f(2, 2.2, 4) * BS, v3f(12, 2.2, 4) * BS,
+		true, false);
+	UASSERT(pointed.type == POINTEDTHING_NOTHING);
+
+	env.addObject(4, v3f(6, 2, 4), v3f(0.5, 0.5, 0.5));
+	pointed = env.raycast(v3f(2, 2.2, 4) * BS, v3f(12, 2.2, 4) * BS,
+		true, false);
+	UASSERT(pointed.type == POINTEDTHING_OBJECT);
+	UASSERT(pointed.object_id == 4);
+
+	// Objects behind the start of the line are not hit either
+	pointed = env.raycast(v3f(7, 2, 4) * BS, v3f(12, 2, 4) * BS, true, false);
+	UASSERT(pointed.type == POINTEDTHING_NOTHING);
+}
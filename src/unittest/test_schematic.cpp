@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_schematic.h"
 #include "gamedef.h"
 #include "nodedef.h"
+#include "map.h"
 
 class TestSchematic : public TestBase {
 public:
@@ -33,6 +34,7 @@ class TestSchematic : public TestBase {
 	void testMtsSerializeDeserialize(INodeDefManager *ndef);
 	void testLuaTableSerialize(INodeDefManager *ndef);
 	void testFileSerializeDeserialize(INodeDefManager *ndef);
+	void testBlitToVManip(INodeDefManager *ndef);
 
 	static const content_t test_schem1_data[7 * 6 * 4];
 	static const content_t test_schem2_data[3 * 3 * 3];
@@ -52,6 +54,7 @@ void TestSchematic::runTests(IGameDef *gamedef)
 	TEST(testMtsSerializeDeserialize, ndef);
 	TEST(testLuaTableSerialize, ndef);
 	TEST(testFileSerializeDeserialize, ndef);
+	TEST(testBlitToVManip, ndef);
 
 	ndef->resetNodeResolveState();
 }
@@ -136,7 +139,7 @@ void TestSchematic::testFileSerializeDeserialize(INodeDefManager *ndef)
 {
 	static const v3s16 size(3, 3, 3);
 	static const u32 volume = size.X * size.Y * size.Z;
-	static const content_t content_map[] = {
+	const content_t content_map[] = {
 		CONTENT_AIR,
 		t_CONTENT_STONE,
 		t_CONTENT_LAVA,
@@ -181,6 +184,90 @@ void TestSchematic::testFileSerializeDeserialize(INodeDefManager *ndef)
 }
 
 
+void TestSchematic::testBlitToVManip(INodeDefManager *ndef)
+{
+	static const v3s16 size(7, 6, 4);
+	static const u32 volume = size.X * size.Y * size.Z;
+	const content_t content_map[] = {
+		CONTENT_IGNORE,
+		t_CONTENT_STONE,
+		t_CONTENT_GRASS,
+		t_CONTENT_BRICK,
+	};
+
+	Schematic schem;
+
+	schem.m_ndef      = ndef;
+	schem.flags       = 0;
+	schem.size        = size;
+	schem.schemdata   = new MapNode[volume];
+	schem.slice_probs = new u8[size.Y];
+	for (size_t i = 0; i != volume; i++) {
+		u8 param1 = (i % 5 == 0) ? MTSCHEM_PROB_NEVER :
+			(i % 3 == 0) ? (MTSCHEM_PROB_ALWAYS | MTSCHEM_FORCE_PLACE) :
+			MTSCHEM_PROB_ALWAYS;
+		schem.schemdata[i] = MapNode(content_map[test_schem1_data[i]], param1, 0);
+	}
+	for (s16 y = 0; y != size.Y; y++)
+		schem.slice_probs[y] = MTSCHEM_PROB_ALWAYS;
+
+	// The schematic sticks out of the area on the -X and +Z sides
+	VoxelArea area(v3s16(-2, -2, -2), v3s16(9, 9, 4));
+	v3s16 p(-3, 0, 0);
+
+	for (int force_place = 0; force_place != 2; force_place++)
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++) {
+		MMVManip vm(NULL);
+		vm.addArea(area);
+		for (s32 i = 0; i != area.getVolume(); i++)
+			vm.m_data[i] = MapNode((i % 2) ? CONTENT_AIR : t_CONTENT_WATER);
+
+		schem.blitToVManip(p, &vm, (Rotation)rot, force_place);
+
+		bool swap_xz = (rot == ROTATE_90 || rot == ROTATE_270);
+		v3s16 rsize = swap_xz ? v3s16(size.Z, size.Y, size.X) : size;
+
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			s32 vi = area.index(x, y, z);
+			MapNode n_orig((vi % 2) ? CONTENT_AIR : t_CONTENT_WATER);
+			MapNode n_expected = n_orig;
+
+			v3s16 r = v3s16(x, y, z) - p;
+			if (r.X >= 0 && r.X < rsize.X && r.Y >= 0 && r.Y < rsize.Y &&
+					r.Z >= 0 && r.Z < rsize.Z) {
+				v3s16 s;
+				switch (rot) {
+				case ROTATE_90:
+					s = v3s16(size.X - 1 - r.Z, r.Y, r.X);
+					break;
+				case ROTATE_180:
+					s = v3s16(size.X - 1 - r.X, r.Y, size.Z - 1 - r.Z);
+					break;
+				case ROTATE_270:
+					s = v3s16(r.Z, r.Y, size.Z - 1 - r.X);
+					break;
+				default:
+					s = r;
+				}
+
+				MapNode n_schem = schem.schemdata[
+					s.Z * size.Y * size.X + s.Y * size.X + s.X];
+				bool placed = n_schem.getContent() != CONTENT_IGNORE &&
+					(n_schem.param1 & MTSCHEM_PROB_MASK) != MTSCHEM_PROB_NEVER &&
+					(force_place || (n_schem.param1 & MTSCHEM_FORCE_PLACE) ||
+					n_orig.getContent() == CONTENT_AIR);
+				if (placed)
+					n_expected = MapNode(n_schem.getContent(), 0, 0);
+			}
+
+			UASSERT(vm.m_data[vi] == n_expected);
+		}
+	}
+}
+
+
 // Should form a cross-shaped-thing...?
 const content_t TestSchematic::test_schem1_data[7 * 6 * 4] = {
 	3, 3, 1, 1, 1, 3, 3, // Y=0, Z=0
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include "util/container.h"
 #include "util/numeric.h"
 #include "util/string.h"
 
@@ -48,6 +49,7 @@ class TestUtilities : public TestBase {
 	void testIsNumber();
 	void testIsPowerOfTwo();
 	void testMyround();
+	void testPositionSet();
 };
 
 static TestUtilities g_test_instance;
@@ -73,6 +75,7 @@ void TestUtilities::runTests(IGameDef *gamedef)
 	TEST(testIsNumber);
 	TEST(testIsPowerOfTwo);
 	TEST(testMyround);
+	TEST(testPositionSet);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -293,3 +296,32 @@ void TestUtilities::testMyround()
 	UASSERT(myround(-6.5f) == -7);
 }
 
+void TestUtilities::testPositionSet()
+{
+	PositionSet set;
+	std::set<v3s16> reference;
+
+	// Cover region borders and negative positions
+	for (s16 z = -17; z <= 17; z += 3)
+	for (s16 y = -17; y <= 17; y += 5)
+	for (s16 x = -17; x <= 17; x += 2) {
+		v3s16 p(x, y, z);
+		UASSERT(set.insert(p) == reference.insert(p).second);
+	}
+	UASSERT(set.insert(v3s16(-17, -17, -17)) == false);
+	UASSERT(set.size() == reference.size());
+
+	for (s16 z = -18; z <= 18; z++)
+	for (s16 y = -18; y <= 18; y++)
+	for (s16 x = -18; x <= 18; x++) {
+		v3s16 p(x, y, z);
+		UASSERT(set.contains(p) == (reference.find(p) != reference.end()));
+	}
+
+	for (std::set<v3s16>::iterator it = reference.begin();
+			it != reference.end(); ++it)
+		UASSERT(set.erase(*it) == true);
+	UASSERT(set.erase(v3s16(1, 2, 3)) == false);
+	UASSERT(set.size() == 0);
+	UASSERT(set.contains(v3s16(-17, -17, -17)) == false);
+}
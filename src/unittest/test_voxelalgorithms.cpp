@@ -20,7 +20,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "gamedef.h"
+#include "map.h"
+#include "mapgen.h"
 #include "voxelalgorithms.h"
+#include "util/directiontables.h"
 
 class TestVoxelAlgorithms : public TestBase {
 public:
@@ -31,6 +34,8 @@ class TestVoxelAlgorithms : public TestBase {
 
 	void testPropogateSunlight(INodeDefManager *ndef);
 	void testClearLightAndCollectSources(INodeDefManager *ndef);
+	void testMapgenLighting(INodeDefManager *ndef);
+	void testVoxelLineIterator();
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -41,6 +46,8 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 
 	TEST(testPropogateSunlight, ndef);
 	TEST(testClearLightAndCollectSources, ndef);
+	TEST(testMapgenLighting, ndef);
+	TEST(testVoxelLineIterator);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -202,3 +209,162 @@ void TestVoxelAlgorithms::testClearLightAndCollectSources(INodeDefManager *ndef)
 		UASSERT(unlight_from.size() == 1);
 	}
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Straightforward recursive version of the mapgen lighting, used as reference
+static void refLightSpread(MMVManip *vm, INodeDefManager *ndef,
+	VoxelArea &a, v3s16 p, u8 light)
+{
+	if (light <= 1 || !a.contains(p))
+		return;
+
+	MapNode &n = vm->m_data[vm->m_area.index(p)];
+
+	light--;
+	if (light <= n.param1 || !ndef->get(n).light_propagates)
+		return;
+
+	n.param1 = light;
+
+	refLightSpread(vm, ndef, a, p + v3s16(0, 0, 1), light);
+	refLightSpread(vm, ndef, a, p + v3s16(0, 1, 0), light);
+	refLightSpread(vm, ndef, a, p + v3s16(1, 0, 0), light);
+	refLightSpread(vm, ndef, a, p - v3s16(0, 0, 1), light);
+	refLightSpread(vm, ndef, a, p - v3s16(0, 1, 0), light);
+	refLightSpread(vm, ndef, a, p - v3s16(1, 0, 0), light);
+}
+
+
+static void refCalcLighting(MMVManip *vm, INodeDefManager *ndef,
+	v3s16 nmin, v3s16 nmax)
+{
+	VoxelArea a(nmin, nmax);
+
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 x = nmin.X; x <= nmax.X; x++) {
+		MapNode &top = vm->getNodeRefUnsafe(v3s16(x, nmax.Y + 1, z));
+		if (top.getContent() != CONTENT_IGNORE &&
+				(top.param1 & 0x0F) != LIGHT_SUN)
+			continue;
+
+		for (s16 y = nmax.Y; y >= nmin.Y; y--) {
+			MapNode &n = vm->getNodeRefUnsafe(v3s16(x, y, z));
+			if (!ndef->get(n).sunlight_propagates)
+				break;
+			n.param1 = LIGHT_SUN;
+		}
+	}
+
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 y = nmin.Y; y <= nmax.Y; y++)
+	for (s16 x = nmin.X; x <= nmax.X; x++) {
+		MapNode &n = vm->getNodeRefUnsafe(v3s16(x, y, z));
+		const ContentFeatures &f = ndef->get(n);
+		if (n.getContent() == CONTENT_IGNORE || !f.light_propagates)
+			continue;
+
+		u8 light_produced = f.light_source & 0x0F;
+		if (light_produced > (n.param1 & 0x0F))
+			n.param1 = light_produced;
+
+		u8 light = n.param1 & 0x0F;
+		for (u16 d = 0; d != 6; d++)
+			refLightSpread(vm, ndef, a, v3s16(x, y, z) + g_6dirs[d], light);
+	}
+}
+
+
+void TestVoxelAlgorithms::testMapgenLighting(INodeDefManager *ndef)
+{
+	// Terrain with an overhang, caves, a pond and some torches underground;
+	// the topmost layer is left as CONTENT_IGNORE to let the sunlight in.
+	v3s16 nmin(-8, -8, -8);
+	v3s16 nmax(39, 39, 39);
+	VoxelArea area(nmin, nmax + v3s16(0, 1, 0));
+
+	MMVManip vm(NULL);
+	vm.addArea(area);
+
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 y = nmin.Y; y <= nmax.Y + 1; y++)
+	for (s16 x = nmin.X; x <= nmax.X; x++) {
+		s16 height = 10 + ((x * 7 + z * 13) & 0xFFFF) % 11;
+		content_t c = CONTENT_AIR;
+		if (y > nmax.Y)
+			c = CONTENT_IGNORE;
+		else if (y < height)
+			c = ((x * x + y * 3 + z) % 7 == 0) ? CONTENT_AIR : t_CONTENT_STONE;
+		else if (y < 14)
+			c = t_CONTENT_WATER;
+		else if (y == 30 && x >= 0 && x < 16 && z >= 0 && z < 16)
+			c = t_CONTENT_STONE;
+
+		if (c == CONTENT_AIR && y < height && (x + y + z) % 29 == 0)
+			c = t_CONTENT_TORCH;
+
+		vm.m_data[area.index(x, y, z)] = MapNode(c, 0, 0);
+	}
+
+	MMVManip vm_ref(NULL);
+	vm_ref.addArea(area);
+	memcpy(vm_ref.m_data, vm.m_data, area.getVolume() * sizeof(MapNode));
+
+	Mapgen mg;
+	mg.vm   = &vm;
+	mg.ndef = ndef;
+	mg.calcLighting(nmin, nmax, nmin, nmax);
+
+	refCalcLighting(&vm_ref, ndef, nmin, nmax);
+
+	u32 num_lit = 0;
+	for (s32 i = 0; i != area.getVolume(); i++) {
+		UASSERTEQ(u8, vm.m_data[i].param1, vm_ref.m_data[i].param1);
+		if (vm.m_data[i].param1 != 0 && vm.m_data[i].param1 != LIGHT_SUN)
+			num_lit++;
+	}
+
+	// Make sure the light actually got spread somewhere
+	UASSERT(num_lit > 0);
+}
+
+void TestVoxelAlgorithms::testVoxelLineIterator()
+{
+	v3f starts[] = {
+		v3f(0, 0, 0),
+		v3f(0.4, -0.3, 0.2),
+		v3f(-3.2, 1.7, 5.5),
+		v3f(10, 10, 10),
+	};
+	v3f lines[] = {
+		v3f(0, 0, 0),
+		v3f(5, 0, 0),
+		v3f(3.3, -7.1, 2.2),
+		v3f(-12.5, 4, -0.3),
+		v3f(0.2, 0.2, 0.2),
+	};
+
+	for (u32 i = 0; i < ARRLEN(starts); i++)
+	for (u32 j = 0; j < ARRLEN(lines); j++) {
+		voxalgo::VoxelLineIterator iterator(starts[i], lines[j]);
+		UASSERT(iterator.m_current_node_pos == floatToInt(starts[i], 1));
+
+		u32 steps = 0;
+		while (iterator.hasNext()) {
+			v3s16 previous = iterator.m_current_node_pos;
+			iterator.next();
+			steps++;
+			// Each step moves to a neighbour along one axis
+			v3s16 d = iterator.m_current_node_pos - previous;
+			UASSERT(abs(d.X) + abs(d.Y) + abs(d.Z) == 1);
+			UASSERT(iterator.m_previous_node_pos == previous);
+		}
+
+		v3s16 end = floatToInt(starts[i] + lines[j], 1);
+		UASSERT(iterator.m_current_node_pos == end);
+		UASSERTEQ(u32, steps, abs(end.X - floatToInt(starts[i], 1).X) +
+			abs(end.Y - floatToInt(starts[i], 1).Y) +
+			abs(end.Z - floatToInt(starts[i], 1).Z));
+	}
+}
@@ -0,0 +1,47 @@
+/*
+Minetest
+Copyright (C) 2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TEST_ENVIRONMENT_HEADER
+#define TEST_ENVIRONMENT_HEADER
+
+#include "environment.h"
+#include "map.h"
+
+class MapBlock;
+
+/*
+	A single map block of air at (0, 0, 0) with a stone floor at y = 0,
+	surrounded by unloaded space. Tests place anything else they need.
+*/
+class TestEnvironment : public Environment {
+public:
+	TestEnvironment(IGameDef *gamedef);
+
+	void step(f32 dtime) {}
+	Map &getMap() { return m_map; }
+
+	// p is relative to the block, which is also the map position
+	void setNode(v3s16 p, MapNode n);
+
+private:
+	Map m_map;
+	MapBlock *m_block;
+};
+
+#endif
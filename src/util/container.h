@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define UTIL_CONTAINER_HEADER
 
 #include "../irrlichttypes.h"
+#include "../irr_v3d.h"
 #include "../exceptions.h"
 #include "../threading/mutex.h"
 #include "../threading/mutex_auto_lock.h"
@@ -30,6 +31,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include <set>
 #include <queue>
+#include <cstring>
 
 /*
 Queue with unique values with fast checking of value existence
@@ -303,5 +305,98 @@ class LRUCache
 	std::list<K> m_queue;
 };
 
-#endif
+/*
+Set of positions, stored as one bit per position in 16x16x16 regions.
+Much smaller and faster than a std::set<v3s16> for sets of
+neighbouring positions, like the blocks around a player.
+*/
+
+class PositionSet
+{
+public:
+	PositionSet() :
+		m_size(0)
+	{}
+
+	bool contains(v3s16 p) const
+	{
+		std::map<v3s16, Region>::const_iterator it =
+			m_regions.find(getRegionPos(p));
+		if (it == m_regions.end())
+			return false;
+		u32 i = getBitIndex(p);
+		return (it->second.bits[i / 32] >> (i % 32)) & 1;
+	}
+
+	// Returns false if p was in the set already
+	bool insert(v3s16 p)
+	{
+		Region &region = m_regions[getRegionPos(p)];
+		u32 i = getBitIndex(p);
+		u32 mask = 1U << (i % 32);
+		if (region.bits[i / 32] & mask)
+			return false;
+		region.bits[i / 32] |= mask;
+		region.count++;
+		m_size++;
+		return true;
+	}
+
+	// Returns false if p was not in the set
+	bool erase(v3s16 p)
+	{
+		std::map<v3s16, Region>::iterator it =
+			m_regions.find(getRegionPos(p));
+		if (it == m_regions.end())
+			return false;
+		Region &region = it->second;
+		u32 i = getBitIndex(p);
+		u32 mask = 1U << (i % 32);
+		if (!(region.bits[i / 32] & mask))
+			return false;
+		region.bits[i / 32] &= ~mask;
+		m_size--;
+		if (--region.count == 0)
+			m_regions.erase(it);
+		return true;
+	}
 
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	void clear()
+	{
+		m_regions.clear();
+		m_size = 0;
+	}
+
+private:
+	struct Region {
+		Region() :
+			count(0)
+		{
+			memset(bits, 0, sizeof(bits));
+		}
+
+		u32 count;
+		u32 bits[16 * 16 * 16 / 32];
+	};
+
+	static v3s16 getRegionPos(v3s16 p)
+	{
+		// Arithmetic shift rounds towards negative infinity
+		return v3s16(p.X >> 4, p.Y >> 4, p.Z >> 4);
+	}
+
+	static u32 getBitIndex(v3s16 p)
+	{
+		return (p.X & 15) | ((p.Y & 15) << 4) | ((p.Z & 15) << 8);
+	}
+
+	std::map<v3s16, Region> m_regions;
+	size_t m_size;
+};
+
+#endif
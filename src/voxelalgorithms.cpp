@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "voxelalgorithms.h"
 #include "nodedef.h"
+#include <cfloat>
 
 namespace voxalgo
 {
@@ -153,5 +154,65 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
 	return SunlightPropagateResult(bottom_sunlight_valid);
 }
 
+VoxelLineIterator::VoxelLineIterator(const v3f &start_position,
+		const v3f &line_vector) :
+	m_current_node_pos(floatToInt(start_position, 1)),
+	m_previous_node_pos(m_current_node_pos),
+	m_current_index(0)
+{
+	v3s16 end_node_pos = floatToInt(start_position + line_vector, 1);
+	// Every step moves by one node on one axis
+	m_last_index = abs(end_node_pos.X - m_current_node_pos.X) +
+		abs(end_node_pos.Y - m_current_node_pos.Y) +
+		abs(end_node_pos.Z - m_current_node_pos.Z);
+
+	f32 start[3] = {start_position.X, start_position.Y, start_position.Z};
+	f32 line[3] = {line_vector.X, line_vector.Y, line_vector.Z};
+	s16 node[3] = {m_current_node_pos.X, m_current_node_pos.Y,
+		m_current_node_pos.Z};
+	s16 step[3];
+	f32 inc[3];
+	f32 next[3];
+	for (int i = 0; i < 3; i++) {
+		// Nodes span from -0.5 to 0.5 around their position
+		if (line[i] > 0) {
+			step[i] = 1;
+			inc[i] = 1 / line[i];
+			next[i] = (node[i] + 0.5f - start[i]) / line[i];
+		} else if (line[i] < 0) {
+			step[i] = -1;
+			inc[i] = -1 / line[i];
+			next[i] = (node[i] - 0.5f - start[i]) / line[i];
+		} else {
+			step[i] = 0;
+			inc[i] = FLT_MAX;
+			next[i] = FLT_MAX;
+		}
+	}
+
+	m_step_directions = v3s16(step[0], step[1], step[2]);
+	m_intersection_multi_inc = v3f(inc[0], inc[1], inc[2]);
+	m_next_intersection_multi = v3f(next[0], next[1], next[2]);
+}
+
+void VoxelLineIterator::next()
+{
+	m_previous_node_pos = m_current_node_pos;
+	m_current_index++;
+
+	// Cross the nearest node border
+	v3f &next = m_next_intersection_multi;
+	if (next.X <= next.Y && next.X <= next.Z) {
+		m_current_node_pos.X += m_step_directions.X;
+		next.X += m_intersection_multi_inc.X;
+	} else if (next.Y <= next.Z) {
+		m_current_node_pos.Y += m_step_directions.Y;
+		next.Y += m_intersection_multi_inc.Y;
+	} else {
+		m_current_node_pos.Z += m_step_directions.Z;
+		next.Z += m_intersection_multi_inc.Z;
+	}
+}
+
 } // namespace voxalgo
 
@@ -52,6 +52,37 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
 		std::set<v3s16> & light_sources,
 		INodeDefManager *ndef);
 
+/*
+	Iterates over the nodes a line segment passes through, in order from
+	the start, using the voxel traversal of Amanatides and Woo.
+	Positions and the line are in nodes.
+*/
+class VoxelLineIterator
+{
+public:
+	VoxelLineIterator(const v3f &start_position, const v3f &line_vector);
+
+	// Steps to the next node on the line
+	void next();
+
+	bool hasNext() const
+	{ return m_current_index < m_last_index; }
+
+	// The node the iterator is at, and the one before it
+	v3s16 m_current_node_pos;
+	v3s16 m_previous_node_pos;
+
+private:
+	// Direction of the steps on each axis (-1, 0 or 1)
+	v3s16 m_step_directions;
+	// Part of the line between two node borders on each axis
+	v3f m_intersection_multi_inc;
+	// Part of the line at which the next node border on each axis is
+	v3f m_next_intersection_multi;
+	u32 m_current_index;
+	u32 m_last_index;
+};
+
 } // namespace voxalgo
 
 #endif